@@ -4,6 +4,8 @@
 #include <QVBoxLayout>
 
 #include "debug.h"
+#include "io/texturepool.h"
+#include "playback/playback.h"
 
 DebugDialog* debug_dialog = nullptr;
 
@@ -19,7 +21,7 @@ DebugDialog::DebugDialog(QWidget *parent) : QDialog(parent) {
 }
 
 void DebugDialog::update_log() {
-	textEdit->setHtml(get_debug_str());
+	textEdit->setHtml(get_texture_pool_summary() + "<br>" + get_seek_latency_summary() + "<br><br>" + get_debug_str());
 }
 
 void DebugDialog::showEvent(QShowEvent *) {
@@ -12,8 +12,11 @@
 #include <QGroupBox>
 #include <QComboBox>
 #include <QSpinBox>
+#include <QCheckBox>
 #include <QPushButton>
 #include <QProgressBar>
+#include <QListWidget>
+#include <QFileInfo>
 
 #include "debug.h"
 #include "panels/panels.h"
@@ -23,6 +26,7 @@
 #include "project/sequence.h"
 #include "io/exportthread.h"
 #include "playback/playback.h"
+#include "playback/renderthread.h"
 #include "mainwindow.h"
 
 extern "C" {
@@ -37,6 +41,7 @@ enum ExportFormats {
 	FORMAT_DNXHD,
 	FORMAT_AC3,
 	FORMAT_FLV,
+	FORMAT_FRAMESERVER,
 	FORMAT_GIF,
 	FORMAT_IMG,
 	FORMAT_MP2,
@@ -74,6 +79,7 @@ ExportDialog::ExportDialog(QWidget *parent) :
 	format_strings[FORMAT_DNXHD] = "DNxHD";
 	format_strings[FORMAT_AC3] = "Dolby Digital (AC3)";
 	format_strings[FORMAT_FLV] = "FLV";
+	format_strings[FORMAT_FRAMESERVER] = "Frameserver (NUT)";
 	format_strings[FORMAT_GIF] = "GIF";
 	format_strings[FORMAT_IMG] = "Image Sequence";
 	format_strings[FORMAT_MP2] = "MP2 Audio";
@@ -101,7 +107,12 @@ ExportDialog::ExportDialog(QWidget *parent) :
 }
 
 ExportDialog::~ExportDialog()
-{}
+{
+	// queued jobs that were never started
+	for (int i=0;i<queued_jobs.size();i++) {
+		delete queued_jobs.at(i);
+	}
+}
 
 void ExportDialog::format_changed(int index)
 {
@@ -161,6 +172,11 @@ void ExportDialog::format_changed(int index)
 
 		format_acodecs.append(AV_CODEC_ID_MP3);
 		break;
+	case FORMAT_FRAMESERVER:
+		format_vcodecs.append(AV_CODEC_ID_RAWVIDEO);
+
+		format_acodecs.append(AV_CODEC_ID_PCM_S16LE);
+		break;
 	case FORMAT_GIF:
 		format_vcodecs.append(AV_CODEC_ID_GIF);
 		break;
@@ -319,28 +335,40 @@ void ExportDialog::format_changed(int index)
 }
 
 void ExportDialog::render_thread_finished() {
-	if (progressBar->value() < 100 && !cancelled) {
+	ExportThread* job = static_cast<ExportThread*>(sender());
+	running_jobs.removeAll(job);
+	if (!job->continueEncode && !cancelled) {
+		if (job_count > 1) {
+			export_errors.append(QString("%1: %2").arg(QFileInfo(job->filename).fileName(), job->export_error));
+		} else {
+			export_errors.append(job->export_error);
+		}
+	}
+
+	// waits for every job that ran together
+	if (!running_jobs.isEmpty()) return;
+
+	if (!export_errors.isEmpty()) {
         QMessageBox::critical(
                     this,
                     tr("Export Failed"),
-                    tr("Export failed - %1").arg(export_error),
+                    tr("Export failed - %1").arg(export_errors.join("\n")),
                     QMessageBox::Ok
                 );
 	}
 	prep_ui_for_render(false);
-	panel_sequence_viewer->viewer_widget->makeCurrent();
-	panel_sequence_viewer->viewer_widget->initializeGL();
 	update_ui(false);
-	if (progressBar->value() == 100) accept();
+	if (export_errors.isEmpty() && !cancelled) accept();
 }
 
 void ExportDialog::prep_ui_for_render(bool r) {
 	export_button->setEnabled(!r);
+	queue_button->setEnabled(!r);
 	cancel_button->setEnabled(!r);
 	renderCancel->setEnabled(r);
 }
 
-void ExportDialog::export_action() {
+ExportThread* ExportDialog::create_export_job() {
 	if (widthSpinbox->value()%2 == 1 || heightSpinbox->value()%2 == 1) {
         QMessageBox::critical(
                     this,
@@ -348,7 +376,7 @@ void ExportDialog::export_action() {
                     tr("Export width and height must both be even numbers/divisible by 2."),
                     QMessageBox::Ok
                 );
-		return;
+		return nullptr;
 	}
 
 	QString ext;
@@ -374,6 +402,9 @@ void ExportDialog::export_action() {
 	case FORMAT_FLV:
 		ext = "flv";
 		break;
+	case FORMAT_FRAMESERVER:
+		ext = "nut";
+		break;
 	case FORMAT_GIF:
 		ext = "gif";
 		break;
@@ -405,7 +436,7 @@ void ExportDialog::export_action() {
                         tr("Couldn't determine output parameters for the selected codec. This is a bug, please contact the developers."),
                         QMessageBox::Ok
                     );
-			return;
+			return nullptr;
 		}
 		break;
 	case FORMAT_MP3:
@@ -475,73 +506,140 @@ void ExportDialog::export_action() {
                     tr("Couldn't determine output format. This is a bug, please contact the developers."),
                     QMessageBox::Ok
                 );
-		return;
+		return nullptr;
+	}
+	bool frameserver = (formatCombobox->currentIndex() == FORMAT_FRAMESERVER);
+	QString filename;
+	if (frameserver) {
+		// an existing FIFO is written to, any other path becomes a UNIX socket the consumer connects to
+		filename = QFileDialog::getSaveFileName(
+					this,
+					tr("Serve Frames To"),
+					"",
+					tr("Named pipe or socket (*)"),
+					nullptr,
+					QFileDialog::DontConfirmOverwrite
+				);
+	} else {
+		filename = QFileDialog::getSaveFileName(
+					this,
+					tr("Export Media"),
+					"",
+					format_strings[formatCombobox->currentIndex()] + " (*." + ext + ")"
+				);
+	}
+	if (filename.isEmpty()) return nullptr;
+
+	if (!frameserver && !filename.endsWith("." + ext, Qt::CaseInsensitive)) {
+		filename += "." + ext;
 	}
-    QString filename = QFileDialog::getSaveFileName(
-                this,
-                tr("Export Media"),
-                "",
-                format_strings[formatCombobox->currentIndex()] + " (*." + ext + ")"
-            );
-	if (!filename.isEmpty()) {
-		if (!filename.endsWith("." + ext, Qt::CaseInsensitive)) {
-			filename += "." + ext;
-		}
 
-		if (formatCombobox->currentIndex() == FORMAT_IMG) {
-			int ext_location = filename.lastIndexOf('.');
-			if (ext_location > filename.lastIndexOf('/')) {
-				filename.insert(ext_location, 'd');
-				filename.insert(ext_location, '5');
-				filename.insert(ext_location, '0');
-				filename.insert(ext_location, '%');
-			}
+	if (formatCombobox->currentIndex() == FORMAT_IMG) {
+		int ext_location = filename.lastIndexOf('.');
+		if (ext_location > filename.lastIndexOf('/')) {
+			filename.insert(ext_location, 'd');
+			filename.insert(ext_location, '5');
+			filename.insert(ext_location, '0');
+			filename.insert(ext_location, '%');
 		}
+	}
 
-		et = new ExportThread();
+	ExportThread* et = new ExportThread();
+
+	et->filename = filename;
+	et->frameserver = frameserver;
+	et->video_enabled = videoGroupbox->isChecked();
+	if (et->video_enabled) {
+		et->video_codec = format_vcodecs.at(vcodecCombobox->currentIndex());
+		et->video_width = widthSpinbox->value();
+		et->video_height = heightSpinbox->value();
+		et->video_frame_rate = framerateSpinbox->value();
+		et->video_compression_type = compressionTypeCombobox->currentData().toInt();
+		et->video_bitrate = videobitrateSpinbox->value();
+		et->smart_render = smartRenderCheckbox->isChecked() && !frameserver;
+	}
+	et->audio_enabled = audioGroupbox->isChecked();
+	if (et->audio_enabled) {
+		et->audio_codec = format_acodecs.at(acodecCombobox->currentIndex());
+		et->audio_sampling_rate = samplingRateSpinbox->value();
+		et->audio_bitrate = audiobitrateSpinbox->value();
+		et->audio_stems = stemsCheckbox->isChecked() && !frameserver;
+	}
 
-		connect(et, SIGNAL(finished()), et, SLOT(deleteLater()));
-		connect(et, SIGNAL(finished()), this, SLOT(render_thread_finished()));
-		connect(et, SIGNAL(progress_changed(int, qint64)), this, SLOT(update_progress_bar(int, qint64)));
+	return et;
+}
 
-		closeActiveClips(sequence);
+void ExportDialog::queue_action() {
+	ExportThread* et = create_export_job();
+	if (et == nullptr) return;
 
-		mainWindow->autorecover_interval();
+	queued_jobs.append(et);
+	queueList->addItem(QString("%1 - %2").arg(formatCombobox->currentText(), QFileInfo(et->filename).fileName()));
+}
 
-		rendering = true;
-		panel_sequence_viewer->viewer_widget->context()->doneCurrent();
-		panel_sequence_viewer->viewer_widget->context()->moveToThread(et);
+void ExportDialog::export_action() {
+	ExportThread* et = create_export_job();
+	if (et == nullptr) return;
 
-		prep_ui_for_render(true);
+	QVector<ExportThread*> jobs;
+	jobs.append(et);
+	jobs += queued_jobs;
+	queued_jobs.clear();
+	queueList->clear();
 
-		et->filename = filename;
-		et->video_enabled = videoGroupbox->isChecked();
-		if (et->video_enabled) {
-			et->video_codec = format_vcodecs.at(vcodecCombobox->currentIndex());
-			et->video_width = widthSpinbox->value();
-			et->video_height = heightSpinbox->value();
-			et->video_frame_rate = framerateSpinbox->value();
-			et->video_compression_type = compressionTypeCombobox->currentData().toInt();
-			et->video_bitrate = videobitrateSpinbox->value();
-		}
-		et->audio_enabled = audioGroupbox->isChecked();
-		if (et->audio_enabled) {
-			et->audio_codec = format_acodecs.at(acodecCombobox->currentIndex());
-			et->audio_sampling_rate = samplingRateSpinbox->value();
-			et->audio_bitrate = audiobitrateSpinbox->value();
+	start_export_jobs(jobs);
+}
+
+void ExportDialog::start_export_jobs(QVector<ExportThread*> jobs) {
+	// the first job with video composites each frame once and passes it on to the others, which encode it with
+	// their own scalers and encoders at the same time
+	int leader = 0;
+	for (int i=0;i<jobs.size();i++) {
+		if (jobs.at(i)->video_enabled) {
+			leader = i;
+			break;
 		}
+	}
 
-		et->start_frame = 0;
-		et->end_frame = sequence->getEndFrame(); // entire sequence
-		if (rangeCombobox->currentIndex() == 1) {
-			et->start_frame = qMax(sequence->workarea_in, et->start_frame);
-			et->end_frame = qMin(sequence->workarea_out, et->end_frame);
+	long start_frame = 0;
+	long end_frame = sequence->getEndFrame(); // entire sequence
+	if (rangeCombobox->currentIndex() == 1) {
+		start_frame = qMax(sequence->workarea_in, start_frame);
+		end_frame = qMin(sequence->workarea_out, end_frame);
+	}
+
+	for (int i=0;i<jobs.size();i++) {
+		ExportThread* et = jobs.at(i);
+
+		connect(et, SIGNAL(finished()), et, SLOT(deleteLater()));
+		connect(et, SIGNAL(finished()), this, SLOT(render_thread_finished()));
+		if (i == leader) {
+			connect(et, SIGNAL(progress_changed(int, qint64)), this, SLOT(update_progress_bar(int, qint64)));
+		} else {
+			et->feed = QSharedPointer<ExportFeed>(new ExportFeed());
+			if (et->video_enabled) jobs.at(leader)->feeds.append(et->feed);
 		}
 
-		et->ed = this;
-		cancelled = false;
+		et->start_frame = start_frame;
+		et->end_frame = end_frame;
+	}
+
+	// stop viewer frames before the clips are reopened for export
+	rendering = true;
+	if (panel_sequence_viewer->viewer_widget->renderer != nullptr) panel_sequence_viewer->viewer_widget->renderer->discard();
+	closeActiveClips(sequence);
+
+	mainWindow->autorecover_interval();
 
-		et->start();
+	prep_ui_for_render(true);
+
+	cancelled = false;
+	export_errors.clear();
+	job_count = jobs.size();
+	running_jobs = jobs;
+
+	for (int i=0;i<jobs.size();i++) {
+		jobs.at(i)->start();
 	}
 }
 
@@ -556,8 +654,10 @@ void ExportDialog::update_progress_bar(int value, qint64 remaining_ms) {
 }
 
 void ExportDialog::cancel_render() {
-	panel_sequence_viewer->viewer_widget->force_quit = true;
-	et->continueEncode = false;
+	for (int i=0;i<running_jobs.size();i++) {
+		running_jobs.at(i)->continueEncode = false;
+	}
+	if (panel_sequence_viewer->viewer_widget->renderer != nullptr) panel_sequence_viewer->viewer_widget->renderer->cancel();
 	cancelled = true;
 }
 
@@ -661,6 +761,10 @@ void ExportDialog::setup_ui() {
 	videobitrateSpinbox->setValue(2);
 	videoGridLayout->addWidget(videobitrateSpinbox, 5, 1, 1, 1);
 
+	smartRenderCheckbox = new QCheckBox(tr("Copy unchanged footage (Smart Render)"), videoGroupbox);
+	smartRenderCheckbox->setToolTip(tr("Footage that fills the whole export is copied as is. Footage between other clips is only copied if it was encoded with the same settings as this export (e.g. an earlier export), otherwise it's encoded again."));
+	videoGridLayout->addWidget(smartRenderCheckbox, 6, 0, 1, 2);
+
 	verticalLayout->addWidget(videoGroupbox);
 
 	audioGroupbox = new QGroupBox(this);
@@ -685,8 +789,17 @@ void ExportDialog::setup_ui() {
 	audiobitrateSpinbox->setValue(256);
 	audioGridLayout->addWidget(audiobitrateSpinbox, 3, 1, 1, 1);
 
+	stemsCheckbox = new QCheckBox(tr("Also export each track to its own file"), audioGroupbox);
+	audioGridLayout->addWidget(stemsCheckbox, 4, 0, 1, 2);
+
 	verticalLayout->addWidget(audioGroupbox);
 
+	verticalLayout->addWidget(new QLabel(tr("Also Export:")));
+
+	queueList = new QListWidget(this);
+	queueList->setMaximumHeight(80);
+	verticalLayout->addWidget(queueList);
+
 	QHBoxLayout* progressLayout = new QHBoxLayout();
 	progressBar = new QProgressBar(this);
 	progressBar->setFormat("%p% (ETA: 0:00:00)");
@@ -712,6 +825,12 @@ void ExportDialog::setup_ui() {
 
 	buttonLayout->addWidget(export_button);
 
+	queue_button = new QPushButton(this);
+	queue_button->setText(tr("Add to Queue"));
+	connect(queue_button, SIGNAL(clicked(bool)), this, SLOT(queue_action()));
+
+	buttonLayout->addWidget(queue_button);
+
 	cancel_button = new QPushButton(this);
 	cancel_button->setText("Cancel");
 	connect(cancel_button, SIGNAL(clicked(bool)), this, SLOT(reject()));
@@ -2,6 +2,7 @@
 #define EXPORTDIALOG_H
 
 #include <QDialog>
+#include <QStringList>
 
 struct Sequence;
 class ExportThread;
@@ -11,6 +12,8 @@ class QDoubleSpinBox;
 class QLabel;
 class QProgressBar;
 class QGroupBox;
+class QCheckBox;
+class QListWidget;
 
 class ExportDialog : public QDialog
 {
@@ -18,11 +21,11 @@ class ExportDialog : public QDialog
 public:
 	explicit ExportDialog(QWidget *parent = 0);
 	~ExportDialog();
-	QString export_error;
 
 private slots:
 	void format_changed(int index);
 	void export_action();
+	void queue_action();
 	void update_progress_bar(int value, qint64 remaining_ms);
 	void cancel_render();
 	void render_thread_finished();
@@ -35,7 +38,15 @@ private:
 	QVector<int> format_acodecs;
 	void setup_ui();
 
-	ExportThread* et;
+	ExportThread* create_export_job();
+	void start_export_jobs(QVector<ExportThread*> jobs);
+
+	// jobs added with the current settings that run together with the next export
+	QVector<ExportThread*> queued_jobs;
+
+	QVector<ExportThread*> running_jobs;
+	QStringList export_errors;
+	int job_count;
 	void prep_ui_for_render(bool r);
 	bool cancelled;
 
@@ -52,11 +63,15 @@ private:
 	QComboBox* formatCombobox;
 	QSpinBox* heightSpinbox;
 	QPushButton* export_button;
+	QPushButton* queue_button;
 	QPushButton* cancel_button;
 	QPushButton* renderCancel;
 	QGroupBox* videoGroupbox;
 	QGroupBox* audioGroupbox;
 	QComboBox* compressionTypeCombobox;
+	QCheckBox* smartRenderCheckbox;
+	QCheckBox* stemsCheckbox;
+	QListWidget* queueList;
 };
 
 #endif // EXPORTDIALOG_H
@@ -2,6 +2,8 @@
 
 #include "io/config.h"
 #include "mainwindow.h"
+#include "io/previewcache.h"
+#include "io/texturepool.h"
 
 #include <QMenuBar>
 #include <QAction>
@@ -20,6 +22,7 @@
 #include <QTreeWidgetItem>
 #include <QList>
 #include <QDoubleSpinBox>
+#include <QSpinBox>
 #include <QFileDialog>
 #include <QMessageBox>
 
@@ -130,6 +133,11 @@ void PreferencesDialog::save() {
 	config.upcoming_queue_type = upcoming_queue_type->currentIndex();
 	config.previous_queue_size = previous_queue_spinbox->value();
 	config.previous_queue_type = previous_queue_type->currentIndex();
+	config.preview_cache_size = preview_cache_spinbox->value();
+	preview_cache.set_budget(qint64(config.preview_cache_size) * 1048576);
+	config.gpu_memory_budget = gpu_memory_spinbox->value();
+	set_texture_pool_budget(qint64(config.gpu_memory_budget) * 1048576);
+	config.export_encode_workers = export_workers_spinbox->value();
 
 	// save keyboard shortcuts
 	for (int i=0;i<key_shortcut_fields.size();i++) {
@@ -292,6 +300,35 @@ void PreferencesDialog::setup_ui() {
 
 	general_layout->addWidget(recordingComboBox, 2, 1, 1, 2);
 
+	general_layout->addWidget(new QLabel(tr("Preview Cache Size:")), 3, 0, 1, 1);
+
+	preview_cache_spinbox = new QSpinBox(general_tab);
+	preview_cache_spinbox->setRange(64, 1048576);
+	preview_cache_spinbox->setSuffix(" MiB");
+	preview_cache_spinbox->setValue(config.preview_cache_size);
+
+	general_layout->addWidget(preview_cache_spinbox, 3, 1, 1, 2);
+
+	general_layout->addWidget(new QLabel(tr("GPU Memory Budget:")), 4, 0, 1, 1);
+
+	gpu_memory_spinbox = new QSpinBox(general_tab);
+	gpu_memory_spinbox->setRange(64, 1048576);
+	gpu_memory_spinbox->setSuffix(" MiB");
+	gpu_memory_spinbox->setValue(config.gpu_memory_budget);
+
+	general_layout->addWidget(gpu_memory_spinbox, 4, 1, 1, 2);
+
+	general_layout->addWidget(new QLabel(tr("Export Encoder Workers:")), 5, 0, 1, 1);
+
+	export_workers_spinbox = new QSpinBox(general_tab);
+	export_workers_spinbox->setRange(1, 64);
+	export_workers_spinbox->setValue(config.export_encode_workers);
+	export_workers_spinbox->setToolTip(tr("More than one encodes long exports in segments at the same time. Only helps "
+										   "when encoding is slower than compositing, and each segment starts its own "
+										   "rate control, so the file differs from a single pass export."));
+
+	general_layout->addWidget(export_workers_spinbox, 5, 1, 1, 2);
+
 	tabWidget->addTab(general_tab, tr("General"));
 	QWidget* behavior_tab = new QWidget();
 	tabWidget->addTab(behavior_tab, tr("Behavior"));
@@ -12,6 +12,7 @@ class QTreeWidgetItem;
 class QMenu;
 class QCheckBox;
 class QDoubleSpinBox;
+class QSpinBox;
 
 class KeySequenceEditor : public QKeySequenceEdit {
 	Q_OBJECT
@@ -59,6 +60,9 @@ private:
 	QComboBox* upcoming_queue_type;
 	QDoubleSpinBox* previous_queue_spinbox;
 	QComboBox* previous_queue_type;
+	QSpinBox* preview_cache_spinbox;
+	QSpinBox* gpu_memory_spinbox;
+	QSpinBox* export_workers_spinbox;
 
 	QVector<QAction*> key_shortcut_actions;
 	QVector<QTreeWidgetItem*> key_shortcut_items;
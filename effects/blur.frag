@@ -0,0 +1,33 @@
+#version 110
+
+// must match BLUR_MAX_TAPS in effects/internal/blureffect.h
+#define MAX_TAPS 9
+
+uniform sampler2D image;
+
+uniform vec2 resolution;
+uniform vec2 direction;
+
+// offsets (in texels) and weights of each tap, mirrored on both sides of the center
+uniform float offsets[MAX_TAPS];
+uniform float weights[MAX_TAPS];
+uniform int tap_count;
+
+// mipmap level to read from for large radii and the matching tap spacing
+uniform float lod;
+uniform float scale;
+
+void main(void) {
+	vec2 texCoord = gl_FragCoord.xy/resolution;
+	vec2 tap_step = direction*scale/resolution;
+
+	vec4 color = texture2D(image, texCoord, lod)*weights[0];
+	for (int i=1;i<MAX_TAPS;i++) {
+		if (i >= tap_count) {
+			break;
+		}
+		color += texture2D(image, texCoord + tap_step*offsets[i], lod)*weights[i];
+		color += texture2D(image, texCoord - tap_step*offsets[i], lod)*weights[i];
+	}
+	gl_FragColor = color;
+}
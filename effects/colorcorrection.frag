@@ -13,9 +13,7 @@ uniform float saturation;
 uniform sampler2D myTexture;
 varying vec2 vTexCoord;
 
-void main(void) {
-	vec4 textureColor = texture2D(myTexture, vTexCoord);
-
+vec4 process(vec4 textureColor) {
 	vec3 rgb = textureColor.rgb;
 
 	// temperature
@@ -65,10 +63,14 @@ void main(void) {
 	vec3 intensity = vec3(dot(rgb, W));
 	rgb = mix(intensity, rgb, saturation*0.01);
 
-	gl_FragColor = vec4(
+	return vec4(
 		rgb.r,
 		rgb.g,
 		rgb.b,
 		textureColor.a
 	);
 }
+
+void main(void) {
+	gl_FragColor = process(texture2D(myTexture, vTexCoord));
+}
@@ -1,8 +1,13 @@
 #version 110
 
+attribute vec2 a_position;
+attribute vec2 a_texcoord;
+
+uniform mat4 mvp_matrix;
+
 varying vec2 vTexCoord;
 
 void main() {
-    vTexCoord = gl_MultiTexCoord0.xy;
-    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    vTexCoord = a_texcoord;
+    gl_Position = mvp_matrix * vec4(a_position, 0.0, 1.0);
 }
\ No newline at end of file
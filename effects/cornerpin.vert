@@ -1,6 +1,10 @@
 #version 110
 #extension GL_EXT_gpu_shader4 : enable
 
+attribute vec2 a_position;
+attribute vec2 a_texcoord;
+
+uniform mat4 mvp_matrix;
 uniform bool perspective;
 uniform vec2 p0;
 uniform vec2 p1;
@@ -14,7 +18,7 @@ varying vec2 b3;
 varying vec2 vTexCoord;
 
 void main() {
-    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    gl_Position = mvp_matrix * vec4(a_position, 0.0, 1.0);
 
     if (perspective) {
         float m1 = (p3.y - p0.y)/(p3.x - p0.x);
@@ -45,7 +49,7 @@ void main() {
         gl_Position[1] *= q;
         gl_Position[3] = q;
 
-        vTexCoord = gl_MultiTexCoord0.xy;
+        vTexCoord = a_texcoord;
     } else {
         vec2 pos;
         
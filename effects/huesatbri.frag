@@ -23,9 +23,7 @@ vec3 hsv2rgb(vec3 c) {
     return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
 }
 
-void main(void) {	
-	vec4 tex_color = texture2D(myTexture, vTexCoord);
-
+vec4 process(vec4 tex_color) {
 	vec3 hsv = rgb2hsv(tex_color.rgb);
 	hsv.r += (hue/360.0);
 	hsv.g *= (saturation*0.01);
@@ -33,10 +31,14 @@ void main(void) {
 
 	vec3 rgb = hsv2rgb(hsv);
 
-	gl_FragColor = vec4(
+	return vec4(
 		rgb.r,
 		rgb.g,
 		rgb.b,
 		tex_color.a
 	);
+}
+
+void main(void) {
+	gl_FragColor = process(texture2D(myTexture, vTexCoord));
 }
\ No newline at end of file
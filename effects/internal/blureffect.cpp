@@ -0,0 +1,99 @@
+#include "blureffect.h"
+
+#include <QtMath>
+
+#include "project/clip.h"
+
+BlurEffect::BlurEffect(Clip* c, const EffectMeta* em, int type) :
+	Effect(c, em),
+	blur_type(type),
+	sigma_val(nullptr)
+{
+	enable_shader = true;
+	enable_mipmaps = true;
+
+	// one horizontal pass followed by one vertical pass
+	setIterations(2);
+
+	radius_val = add_row(tr("Radius"))->add_field(EFFECT_FIELD_DOUBLE, "radius");
+	radius_val->set_double_minimum_value(0);
+	radius_val->set_double_default_value(10);
+
+	if (blur_type == BLUR_TYPE_GAUSSIAN) {
+		sigma_val = add_row(tr("Sigma"))->add_field(EFFECT_FIELD_DOUBLE, "sigma");
+		sigma_val->set_double_minimum_value(0);
+		sigma_val->set_double_default_value(5.5);
+	}
+
+	horiz_blur_val = add_row(tr("Horizontal"))->add_field(EFFECT_FIELD_BOOL, "horiz_blur");
+	horiz_blur_val->set_bool_value(true);
+
+	vert_blur_val = add_row(tr("Vertical"))->add_field(EFFECT_FIELD_BOOL, "vert_blur");
+	vert_blur_val->set_bool_value(true);
+
+	vertPath = "common.vert";
+	fragPath = "blur.frag";
+}
+
+void BlurEffect::process_shader(double timecode, GLTextureCoords&, int iteration) {
+	bool horiz_blur = horiz_blur_val->get_bool_value(timecode);
+	bool vert_blur = vert_blur_val->get_bool_value(timecode);
+	double radius = radius_val->get_double_value(timecode);
+	double sigma = (sigma_val == nullptr) ? 0.0 : sigma_val->get_double_value(timecode);
+
+	// a pass in a disabled direction (or with nothing to blur) just copies the image
+	GLfloat offsets[BLUR_MAX_TAPS] = {0};
+	GLfloat weights[BLUR_MAX_TAPS] = {1.0f};
+	int tap_count = 1;
+	float lod = 0.0f;
+	float scale = 1.0f;
+
+	bool pass_enabled = (iteration == 0) ? horiz_blur : vert_blur;
+	if (pass_enabled && radius > 0.0 && (blur_type == BLUR_TYPE_BOX || sigma > 0.0)) {
+		if (radius > BLUR_MAX_RADIUS) {
+			if (horiz_blur && vert_blur) {
+				// read from a mipmap level that brings the radius back in range, the linear filter upsamples it again
+				lod = qCeil(qLn(radius / BLUR_MAX_RADIUS) / qLn(2.0));
+				scale = qPow(2.0, lod);
+			} else {
+				// mipmaps shrink both axes, so one-way blurs spread their taps instead
+				scale = radius / BLUR_MAX_RADIUS;
+			}
+		}
+
+		double scaled_radius = radius / scale;
+		double scaled_sigma = sigma / scale;
+		int r = qMin(qCeil(scaled_radius), (BLUR_MAX_TAPS - 1) * 2);
+
+		// weights are computed once per frame rather than per pixel
+		QVector<double> kernel(r + 1);
+		double sum = 0.0;
+		for (int i=0;i<=r;i++) {
+			if (blur_type == BLUR_TYPE_GAUSSIAN) {
+				kernel[i] = qExp(-0.5 * (i * i) / (scaled_sigma * scaled_sigma));
+			} else {
+				kernel[i] = 1.0;
+			}
+			sum += (i == 0) ? kernel[i] : kernel[i] * 2.0;
+		}
+
+		weights[0] = GLfloat(kernel[0] / sum);
+
+		// merge each pair of neighboring taps into one read between them, the linear filter weighs them for us
+		for (int i=1;i<=r;i+=2) {
+			double w1 = kernel[i] / sum;
+			double w2 = (i + 1 <= r) ? kernel[i + 1] / sum : 0.0;
+			weights[tap_count] = GLfloat(w1 + w2);
+			offsets[tap_count] = GLfloat((i * w1 + (i + 1) * w2) / (w1 + w2));
+			tap_count++;
+		}
+	}
+
+	glslProgram->setUniformValue("resolution", parent_clip->getWidth(), parent_clip->getHeight());
+	glslProgram->setUniformValue("direction", (iteration == 0) ? 1.0f : 0.0f, (iteration == 0) ? 0.0f : 1.0f);
+	glslProgram->setUniformValueArray("offsets", offsets, BLUR_MAX_TAPS, 1);
+	glslProgram->setUniformValueArray("weights", weights, BLUR_MAX_TAPS, 1);
+	glslProgram->setUniformValue("tap_count", tap_count);
+	glslProgram->setUniformValue("lod", lod);
+	glslProgram->setUniformValue("scale", scale);
+}
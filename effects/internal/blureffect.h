@@ -0,0 +1,29 @@
+#ifndef BLUREFFECT_H
+#define BLUREFFECT_H
+
+#include "project/effect.h"
+
+#define BLUR_TYPE_GAUSSIAN 0
+#define BLUR_TYPE_BOX 1
+
+// taps per side (including the center) the shader reads per pass, see blur.frag
+#define BLUR_MAX_TAPS 9
+
+// largest radius (in pixels) covered at full resolution, larger blurs sample downscaled mipmaps
+#define BLUR_MAX_RADIUS 16
+
+class BlurEffect : public Effect {
+	Q_OBJECT
+public:
+	BlurEffect(Clip* c, const EffectMeta* em, int type);
+	void process_shader(double timecode, GLTextureCoords& coords, int iteration);
+private:
+	int blur_type;
+
+	EffectField* radius_val;
+	EffectField* sigma_val;
+	EffectField* horiz_blur_val;
+	EffectField* vert_blur_val;
+};
+
+#endif // BLUREFFECT_H
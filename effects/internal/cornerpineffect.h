@@ -8,7 +8,7 @@ class CornerPinEffect : public Effect {
 public:
     CornerPinEffect(Clip* c, const EffectMeta* em);
     void process_coords(double timecode, GLTextureCoords& coords, int data);
-	void process_shader(double timecode, GLTextureCoords& coords);
+	void process_shader(double timecode, GLTextureCoords& coords, int iteration);
     void gizmo_draw(double timecode, GLTextureCoords& coords);
 private:
     EffectField* top_left_x;
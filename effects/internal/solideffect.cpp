@@ -38,13 +38,15 @@ SolidEffect::SolidEffect(Clip* c, const EffectMeta* em) : Effect(c, em) {
 	checkerboard_size_field->set_double_minimum_value(1);
 	checkerboard_size_field->set_double_default_value(10);
 
+	/*vertPath = ":/shaders/common.vert";
+	fragPath = ":/shaders/solideffect.frag";*/
+}
+
+void SolidEffect::setup_ui() {
 	// hacky but eh
 	QComboBox* solid_type_combo = static_cast<QComboBox*>(solid_type->get_ui_element());
 	connect(solid_type_combo, SIGNAL(currentIndexChanged(int)), this, SLOT(ui_update(int)));
 	ui_update(solid_type_combo->currentIndex());
-
-	/*vertPath = ":/shaders/common.vert";
-	fragPath = ":/shaders/solideffect.frag";*/
 }
 
 void SolidEffect::redraw(double timecode) {
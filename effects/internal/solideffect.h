@@ -11,6 +11,8 @@ class SolidEffect : public Effect {
 public:
 	SolidEffect(Clip* c, const EffectMeta *em);	
 	void redraw(double timecode);
+protected:
+	void setup_ui();
 private slots:
     void ui_update(int);
 private:
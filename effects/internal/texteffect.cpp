@@ -12,6 +12,8 @@
 #include <QWidget>
 #include <QtMath>
 #include <QMenu>
+#include <QMutex>
+#include <QHash>
 
 #include "ui/labelslider.h"
 #include "ui/collapsiblewidget.h"
@@ -22,17 +24,169 @@
 #include "ui/fontcombobox.h"
 #include "dialogs/texteditdialog.h"
 #include "mainwindow.h"
+#include "playback/renderthread.h"
+
+// laid out outlines shared by every text effect, so animating colors or the outline doesn't lay the text out again
+#define TEXT_LAYOUT_CACHE_SIZE 64
+QMutex text_layout_lock;
+QHash<QString, QPainterPath> text_layout_cache;
+
+QStringList wrap_text(const QString& text, const QFontMetrics& fm, int width) {
+	QStringList lines;
+	QStringList paragraphs = text.split('\n');
+	int space_width = fm.width(' ');
+
+	for (int i=0;i<paragraphs.size();i++) {
+		// each word is measured once and lines grow by those widths instead of re-measuring every prefix
+		QStringList words = paragraphs.at(i).split(' ');
+		QString line = words.first();
+		int line_width = fm.width(line);
+		for (int j=1;j<words.size();j++) {
+			int word_width = fm.width(words.at(j));
+			if (line_width + space_width + word_width > width) {
+				lines.append(line);
+				line = words.at(j);
+				line_width = word_width;
+			} else {
+				line.append(' ');
+				line.append(words.at(j));
+				line_width += space_width + word_width;
+			}
+		}
+		lines.append(line);
+	}
+
+	return lines;
+}
+
+QString justify_line(const QString& line, const QFontMetrics& fm, int width) {
+	int gaps = 0;
+	for (int i=0;i<line.length();i++) {
+		if (line.at(i) == ' ' && (i == 0 || line.at(i-1) != ' ')) gaps++;
+	}
+
+	int space_width = fm.width(' ');
+	if (gaps == 0 || space_width <= 0) return line;
+
+	// widen every gap by the same number of spaces, as many as still fit
+	int extra = (width - fm.width(line)) / (gaps * space_width);
+	if (extra <= 0) return line;
+
+	QString padding(extra, ' ');
+	QString spaced;
+	for (int i=0;i<line.length();i++) {
+		if (line.at(i) == ' ' && (i == 0 || line.at(i-1) != ' ')) spaced.append(padding);
+		spaced.append(line.at(i));
+	}
+	return spaced;
+}
+
+QPainterPath get_text_layout(const QString& text, const QFont& font, int halign, int valign, bool word_wrap, const QSize& size) {
+	QString key = QString("%1|%2|%3|%4|%5x%6|").arg(font.key()).arg(halign).arg(valign).arg(word_wrap).arg(size.width()).arg(size.height()) + text;
+
+	text_layout_lock.lock();
+	if (text_layout_cache.contains(key)) {
+		QPainterPath path = text_layout_cache.value(key);
+		text_layout_lock.unlock();
+		return path;
+	}
+	text_layout_lock.unlock();
+
+	int width = size.width();
+	int height = size.height();
+	QFontMetrics fm(font);
+
+	QStringList lines = (word_wrap) ? wrap_text(text, fm, width) : text.split('\n');
+
+	QPainterPath path;
+
+	int text_height = fm.height()*lines.size();
+
+	for (int i=0;i<lines.size();i++) {
+		int text_x, text_y;
+
+		switch (halign) {
+		case Qt::AlignLeft: text_x = 0; break;
+		case Qt::AlignRight: text_x = width - fm.width(lines.at(i)); break;
+		case Qt::AlignJustify:
+			text_x = 0;
+			lines[i] = justify_line(lines.at(i), fm, width);
+			break;
+		case Qt::AlignHCenter:
+		default:
+			text_x = (width/2) - (fm.width(lines.at(i))/2);
+			break;
+		}
+
+		switch (valign) {
+		case Qt::AlignTop:
+			text_y = (fm.height()*i)+fm.ascent();
+			break;
+		case Qt::AlignBottom:
+			text_y = (height - text_height - fm.descent()) + (fm.height()*(i+1));
+			break;
+		case Qt::AlignVCenter:
+		default:
+			text_y = ((height/2) - (text_height/2) - fm.descent()) + (fm.height()*(i+1));
+			break;
+		}
+
+		path.addText(text_x, text_y, font, lines.at(i));
+	}
+
+	text_layout_lock.lock();
+	if (text_layout_cache.size() >= TEXT_LAYOUT_CACHE_SIZE) text_layout_cache.clear();
+	text_layout_cache.insert(key, path);
+	text_layout_lock.unlock();
+
+	return path;
+}
+
+// runs on a worker thread from a snapshot made by get_superimpose_params()
+QImage paint_text(const QVariantList& params, const QSize& size, QPoint& offset) {
+	QFont font;
+	font.setStyleHint(QFont::Helvetica, QFont::PreferAntialias);
+	font.setFamily(params.at(1).toString());
+	font.setPointSize(params.at(2).toDouble());
+
+	QPainterPath path = get_text_layout(params.at(0).toString(), font, params.at(4).toInt(), params.at(5).toInt(), params.at(6).toBool(), size);
+	int outline_width = params.at(8).toInt();
+
+	// outlines are centered on the path, plus a pixel for antialiasing
+	QRectF bounds = path.boundingRect().adjusted(-outline_width-1, -outline_width-1, outline_width+1, outline_width+1);
+	QImage patch = create_superimpose_patch(bounds, size, offset);
+
+	if (!patch.isNull()) {
+		QPainter p(&patch);
+		p.setRenderHint(QPainter::Antialiasing);
+		p.translate(-offset);
+
+		// draw outline
+		if (outline_width > 0) {
+			QPen outline(params.at(7).value<QColor>());
+			outline.setWidth(outline_width);
+			p.setPen(outline);
+			p.setBrush(Qt::NoBrush);
+			p.drawPath(path);
+		}
+
+		// draw "master" text
+		p.setPen(Qt::NoPen);
+		p.setBrush(params.at(3).value<QColor>());
+		p.drawPath(path);
+	}
+
+	return patch;
+}
 
 TextEffect::TextEffect(Clip *c, const EffectMeta* em) :
 	Effect(c, em)
 {
 	enable_superimpose = true;
 	//enable_shader = true;
+	superimpose_renderer = new SuperimposeRenderer(paint_text);
 
     text_val = add_row(tr("Text"))->add_field(EFFECT_FIELD_STRING, "text", 2);
-	QTextEdit* text_widget = static_cast<QTextEdit*>(text_val->ui_element);
-	text_widget->setContextMenuPolicy(Qt::CustomContextMenu);
-	connect(text_widget, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(text_edit_menu()));
 
     set_font_combobox = add_row(tr("Font"))->add_field(EFFECT_FIELD_FONT, "font", 2);
 
@@ -93,120 +247,34 @@ TextEffect::TextEffect(Clip *c, const EffectMeta* em) :
 	fragPath = "dropshadow.frag";
 }
 
-void TextEffect::redraw(double timecode) {
-	img.fill(Qt::transparent);
-
-	QPainter p(&img);
-	p.setRenderHint(QPainter::Antialiasing);
-	int width = img.width();
-	int height = img.height();
-
-	// set font
-	font.setStyleHint(QFont::Helvetica, QFont::PreferAntialias);
-	font.setFamily(set_font_combobox->get_font_name(timecode));
-	font.setPointSize(size_val->get_double_value(timecode));
-	p.setFont(font);
-	QFontMetrics fm(font);
-
-	QStringList lines = text_val->get_string_value(timecode).split('\n');
-
-	// word wrap function
-	if (word_wrap_field->get_bool_value(timecode)) {
-		for (int i=0;i<lines.size();i++) {
-			QString s(lines.at(i));
-			if (fm.width(s) > width) {
-				int last_space_index = 0;
-				for (int j=0;j<s.length();j++) {
-					if (s.at(j) == ' ') {
-						if (fm.width(s.left(j)) > width) {
-							break;
-						} else {
-							last_space_index = j;
-						}
-					}
-				}
-				if (last_space_index > 0) {
-					lines.insert(i+1, s.mid(last_space_index + 1));
-					lines[i] = s.left(last_space_index);
-				}
-			}
-		}
-	}
-
-	QPainterPath path;
-
-	int text_height = fm.height()*lines.size();
-
-	for (int i=0;i<lines.size();i++) {
-		int text_x, text_y;
-
-		switch (halign_field->get_combo_data(timecode).toInt()) {
-		case Qt::AlignLeft: text_x = 0; break;
-		case Qt::AlignRight: text_x = width - fm.width(lines.at(i)); break;
-		case Qt::AlignJustify:
-			// add spaces until the string is too big
-			text_x = 0;
-			while (fm.width(lines.at(i)) < width) {
-				bool space = false;
-				QString spaced(lines.at(i));
-				for (int i=0;i<spaced.length();i++) {
-					if (spaced.at(i) == ' ') {
-						// insert a space
-						spaced.insert(i, ' ');
-						space = true;
-
-						// scan to next non-space
-						while (i < spaced.length() && spaced.at(i) == ' ') i++;
-					}
-				}
-				if (fm.width(spaced) > width || !space) {
-					break;
-				} else {
-					lines[i] = spaced;
-				}
-			}
-			break;
-		case Qt::AlignHCenter:
-		default:
-			text_x = (width/2) - (fm.width(lines.at(i))/2);
-			break;
-		}
-
-		switch (valign_field->get_combo_data(timecode).toInt()) {
-		case Qt::AlignTop:
-			text_y = (fm.height()*i)+fm.ascent();
-			break;
-		case Qt::AlignBottom:
-			text_y = (height - text_height - fm.descent()) + (fm.height()*(i+1));
-			break;
-		case Qt::AlignVCenter:
-		default:
-			text_y = ((height/2) - (text_height/2) - fm.descent()) + (fm.height()*(i+1));
-			break;
-		}
-
-		path.addText(text_x, text_y, font, lines.at(i));
-	}
-
-	// draw outline
-	int outline_width_val = outline_width->get_double_value(timecode);
-	if (outline_bool->get_bool_value(timecode) && outline_width_val > 0) {
-		QPen outline(outline_color->get_color_value(timecode));
-		outline.setWidth(outline_width_val);
-		p.setPen(outline);
-		p.setBrush(Qt::NoBrush);
-		p.drawPath(path);
-	}
+void TextEffect::setup_ui() {
+	QTextEdit* text_widget = static_cast<QTextEdit*>(text_val->get_ui_element());
+	text_widget->setContextMenuPolicy(Qt::CustomContextMenu);
+	connect(text_widget, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(text_edit_menu()));
+}
 
-	// draw "master" text
-	p.setPen(Qt::NoPen);
-	p.setBrush(set_color_button->get_color_value(timecode));
-	p.drawPath(path);
+QVariantList TextEffect::get_superimpose_params(double timecode, int, bool async) {
+	int outline = 0;
+	if (outline_bool->get_bool_value(timecode, async)) outline = outline_width->get_double_value(timecode, async);
+
+	return QVariantList()
+			<< text_val->get_string_value(timecode, async)
+			<< set_font_combobox->get_font_name(timecode, async)
+			<< size_val->get_double_value(timecode, async)
+			<< set_color_button->get_color_value(timecode, async)
+			<< halign_field->get_combo_data(timecode, async)
+			<< valign_field->get_combo_data(timecode, async)
+			<< word_wrap_field->get_bool_value(timecode, async)
+			<< outline_color->get_color_value(timecode, async)
+			<< outline;
 }
 
 void TextEffect::shadow_enable(bool e) {
+	// the shader and texture are swapped by the render thread, which may be drawing with them right now
+	render_lock.lock();
 	enable_shader = e;
-	close();
+	request_reopen();
+	render_lock.unlock();
 
 	shadow_color->set_enabled(e);
 	shadow_distance->set_enabled(e);
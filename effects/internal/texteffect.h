@@ -3,15 +3,12 @@
 
 #include "project/effect.h"
 
-#include <QFont>
 #include <QImage>
-class QOpenGLTexture;
 
 class TextEffect : public Effect {
 	Q_OBJECT
 public:
 	TextEffect(Clip* c, const EffectMeta *em);
-	void redraw(double timecode);
 
 	EffectField* text_val;
 	EffectField* size_val;
@@ -30,13 +27,14 @@ public:
 	EffectField* shadow_color;
 	EffectField* shadow_softness;
 	EffectField* shadow_opacity;
+protected:
+	void setup_ui();
+	QVariantList get_superimpose_params(double timecode, int lookahead, bool async);
 private slots:
 	void outline_enable(bool);
 	void shadow_enable(bool);
 	void text_edit_menu();
 	void open_text_edit();
-private:
-	QFont font;
 };
 
 #endif // TEXTEFFECT_H
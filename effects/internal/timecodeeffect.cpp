@@ -23,11 +23,60 @@
 #include "io/config.h"
 #include "playback/playback.h"
 
+// runs on a worker thread from a snapshot made by get_superimpose_params()
+QImage paint_timecode(const QVariantList& params, const QSize& size, QPoint& offset) {
+	QString display_timecode = params.at(0).toString();
+	int width = size.width();
+	int height = size.height();
+
+	// set font
+	QFont font;
+	font.setStyleHint(QFont::Helvetica, QFont::PreferAntialias);
+	font.setFamily("Helvetica");
+	font.setPixelSize(qCeil(params.at(1).toDouble()*.01*(height/10)));
+	QFontMetrics fm(font);
+
+	QPainterPath path;
+
+	int text_x, text_y, rect_y, offset_x, offset_y;
+	int text_height = fm.height();
+	int text_width = fm.width(display_timecode);
+
+	offset_x = params.at(4).toInt();
+	offset_y = params.at(5).toInt();
+
+	text_x = offset_x + (width/2) - (text_width/2);
+	text_y = offset_y + height - height/10;
+	rect_y = text_y + fm.descent()/2 - text_height;
+
+	path.addText(text_x, text_y, font, display_timecode);
+
+	QRect background_rect(text_x-fm.descent()/2, rect_y, text_width+fm.descent(), text_height);
+
+	// plus a pixel for antialiasing
+	QRectF bounds = path.boundingRect().united(background_rect).adjusted(-1, -1, 1, 1);
+	QImage patch = create_superimpose_patch(bounds, size, offset);
+
+	if (!patch.isNull()) {
+		QPainter p(&patch);
+		p.setRenderHint(QPainter::Antialiasing);
+		p.translate(-offset);
+
+		p.setPen(Qt::NoPen);
+		p.setBrush(params.at(3).value<QColor>());
+		p.drawRect(background_rect);
+		p.setBrush(params.at(2).value<QColor>());
+		p.drawPath(path);
+	}
+
+	return patch;
+}
+
 TimecodeEffect::TimecodeEffect(Clip *c, const EffectMeta* em) :
 	Effect(c, em)
 {
-	enable_always_update = true;
 	enable_superimpose = true;
+	superimpose_renderer = new SuperimposeRenderer(paint_timecode);
 
     EffectRow* tc_row = add_row(tr("Timecode"));
 	tc_select = tc_row->add_field(EFFECT_FIELD_COMBO, "tc_selector");
@@ -59,47 +108,23 @@ TimecodeEffect::TimecodeEffect(Clip *c, const EffectMeta* em) :
 }
 
 
-void TimecodeEffect::redraw(double timecode) {
-	if (tc_select->get_combo_data(timecode).toBool()){
-		display_timecode = prepend_text->get_string_value(timecode) + frame_to_timecode(sequence->playhead, config.timecode_view, sequence->frame_rate);}
+QVariantList TimecodeEffect::get_superimpose_params(double timecode, int lookahead, bool async) {
+	QString display_timecode;
+	if (tc_select->get_combo_data(timecode, async).toBool()){
+		display_timecode = prepend_text->get_string_value(timecode, async) + frame_to_timecode(sequence->playhead + lookahead, config.timecode_view, sequence->frame_rate);}
 	else {
 		double media_rate = parent_clip->getMediaFrameRate();
-		display_timecode = prepend_text->get_string_value(timecode) + frame_to_timecode(timecode * media_rate, config.timecode_view, media_rate);}
-	img.fill(Qt::transparent);
-
-	QPainter p(&img);
-	p.setRenderHint(QPainter::Antialiasing);
-	int width = img.width();
-	int height = img.height();
-
-	// set font
-	font.setStyleHint(QFont::Helvetica, QFont::PreferAntialias);
-	font.setFamily("Helvetica");
-	font.setPixelSize(qCeil(scale_val->get_double_value(timecode)*.01*(height/10)));
-	p.setFont(font);
-	QFontMetrics fm(font);
-
-	QPainterPath path;
+		display_timecode = prepend_text->get_string_value(timecode, async) + frame_to_timecode(timecode * media_rate, config.timecode_view, media_rate);}
 
-	int text_x, text_y, rect_y, offset_x, offset_y;
-	int text_height = fm.height();
-	int text_width = fm.width(display_timecode);
-	QColor background_color = color_bg_val->get_color_value(timecode);
-	int alpha_val = bg_alpha->get_double_value(timecode)*2.55;
+	QColor background_color = color_bg_val->get_color_value(timecode, async);
+	int alpha_val = bg_alpha->get_double_value(timecode, async)*2.55;
 	background_color.setAlpha(alpha_val);
 
-	offset_x = int(offset_x_val->get_double_value(timecode));
-	offset_y = int(offset_y_val->get_double_value(timecode));
-
-	text_x = offset_x + (width/2) - (text_width/2);
-	text_y = offset_y + height - height/10;
-	rect_y = text_y + fm.descent()/2 - text_height;
-
-	path.addText(text_x, text_y, font, display_timecode);
-
-	p.setPen(Qt::NoPen);
-	p.setBrush(background_color);
-	p.drawRect(QRect(text_x-fm.descent()/2, rect_y, text_width+fm.descent(), text_height));
-	p.setBrush(color_val->get_color_value(timecode));
-	p.drawPath(path);
+	return QVariantList()
+			<< display_timecode
+			<< scale_val->get_double_value(timecode, async)
+			<< color_val->get_color_value(timecode, async)
+			<< background_color
+			<< int(offset_x_val->get_double_value(timecode, async))
+			<< int(offset_y_val->get_double_value(timecode, async));
 }
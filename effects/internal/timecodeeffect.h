@@ -3,15 +3,12 @@
 
 #include "project/effect.h"
 
-#include <QFont>
 #include <QImage>
-class QOpenGLTexture;
 
 class TimecodeEffect : public Effect {
 	Q_OBJECT
 public:
     TimecodeEffect(Clip* c, const EffectMeta *em);
-    void redraw(double timecode);
     EffectField * scale_val;
     EffectField * color_val;
     EffectField * color_bg_val;
@@ -20,10 +17,8 @@ public:
     EffectField * offset_y_val;
     EffectField * prepend_text;
     EffectField * tc_select;
-
-private:
-    QFont font;
-    QString display_timecode;
+protected:
+    QVariantList get_superimpose_params(double timecode, int lookahead, bool async);
 };
 
 #endif // TIMECODEEFFECT_H
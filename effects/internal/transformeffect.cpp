@@ -175,6 +175,26 @@ void TransformEffect::refresh() {
 	}
 }
 
+bool TransformEffect::is_passthrough() {
+	if (!is_enabled()) return true;
+
+	// every clip gets a transform, it only changes the frame if it's been moved away from its defaults
+	for (int i=0;i<row_count();i++) {
+		for (int j=0;j<row(i)->fieldCount();j++) {
+			if (!row(i)->field(j)->keyframes.isEmpty()) return false;
+		}
+	}
+	return (position_x->get_double_value(0, true) == parent_clip->sequence->width/2
+			&& position_y->get_double_value(0, true) == parent_clip->sequence->height/2
+			&& scale_x->get_double_value(0, true) == 100
+			&& (uniform_scale_field->get_bool_value(0, true) || scale_y->get_double_value(0, true) == 100)
+			&& rotation->get_double_value(0, true) == 0
+			&& anchor_x_box->get_double_value(0, true) == 0
+			&& anchor_y_box->get_double_value(0, true) == 0
+			&& opacity->get_double_value(0, true) == 100
+			&& blend_mode_box->get_combo_data(0, true).toInt() == BLEND_MODE_NORMAL);
+}
+
 void TransformEffect::toggle_uniform_scale(bool enabled) {
 	scale_y->set_enabled(!enabled);
 
@@ -188,7 +208,7 @@ void TransformEffect::toggle_uniform_scale(bool enabled) {
 
 void TransformEffect::process_coords(double timecode, GLTextureCoords& coords, int) {
 	// position
-	glTranslatef(position_x->get_double_value(timecode)-(parent_clip->sequence->width/2), position_y->get_double_value(timecode)-(parent_clip->sequence->height/2), 0);
+	coords.matrix.translate(position_x->get_double_value(timecode)-(parent_clip->sequence->width/2), position_y->get_double_value(timecode)-(parent_clip->sequence->height/2), 0);
 
 	// anchor point
 	int anchor_x_offset = (anchor_x_box->get_double_value(timecode));
@@ -203,35 +223,39 @@ void TransformEffect::process_coords(double timecode, GLTextureCoords& coords, i
 	coords.vertexBottomRightY -= anchor_y_offset;
 
 	// rotation
-	glRotatef(rotation->get_double_value(timecode), 0, 0, 1);
+	coords.matrix.rotate(rotation->get_double_value(timecode), 0, 0, 1);
 
 	// scale
 	float sx = scale_x->get_double_value(timecode)*0.01;
 	float sy = (uniform_scale_field->get_bool_value(timecode)) ? sx : scale_y->get_double_value(timecode)*0.01;
-	glScalef(sx, sy, 1);
+	coords.matrix.scale(sx, sy, 1);
 
 	// blend mode
+	coords.custom_blend = true;
 	switch (blend_mode_box->get_combo_data(timecode).toInt()) {
 	case BLEND_MODE_NORMAL:
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		coords.blend_src = GL_SRC_ALPHA;
+		coords.blend_dst = GL_ONE_MINUS_SRC_ALPHA;
 		break;
 	case BLEND_MODE_OVERLAY:
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		coords.blend_src = GL_SRC_ALPHA;
+		coords.blend_dst = GL_ONE;
 		break;
 	case BLEND_MODE_SCREEN:
-		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_COLOR);
+		coords.blend_src = GL_ONE;
+		coords.blend_dst = GL_ONE_MINUS_SRC_COLOR;
 		break;
 	case BLEND_MODE_MULTIPLY:
-		glBlendFunc(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA);
+		coords.blend_src = GL_DST_COLOR;
+		coords.blend_dst = GL_ONE_MINUS_SRC_ALPHA;
 		break;
 	default:
+		coords.custom_blend = false;
 		qCritical() << "Invalid blend mode. This is a bug - please contact developers";
 	}
 
 	// opacity
-	float color[4];
-	glGetFloatv(GL_CURRENT_COLOR, color);
-	glColor4f(1.0, 1.0, 1.0, color[3]*(opacity->get_double_value(timecode)*0.01));
+	coords.opacity *= opacity->get_double_value(timecode)*0.01;
 }
 
 void TransformEffect::gizmo_draw(double, GLTextureCoords& coords) {
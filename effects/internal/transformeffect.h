@@ -8,6 +8,7 @@ class TransformEffect : public Effect {
 public:
 	TransformEffect(Clip* c, const EffectMeta* em);
 	void refresh();
+	bool is_passthrough();
 	void process_coords(double timecode, GLTextureCoords& coords, int data);
 
 	void gizmo_draw(double timecode, GLTextureCoords& coords);
@@ -5,18 +5,22 @@
 #include <QFile>
 
 #include "ui/collapsiblewidget.h"
+#include "io/projectsnapshot.h"
 #include "debug.h"
 
 VoidEffect::VoidEffect(Clip *c, const QString& n) : Effect(c, nullptr) {
 	name = n;
+    add_row(tr("Missing Effect"), false, false);
+}
+
+void VoidEffect::setup_ui() {
 	QString display_name;
-	if (n.isEmpty()) {
+	if (name.isEmpty()) {
         display_name = tr("(unknown)");
 	} else {
-		display_name = n;
+		display_name = name;
 	}
-    EffectRow* row = add_row(tr("Missing Effect"), false, false);
-	row->add_widget(new QLabel(display_name));
+	row(0)->add_widget(new QLabel(display_name));
 	container->setText(display_name);
 }
 
@@ -44,19 +48,15 @@ void VoidEffect::load(QXmlStreamReader &stream) {
 	}
 }
 
-void VoidEffect::save(QXmlStreamWriter &stream) {
+void VoidEffect::save(ProjectSnapshotElement* element) {
 	if (!name.isEmpty()) {
-		stream.writeAttribute("name", name);
-		stream.writeAttribute("enabled", QString::number(is_enabled()));
+		element->set_attribute("name", name);
+		element->set_attribute("enabled", QString::number(is_enabled()));
 
 		// force xml writer to expand <effect> tag, ignored when loading
-		stream.writeStartElement("void");
-		stream.writeEndElement();
+		element->add_child("void");
 
-		if (!bytes.isEmpty()) {
-			// write stored data
-			QIODevice* device = stream.device();
-			device->write(bytes);
-		}
+		// write stored data
+		element->set_raw(bytes);
 	}
 }
@@ -13,7 +13,9 @@ class VoidEffect : public Effect {
 public:
     VoidEffect(Clip* c, const QString& n);
     void load(QXmlStreamReader &stream) override;
-    void save(QXmlStreamWriter &stream) override;
+    void save(ProjectSnapshotElement* element) override;
+protected:
+    void setup_ui() override;
 private:
     QByteArray bytes;
 };
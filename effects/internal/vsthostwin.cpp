@@ -8,10 +8,11 @@
 #include <QDialog>
 #include <QMessageBox>
 #include <QFile>
-#include <QXmlStreamWriter>
+#include <QApplication>
 
 #include "playback/audio.h"
 #include "mainwindow.h"
+#include "io/projectsnapshot.h"
 #include "debug.h"
 
 #define BLOCK_SIZE 512
@@ -164,18 +165,19 @@ VSTHostWin::VSTHostWin(Clip* c, const EffectMeta *em) : Effect(c, em) {
 	file_field = add_row(tr("Plugin"), true, false)->add_field(EFFECT_FIELD_FILE, "filename");
 	connect(file_field, SIGNAL(changed()), this, SLOT(change_plugin()));
 
-	EffectRow* interface_row = add_row(tr("Interface"), false, false);
+	interface_row = add_row(tr("Interface"), false, false);
+
+	// widgets are created on the GUI thread, see setup_ui() and change_plugin()
+	show_interface_btn = nullptr;
+	dialog = nullptr;
+}
+
+void VSTHostWin::setup_ui() {
 	show_interface_btn = new QPushButton(tr("Show"));
 	show_interface_btn->setCheckable(true);
-	show_interface_btn->setEnabled(false);
+	show_interface_btn->setEnabled(plugin != nullptr);
 	connect(show_interface_btn, SIGNAL(toggled(bool)), this, SLOT(show_interface(bool)));
 	interface_row->add_widget(show_interface_btn);
-
-	dialog = new QDialog(mainWindow);
-	dialog->setWindowTitle(tr("VST Plugin"));
-	dialog->setAttribute(Qt::WA_NativeWindow, true);
-	dialog->setWindowFlags(dialog->windowFlags() | Qt::MSWindowsFixedSizeDialogHint);
-	connect(dialog, SIGNAL(finished(int)), this, SLOT(uncheck_show_button()));
 }
 
 VSTHostWin::~VSTHostWin() {
@@ -224,17 +226,20 @@ void VSTHostWin::custom_load(QXmlStreamReader &stream) {
 		QByteArray b = QByteArray::fromBase64(stream.text().toUtf8());
 		if (plugin != nullptr) {
 			dispatcher(plugin, effSetChunk, 0, VstInt32(b.size()), static_cast<void*>(b.data()), 0);
+		} else {
+			// plugin is loaded once the effect reaches the GUI thread
+			pending_chunk = b;
 		}
 	}
 }
 
-void VSTHostWin::save(QXmlStreamWriter &stream) {
-	Effect::save(stream);
+void VSTHostWin::save(ProjectSnapshotElement* element) {
+	Effect::save(element);
 	if (plugin != nullptr) {
 		char* p = nullptr;
 		VstInt32 length = VstInt32(dispatcher(plugin, effGetChunk, 0, 0, &p, 0));
 		QByteArray b(p, length);
-		stream.writeTextElement("plugindata", b.toBase64());
+		element->add_child("plugindata")->set_text(b.toBase64());
 	}
 }
 
@@ -243,15 +248,32 @@ void VSTHostWin::show_interface(bool show) {
 }
 
 void VSTHostWin::uncheck_show_button() {
-	show_interface_btn->setChecked(false);
+	if (show_interface_btn != nullptr) show_interface_btn->setChecked(false);
 }
 
 void VSTHostWin::change_plugin() {
+	if (QThread::currentThread() != QApplication::instance()->thread()) {
+		// effects may be created by the load thread, the editor window needs the GUI thread
+		QMetaObject::invokeMethod(this, "change_plugin", Qt::QueuedConnection);
+		return;
+	}
+
 	freePlugin();
 	loadPlugin();
 	if (plugin != nullptr) {
 		if (configurePluginCallbacks()) {
 			startPlugin();
+			if (!pending_chunk.isEmpty()) {
+				dispatcher(plugin, effSetChunk, 0, VstInt32(pending_chunk.size()), static_cast<void*>(pending_chunk.data()), 0);
+				pending_chunk.clear();
+			}
+			if (dialog == nullptr) {
+				dialog = new QDialog(mainWindow);
+				dialog->setWindowTitle(tr("VST Plugin"));
+				dialog->setAttribute(Qt::WA_NativeWindow, true);
+				dialog->setWindowFlags(dialog->windowFlags() | Qt::MSWindowsFixedSizeDialogHint);
+				connect(dialog, SIGNAL(finished(int)), this, SLOT(uncheck_show_button()));
+			}
 			dispatcher(plugin, effEditOpen, 0, 0, reinterpret_cast<HWND>(dialog->winId()), 0);
 			ERect* eRect = nullptr;
 			plugin->dispatcher(plugin, effEditGetRect, 0, 0, &eRect, 0);
@@ -262,5 +284,5 @@ void VSTHostWin::change_plugin() {
 			plugin = nullptr;
 		}
 	}
-	show_interface_btn->setEnabled(plugin != nullptr);
+	if (show_interface_btn != nullptr) show_interface_btn->setEnabled(plugin != nullptr);
 }
@@ -19,7 +19,9 @@ public:
 	void process_audio(double timecode_start, double timecode_end, quint8* samples, int nb_bytes, int channel_count);
 
 	void custom_load(QXmlStreamReader& stream);
-	void save(QXmlStreamWriter& stream);
+	void save(ProjectSnapshotElement* element);
+protected:
+	void setup_ui();
 private slots:
 	void show_interface(bool show);
 	void uncheck_show_button();
@@ -42,7 +44,9 @@ private:
 	float** inputs;
 	float** outputs;
 	QDialog* dialog;
+	EffectRow* interface_row;
 	QPushButton* show_interface_btn;
+	QByteArray pending_chunk;
 	HMODULE modulePtr;
 };
 
@@ -5,9 +5,12 @@ uniform float amount;
 uniform sampler2D myTexture;
 varying vec2 vTexCoord;
 
-void main(void) {
-	vec4 textureColor = texture2D(myTexture, vTexCoord);
+vec4 process(vec4 textureColor) {
 	float amount_val = amount * 0.01;
 	vec3 col = textureColor.rgb+((vec3(1.0)-textureColor.rgb-textureColor.rgb)*vec3(amount_val));
-	gl_FragColor = vec4(col, textureColor.a);
+	return vec4(col, textureColor.a);
+}
+
+void main(void) {
+	gl_FragColor = process(texture2D(myTexture, vTexCoord));
 }
\ No newline at end of file
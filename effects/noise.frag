@@ -20,7 +20,7 @@ float gold_noise(vec2 coordinate, float seed){
     return fract(tan(distance(coordinate*(seed+PHI), vec2(PHI, PI)))*SQ2)*(amount*0.01);
 }
 
-void main(void) {
+vec4 process(vec4 textureColor) {
 	vec3 noise;
 	if (color) {
 		noise = vec3(gold_noise(vTexCoord, time + 42069.0), gold_noise(vTexCoord, time + 69220.0), gold_noise(vTexCoord, time + 1337.0));
@@ -31,13 +31,16 @@ void main(void) {
 	if (blend) {
 		noise = (noise - vec3(amount*0.005))*vec3(2.0);
 
-		vec4 textureColor = texture2D(myTexture, vec2(vTexCoord.x, vTexCoord.y));
-		gl_FragColor = vec4(textureColor.rgb+noise, textureColor.a);
+		return vec4(textureColor.rgb+noise, textureColor.a);
 	} else {
-		gl_FragColor = vec4(noise, 1.0);
+		return vec4(noise, 1.0);
 	}
 }
 
+void main(void) {
+	gl_FragColor = process(texture2D(myTexture, vTexCoord));
+}
+
 /*void main(void) {
 	vec4 textureColor = texture2D(myTexture, vec2(vTexCoord.x, vTexCoord.y));
 	textureColor.r += gold_noise(resolution);
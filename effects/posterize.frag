@@ -6,14 +6,17 @@ uniform float numColors; // 8.0
 
 varying vec2 vTexCoord;
 
-void main() {
+vec4 process(vec4 color) {
 	float gamma = gamma_cent*0.01;
-	vec4 color = texture2D(sceneTex, vTexCoord);
 	vec3 c = color.rgb;
 	c = pow(c, vec3(gamma, gamma, gamma));
 	c = c * numColors;
 	c = floor(c);
 	c = c / numColors;
 	c = pow(c, vec3(1.0/gamma));
-	gl_FragColor = vec4(c, color.a);
+	return vec4(c, color.a);
+}
+
+void main() {
+	gl_FragColor = process(texture2D(sceneTex, vTexCoord));
 }
\ No newline at end of file
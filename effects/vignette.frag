@@ -9,11 +9,10 @@ uniform vec2 resolution;
 
 varying vec2 vTexCoord;
 
-void main(void) {
+vec4 process(vec4 c) {
 	if (lensRadiusX == 0.0) {
-		discard;
+		return vec4(0.0);
 	}
-	vec4 c = texture2D(sceneTex, vTexCoord);
 	vec2 vignetteCoord = vTexCoord;
 	if (circular) {
 		float ar = (resolution.x/resolution.y);
@@ -23,5 +22,9 @@ void main(void) {
 	float dist = distance(vignetteCoord, vec2(0.5,0.5));
 	float size = (lensRadiusX*0.01);
 	c *= smoothstep(size, size*0.99*(1.0-lensRadiusY*0.01), dist);
-	gl_FragColor = c;
+	return c;
+}
+
+void main(void) {
+	gl_FragColor = process(texture2D(sceneTex, vTexCoord));
 }
\ No newline at end of file
@@ -0,0 +1,501 @@
+#include "audiomixdown.h"
+
+#include <QtMath>
+
+#include <algorithm>
+
+#include "project/sequence.h"
+#include "project/clip.h"
+#include "project/footage.h"
+#include "project/media.h"
+#include "project/effect.h"
+#include "playback/cacher.h"
+#include "debug.h"
+
+extern "C" {
+	#include <libavformat/avformat.h>
+	#include <libavcodec/avcodec.h>
+	#include <libavfilter/avfilter.h>
+	#include <libavfilter/buffersrc.h>
+	#include <libavfilter/buffersink.h>
+	#include <libavutil/opt.h>
+}
+
+struct MixdownSource {
+	Clip* clip;
+	QVector<Clip*> nests;
+
+	// export samples the clip is heard in
+	long out_in;
+	long out_out;
+
+	// seconds from the clip's sequence to the export's
+	double shift;
+
+	// index into the stem tracks
+	int stem;
+
+	bool opened;
+	double speed;
+
+	AVFormatContext* fmt_ctx;
+	AVStream* stream;
+	AVCodecContext* codec_ctx;
+	AVFilterGraph* filter_graph;
+	AVFilterContext* buffersrc_ctx;
+	AVFilterContext* buffersink_ctx;
+	AVPacket* packet;
+	AVFrame* decoded;
+	AVFrame* filtered;
+	int filtered_read;
+	bool flushed;
+	bool ended;
+
+	// lines the first decoded frame up with where the clip starts
+	double source_in;
+	int64_t first_pts;
+	bool aligned;
+	long skip;
+	long silence;
+
+	// reversed clips decode a block forwards and play it backwards from here, the next block ends where this one
+	// starts, reversed_end samples after reversed_in
+	QVector<qint16> reversed;
+	int reversed_read;
+	double reversed_in;
+	long reversed_end;
+};
+
+// seconds into the clip at a time in its own sequence, before speed is applied
+static double clip_seconds(Clip* c, double t) {
+	return t - (double) (c->get_timeline_in_with_transition() - c->get_clip_in_with_transition()) / c->sequence->frame_rate;
+}
+
+static bool create_filter_graph(MixdownSource* s, int rate) {
+	s->filter_graph = avfilter_graph_alloc();
+	if (s->filter_graph == nullptr) return false;
+
+	if (s->codec_ctx->channel_layout == 0) s->codec_ctx->channel_layout = av_get_default_channel_layout(s->stream->codecpar->channels);
+
+	char filter_args[512];
+	snprintf(filter_args, sizeof(filter_args), "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%" PRIx64,
+				s->stream->time_base.num,
+				s->stream->time_base.den,
+				s->stream->codecpar->sample_rate,
+				av_get_sample_fmt_name(s->codec_ctx->sample_fmt),
+				s->codec_ctx->channel_layout
+			 );
+
+	if (avfilter_graph_create_filter(&s->buffersrc_ctx, avfilter_get_by_name("abuffer"), "in", filter_args, nullptr, s->filter_graph) < 0
+			|| avfilter_graph_create_filter(&s->buffersink_ctx, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr, s->filter_graph) < 0) {
+		return false;
+	}
+
+	enum AVSampleFormat sample_fmts[] = { AV_SAMPLE_FMT_S16, static_cast<AVSampleFormat>(-1) };
+	av_opt_set_int_list(s->buffersink_ctx, "sample_fmts", sample_fmts, -1, AV_OPT_SEARCH_CHILDREN);
+
+	int64_t channel_layouts[] = { AV_CH_LAYOUT_STEREO, static_cast<AVSampleFormat>(-1) };
+	av_opt_set_int_list(s->buffersink_ctx, "channel_layouts", channel_layouts, -1, AV_OPT_SEARCH_CHILDREN);
+
+	// same speed handling as playback, so an export sounds like what was heard in the viewer
+	AVFilterContext* last_filter = s->buffersrc_ctx;
+	int target_sample_rate = rate;
+	if (!qFuzzyCompare(s->speed, 1.0)) {
+		if (s->clip->maintain_audio_pitch) {
+			double base = (s->speed > 1.0) ? 2.0 : 0.5;
+			double speedlog = log(s->speed) / log(base);
+			int whole2 = qFloor(speedlog);
+			speedlog -= whole2;
+
+			char speed_param[10];
+			for (int i=0;i<=whole2;i++) {
+				snprintf(speed_param, sizeof(speed_param), "%f", (i < whole2) ? base : qPow(base, speedlog));
+				AVFilterContext* tempo_filter = nullptr;
+				avfilter_graph_create_filter(&tempo_filter, avfilter_get_by_name("atempo"), "atempo", speed_param, nullptr, s->filter_graph);
+				avfilter_link(last_filter, 0, tempo_filter, 0);
+				last_filter = tempo_filter;
+			}
+		} else {
+			target_sample_rate = qRound64(rate / s->speed);
+		}
+	}
+	avfilter_link(last_filter, 0, s->buffersink_ctx, 0);
+
+	int sample_rates[] = { target_sample_rate, 0 };
+	av_opt_set_int_list(s->buffersink_ctx, "sample_rates", sample_rates, 0, AV_OPT_SEARCH_CHILDREN);
+
+	return (avfilter_graph_config(s->filter_graph, nullptr) >= 0);
+}
+
+// fills s->filtered with the next samples, returns AVERROR_EOF once the file is used up
+static int read_source_frame(MixdownSource* s) {
+	while (true) {
+		int ret = av_buffersink_get_frame(s->buffersink_ctx, s->filtered);
+		if (ret != AVERROR(EAGAIN)) return ret;
+		if (s->flushed) return AVERROR_EOF;
+
+		ret = avcodec_receive_frame(s->codec_ctx, s->decoded);
+		if (ret == AVERROR(EAGAIN)) {
+			if (av_read_frame(s->fmt_ctx, s->packet) < 0) {
+				avcodec_send_packet(s->codec_ctx, nullptr);
+			} else {
+				if (s->packet->stream_index == s->stream->index) avcodec_send_packet(s->codec_ctx, s->packet);
+				av_packet_unref(s->packet);
+			}
+		} else if (ret < 0) {
+			// decoder is drained, let the filters hand over what they still hold
+			av_buffersrc_add_frame(s->buffersrc_ctx, nullptr);
+			s->flushed = true;
+		} else {
+			if (s->first_pts == AV_NOPTS_VALUE) s->first_pts = s->decoded->best_effort_timestamp;
+			av_buffersrc_add_frame(s->buffersrc_ctx, s->decoded);
+		}
+	}
+}
+
+// decodes the next count samples in order, silence where the file has none
+static void read_source(MixdownSource* s, qint16* out, long count) {
+	long written = 0;
+	while (written < count) {
+		if (s->silence > 0) {
+			long n = qMin(s->silence, count - written);
+			memset(out + written*2, 0, n*4);
+			written += n;
+			s->silence -= n;
+			continue;
+		}
+
+		if (s->filtered_read >= s->filtered->nb_samples) {
+			av_frame_unref(s->filtered);
+			s->filtered_read = 0;
+			if (s->ended || read_source_frame(s) < 0) {
+				s->ended = true;
+				memset(out + written*2, 0, (count - written)*4);
+				return;
+			}
+
+			// the seek lands on or before the clip's start, the difference is skipped or padded
+			if (!s->aligned) {
+				s->aligned = true;
+				if (s->first_pts != AV_NOPTS_VALUE) {
+					int64_t start_time = (s->stream->start_time == AV_NOPTS_VALUE) ? 0 : s->stream->start_time;
+					double frame_secs = (s->first_pts - start_time) * av_q2d(s->stream->time_base);
+					long offset = qRound64((s->source_in - frame_secs) * s->filtered->sample_rate);
+					if (s->clip->maintain_audio_pitch) offset = qRound64(offset / s->speed);
+					if (offset > 0) {
+						s->skip = offset;
+					} else {
+						s->silence = -offset;
+					}
+				}
+			}
+			continue;
+		}
+
+		long available = s->filtered->nb_samples - s->filtered_read;
+		if (s->skip > 0) {
+			long n = qMin(s->skip, available);
+			s->skip -= n;
+			s->filtered_read += n;
+			continue;
+		}
+
+		long n = qMin(available, count - written);
+		memcpy(out + written*2, s->filtered->data[0] + s->filtered_read*4, n*4);
+		written += n;
+		s->filtered_read += n;
+	}
+}
+
+// carries on decoding from a time in the clip, dropping whatever was decoded before
+static bool seek_source(MixdownSource* s, double u, int rate) {
+	s->source_in = qMax(0.0, u * s->speed);
+
+	av_frame_unref(s->filtered);
+	s->filtered_read = 0;
+	s->flushed = false;
+	s->ended = false;
+	s->first_pts = AV_NOPTS_VALUE;
+	s->aligned = false;
+	s->skip = 0;
+	s->silence = 0;
+
+	int64_t start_time = (s->stream->start_time == AV_NOPTS_VALUE) ? 0 : s->stream->start_time;
+	int64_t target = qRound64(s->source_in / av_q2d(s->stream->time_base)) + start_time;
+	av_seek_frame(s->fmt_ctx, s->stream->index, target, AVSEEK_FLAG_BACKWARD);
+	avcodec_flush_buffers(s->codec_ctx);
+
+	// the filters still hold samples from before the seek, and their end of stream if they were flushed
+	avfilter_graph_free(&s->filter_graph);
+	return create_filter_graph(s, rate);
+}
+
+// decodes the block of a reversed clip that plays next and turns it around
+static bool read_reversed_block(MixdownSource* s, int rate) {
+	long count = qMin(static_cast<long>(MIXDOWN_REVERSE_BLOCK_SECONDS * rate), s->reversed_end);
+	if (count <= 0) return false;
+
+	s->reversed_end -= count;
+	if (!seek_source(s, s->reversed_in + (double) s->reversed_end / rate, rate)) return false;
+
+	s->reversed.resize(count*2);
+	read_source(s, s->reversed.data(), count);
+	for (long i=0;i<count/2;i++) {
+		qint16 left = s->reversed.at(i*2);
+		qint16 right = s->reversed.at(i*2+1);
+		s->reversed[i*2] = s->reversed.at((count-i-1)*2);
+		s->reversed[i*2+1] = s->reversed.at((count-i-1)*2+1);
+		s->reversed[(count-i-1)*2] = left;
+		s->reversed[(count-i-1)*2+1] = right;
+	}
+	s->reversed_read = 0;
+	return true;
+}
+
+// the next count samples of a reversed clip, silence if the file has run out
+static void read_reversed(MixdownSource* s, qint16* out, long count, int rate) {
+	long written = 0;
+	while (written < count) {
+		if (s->reversed_read*2 >= s->reversed.size() && !read_reversed_block(s, rate)) {
+			memset(out + written*2, 0, (count - written)*4);
+			return;
+		}
+
+		long n = qMin(count - written, static_cast<long>(s->reversed.size()/2 - s->reversed_read));
+		memcpy(out + written*2, s->reversed.constData() + s->reversed_read*2, n*4);
+		written += n;
+		s->reversed_read += n;
+	}
+}
+
+static void close_source(MixdownSource* s) {
+	if (s->filter_graph != nullptr) avfilter_graph_free(&s->filter_graph);
+	if (s->codec_ctx != nullptr) avcodec_free_context(&s->codec_ctx);
+	if (s->fmt_ctx != nullptr) avformat_close_input(&s->fmt_ctx);
+	if (s->packet != nullptr) av_packet_free(&s->packet);
+	if (s->decoded != nullptr) av_frame_free(&s->decoded);
+	if (s->filtered != nullptr) av_frame_free(&s->filtered);
+	s->reversed.clear();
+}
+
+// opens the clip's file at the source time the export sample from is heard at, tone clips have nothing to open
+static bool open_source(MixdownSource* s, double secs, int rate) {
+	s->opened = true;
+	if (s->clip->media == nullptr) return true;
+
+	Footage* f = s->clip->media->to_footage();
+	const FootageStream* ms = f->get_stream_from_file_index(false, s->clip->media_stream);
+	QByteArray ba = f->url.toUtf8();
+	if (ms == nullptr
+			|| avformat_open_input(&s->fmt_ctx, ba.constData(), nullptr, nullptr) != 0
+			|| avformat_find_stream_info(s->fmt_ctx, nullptr) < 0
+			|| ms->file_index >= (int) s->fmt_ctx->nb_streams) {
+		qCritical() << "Could not open" << f->url << "for mixdown";
+		return false;
+	}
+
+	for (unsigned int i=0;i<s->fmt_ctx->nb_streams;i++) {
+		if ((int) i != ms->file_index) s->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+	}
+	s->stream = s->fmt_ctx->streams[ms->file_index];
+
+	AVCodec* codec = avcodec_find_decoder(s->stream->codecpar->codec_id);
+	s->codec_ctx = avcodec_alloc_context3(codec);
+	avcodec_parameters_to_context(s->codec_ctx, s->stream->codecpar);
+	if (codec == nullptr || avcodec_open2(s->codec_ctx, codec, nullptr) < 0) {
+		qCritical() << "Could not open decoder for" << f->url << "for mixdown";
+		return false;
+	}
+
+	s->packet = av_packet_alloc();
+	s->decoded = av_frame_alloc();
+	s->filtered = av_frame_alloc();
+
+	double u = clip_seconds(s->clip, secs - s->shift);
+	if (s->clip->reverse) {
+		// reversed clips start from the source's last block, decoded once the first samples are asked for
+		long count = s->out_out - s->out_in;
+		s->reversed_in = (double) s->clip->getMaximumLength() / s->clip->sequence->frame_rate - u - (double) count / rate;
+		s->reversed_end = count;
+		s->reversed.clear();
+		s->reversed_read = 0;
+		return true;
+	}
+
+	if (!seek_source(s, u, rate)) {
+		qCritical() << "Could not set up filters for" << f->url << "for mixdown";
+		return false;
+	}
+
+	return true;
+}
+
+AudioMixdown::AudioMixdown(Sequence* s, long start_frame, long end_frame, int rate) :
+	start_secs((double) start_frame / s->frame_rate),
+	sample_rate(rate),
+	position(0)
+{
+	length = qRound64((double) (end_frame - start_frame) / s->frame_rate * rate);
+
+	QVector<Clip*> nests;
+	add_sequence(s, nests, 0, start_secs, (double) end_frame / s->frame_rate);
+
+	// sources only learn their stem once every track is known
+	std::sort(stem_tracks.begin(), stem_tracks.end());
+	for (int i=0;i<sources.size();i++) {
+		MixdownSource* source = sources.at(i);
+		int track = source->nests.isEmpty() ? source->clip->track : source->nests.first()->track;
+		source->stem = stem_tracks.indexOf(track);
+	}
+
+	qInfo() << "Mixing down" << sources.size() << "audio clips," << length << "samples";
+}
+
+AudioMixdown::~AudioMixdown() {
+	for (int i=0;i<sources.size();i++) {
+		close_source(sources.at(i));
+		delete sources.at(i);
+	}
+}
+
+void AudioMixdown::add_sequence(Sequence* s, QVector<Clip*>& nests, double shift, double visible_in, double visible_out) {
+	for (int i=0;i<s->clips.size();i++) {
+		Clip* c = s->clips.at(i);
+		if (c == nullptr || c->track < 0 || !c->enabled) continue;
+
+		// where the clip is heard, in export seconds
+		double clip_in = qMax(visible_in, (double) c->get_timeline_in_with_transition() / s->frame_rate + shift);
+		double clip_out = qMin(visible_out, (double) c->get_timeline_out_with_transition() / s->frame_rate + shift);
+		if (clip_out <= clip_in) continue;
+
+		if (c->media != nullptr && c->media->get_type() == MEDIA_TYPE_SEQUENCE) {
+			// the nested sequence's own time starts where the clip's in point is
+			nests.append(c);
+			add_sequence(c->media->to_sequence(), nests, shift + (double) (c->get_timeline_in_with_transition() - c->get_clip_in_with_transition()) / s->frame_rate, clip_in, clip_out);
+			nests.removeLast();
+			continue;
+		}
+
+		if (c->media != nullptr) {
+			if (c->media->get_type() != MEDIA_TYPE_FOOTAGE) continue;
+			Footage* f = c->media->to_footage();
+			if (f->invalid || f->get_stream_from_file_index(false, c->media_stream) == nullptr) continue;
+		}
+
+		MixdownSource* source = new MixdownSource();
+		source->clip = c;
+		source->nests = nests;
+		source->out_in = qMax(0LL, qRound64((clip_in - start_secs) * sample_rate));
+		source->out_out = qMin(static_cast<long long>(length), qRound64((clip_out - start_secs) * sample_rate));
+		source->shift = shift;
+		source->opened = false;
+		source->speed = c->speed * ((c->media != nullptr) ? c->media->to_footage()->speed : 1.0);
+		source->fmt_ctx = nullptr;
+		source->stream = nullptr;
+		source->codec_ctx = nullptr;
+		source->filter_graph = nullptr;
+		source->buffersrc_ctx = nullptr;
+		source->buffersink_ctx = nullptr;
+		source->packet = nullptr;
+		source->decoded = nullptr;
+		source->filtered = nullptr;
+		source->filtered_read = 0;
+		source->flushed = false;
+		source->ended = false;
+		source->source_in = 0;
+		source->first_pts = AV_NOPTS_VALUE;
+		source->aligned = false;
+		source->skip = 0;
+		source->silence = 0;
+		source->reversed_read = 0;
+		source->reversed_in = 0;
+		source->reversed_end = 0;
+		source->stem = -1;
+		if (source->out_out > source->out_in) {
+			sources.append(source);
+
+			int track = nests.isEmpty() ? c->track : nests.first()->track;
+			if (!stem_tracks.contains(track)) stem_tracks.append(track);
+		} else {
+			delete source;
+		}
+	}
+}
+
+int AudioMixdown::mix(qint16* samples, int max_samples, const QVector<qint16*>& stems) {
+	int count = qMin(static_cast<long>(max_samples), length - position);
+	if (count <= 0) return 0;
+
+	memset(samples, 0, count*4);
+	for (int i=0;i<stems.size();i++) {
+		memset(stems.at(i), 0, count*4);
+	}
+	if (block.size() < count*2) block.resize(count*2);
+
+	AVFrame* frame = av_frame_alloc();
+	frame->channels = 2;
+	frame->sample_rate = sample_rate;
+
+	for (int i=0;i<sources.size();i++) {
+		MixdownSource* s = sources.at(i);
+		long from = qMax(position, s->out_in);
+		long to = qMin(position + count, s->out_out);
+		if (to <= from) continue;
+
+		double secs = start_secs + (double) from / sample_rate;
+		if (!s->opened && !open_source(s, secs, sample_rate)) {
+			// a file that can't be read is left out instead of failing the whole export
+			close_source(s);
+			s->out_out = s->out_in;
+			continue;
+		}
+
+		long n = to - from;
+		qint16* data = block.data();
+		if (s->clip->media == nullptr) {
+			// tone clips are generated by their effects
+			memset(data, 0, n*4);
+		} else if (s->clip->reverse) {
+			read_reversed(s, data, n, sample_rate);
+		} else {
+			read_source(s, data, n);
+		}
+
+		frame->data[0] = reinterpret_cast<uint8_t*>(data);
+		frame->nb_samples = n;
+		apply_audio_effects(s->clip, clip_seconds(s->clip, secs - s->shift), frame, n*4, s->nests);
+
+		qint16* out = samples + (from - position)*2;
+		for (long j=0;j<n*2;j++) {
+			out[j] = mix_audio_sample(out[j], data[j]);
+		}
+
+		// the clip's track gets its own copy of the block, decoded once for both
+		if (s->stem > -1 && s->stem < stems.size()) {
+			qint16* stem_out = stems.at(s->stem) + (from - position)*2;
+			for (long j=0;j<n*2;j++) {
+				stem_out[j] = mix_audio_sample(stem_out[j], data[j]);
+			}
+		}
+
+		if (to == s->out_out) close_source(s);
+	}
+
+	frame->data[0] = nullptr;
+	av_frame_free(&frame);
+
+	position += count;
+	return count;
+}
+
+QVector<int> AudioMixdown::get_stem_tracks() {
+	return stem_tracks;
+}
+
+long AudioMixdown::get_position() {
+	return position;
+}
+
+long AudioMixdown::get_length() {
+	return length;
+}
@@ -0,0 +1,50 @@
+#ifndef AUDIOMIXDOWN_H
+#define AUDIOMIXDOWN_H
+
+#include <QVector>
+
+struct Sequence;
+struct Clip;
+struct MixdownSource;
+
+// samples per channel mixed at a time when nothing asks for less
+#define MIXDOWN_BLOCK_SAMPLES 8192
+
+// reversed clips are decoded this much at a time, from their end backwards
+#define MIXDOWN_REVERSE_BLOCK_SECONDS 10
+
+/*
+ * Mixes a sequence's audio for export without the playback buffer or the audio device. Every audio clip, including
+ * those inside nested sequences, decodes its file separately in order, goes through the clip's effects and
+ * transitions and is mixed in blocks, so nothing waits on real time or on the render loop. Reversed clips seek back
+ * a block at a time and play each block backwards, so they don't hold more of their file than that in memory.
+ */
+class AudioMixdown {
+public:
+	// end_frame is the first frame that isn't exported
+	AudioMixdown(Sequence* s, long start_frame, long end_frame, int rate);
+	~AudioMixdown();
+
+	// interleaved 16-bit stereo, returns samples per channel written, 0 once the range is done. Each stem buffer gets
+	// the same block with only its track mixed in, in the order of get_stem_tracks()
+	int mix(qint16* samples, int max_samples, const QVector<qint16*>& stems = QVector<qint16*>());
+
+	// the sequence's audio tracks that have anything on them in the range, clips inside nested sequences count
+	// towards the track of the clip they're nested in
+	QVector<int> get_stem_tracks();
+
+	long get_position();
+	long get_length();
+private:
+	void add_sequence(Sequence* s, QVector<Clip*>& nests, double shift, double visible_in, double visible_out);
+
+	QVector<MixdownSource*> sources;
+	QVector<int> stem_tracks;
+	double start_secs;
+	int sample_rate;
+	long position;
+	long length;
+	QVector<qint16> block;
+};
+
+#endif // AUDIOMIXDOWN_H
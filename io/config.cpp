@@ -46,7 +46,10 @@ Config::Config()
 	  upcoming_queue_type(FRAME_QUEUE_TYPE_SECONDS),
 	  loop(true),
 	  pause_at_out_point(true),
-      seek_also_selects(false)
+      seek_also_selects(false),
+	  preview_cache_size(1024),
+	  gpu_memory_budget(1024),
+	  export_encode_workers(1)
 {}
 
 void Config::load(QString path) {
@@ -165,7 +168,16 @@ void Config::load(QString path) {
                 } else if (stream.name() == "CSSPath") {
                     stream.readNext();
                     css_path = stream.text().toString();
-                }
+				} else if (stream.name() == "PreviewCacheSize") {
+					stream.readNext();
+					preview_cache_size = stream.text().toInt();
+				} else if (stream.name() == "GPUMemoryBudget") {
+					stream.readNext();
+					gpu_memory_budget = stream.text().toInt();
+				} else if (stream.name() == "ExportEncodeWorkers") {
+					stream.readNext();
+					export_encode_workers = stream.text().toInt();
+				}
 			}
 		}
 		if (stream.hasError()) {
@@ -225,6 +237,9 @@ void Config::save(QString path) {
 	stream.writeTextElement("PauseAtOutPoint", QString::number(pause_at_out_point));
     stream.writeTextElement("SeekAlsoSelects", QString::number(seek_also_selects));
     stream.writeTextElement("CSSPath", css_path);
+	stream.writeTextElement("PreviewCacheSize", QString::number(preview_cache_size));
+	stream.writeTextElement("GPUMemoryBudget", QString::number(gpu_memory_budget));
+	stream.writeTextElement("ExportEncodeWorkers", QString::number(export_encode_workers));
 
 	stream.writeEndElement(); // configuration
 	stream.writeEndDocument(); // doc
@@ -62,6 +62,9 @@ struct Config {
     bool pause_at_out_point;
     bool seek_also_selects;
     QString css_path;
+	int preview_cache_size;
+	int gpu_memory_budget;
+	int export_encode_workers;
 
 	void load(QString path);
 	void save(QString path);
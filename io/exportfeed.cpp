@@ -0,0 +1,55 @@
+#include "exportfeed.h"
+
+extern "C" {
+	#include <libavutil/frame.h>
+}
+
+ExportFeed::ExportFeed() :
+	closed(false),
+	aborted(false)
+{}
+
+ExportFeed::~ExportFeed() {
+	for (int i=0;i<frames.size();i++) {
+		AVFrame* frame = frames.at(i);
+		av_frame_free(&frame);
+	}
+}
+
+void ExportFeed::push(AVFrame* frame) {
+	QMutexLocker locker(&lock);
+	while (frames.size() >= EXPORT_FEED_QUEUE && !aborted) {
+		cond.wait(&lock);
+	}
+	if (aborted) return;
+	frames.append(av_frame_clone(frame));
+	cond.wakeAll();
+}
+
+AVFrame* ExportFeed::take() {
+	QMutexLocker locker(&lock);
+	while (frames.isEmpty() && !closed && !aborted) {
+		cond.wait(&lock);
+	}
+	if (frames.isEmpty() || aborted) return nullptr;
+	AVFrame* frame = frames.takeFirst();
+	cond.wakeAll();
+	return frame;
+}
+
+void ExportFeed::close() {
+	QMutexLocker locker(&lock);
+	closed = true;
+	cond.wakeAll();
+}
+
+void ExportFeed::abort() {
+	QMutexLocker locker(&lock);
+	aborted = true;
+	for (int i=0;i<frames.size();i++) {
+		AVFrame* frame = frames.at(i);
+		av_frame_free(&frame);
+	}
+	frames.clear();
+	cond.wakeAll();
+}
@@ -0,0 +1,42 @@
+#ifndef EXPORTFEED_H
+#define EXPORTFEED_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+
+struct AVFrame;
+
+// composited frames allowed to wait for a follower before the export compositing them waits too
+#define EXPORT_FEED_QUEUE 8
+
+/*
+ * Passes composited frames from one export to another that encodes the same range of the same sequence, so a
+ * sequence delivered in several formats is composited once. Frames are referenced, not copied, and each follower
+ * converts them with its own scaler.
+ */
+class ExportFeed {
+public:
+	ExportFeed();
+	~ExportFeed();
+
+	// adds a reference to frame, waits while the follower is behind
+	void push(AVFrame* frame);
+
+	// waits for the next frame, nullptr once there are none left
+	AVFrame* take();
+
+	// no more frames will be pushed
+	void close();
+
+	// the follower stopped, drops frames that haven't been taken and stops push() from waiting
+	void abort();
+private:
+	QMutex lock;
+	QWaitCondition cond;
+	QList<AVFrame*> frames;
+	bool closed;
+	bool aborted;
+};
+
+#endif // EXPORTFEED_H
@@ -0,0 +1,143 @@
+#include "exportsegment.h"
+
+#include <QCoreApplication>
+
+#include "debug.h"
+
+extern "C" {
+	#include <libavcodec/avcodec.h>
+	#include <libswscale/swscale.h>
+}
+
+ExportSegment::ExportSegment(AVCodecContext* e, SwsContext* s, long count, QSemaphore* budget) :
+	encoder(e),
+	frame_count(count),
+	scaler(s),
+	frame_budget(budget),
+	pushed(0),
+	aborted(false),
+	finished(false)
+{
+	// the export thread collects the packets before deleting it
+	setAutoDelete(false);
+}
+
+ExportSegment::~ExportSegment() {
+	for (int i=0;i<queue.size();i++) {
+		AVFrame* frame = queue.at(i);
+		av_frame_free(&frame);
+		frame_budget->release();
+	}
+	for (int i=0;i<packets.size();i++) {
+		AVPacket* packet = packets.at(i);
+		av_packet_free(&packet);
+	}
+	avcodec_free_context(&encoder);
+	if (scaler != nullptr) sws_freeContext(scaler);
+}
+
+void ExportSegment::push(AVFrame* frame) {
+	QMutexLocker locker(&lock);
+	queue.append(frame);
+	frame_pts.append(frame->pts);
+	pushed++;
+	cond.wakeAll();
+}
+
+bool ExportSegment::is_full() {
+	QMutexLocker locker(&lock);
+	return (pushed == frame_count);
+}
+
+bool ExportSegment::is_finished() {
+	QMutexLocker locker(&lock);
+	return finished;
+}
+
+void ExportSegment::wait_finished() {
+	QMutexLocker locker(&lock);
+	while (!finished) {
+		cond.wait(&lock);
+	}
+}
+
+void ExportSegment::abort() {
+	QMutexLocker locker(&lock);
+	aborted = true;
+	cond.wakeAll();
+}
+
+bool ExportSegment::encode(AVFrame* frame, AVPacket* packet) {
+	int ret = avcodec_send_frame(encoder, frame);
+	if (ret < 0) {
+		qCritical() << "Failed to send frame to segment encoder." << ret;
+		error = QCoreApplication::translate("ExportThread", "failed to send frame to encoder (%1)").arg(QString::number(ret));
+		return false;
+	}
+
+	while (true) {
+		ret = avcodec_receive_packet(encoder, packet);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+			return true;
+		} else if (ret < 0) {
+			qCritical() << "Failed to receive packet from segment encoder." << ret;
+			error = QCoreApplication::translate("ExportThread", "failed to receive packet from encoder (%1)").arg(QString::number(ret));
+			return false;
+		}
+
+		AVPacket* kept = av_packet_alloc();
+		av_packet_move_ref(kept, packet);
+		packets.append(kept);
+	}
+}
+
+void ExportSegment::run() {
+	AVFrame* converted = av_frame_alloc();
+	converted->format = encoder->pix_fmt;
+	converted->width = encoder->width;
+	converted->height = encoder->height;
+	av_frame_get_buffer(converted, 0);
+
+	AVPacket* packet = av_packet_alloc();
+
+	bool ok = true;
+	for (long i=0;i<frame_count && ok;i++) {
+		lock.lock();
+		while (queue.isEmpty() && !aborted) {
+			cond.wait(&lock);
+		}
+		if (aborted) {
+			lock.unlock();
+			ok = false;
+			break;
+		}
+		AVFrame* frame = queue.takeFirst();
+		lock.unlock();
+
+		if (scaler == nullptr) {
+			// converted on the GPU already
+			ok = encode(frame, packet);
+		} else {
+			// change pixel format
+			av_frame_make_writable(converted);
+			sws_scale(scaler, frame->data, frame->linesize, 0, frame->height, converted->data, converted->linesize);
+			converted->pts = frame->pts;
+			ok = encode(converted, packet);
+		}
+
+		av_frame_free(&frame);
+		frame_budget->release();
+	}
+
+	// flush the encoder, the segment's last GOP ends here
+	if (ok) ok = encode(nullptr, packet);
+
+	av_packet_free(&packet);
+	av_frame_free(&converted);
+
+	lock.lock();
+	if (!ok && error.isEmpty()) error = QCoreApplication::translate("ExportThread", "encoding was cancelled");
+	finished = true;
+	cond.wakeAll();
+	lock.unlock();
+}
@@ -0,0 +1,71 @@
+#ifndef EXPORTSEGMENT_H
+#define EXPORTSEGMENT_H
+
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
+#include <QList>
+#include <QVector>
+#include <QString>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+// length of an export segment, rounded up to whole GOPs
+#define EXPORT_SEGMENT_SECONDS 10
+
+// rendered frames allowed to wait for an encoder per worker before rendering waits too
+#define EXPORT_SEGMENT_QUEUE 8
+
+/*
+ * Encodes one run of an export's frames with its own encoder, so several runs of a long export are compressed at
+ * the same time while the render thread composites the next one. Only encoding runs in parallel, frames are still
+ * composited one at a time, so this pays off when the encoder is the slow part. Segments start on a key frame and
+ * end by flushing the encoder, so their GOPs are closed and their packets, B-frames included, can be copied into the
+ * output one after another without decoding them. Rate control restarts with every segment, so the bitstream isn't
+ * the one a single pass would produce.
+ */
+class ExportSegment : public QRunnable {
+public:
+	// takes ownership of the encoder and the scaler, which is nullptr if frames arrive in the encoder's format
+	ExportSegment(AVCodecContext* e, SwsContext* s, long count, QSemaphore* budget);
+	~ExportSegment();
+	void run();
+
+	// hands a rendered frame over, it's freed and its slot in the budget released once it's converted
+	void push(AVFrame* frame);
+	bool is_full();
+
+	bool is_finished();
+	void wait_finished();
+
+	// stops encoding, frames that haven't been pushed yet won't arrive
+	void abort();
+
+	AVCodecContext* encoder;
+	long frame_count;
+
+	// timestamps of the frames pushed, in order
+	QVector<int64_t> frame_pts;
+
+	// only valid once finished, packets are in the encoder's time base
+	QVector<AVPacket*> packets;
+	QString error;
+private:
+	bool encode(AVFrame* frame, AVPacket* packet);
+
+	SwsContext* scaler;
+	QSemaphore* frame_budget;
+
+	QMutex lock;
+	QWaitCondition cond;
+	QList<AVFrame*> queue;
+	long pushed;
+	bool aborted;
+	bool finished;
+};
+
+#endif // EXPORTSEGMENT_H
@@ -0,0 +1,147 @@
+#include "exportstill.h"
+
+#include <QCoreApplication>
+#include <QFile>
+
+#include "debug.h"
+
+extern "C" {
+	#include <libavcodec/avcodec.h>
+	#include <libswscale/swscale.h>
+}
+
+ExportStillQueue::ExportStillQueue(QSemaphore* budget) :
+	frame_budget(budget),
+	closed(false)
+{}
+
+ExportStillQueue::~ExportStillQueue() {
+	for (int i=0;i<frames.size();i++) {
+		AVFrame* frame = frames.at(i);
+		av_frame_free(&frame);
+		frame_budget->release();
+	}
+}
+
+void ExportStillQueue::push(AVFrame* frame, const QString& filename) {
+	QMutexLocker locker(&lock);
+	if (!error.isEmpty()) {
+		// the workers have stopped already
+		av_frame_free(&frame);
+		frame_budget->release();
+		return;
+	}
+	frames.append(frame);
+	filenames.append(filename);
+	cond.wakeOne();
+}
+
+bool ExportStillQueue::take(AVFrame** frame, QString* filename) {
+	QMutexLocker locker(&lock);
+	while (frames.isEmpty() && !closed && error.isEmpty()) {
+		cond.wait(&lock);
+	}
+	if (frames.isEmpty() || !error.isEmpty()) return false;
+	*frame = frames.takeFirst();
+	*filename = filenames.takeFirst();
+	return true;
+}
+
+void ExportStillQueue::close() {
+	QMutexLocker locker(&lock);
+	closed = true;
+	cond.wakeAll();
+}
+
+void ExportStillQueue::abort(const QString& e) {
+	QMutexLocker locker(&lock);
+	if (error.isEmpty()) error = e;
+	for (int i=0;i<frames.size();i++) {
+		AVFrame* frame = frames.at(i);
+		av_frame_free(&frame);
+		frame_budget->release();
+	}
+	frames.clear();
+	filenames.clear();
+	cond.wakeAll();
+}
+
+void ExportStillQueue::done(AVFrame* frame) {
+	av_frame_free(&frame);
+	frame_budget->release();
+}
+
+QString ExportStillQueue::get_error() {
+	QMutexLocker locker(&lock);
+	return error;
+}
+
+ExportStillWorker::ExportStillWorker(ExportStillQueue* q, AVCodecContext* e, SwsContext* s) :
+	queue(q),
+	encoder(e),
+	scaler(s),
+	converted(nullptr)
+{}
+
+ExportStillWorker::~ExportStillWorker() {
+	avcodec_free_context(&encoder);
+	if (scaler != nullptr) sws_freeContext(scaler);
+	av_frame_free(&converted);
+}
+
+bool ExportStillWorker::write(AVFrame* frame, const QString& filename) {
+	AVFrame* encoded = frame;
+	if (scaler != nullptr) {
+		// change pixel format
+		av_frame_make_writable(converted);
+		sws_scale(scaler, frame->data, frame->linesize, 0, frame->height, converted->data, converted->linesize);
+		converted->pts = frame->pts;
+		encoded = converted;
+	}
+
+	int ret = avcodec_send_frame(encoder, encoded);
+	if (ret < 0) {
+		qCritical() << "Failed to send frame to still encoder." << ret;
+		queue->abort(QCoreApplication::translate("ExportThread", "failed to send frame to encoder (%1)").arg(QString::number(ret)));
+		return false;
+	}
+
+	// image encoders give a packet for every frame straight away
+	AVPacket* packet = av_packet_alloc();
+	ret = avcodec_receive_packet(encoder, packet);
+	if (ret < 0) {
+		qCritical() << "Failed to receive packet from still encoder." << ret;
+		queue->abort(QCoreApplication::translate("ExportThread", "failed to receive packet from encoder (%1)").arg(QString::number(ret)));
+		av_packet_free(&packet);
+		return false;
+	}
+
+	QFile file(filename);
+	bool ok = (file.open(QFile::WriteOnly) && file.write(reinterpret_cast<const char*>(packet->data), packet->size) == packet->size);
+	av_packet_free(&packet);
+	if (!ok) {
+		qCritical() << "Could not write still" << filename << file.errorString();
+		queue->abort(QCoreApplication::translate("ExportThread", "could not write %1 (%2)").arg(filename, file.errorString()));
+		return false;
+	}
+
+	return true;
+}
+
+void ExportStillWorker::run() {
+	if (scaler != nullptr) {
+		converted = av_frame_alloc();
+		converted->format = encoder->pix_fmt;
+		converted->width = encoder->width;
+		converted->height = encoder->height;
+		av_frame_get_buffer(converted, 0);
+	}
+
+	AVFrame* frame;
+	QString filename;
+	while (queue->take(&frame, &filename)) {
+		// a failed write stops the queue, so the loop ends on the next take
+		write(frame, filename);
+		queue->done(frame);
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef EXPORTSTILL_H
+#define EXPORTSTILL_H
+
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
+#include <QList>
+#include <QString>
+
+struct AVCodecContext;
+struct AVFrame;
+struct SwsContext;
+
+/*
+ * Rendered frames of an image sequence waiting to be written. Each still is a file of its own and doesn't depend on
+ * any other frame, so several workers take frames from here and compress and write them at the same time.
+ */
+class ExportStillQueue {
+public:
+	ExportStillQueue(QSemaphore* budget);
+	~ExportStillQueue();
+
+	// hands a rendered frame over, it's freed and its slot in the budget released once it's written
+	void push(AVFrame* frame, const QString& filename);
+
+	// waits for the next frame, returns false once there are none left or something went wrong
+	bool take(AVFrame** frame, QString* filename);
+
+	// frees a frame take() returned along with its slot in the budget
+	void done(AVFrame* frame);
+
+	// no more frames will be pushed
+	void close();
+
+	// drops frames that haven't been taken and stops the workers
+	void abort(const QString& e);
+
+	QString get_error();
+private:
+	QSemaphore* frame_budget;
+
+	QMutex lock;
+	QWaitCondition cond;
+	QList<AVFrame*> frames;
+	QList<QString> filenames;
+	QString error;
+	bool closed;
+};
+
+// one of an image sequence's encoders, writes stills from the queue until it's closed
+class ExportStillWorker : public QRunnable {
+public:
+	// takes ownership of the encoder and the scaler, which is nullptr if frames arrive in the encoder's format
+	ExportStillWorker(ExportStillQueue* q, AVCodecContext* e, SwsContext* s);
+	~ExportStillWorker();
+	void run();
+private:
+	bool write(AVFrame* frame, const QString& filename);
+
+	ExportStillQueue* queue;
+	AVCodecContext* encoder;
+	SwsContext* scaler;
+	AVFrame* converted;
+};
+
+#endif // EXPORTSTILL_H
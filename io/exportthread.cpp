@@ -8,25 +8,43 @@
 #include "ui/viewerwidget.h"
 #include "playback/playback.h"
 #include "playback/audio.h"
+#include "playback/renderthread.h"
+#include "io/exportsegment.h"
+#include "io/exportstill.h"
+#include "io/audiomixdown.h"
+#include "io/yuvconverter.h"
+#include "io/config.h"
 #include "dialogs/exportdialog.h"
 #include "debug.h"
 
 extern "C" {
 	#include <libavformat/avformat.h>
 	#include <libavutil/opt.h>
+	#include <libavutil/pixdesc.h>
 	#include <libswresample/swresample.h>
 	#include <libswscale/swscale.h>
 }
 
 #include <QApplication>
-#include <QOffscreenSurface>
-#include <QOpenGLFramebufferObject>
-#include <QOpenGLPaintDevice>
 #include <QPainter>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QFileInfo>
+#include <QDir>
+#include <QFile>
+
+#include <algorithm>
+
+#ifndef Q_OS_WIN
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#endif
 
 ExportThread::ExportThread() : continueEncode(true) {
-	surface.create();
-
 	fmt_ctx = nullptr;
 	video_stream = nullptr;
 	vcodec = nullptr;
@@ -34,6 +52,7 @@ ExportThread::ExportThread() : continueEncode(true) {
 	video_frame = nullptr;
 	sws_frame = nullptr;
 	sws_ctx = nullptr;
+	gpu_convert = false;
 	audio_stream = nullptr;
 	acodec = nullptr;
 	audio_frame = nullptr;
@@ -41,6 +60,16 @@ ExportThread::ExportThread() : continueEncode(true) {
 	acodec_ctx = nullptr;
 	swr_ctx = nullptr;
 
+	renderer = nullptr;
+
+	segment_length = 0;
+	still_sequence = false;
+	smart_render = false;
+	frameserver = false;
+	fifo_fd = -1;
+	mixdown = nullptr;
+	audio_stems = false;
+
 	vpkt_alloc = false;
 	apkt_alloc = false;
 }
@@ -49,7 +78,7 @@ bool ExportThread::encode(AVFormatContext* ofmt_ctx, AVCodecContext* codec_ctx,
 	ret = avcodec_send_frame(codec_ctx, frame);
 	if (ret < 0) {
 		qCritical() << "Failed to send frame to encoder." << ret;
-		ed->export_error = tr("failed to send frame to encoder (%1)").arg(QString::number(ret));
+		export_error = tr("failed to send frame to encoder (%1)").arg(QString::number(ret));
 		return false;
 	}
 
@@ -60,19 +89,205 @@ bool ExportThread::encode(AVFormatContext* ofmt_ctx, AVCodecContext* codec_ctx,
 		} else if (ret < 0) {
 			if (ret != AVERROR_EOF) {
 				qCritical() << "Failed to receive packet from encoder." << ret;
-				ed->export_error = tr("failed to receive packet from encoder (%1)").arg(QString::number(ret));
+				export_error = tr("failed to receive packet from encoder (%1)").arg(QString::number(ret));
 			}
 			return false;
 		}
 
 		packet->stream_index = stream->index;
 		if (rescale) av_packet_rescale_ts(packet, codec_ctx->time_base, stream->time_base);
-		av_interleaved_write_frame(ofmt_ctx, packet);
+		bool written = write_packet(ofmt_ctx, packet);
 		av_packet_unref(packet);
+		if (!written) return false;
 	}
 	return true;
 }
 
+bool ExportThread::write_packet(AVFormatContext* ofmt_ctx, AVPacket* packet) {
+	ret = av_interleaved_write_frame(ofmt_ctx, packet);
+	if (ret < 0) {
+		qCritical() << "Failed to write packet." << ret;
+		if (frameserver && ret == AVERROR(EPIPE)) {
+			export_error = tr("the program reading the frameserver disconnected");
+		} else {
+			export_error = tr("failed to write packet (%1)").arg(QString::number(ret));
+		}
+		return false;
+	}
+	return true;
+}
+
+AVCodecContext* ExportThread::create_video_encoder() {
+	// allocate context
+//	encoder_ctx = video_stream->codec;
+	AVCodecContext* encoder_ctx = avcodec_alloc_context3(vcodec);
+	if (!encoder_ctx) {
+		qCritical() << "Could not allocate video encoding context";
+		export_error = tr("could not allocate video encoding context");
+		return nullptr;
+	}
+
+	// setup context
+	encoder_ctx->codec_id = static_cast<AVCodecID>(video_codec);
+	encoder_ctx->codec_type = AVMEDIA_TYPE_VIDEO;
+	encoder_ctx->width = video_width;
+	encoder_ctx->height = video_height;
+	encoder_ctx->sample_aspect_ratio = {1, 1};
+	// encoders like rawvideo take anything and don't list formats
+	encoder_ctx->pix_fmt = (vcodec->pix_fmts == nullptr) ? AV_PIX_FMT_YUV420P : vcodec->pix_fmts[0]; // maybe be breakable code
+	if (!(av_pix_fmt_desc_get(encoder_ctx->pix_fmt)->flags & AV_PIX_FMT_FLAG_RGB)) {
+		// tag the matrix and range both conversion paths use
+		encoder_ctx->colorspace = static_cast<AVColorSpace>(get_export_colorspace(video_height));
+		encoder_ctx->color_range = (encoder_ctx->pix_fmt == AV_PIX_FMT_YUVJ420P
+									|| encoder_ctx->pix_fmt == AV_PIX_FMT_YUVJ422P
+									|| encoder_ctx->pix_fmt == AV_PIX_FMT_YUVJ444P) ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+	}
+	encoder_ctx->framerate = av_d2q(video_frame_rate, INT_MAX);
+	if (video_compression_type == COMPRESSION_TYPE_CBR) encoder_ctx->bit_rate = video_bitrate * 1000000;
+	encoder_ctx->time_base = av_inv_q(encoder_ctx->framerate);
+	video_stream->time_base = encoder_ctx->time_base;
+
+	if (fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+		encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+
+	if (encoder_ctx->codec_id == AV_CODEC_ID_H264) {
+		/*char buffer[50];
+		itoa(encoder_ctx, buffer, 10);*/
+
+		//av_opt_set(encoder_ctx->priv_data, "preset", "fast", AV_OPT_SEARCH_CHILDREN);
+		//av_opt_set(encoder_ctx->priv_data, "x264opts", "opencl", AV_OPT_SEARCH_CHILDREN);
+
+		switch (video_compression_type) {
+		case COMPRESSION_TYPE_CFR:
+			av_opt_set(encoder_ctx->priv_data, "crf", QString::number(static_cast<int>(video_bitrate)).toUtf8(), AV_OPT_SEARCH_CHILDREN);
+			break;
+		}
+	}
+
+	AVDictionary* opts = nullptr;
+	if (segment_length > 0) {
+		// copied source packets carry their own reorder delay, frames encoded around them can't reorder across them
+		if (smart_render) encoder_ctx->max_b_frames = 0;
+
+		// the workers share the cores instead of each encoder assuming it has all of them
+		av_dict_set(&opts, "threads", QString::number(qMax(1, QThread::idealThreadCount() / config.export_encode_workers)).toUtf8(), 0);
+	} else if (still_sequence) {
+		// every still worker has an encoder of its own
+		av_dict_set(&opts, "threads", "1", 0);
+	} else {
+		av_dict_set(&opts, "threads", "auto", 0);
+	}
+
+	ret = avcodec_open2(encoder_ctx, vcodec, &opts);
+	av_dict_free(&opts);
+	if (ret < 0) {
+		qCritical() << "Could not open output video encoder." << ret;
+		export_error = tr("could not open output video encoder (%1)").arg(QString::number(ret));
+		avcodec_free_context(&encoder_ctx);
+		return nullptr;
+	}
+
+	return encoder_ctx;
+}
+
+SwsContext* ExportThread::create_scaler() {
+	SwsContext* scaler;
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+	scaler = sws_alloc_context();
+	if (scaler == nullptr) return nullptr;
+	av_opt_set_int(scaler, "srcw", sequence->width, 0);
+	av_opt_set_int(scaler, "srch", sequence->height, 0);
+	av_opt_set_int(scaler, "src_format", AV_PIX_FMT_RGBA, 0);
+	av_opt_set_int(scaler, "dstw", video_width, 0);
+	av_opt_set_int(scaler, "dsth", video_height, 0);
+	av_opt_set_int(scaler, "dst_format", vcodec_ctx->pix_fmt, 0);
+	av_opt_set_int(scaler, "sws_flags", SWS_FAST_BILINEAR, 0);
+
+	// segments already run in parallel, a single pass splits each frame into slices instead
+	av_opt_set_int(scaler, "threads", (segment_length > 0 || still_sequence) ? 1 : 0, 0);
+
+	if (sws_init_context(scaler, nullptr, nullptr) < 0) {
+		sws_freeContext(scaler);
+		return nullptr;
+	}
+#else
+	scaler = sws_getContext(
+				sequence->width,
+				sequence->height,
+				AV_PIX_FMT_RGBA,
+				video_width,
+				video_height,
+				vcodec_ctx->pix_fmt,
+				SWS_FAST_BILINEAR,
+				nullptr,
+				nullptr,
+				nullptr
+			);
+	if (scaler == nullptr) return nullptr;
+#endif
+
+	// match the matrix and range the encoder is tagged with
+	int* inv_table;
+	int* table;
+	int src_range, dst_range, brightness, contrast, saturation;
+	if (sws_getColorspaceDetails(scaler, &inv_table, &src_range, &table, &dst_range, &brightness, &contrast, &saturation) >= 0) {
+		sws_setColorspaceDetails(scaler,
+								 sws_getCoefficients(get_export_colorspace(video_height)),
+								 1,
+								 sws_getCoefficients(get_export_colorspace(video_height)),
+								 (vcodec_ctx->color_range == AVCOL_RANGE_JPEG) ? 1 : 0,
+								 brightness,
+								 contrast,
+								 saturation);
+	}
+
+	return scaler;
+}
+
+AVFrame* ExportThread::render_frame() {
+	if (!feed.isNull()) {
+		AVFrame* fed = feed->take();
+		if (fed == nullptr) export_error = tr("the export compositing its frames stopped");
+		return fed;
+	}
+
+	AVFrame* rendered = av_frame_alloc();
+	if (gpu_convert) {
+		rendered->format = vcodec_ctx->pix_fmt;
+		rendered->width = video_width;
+		rendered->height = video_height;
+	} else {
+		rendered->format = AV_PIX_FMT_RGBA;
+		rendered->width = sequence->width;
+		rendered->height = sequence->height;
+	}
+	av_frame_get_buffer(rendered, 0);
+
+	// get image from opengl
+	bool got_frame = gpu_convert
+			? renderer->render_planes(sequence, rendered)
+			: renderer->render_image(sequence, false, rendered->data[0], rendered->linesize[0]/4);
+	if (got_frame) {
+		feed_followers(rendered);
+	} else {
+		av_frame_free(&rendered);
+	}
+
+	return rendered;
+}
+
+void ExportThread::feed_followers(AVFrame* frame) {
+	for (int i=0;i<feeds.size();i++) {
+		feeds.at(i)->push(frame);
+	}
+}
+
+int ExportThread::get_still_workers() {
+	// stills lose nothing by being split up, so if the preference was left at one they use every core
+	return (config.export_encode_workers > 1) ? config.export_encode_workers : QThread::idealThreadCount();
+}
+
 bool ExportThread::setupVideo() {
 	// if video is disabled, no setup necessary
 	if (!video_enabled) return true;
@@ -81,7 +296,7 @@ bool ExportThread::setupVideo() {
 	vcodec = avcodec_find_encoder((enum AVCodecID) video_codec);
 	if (!vcodec) {
 		qCritical() << "Could not find video encoder";
-		ed->export_error = tr("could not video encoder for %1").arg(QString::number(video_codec));
+		export_error = tr("could not video encoder for %1").arg(QString::number(video_codec));
 		return false;
 	}
 
@@ -90,64 +305,72 @@ bool ExportThread::setupVideo() {
 	video_stream->id = 0;
 	if (!video_stream) {
 		qCritical() << "Could not allocate video stream";
-		ed->export_error = tr("could not allocate video stream");
+		export_error = tr("could not allocate video stream");
 		return false;
 	}
 
-	// allocate context
-//	vcodec_ctx = video_stream->codec;
-	vcodec_ctx = avcodec_alloc_context3(vcodec);
-	if (!vcodec_ctx) {
-		qCritical() << "Could not allocate video encoding context";
-		ed->export_error = tr("could not allocate video encoding context");
-		return false;
-	}
+	// stills don't depend on each other, so they're spread over workers frame by frame instead of in segments
+	still_sequence = (strcmp(fmt_ctx->oformat->name, "image2") == 0);
+	if (still_sequence) smart_render = false;
 
-	// setup context
-	vcodec_ctx->codec_id = static_cast<AVCodecID>(video_codec);
-	vcodec_ctx->codec_type = AVMEDIA_TYPE_VIDEO;
-	vcodec_ctx->width = video_width;
-	vcodec_ctx->height = video_height;
-	vcodec_ctx->sample_aspect_ratio = {1, 1};
-	vcodec_ctx->pix_fmt = vcodec->pix_fmts[0]; // maybe be breakable code
-	vcodec_ctx->framerate = av_d2q(video_frame_rate, INT_MAX);
-	if (video_compression_type == COMPRESSION_TYPE_CBR) vcodec_ctx->bit_rate = video_bitrate * 1000000;
-	vcodec_ctx->time_base = av_inv_q(vcodec_ctx->framerate);
-	video_stream->time_base = vcodec_ctx->time_base;
+	// exports sharing composited frames need every frame composited
+	if (!feeds.isEmpty() || !feed.isNull()) smart_render = false;
 
-	if (fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
-		vcodec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	// long exports are split into segments encoded in parallel, as long as there's more than one of them
+	segment_length = 0;
+	long length = qMax(1LL, qRound64(EXPORT_SEGMENT_SECONDS * video_frame_rate));
+	// a frameserver renders each frame as it's read, so frames aren't queued up for segments
+	if (config.export_encode_workers > 1 && end_frame - start_frame + 1 > length && !frameserver && !still_sequence) {
+		segment_length = length;
 	}
 
-	if (vcodec_ctx->codec_id == AV_CODEC_ID_H264) {
-		/*char buffer[50];
-		itoa(vcodec_ctx, buffer, 10);*/
+	// smart render encodes the frames around copied ones in segments, so B-frames never reach across a copy
+	long encoded_length = segment_length;
+	if (smart_render) segment_length = length;
 
-		//av_opt_set(vcodec_ctx->priv_data, "preset", "fast", AV_OPT_SEARCH_CHILDREN);
-		//av_opt_set(vcodec_ctx->priv_data, "x264opts", "opencl", AV_OPT_SEARCH_CHILDREN);
+	vcodec_ctx = create_video_encoder();
+	if (vcodec_ctx == nullptr) return false;
 
-		switch (video_compression_type) {
-		case COMPRESSION_TYPE_CFR:
-			av_opt_set(vcodec_ctx->priv_data, "crf", QString::number(static_cast<int>(video_bitrate)).toUtf8(), AV_OPT_SEARCH_CHILDREN);
-			break;
+	smart_render_runs.clear();
+	if (smart_render) {
+		smart_render_runs = plan_smart_render(sequence, start_frame, end_frame + 1, vcodec_ctx);
+
+		bool copies = false;
+		for (int i=0;i<smart_render_runs.size();i++) {
+			if (smart_render_runs.at(i).clip != nullptr) copies = true;
 		}
-	}
 
-	AVDictionary* opts = nullptr;
-	av_dict_set(&opts, "threads", "auto", 0);
+		// nothing can be copied, export it like any other, B-frames included
+		if (!copies) {
+			smart_render = false;
+			smart_render_runs.clear();
+			segment_length = encoded_length;
+			avcodec_free_context(&vcodec_ctx);
+			vcodec_ctx = create_video_encoder();
+			if (vcodec_ctx == nullptr) return false;
+		}
+	}
 
-	ret = avcodec_open2(vcodec_ctx, vcodec, &opts);
-	if (ret < 0) {
-		qCritical() << "Could not open output video encoder." << ret;
-		ed->export_error = tr("could not open output video encoder (%1)").arg(QString::number(ret));
-		return false;
+	// segments end on a GOP boundary
+	if (segment_length > 0 && vcodec_ctx->gop_size > 1) {
+		segment_length = ((segment_length + vcodec_ctx->gop_size - 1) / vcodec_ctx->gop_size) * vcodec_ctx->gop_size;
 	}
 
-	// copy video encoder parameters to output stream
-	ret = avcodec_parameters_from_context(video_stream->codecpar, vcodec_ctx);
+	if (smart_render_runs.size() == 1) {
+		// the whole export is copied, so it keeps the source's stream headers
+		if (!get_smart_render_parameters(smart_render_runs.first(), video_stream->codecpar)) {
+			qCritical() << "Could not copy source parameters to output stream";
+			export_error = tr("could not copy source parameters to output stream");
+			return false;
+		}
+		ret = 0;
+	} else {
+		// copy video encoder parameters to output stream
+		ret = avcodec_parameters_from_context(video_stream->codecpar, vcodec_ctx);
+	}
 	if (ret < 0) {
 		qCritical() << "Could not copy video encoder parameters to output stream." << ret;
-		ed->export_error = tr("could not copy video encoder parameters to output stream (%1)").arg(QString::number(ret));
+		export_error = tr("could not copy video encoder parameters to output stream (%1)").arg(QString::number(ret));
 		return false;
 	}
 
@@ -161,18 +384,17 @@ bool ExportThread::setupVideo() {
 
 	av_init_packet(&video_pkt);
 
-	sws_ctx = sws_getContext(
-				sequence->width,
-				sequence->height,
-				AV_PIX_FMT_RGBA,
-				video_width,
-				video_height,
-				vcodec_ctx->pix_fmt,
-				SWS_FAST_BILINEAR,
-				nullptr,
-				nullptr,
-				nullptr
-			);
+	// the render thread can write planar YUV directly, everything else goes through swscale. Shared frames stay RGBA
+	// so every export can scale them to its own format
+	gpu_convert = can_convert_on_gpu(vcodec_ctx->pix_fmt) && feeds.isEmpty() && feed.isNull();
+	if (!gpu_convert) {
+		sws_ctx = create_scaler();
+		if (sws_ctx == nullptr) {
+			qCritical() << "Could not create video scaler";
+			export_error = tr("could not create video scaler");
+			return false;
+		}
+	}
 
 	sws_frame = av_frame_alloc();
 	sws_frame->format = vcodec_ctx->pix_fmt;
@@ -183,141 +405,414 @@ bool ExportThread::setupVideo() {
 	return true;
 }
 
-bool ExportThread::setupAudio() {
-	// if audio is disabled, no setup necessary
-	if (!audio_enabled) return true;
-
-	// find encoder
-	acodec = avcodec_find_encoder(static_cast<AVCodecID>(audio_codec));
-	if (!acodec) {
-		qCritical() << "Could not find audio encoder";
-		ed->export_error = tr("could not audio encoder for %1").arg(QString::number(audio_codec));
-		return false;
-	}
-
+bool ExportThread::create_audio_encoder(AVFormatContext* ctx, AVStream** stream, AVCodecContext** encoder, SwrContext** resampler, AVFrame** converted) {
 	// allocate audio stream
-	audio_stream = avformat_new_stream(fmt_ctx, acodec);
-	audio_stream->id = 1;
-	if (!audio_stream) {
+	*stream = avformat_new_stream(ctx, acodec);
+	if (!*stream) {
 		qCritical() << "Could not allocate audio stream";
-		ed->export_error = tr("could not allocate audio stream");
+		export_error = tr("could not allocate audio stream");
 		return false;
 	}
+	(*stream)->id = ctx->nb_streams - 1;
 
 	// allocate context
-//	acodec_ctx = audio_stream->codec;
-	acodec_ctx = avcodec_alloc_context3(acodec);
-	if (!acodec_ctx) {
+	AVCodecContext* encoder_ctx = avcodec_alloc_context3(acodec);
+	if (!encoder_ctx) {
 		qCritical() << "Could not find allocate audio encoding context";
-		ed->export_error = tr("could not allocate audio encoding context");
+		export_error = tr("could not allocate audio encoding context");
 		return false;
 	}
+	*encoder = encoder_ctx;
 
 	// setup context
-	acodec_ctx->codec_id = static_cast<AVCodecID>(audio_codec);
-	acodec_ctx->codec_type = AVMEDIA_TYPE_AUDIO;
-	acodec_ctx->sample_rate = audio_sampling_rate;
-	acodec_ctx->channel_layout = AV_CH_LAYOUT_STEREO;  // change this to support surround/mono sound in the future (this is what the user sets the output audio to)
-	acodec_ctx->channels = av_get_channel_layout_nb_channels(acodec_ctx->channel_layout);
-	acodec_ctx->sample_fmt = acodec->sample_fmts[0];
-	acodec_ctx->bit_rate = audio_bitrate * 1000;
-
-	acodec_ctx->time_base.num = 1;
-	acodec_ctx->time_base.den = audio_sampling_rate;
-	audio_stream->time_base = acodec_ctx->time_base;
-
-	if (fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
-		acodec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	encoder_ctx->codec_id = static_cast<AVCodecID>(audio_codec);
+	encoder_ctx->codec_type = AVMEDIA_TYPE_AUDIO;
+	encoder_ctx->sample_rate = audio_sampling_rate;
+	encoder_ctx->channel_layout = AV_CH_LAYOUT_STEREO;  // change this to support surround/mono sound in the future (this is what the user sets the output audio to)
+	encoder_ctx->channels = av_get_channel_layout_nb_channels(encoder_ctx->channel_layout);
+	encoder_ctx->sample_fmt = acodec->sample_fmts[0];
+	encoder_ctx->bit_rate = audio_bitrate * 1000;
+
+	encoder_ctx->time_base.num = 1;
+	encoder_ctx->time_base.den = audio_sampling_rate;
+	(*stream)->time_base = encoder_ctx->time_base;
+
+	if (ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+		encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 	}
 
 	// open encoder
-	ret = avcodec_open2(acodec_ctx, acodec, nullptr);
+	ret = avcodec_open2(encoder_ctx, acodec, nullptr);
 	if (ret < 0) {
 		qCritical() << "Could not open output audio encoder." << ret;
-		ed->export_error = tr("could not open output audio encoder (%1)").arg(QString::number(ret));
+		export_error = tr("could not open output audio encoder (%1)").arg(QString::number(ret));
 		return false;
 	}
 
 	// copy params to output stream
-	ret = avcodec_parameters_from_context(audio_stream->codecpar, acodec_ctx);
+	ret = avcodec_parameters_from_context((*stream)->codecpar, encoder_ctx);
 	if (ret < 0) {
 		qCritical() << "Could not copy audio encoder parameters to output stream." << ret;
-		ed->export_error = tr("could not copy audio encoder parameters to output stream (%1)").arg(QString::number(ret));
+		export_error = tr("could not copy audio encoder parameters to output stream (%1)").arg(QString::number(ret));
 		return false;
 	}
 
 	// init audio resampler context
-	swr_ctx = swr_alloc_set_opts(
+	*resampler = swr_alloc_set_opts(
 			nullptr,
-			acodec_ctx->channel_layout,
-			acodec_ctx->sample_fmt,
-			acodec_ctx->sample_rate,
+			encoder_ctx->channel_layout,
+			encoder_ctx->sample_fmt,
+			encoder_ctx->sample_rate,
 			sequence->audio_layout,
 			AV_SAMPLE_FMT_S16,
 			sequence->audio_frequency,
 			0,
 			nullptr
 		);
-	swr_init(swr_ctx);
+	swr_init(*resampler);
+
+	// init converted audio frame
+	*converted = av_frame_alloc();
+	(*converted)->channel_layout = encoder_ctx->channel_layout;
+	(*converted)->channels = encoder_ctx->channels;
+	(*converted)->sample_rate = encoder_ctx->sample_rate;
+	(*converted)->format = encoder_ctx->sample_fmt;
+	av_frame_make_writable(*converted);
+
+	return true;
+}
 
+AVFrame* ExportThread::create_audio_frame() {
 	// initialize raw audio frame
-	audio_frame = av_frame_alloc();
-	audio_frame->sample_rate = sequence->audio_frequency;
-	audio_frame->nb_samples = acodec_ctx->frame_size;
-	if (audio_frame->nb_samples == 0) audio_frame->nb_samples = 256; // should possibly be smaller?
-	audio_frame->format = AV_SAMPLE_FMT_S16;
-	audio_frame->channel_layout = AV_CH_LAYOUT_STEREO; // change this to support surround/mono sound in the future (this is whatever format they're held in the internal buffer)
-	audio_frame->channels = av_get_channel_layout_nb_channels(audio_frame->channel_layout);
-	av_frame_make_writable(audio_frame);
-	ret = av_frame_get_buffer(audio_frame, 0);
+	AVFrame* frame = av_frame_alloc();
+	frame->sample_rate = sequence->audio_frequency;
+	frame->nb_samples = acodec_ctx->frame_size;
+	if (frame->nb_samples == 0) frame->nb_samples = MIXDOWN_BLOCK_SAMPLES;
+	frame->format = AV_SAMPLE_FMT_S16;
+	frame->channel_layout = AV_CH_LAYOUT_STEREO; // change this to support surround/mono sound in the future (this is whatever format they're held in the internal buffer)
+	frame->channels = av_get_channel_layout_nb_channels(frame->channel_layout);
+	av_frame_make_writable(frame);
+	ret = av_frame_get_buffer(frame, 0);
 	if (ret < 0) {
 		qCritical() << "Could not allocate audio buffer." << ret;
-		ed->export_error = tr("could not allocate audio buffer (%1)").arg(QString::number(ret));
+		export_error = tr("could not allocate audio buffer (%1)").arg(QString::number(ret));
+		av_frame_free(&frame);
+		return nullptr;
+	}
+	return frame;
+}
+
+bool ExportThread::setupAudio() {
+	// if audio is disabled, no setup necessary
+	if (!audio_enabled) return true;
+
+	// find encoder
+	acodec = avcodec_find_encoder(static_cast<AVCodecID>(audio_codec));
+	if (!acodec) {
+		qCritical() << "Could not find audio encoder";
+		export_error = tr("could not audio encoder for %1").arg(QString::number(audio_codec));
 		return false;
 	}
-	aframe_bytes = av_samples_get_buffer_size(nullptr, audio_frame->channels, audio_frame->nb_samples, static_cast<AVSampleFormat>(audio_frame->format), 0);
 
-	// init converted audio frame
-	swr_frame = av_frame_alloc();
-	swr_frame->channel_layout = acodec_ctx->channel_layout;
-	swr_frame->channels = acodec_ctx->channels;
-	swr_frame->sample_rate = acodec_ctx->sample_rate;
-	swr_frame->format = acodec_ctx->sample_fmt;
-	av_frame_make_writable(swr_frame);
+	if (!create_audio_encoder(fmt_ctx, &audio_stream, &acodec_ctx, &swr_ctx, &swr_frame)) return false;
+
+	audio_frame = create_audio_frame();
+	if (audio_frame == nullptr) return false;
 
 	av_init_packet(&audio_pkt);
 
+	mixdown = new AudioMixdown(sequence, start_frame, end_frame + 1, sequence->audio_frequency);
+
+	// every track also gets a file of its own, encoded from the same mixdown
+	if (audio_stems) {
+		QFileInfo info(filename);
+		QVector<int> tracks = mixdown->get_stem_tracks();
+		for (int i=0;i<tracks.size();i++) {
+			ExportStem* stem = new ExportStem();
+			stems.append(stem);
+			stem->filename = info.dir().filePath(QString("%1 - A%2.%3").arg(info.completeBaseName(), QString::number(tracks.at(i) + 1), info.suffix()));
+			stem->stream = nullptr;
+			stem->encoder = nullptr;
+			stem->resampler = nullptr;
+			stem->converted = nullptr;
+			stem->frame = nullptr;
+			stem->file_samples = 0;
+			av_init_packet(&stem->pkt);
+
+			QByteArray stem_filename = stem->filename.toUtf8();
+			stem->fmt_ctx = nullptr;
+			avformat_alloc_output_context2(&stem->fmt_ctx, nullptr, nullptr, stem_filename.constData());
+			if (!stem->fmt_ctx) {
+				qCritical() << "Could not create stem output context" << stem->filename;
+				export_error = tr("could not create output format context for %1").arg(stem->filename);
+				return false;
+			}
+
+			ret = avio_open(&stem->fmt_ctx->pb, stem_filename.constData(), AVIO_FLAG_WRITE);
+			if (ret < 0) {
+				qCritical() << "Could not open stem output file." << stem->filename << ret;
+				export_error = tr("could not open output file %1 (%2)").arg(stem->filename, QString::number(ret));
+				return false;
+			}
+
+			if (!create_audio_encoder(stem->fmt_ctx, &stem->stream, &stem->encoder, &stem->resampler, &stem->converted)) return false;
+
+			stem->frame = create_audio_frame();
+			if (stem->frame == nullptr) return false;
+
+			ret = avformat_write_header(stem->fmt_ctx, nullptr);
+			if (ret < 0) {
+				qCritical() << "Could not write stem file header." << stem->filename << ret;
+				export_error = tr("could not write output file header (%1)").arg(QString::number(ret));
+				return false;
+			}
+		}
+	}
+
 	return true;
 }
 
+static int export_interrupted(void* opaque) {
+	return !static_cast<ExportThread*>(opaque)->continueEncode;
+}
+
+static bool is_fifo(const QString& path) {
+#ifdef Q_OS_WIN
+	Q_UNUSED(path);
+	return false;
+#else
+	struct stat info;
+	return (stat(QFile::encodeName(path).constData(), &info) == 0 && S_ISFIFO(info.st_mode));
+#endif
+}
+
+static bool is_socket(const QString& path) {
+#ifdef Q_OS_WIN
+	Q_UNUSED(path);
+	return false;
+#else
+	struct stat info;
+	return (stat(QFile::encodeName(path).constData(), &info) == 0 && S_ISSOCK(info.st_mode));
+#endif
+}
+
+// opens a FIFO without blocking once a reader has it open, waiting for one can be cancelled. Returns -1 with errno set
+// if it can't be opened
+static int open_fifo(ExportThread* thread, const char* path) {
+#ifdef Q_OS_WIN
+	Q_UNUSED(thread);
+	Q_UNUSED(path);
+	errno = ENOSYS;
+	return -1;
+#else
+	while (thread->continueEncode) {
+		int fd = open(path, O_WRONLY | O_NONBLOCK);
+		if (fd >= 0 || errno != ENXIO) return fd;
+
+		// nothing is reading yet
+		QThread::msleep(100);
+	}
+	errno = ECANCELED;
+	return -1;
+#endif
+}
+
 bool ExportThread::setupContainer() {
-	avformat_alloc_output_context2(&fmt_ctx, nullptr, nullptr, c_filename);
+	// a frameserver's path doesn't have an extension to guess the format from
+	avformat_alloc_output_context2(&fmt_ctx, nullptr, frameserver ? "nut" : nullptr, c_filename);
 	if (!fmt_ctx) {
 		qCritical() << "Could not create output context";
-		ed->export_error = tr("could not create output format context");
+		export_error = tr("could not create output format context");
 		return false;
 	}
 
 	//av_dump_format(fmt_ctx, 0, c_filename, 1);
 
-	ret = avio_open(&fmt_ctx->pb, c_filename, AVIO_FLAG_WRITE);
+	if (frameserver) {
+		// writes wait while the consumer isn't reading, so frames are rendered as fast as they're read. Waiting for
+		// the consumer to connect or read can still be cancelled
+		fmt_ctx->interrupt_callback.callback = export_interrupted;
+		fmt_ctx->interrupt_callback.opaque = this;
+
+		if (is_fifo(filename)) {
+			// the pipe protocol retries writes the full FIFO turns away, checking the interrupt callback in between
+			fifo_fd = open_fifo(this, c_filename);
+			if (fifo_fd < 0) {
+				ret = AVERROR(errno);
+			} else {
+				QByteArray url = QString("pipe:%1").arg(fifo_fd).toUtf8();
+				ret = avio_open2(&fmt_ctx->pb, url.constData(), AVIO_FLAG_WRITE, &fmt_ctx->interrupt_callback, nullptr);
+			}
+		} else {
+			// a socket left at the path by an earlier export is in the way of listening, anything else is left alone
+			if (is_socket(filename)) QFile::remove(filename);
+
+			QByteArray url = QString("unix:%1").arg(filename).toUtf8();
+			AVDictionary* opts = nullptr;
+			av_dict_set(&opts, "listen", "1", 0);
+			ret = avio_open2(&fmt_ctx->pb, url.constData(), AVIO_FLAG_WRITE, &fmt_ctx->interrupt_callback, &opts);
+			av_dict_free(&opts);
+		}
+	} else {
+		ret = avio_open(&fmt_ctx->pb, c_filename, AVIO_FLAG_WRITE);
+	}
 	if (ret < 0) {
 		qCritical() << "Could not open output file." << ret;
-		ed->export_error = tr("could not open output file (%1)").arg(QString::number(ret));
+		export_error = tr("could not open output file (%1)").arg(QString::number(ret));
 		return false;
 	}
 
 	return true;
 }
 
-void ExportThread::run() {
-	panel_sequence_viewer->pause();
+bool ExportThread::write_segment(ExportSegment* segment) {
+	segment->wait_finished();
+	if (!segment->error.isEmpty()) {
+		export_error = segment->error;
+		return false;
+	}
+
+	// the segment can only be copied after the previous one if it decodes like part of a single pass would: same
+	// stream headers and reorder delay, a key frame first, decode order carrying on from the previous segment, and
+	// every frame it was given presented exactly once with its own timestamp
+	bool matches = (segment->packets.size() == segment->frame_pts.size()
+					&& !segment->packets.isEmpty()
+					&& (segment->packets.first()->flags & AV_PKT_FLAG_KEY)
+					&& segment->encoder->has_b_frames == vcodec_ctx->has_b_frames
+					&& segment->encoder->extradata_size == vcodec_ctx->extradata_size
+					&& (vcodec_ctx->extradata_size == 0 || memcmp(segment->encoder->extradata, vcodec_ctx->extradata, vcodec_ctx->extradata_size) == 0));
+	QVector<int64_t> presented;
+	for (int i=0;i<segment->packets.size() && matches;i++) {
+		AVPacket* packet = segment->packets.at(i);
+		if (packet->dts <= last_segment_dts || packet->pts < packet->dts) {
+			matches = false;
+		}
+		last_segment_dts = packet->dts;
+		presented.append(packet->pts);
+	}
+	std::sort(presented.begin(), presented.end());
+	if (matches && presented != segment->frame_pts) matches = false;
+	if (!matches) {
+		qCritical() << "Export segment can't be joined to the previous one";
+		export_error = tr("segments encoded in parallel couldn't be joined, try again with one encoder worker");
+		return false;
+	}
 
-	if (!panel_sequence_viewer->viewer_widget->context()->makeCurrent(&surface)) {
-		qCritical() << "Make current failed";
-		ed->export_error = tr("could not make OpenGL context current");
-		return;
+	for (int i=0;i<segment->packets.size();i++) {
+		AVPacket* packet = segment->packets.at(i);
+		packet->stream_index = video_stream->index;
+		av_packet_rescale_ts(packet, segment->encoder->time_base, video_stream->time_base);
+		last_video_dts = packet->dts;
+		if (!write_packet(fmt_ctx, packet)) return false;
 	}
+	return true;
+}
+
+bool ExportThread::mix_audio(double timecode_secs) {
+	QVector<qint16*> stem_buffers;
+	for (int i=0;i<stems.size();i++) {
+		stem_buffers.append(reinterpret_cast<qint16*>(stems.at(i)->frame->data[0]));
+	}
+
+	while (file_audio_samples <= (timecode_secs*audio_sampling_rate)) {
+		int count = mixdown->mix(reinterpret_cast<qint16*>(audio_frame->data[0]), audio_frame->nb_samples, stem_buffers);
+		if (count == 0) break;
+
+		// the last block is padded to a whole encoder frame
+		if (count < audio_frame->nb_samples) {
+			memset(audio_frame->data[0] + count*4, 0, (audio_frame->nb_samples - count)*4);
+			for (int i=0;i<stems.size();i++) {
+				memset(stems.at(i)->frame->data[0] + count*4, 0, (audio_frame->nb_samples - count)*4);
+			}
+		}
+
+		for (int i=0;i<stems.size();i++) {
+			ExportStem* stem = stems.at(i);
+			swr_convert_frame(stem->resampler, stem->converted, stem->frame);
+			stem->converted->pts = stem->file_samples;
+			if (!encode(stem->fmt_ctx, stem->encoder, stem->converted, &stem->pkt, stem->stream, true)) return false;
+			stem->file_samples += stem->converted->nb_samples;
+		}
+
+		// convert to export sample format
+		swr_convert_frame(swr_ctx, swr_frame, audio_frame);
+		swr_frame->pts = file_audio_samples;
+
+		// send to encoder
+		if (!encode(fmt_ctx, acodec_ctx, swr_frame, &audio_pkt, audio_stream, true)) return false;
+
+		file_audio_samples += swr_frame->nb_samples;
+	}
+	return true;
+}
+
+bool ExportThread::finish_stem(ExportStem* stem) {
+	// flush swresample
+	do {
+		swr_convert_frame(stem->resampler, stem->converted, nullptr);
+		if (stem->converted->nb_samples == 0) break;
+		stem->converted->pts = stem->file_samples;
+		if (!encode(stem->fmt_ctx, stem->encoder, stem->converted, &stem->pkt, stem->stream, true)) return false;
+		stem->file_samples += stem->converted->nb_samples;
+	} while (stem->converted->nb_samples > 0);
+
+	// flush remaining packets, encode() returns false once the encoder is drained
+	encode(stem->fmt_ctx, stem->encoder, nullptr, &stem->pkt, stem->stream, true);
+	if (!export_error.isEmpty()) return false;
+
+	ret = av_write_trailer(stem->fmt_ctx);
+	if (ret < 0) {
+		qCritical() << "Could not write stem file trailer." << stem->filename << ret;
+		export_error = tr("could not write output file trailer (%1)").arg(QString::number(ret));
+		return false;
+	}
+	return true;
+}
+
+void ExportThread::free_stem(ExportStem* stem) {
+	if (stem->fmt_ctx != nullptr) {
+		avio_closep(&stem->fmt_ctx->pb);
+		avformat_free_context(stem->fmt_ctx);
+	}
+	av_packet_unref(&stem->pkt);
+	if (stem->frame != nullptr) av_frame_free(&stem->frame);
+	if (stem->converted != nullptr) av_frame_free(&stem->converted);
+	if (stem->encoder != nullptr) avcodec_free_context(&stem->encoder);
+	if (stem->resampler != nullptr) swr_free(&stem->resampler);
+	delete stem;
+}
+
+int ExportThread::find_smart_render_run(long frame) {
+	for (int i=0;i<smart_render_runs.size();i++) {
+		if (frame >= smart_render_runs.at(i).start && frame < smart_render_runs.at(i).end) return i;
+	}
+	return -1;
+}
+
+void ExportThread::run() {
+	if (feed.isNull()) {
+		panel_sequence_viewer->pause();
+
+		// frames are composited by the viewer's render thread, this thread only encodes them
+		renderer = panel_sequence_viewer->viewer_widget->renderer;
+		if (renderer == nullptr) {
+			qCritical() << "Viewer has no render thread";
+			export_error = tr("could not start rendering");
+			for (int i=0;i<feeds.size();i++) {
+				feeds.at(i)->close();
+			}
+			rendering = false;
+			return;
+		}
+	}
+
+#ifndef Q_OS_WIN
+	// a reader closing the frameserver's FIFO or socket fails the write with EPIPE instead of killing the editor
+	sigset_t sigpipe_set, old_mask;
+	sigemptyset(&sigpipe_set);
+	sigaddset(&sigpipe_set, SIGPIPE);
+	if (frameserver) pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_mask);
+#endif
 
 	// copy filename
 	QByteArray ba = filename.toUtf8();
@@ -334,91 +829,229 @@ void ExportThread::run() {
 		ret = avformat_write_header(fmt_ctx, nullptr);
 		if (ret < 0) {
 			qCritical() << "Could not write output file header." << ret;
-			ed->export_error = tr("could not write output file header (%1)").arg(QString::number(ret));
+			export_error = tr("could not write output file header (%1)").arg(QString::number(ret));
 			continueEncode = false;
 		}
 	}
 
-	panel_sequence_viewer->seek(start_frame);
-	panel_sequence_viewer->reset_all_audio();
+	// followers don't move the playhead, they take frames in order from the export that does
+	long playhead = start_frame;
+	if (feed.isNull()) panel_sequence_viewer->seek(start_frame);
 
-	QOpenGLFramebufferObject fbo(sequence->width, sequence->height, QOpenGLFramebufferObject::CombinedDepthStencil, GL_TEXTURE_RECTANGLE);
-	fbo.bind();
-
-	panel_sequence_viewer->viewer_widget->default_fbo = &fbo;
-
-	long file_audio_samples = 0;
+	file_audio_samples = 0;
 	qint64 start_time, frame_time, avg_time, eta, total_time = 0;
 	long remaining_frames, frame_count = 1;
 
-	while (sequence->playhead <= end_frame && continueEncode) {
+	// the pool is declared last so its workers are done before the queues they use go away
+	int workers = still_sequence ? get_still_workers() : config.export_encode_workers;
+	QSemaphore frame_budget(workers * EXPORT_SEGMENT_QUEUE);
+	ExportStillQueue stills(&frame_budget);
+	QThreadPool segment_pool;
+	segment_pool.setMaxThreadCount(workers);
+	QList<ExportSegment*> segments;
+
+	for (int i=0;i<workers && still_sequence;i++) {
+		AVCodecContext* encoder = create_video_encoder();
+		if (encoder == nullptr) {
+			continueEncode = false;
+			break;
+		}
+		segment_pool.start(new ExportStillWorker(&stills, encoder, gpu_convert ? nullptr : create_scaler()));
+	}
+
+	last_segment_dts = INT64_MIN;
+	last_video_dts = INT64_MIN;
+
+	// audio is mixed separately, so only video goes through the render loop
+	while (video_enabled && playhead <= end_frame && continueEncode) {
 		start_time = QDateTime::currentMSecsSinceEpoch();
 
-		panel_sequence_viewer->viewer_widget->paintGL();
+		double timecode_secs = (double) (playhead-start_frame) / sequence->frame_rate;
 
-		double timecode_secs = (double) (sequence->playhead-start_frame) / sequence->frame_rate;
-		if (video_enabled) {
-			// get image from opengl
-			glReadPixels(0, 0, video_frame->linesize[0]/4, sequence->height, GL_RGBA, GL_UNSIGNED_BYTE, video_frame->data[0]);
+		int run_index = find_smart_render_run(playhead);
+		bool copied = (run_index > -1 && smart_render_runs.at(run_index).clip != nullptr);
+		if (video_enabled && copied && playhead == smart_render_runs.at(run_index).start) {
+			const SmartRenderRun& run = smart_render_runs.at(run_index);
 
-			// change pixel format
-			sws_scale(sws_ctx, video_frame->data, video_frame->linesize, 0, video_frame->height, sws_frame->data, sws_frame->linesize);
-			sws_frame->pts = qRound(timecode_secs/av_q2d(video_stream->time_base));
+			// everything encoded before the run goes into the file first
+			while (continueEncode && !segments.isEmpty()) {
+				continueEncode = write_segment(segments.first());
+				delete segments.takeFirst();
+			}
+			if (!continueEncode) break;
 
-			// send to encoder
-			if (!encode(fmt_ctx, vcodec_ctx, sws_frame, &video_pkt, video_stream, false)) continueEncode = false;
+			QString error;
+			if (!copy_smart_render_run(run, start_frame, fmt_ctx, video_stream, vcodec_ctx, last_video_dts, error)) {
+				export_error = error;
+				continueEncode = false;
+				break;
+			}
+
+			// segments after the run carry on from its last frame, they don't reorder so decode and presentation match
+			last_segment_dts = qRound(((double) (run.end-1-start_frame) / sequence->frame_rate)/av_q2d(vcodec_ctx->time_base));
 		}
-		if (audio_enabled) {
-			// do we need to encode more audio samples?
-			while (continueEncode && file_audio_samples <= (timecode_secs*audio_sampling_rate)) {
-				int adjusted_read = audio_ibuffer_read%audio_ibuffer_size;
-				int copylen = qMin(aframe_bytes, audio_ibuffer_size-adjusted_read);
-				memcpy(audio_frame->data[0], audio_ibuffer+adjusted_read, copylen);
-				memset(audio_ibuffer+adjusted_read, 0, copylen);
-				audio_ibuffer_read += copylen;
-
-				if (copylen < aframe_bytes) {
-					// copy remainder
-					int remainder_len = aframe_bytes-copylen;
-					memcpy(audio_frame->data[0]+copylen, audio_ibuffer, remainder_len);
-					memset(audio_ibuffer, 0, remainder_len);
-					audio_ibuffer_read += remainder_len;
-				}
 
-				// convert to export sample format
-				swr_convert_frame(swr_ctx, swr_frame, audio_frame);
-				swr_frame->pts = file_audio_samples;
+		if (video_enabled && still_sequence) {
+			// waits here while the workers are behind
+			frame_budget.acquire();
 
-				// send to encoder
-				if (!encode(fmt_ctx, acodec_ctx, swr_frame, &audio_pkt, audio_stream, true)) continueEncode = false;
+			AVFrame* rendered = render_frame();
+			if (rendered == nullptr) {
+				frame_budget.release();
+				continueEncode = false;
+				break;
+			}
+			rendered->pts = qRound(timecode_secs/av_q2d(vcodec_ctx->time_base));
+
+			// numbered the way the image2 muxer would, from 1
+			char still_filename[4096];
+			if (av_get_frame_filename2(still_filename, sizeof(still_filename), c_filename, playhead - start_frame + 1, 0) < 0) {
+				strcpy(still_filename, c_filename);
+			}
+			stills.push(rendered, QString::fromUtf8(still_filename));
+
+			if (!stills.get_error().isEmpty()) {
+				export_error = stills.get_error();
+				continueEncode = false;
+				break;
+			}
+		} else if (video_enabled && !copied && segment_length > 0) {
+			// copied frames are already in the file, waits here while the encoders are behind
+			frame_budget.acquire();
+
+			AVFrame* rendered = render_frame();
+			if (rendered == nullptr) {
+				frame_budget.release();
+				continueEncode = false;
+				break;
+			}
+			rendered->pts = qRound(timecode_secs/av_q2d(vcodec_ctx->time_base));
+
+			if (segments.isEmpty() || segments.last()->is_full()) {
+				AVCodecContext* encoder = create_video_encoder();
+				if (encoder == nullptr) {
+					av_frame_free(&rendered);
+					frame_budget.release();
+					continueEncode = false;
+					break;
+				}
+				// segments stop where a copied run starts
+				long limit = (run_index > -1) ? smart_render_runs.at(run_index).end : end_frame + 1;
+				ExportSegment* segment = new ExportSegment(encoder, gpu_convert ? nullptr : create_scaler(), qMin(segment_length, limit - playhead), &frame_budget);
+				segments.append(segment);
+				segment_pool.start(segment);
+			}
+			segments.last()->push(rendered);
 
-				file_audio_samples += swr_frame->nb_samples;
+			// copy finished segments into the file in order
+			while (continueEncode && !segments.isEmpty() && segments.first()->is_finished()) {
+				continueEncode = write_segment(segments.first());
+				delete segments.takeFirst();
+			}
+		} else if (video_enabled && !copied) {
+			// the encoder may still hold a reference to the last frame's buffers
+			av_frame_make_writable(sws_frame);
+
+			// get image from opengl
+			bool got_frame;
+			if (gpu_convert) {
+				got_frame = renderer->render_planes(sequence, sws_frame);
+			} else {
+				// followers may still be reading the last frame, so every frame gets a buffer of its own
+				AVFrame* rendered = render_frame();
+				got_frame = (rendered != nullptr);
+				if (got_frame) {
+					av_frame_unref(video_frame);
+					av_frame_move_ref(video_frame, rendered);
+					av_frame_free(&rendered);
+				}
+			}
+			if (!got_frame) {
+				continueEncode = false;
+				break;
 			}
 		}
 
+		if (video_enabled && segment_length == 0 && !still_sequence) {
+			// change pixel format
+			if (!gpu_convert) sws_scale(sws_ctx, video_frame->data, video_frame->linesize, 0, video_frame->height, sws_frame->data, sws_frame->linesize);
+			sws_frame->pts = qRound(timecode_secs/av_q2d(video_stream->time_base));
+
+			// send to encoder
+			if (!encode(fmt_ctx, vcodec_ctx, sws_frame, &video_pkt, video_stream, false)) continueEncode = false;
+		}
+		// mix and encode the audio up to this frame
+		if (audio_enabled && continueEncode && !mix_audio(timecode_secs)) continueEncode = false;
+
 		// encoding stats
 		frame_time = (QDateTime::currentMSecsSinceEpoch()-start_time);
 		total_time += frame_time;
-		remaining_frames = (end_frame-sequence->playhead);
+		remaining_frames = (end_frame-playhead);
 		avg_time = (total_time/frame_count);
 		eta = (remaining_frames*avg_time);
 
 //        qInfo() << "Encoded frame" << sequence->playhead << "- took" << frame_time << "ms (avg:" << avg_time << "ms, remaining:" << remaining_frames << ", ETA:" << eta << ")";
 
-		emit progress_changed(qRound(((double) (sequence->playhead-start_frame) / (double) (end_frame-start_frame)) * 100), eta);
-		sequence->playhead++;
+		emit progress_changed(qRound(((double) (playhead-start_frame) / (double) (end_frame-start_frame)) * 100), eta);
+		playhead++;
+		if (feed.isNull()) sequence->playhead++;
 		frame_count++;
 	}
 
+	// followers get everything that was composited, and whoever composites stops waiting on a follower that's done
+	for (int i=0;i<feeds.size();i++) {
+		feeds.at(i)->close();
+	}
+	if (!feed.isNull()) feed->abort();
+
+	// the last stills are still being written
+	if (still_sequence) {
+		if (continueEncode) {
+			stills.close();
+		} else {
+			stills.abort(tr("encoding was cancelled"));
+		}
+		segment_pool.waitForDone();
+		if (continueEncode && !stills.get_error().isEmpty()) {
+			export_error = stills.get_error();
+			continueEncode = false;
+		}
+	}
+
+	// the last segments are still encoding
+	while (!segments.isEmpty()) {
+		if (continueEncode) {
+			continueEncode = write_segment(segments.first());
+		} else {
+			segments.first()->abort();
+		}
+		segments.first()->wait_finished();
+		delete segments.takeFirst();
+	}
+
+	if (audio_enabled && !video_enabled) {
+		// without video the mixdown runs as fast as the encoder takes it, a second of audio at a time
+		qint64 mix_start = QDateTime::currentMSecsSinceEpoch();
+		double mixed_secs = 0;
+		while (continueEncode && mixdown->get_position() < mixdown->get_length()) {
+			mixed_secs++;
+			continueEncode = mix_audio(mixed_secs);
+
+			double done = (double) mixdown->get_position() / (double) mixdown->get_length();
+			qint64 elapsed = QDateTime::currentMSecsSinceEpoch() - mix_start;
+			emit progress_changed(qRound(done * 100), qRound64(elapsed / done * (1.0 - done)));
+		}
+	}
+
+	// the rest of the last frame's audio
+	if (audio_enabled && continueEncode) continueEncode = mix_audio((double) (end_frame + 1 - start_frame) / sequence->frame_rate);
+
 	if (continueEncode) {
 		if (video_enabled) vpkt_alloc = true;
 		if (audio_enabled) apkt_alloc = true;
 	}
 
-	panel_sequence_viewer->viewer_widget->default_fbo = nullptr;
-	rendering = false;
-
-	fbo.release();
+	if (feed.isNull()) rendering = false;
 
 	if (audio_enabled && continueEncode) {
 		// flush swresample
@@ -426,11 +1059,18 @@ void ExportThread::run() {
 			swr_convert_frame(swr_ctx, swr_frame, nullptr);
 			if (swr_frame->nb_samples == 0) break;
 			swr_frame->pts = file_audio_samples;
-			if (!encode(fmt_ctx, acodec_ctx, swr_frame, &audio_pkt, audio_stream, true)) continueEncode = false;
+			if (!encode(fmt_ctx, acodec_ctx, swr_frame, &audio_pkt, audio_stream, true)) {
+				continueEncode = false;
+				break;
+			}
 			file_audio_samples += swr_frame->nb_samples;
 		} while (swr_frame->nb_samples > 0);
 	}
 
+	for (int i=0;i<stems.size() && continueEncode;i++) {
+		continueEncode = finish_stem(stems.at(i));
+	}
+
 	bool continueVideo = true;
 	bool continueAudio = true;
 	if (continueEncode) {
@@ -440,18 +1080,37 @@ void ExportThread::run() {
 			if (continueAudio && audio_enabled) continueAudio = encode(fmt_ctx, acodec_ctx, nullptr, &audio_pkt, audio_stream, true);
 		}
 
+		// draining the encoders ends with encode() returning false, so only a set error means a write failed
+		if (!export_error.isEmpty()) continueEncode = false;
+	}
+
+	if (continueEncode) {
 		ret = av_write_trailer(fmt_ctx);
 		if (ret < 0) {
 			qCritical() << "Could not write output file trailer." << ret;
-			ed->export_error = tr("could not write output file trailer (%1)").arg(QString::number(ret));
+			export_error = tr("could not write output file trailer (%1)").arg(QString::number(ret));
 			continueEncode = false;
 		}
 
 		emit progress_changed(100, 0);
 	}
 
+	if (frameserver && fmt_ctx->pb != nullptr && fmt_ctx->pb->error == AVERROR(EPIPE)) {
+		qCritical() << "Frameserver reader disconnected";
+		export_error = tr("the program reading the frameserver disconnected");
+		continueEncode = false;
+	}
+
 	avio_closep(&fmt_ctx->pb);
 
+#ifndef Q_OS_WIN
+	// the pipe protocol leaves its file descriptor open
+	if (fifo_fd >= 0) {
+		close(fifo_fd);
+		fifo_fd = -1;
+	}
+#endif
+
 	if (vpkt_alloc) av_packet_unref(&video_pkt);
 	if (video_frame != nullptr) av_frame_free(&video_frame);
 	if (vcodec_ctx != nullptr) {
@@ -461,6 +1120,11 @@ void ExportThread::run() {
 
 	if (apkt_alloc) av_packet_unref(&audio_pkt);
 	if (audio_frame != nullptr) av_frame_free(&audio_frame);
+	delete mixdown;
+	for (int i=0;i<stems.size();i++) {
+		free_stem(stems.at(i));
+	}
+	stems.clear();
 	if (acodec_ctx != nullptr) {
 		avcodec_close(acodec_ctx);
 		avcodec_free_context(&acodec_ctx);
@@ -468,10 +1132,8 @@ void ExportThread::run() {
 
 	avformat_free_context(fmt_ctx);
 
-	if (sws_ctx != nullptr) {
-		sws_freeContext(sws_ctx);
-		av_frame_free(&sws_frame);
-	}
+	if (sws_ctx != nullptr) sws_freeContext(sws_ctx);
+	if (sws_frame != nullptr) av_frame_free(&sws_frame);
 	if (swr_ctx != nullptr) {
 		swr_free(&swr_ctx);
 		av_frame_free(&swr_frame);
@@ -479,8 +1141,18 @@ void ExportThread::run() {
 
 	delete [] c_filename;
 
-	panel_sequence_viewer->viewer_widget->context()->doneCurrent();
-	panel_sequence_viewer->viewer_widget->context()->moveToThread(qApp->thread());
+#ifndef Q_OS_WIN
+	if (frameserver) {
+		// a broken pipe leaves SIGPIPE pending on this thread, it's taken before the mask is restored
+		sigset_t pending;
+		sigpending(&pending);
+		if (sigismember(&pending, SIGPIPE)) {
+			int sig;
+			sigwait(&sigpipe_set, &sig);
+		}
+		pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+	}
+#endif
 
-	rendering = false;
+	if (feed.isNull()) rendering = false;
 }
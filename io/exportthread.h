@@ -2,9 +2,13 @@
 #define EXPORTTHREAD_H
 
 #include <QThread>
-#include <QOffscreenSurface>
+#include <QVector>
+#include <QSharedPointer>
 
-class ExportDialog;
+#include "io/smartrender.h"
+#include "io/exportfeed.h"
+
+class ExportSegment;
 struct AVFormatContext;
 struct AVCodecContext;
 struct AVFrame;
@@ -13,6 +17,8 @@ struct AVStream;
 struct AVCodec;
 struct SwsContext;
 struct SwrContext;
+class AudioMixdown;
+class RenderThread;
 
 extern "C" {
 	#include <libavcodec/avcodec.h>
@@ -23,6 +29,19 @@ extern "C" {
 #define COMPRESSION_TYPE_TARGETSIZE 2
 #define COMPRESSION_TYPE_TARGETBR 3
 
+// a track's audio written to a file of its own next to the export
+struct ExportStem {
+	QString filename;
+	AVFormatContext* fmt_ctx;
+	AVStream* stream;
+	AVCodecContext* encoder;
+	SwrContext* resampler;
+	AVFrame* frame;
+	AVFrame* converted;
+	AVPacket pkt;
+	long file_samples;
+};
+
 class ExportThread : public QThread {
 	Q_OBJECT
 public:
@@ -42,21 +61,49 @@ public:
 	int audio_codec;
 	int audio_sampling_rate;
 	int audio_bitrate;
+	bool audio_stems;
 	long start_frame;
 	long end_frame;
 
-	QOffscreenSurface surface;
+	// copies untouched source frames instead of encoding them again where possible
+	bool smart_render;
+
+	// streams raw frames as NUT to whoever reads filename, a FIFO or a UNIX socket that's listened on
+	bool frameserver;
+
+	// composited frames are also pushed to these, for exports of the same range in other formats
+	QVector<QSharedPointer<ExportFeed> > feeds;
 
-	ExportDialog* ed;
+	// where the frames come from if another export composites them, null if this one does
+	QSharedPointer<ExportFeed> feed;
+
+	// why the export failed, read once the thread has finished
+	QString export_error;
 
 	bool continueEncode;
 signals:
 	void progress_changed(int value, qint64 remaining_ms);
 private:
 	bool encode(AVFormatContext* ofmt_ctx, AVCodecContext* codec_ctx, AVFrame* frame, AVPacket* packet, AVStream* stream, bool rescale);
+	bool write_packet(AVFormatContext* ofmt_ctx, AVPacket* packet);
 	bool setupVideo();
 	bool setupAudio();
 	bool setupContainer();
+	AVCodecContext* create_video_encoder();
+	SwsContext* create_scaler();
+	AVFrame* render_frame();
+	void feed_followers(AVFrame* frame);
+	int get_still_workers();
+	bool write_segment(ExportSegment* segment);
+	int find_smart_render_run(long frame);
+	bool mix_audio(double timecode_secs);
+	bool create_audio_encoder(AVFormatContext* ctx, AVStream** stream, AVCodecContext** encoder, SwrContext** resampler, AVFrame** converted);
+	AVFrame* create_audio_frame();
+	bool finish_stem(ExportStem* stem);
+	void free_stem(ExportStem* stem);
+
+	// composites the frames, the viewer's render thread
+	RenderThread* renderer;
 
     AVFormatContext* fmt_ctx;
 	AVStream* video_stream;
@@ -65,6 +112,8 @@ private:
 	AVFrame* video_frame;
 	AVFrame* sws_frame;
     SwsContext* sws_ctx;
+	// frames are converted to the encoder's format by the render thread instead of sws_ctx
+	bool gpu_convert;
 	AVStream* audio_stream;
 	AVCodec* acodec;
 	AVFrame* audio_frame;
@@ -73,11 +122,27 @@ private:
 	AVPacket video_pkt;
 	AVPacket audio_pkt;
     SwrContext* swr_ctx;
+	AudioMixdown* mixdown;
+	long file_audio_samples;
+	QVector<ExportStem*> stems;
+
+	// frames per segment encoded in parallel, 0 for a single pass
+	long segment_length;
+
+	// image sequences write every frame to its own file from a pool of workers
+	bool still_sequence;
+	int64_t last_segment_dts;
+
+	// smart render plan, empty if everything is encoded
+	QVector<SmartRenderRun> smart_render_runs;
+	int64_t last_video_dts;
+
+	// frameserver FIFO, opened here instead of by the file protocol so it doesn't block
+	int fifo_fd;
 
     bool vpkt_alloc;
     bool apkt_alloc;
 
-	int aframe_bytes;
 	int ret;
 	char* c_filename;
 };
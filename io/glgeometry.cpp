@@ -0,0 +1,337 @@
+#include "glgeometry.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QColor>
+
+#include "io/shadercache.h"
+#include "project/effect.h"
+#include "debug.h"
+
+// indices are 16-bit so meshes stay drawable on GL ES 2
+#define GEOMETRY_MAX_GRID_SIZE 128
+
+// x, y, s, t
+#define GEOMETRY_VERTEX_SIZE 4
+
+const char* const composite_vert_source =
+		"#version 110\n"
+		"\n"
+		"attribute vec2 a_position;\n"
+		"attribute vec2 a_texcoord;\n"
+		"\n"
+		"uniform mat4 mvp_matrix;\n"
+		"uniform vec2 corners[4];\n"
+		"uniform vec2 tex_corners[4];\n"
+		"\n"
+		"varying vec2 vTexCoord;\n"
+		"\n"
+		"void main() {\n"
+		"	vec2 top = mix(corners[0], corners[1], a_position.x);\n"
+		"	vec2 bottom = mix(corners[3], corners[2], a_position.x);\n"
+		"	gl_Position = mvp_matrix * vec4(mix(top, bottom, a_position.y), 0.0, 1.0);\n"
+		"\n"
+		"	vec2 tex_top = mix(tex_corners[0], tex_corners[1], a_texcoord.x);\n"
+		"	vec2 tex_bottom = mix(tex_corners[3], tex_corners[2], a_texcoord.x);\n"
+		"	vTexCoord = mix(tex_top, tex_bottom, a_texcoord.y);\n"
+		"}\n";
+
+const char* const composite_frag_source =
+		"#version 110\n"
+		"\n"
+		"uniform sampler2D image;\n"
+		"uniform float opacity;\n"
+		"\n"
+		"varying vec2 vTexCoord;\n"
+		"\n"
+		"void main(void) {\n"
+		"	vec4 color = texture2D(image, vTexCoord);\n"
+		"	gl_FragColor = vec4(color.rgb, color.a * opacity);\n"
+		"}\n";
+
+const char* const flat_vert_source =
+		"#version 110\n"
+		"\n"
+		"attribute vec2 a_position;\n"
+		"\n"
+		"uniform mat4 mvp_matrix;\n"
+		"\n"
+		"void main() {\n"
+		"	gl_Position = mvp_matrix * vec4(a_position, 0.0, 1.0);\n"
+		"}\n";
+
+const char* const flat_frag_source =
+		"#version 110\n"
+		"\n"
+		"uniform vec4 color;\n"
+		"\n"
+		"void main(void) {\n"
+		"	gl_FragColor = color;\n"
+		"}\n";
+
+void set_vertex_attributes(QOpenGLFunctions* f, bool texcoords) {
+	GLsizei stride = GEOMETRY_VERTEX_SIZE * sizeof(GLfloat);
+	f->glEnableVertexAttribArray(GEOMETRY_POSITION_ATTRIBUTE);
+	f->glVertexAttribPointer(GEOMETRY_POSITION_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, stride, nullptr);
+	if (texcoords) {
+		f->glEnableVertexAttribArray(GEOMETRY_TEXCOORD_ATTRIBUTE);
+		f->glVertexAttribPointer(GEOMETRY_TEXCOORD_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(2 * sizeof(GLfloat)));
+	}
+}
+
+void unset_vertex_attributes(QOpenGLFunctions* f) {
+	f->glDisableVertexAttribArray(GEOMETRY_POSITION_ATTRIBUTE);
+	f->glDisableVertexAttribArray(GEOMETRY_TEXCOORD_ATTRIBUTE);
+}
+
+GeometryCache::GeometryCache(QOpenGLContext* ctx) :
+	QObject(ctx),
+	stream(QOpenGLBuffer::VertexBuffer),
+	stream_vao(nullptr)
+{
+	// buffers have to be freed while the context still exists
+	connect(ctx, SIGNAL(aboutToBeDestroyed()), this, SLOT(destroy_buffers()));
+}
+
+GeometryCache::~GeometryCache() {
+	destroy_buffers();
+}
+
+GeometryCache* GeometryCache::get(QOpenGLContext* ctx) {
+	GeometryCache* cache = ctx->findChild<GeometryCache*>(QString(), Qt::FindDirectChildrenOnly);
+	if (cache == nullptr) cache = new GeometryCache(ctx);
+	return cache;
+}
+
+GeometryMesh* GeometryCache::get_mesh(int grid_size) {
+	grid_size = qBound(1, grid_size, GEOMETRY_MAX_GRID_SIZE);
+
+	GeometryMesh* mesh = meshes.value(grid_size);
+	if (mesh != nullptr) return mesh;
+
+	QVector<GLfloat> vertices;
+	QVector<GLushort> indices;
+	if (grid_size == 1) {
+		// single quad as a fan in corner order
+		vertices = {0, 0, 0, 0,
+					1, 0, 1, 0,
+					1, 1, 1, 1,
+					0, 1, 0, 1};
+	} else {
+		int row_length = grid_size + 1;
+		vertices.reserve(row_length * row_length * GEOMETRY_VERTEX_SIZE);
+		for (int i=0;i<=grid_size;i++) {
+			GLfloat y = GLfloat(i) / grid_size;
+			for (int j=0;j<=grid_size;j++) {
+				GLfloat x = GLfloat(j) / grid_size;
+				vertices << x << y << x << y;
+			}
+		}
+		indices.reserve(grid_size * grid_size * 6);
+		for (int i=0;i<grid_size;i++) {
+			for (int j=0;j<grid_size;j++) {
+				GLushort top_left = i * row_length + j;
+				GLushort bottom_left = top_left + row_length;
+				indices << top_left << top_left + 1 << bottom_left + 1
+						<< top_left << bottom_left + 1 << bottom_left;
+			}
+		}
+	}
+
+	mesh = new GeometryMesh();
+	mesh->vertex_count = vertices.size() / GEOMETRY_VERTEX_SIZE;
+	mesh->index_count = indices.size();
+	mesh->vertices = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	mesh->indices = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+
+	mesh->vertices.create();
+	mesh->vertices.bind();
+	mesh->vertices.allocate(vertices.constData(), vertices.size() * sizeof(GLfloat));
+	if (mesh->index_count > 0) {
+		mesh->indices.create();
+		mesh->indices.bind();
+		mesh->indices.allocate(indices.constData(), indices.size() * sizeof(GLushort));
+	}
+
+	// record the attribute layout once where vertex array objects are available (required on core profiles)
+	mesh->vao = new QOpenGLVertexArrayObject();
+	if (mesh->vao->create()) {
+		mesh->vao->bind();
+		mesh->vertices.bind();
+		if (mesh->index_count > 0) mesh->indices.bind();
+		set_vertex_attributes(QOpenGLContext::currentContext()->functions(), true);
+		mesh->vao->release();
+	} else {
+		delete mesh->vao;
+		mesh->vao = nullptr;
+	}
+
+	mesh->vertices.release();
+	if (mesh->index_count > 0) mesh->indices.release();
+
+	meshes.insert(grid_size, mesh);
+	return mesh;
+}
+
+QOpenGLVertexArrayObject* GeometryCache::get_stream_vao() {
+	if (!stream.isCreated()) {
+		stream.create();
+		stream.setUsagePattern(QOpenGLBuffer::StreamDraw);
+
+		stream_vao = new QOpenGLVertexArrayObject();
+		if (stream_vao->create()) {
+			stream_vao->bind();
+			stream.bind();
+			set_vertex_attributes(QOpenGLContext::currentContext()->functions(), false);
+			stream_vao->release();
+			stream.release();
+		} else {
+			delete stream_vao;
+			stream_vao = nullptr;
+		}
+	}
+	return stream_vao;
+}
+
+void GeometryCache::destroy_buffers() {
+	QHashIterator<int, GeometryMesh*> i(meshes);
+	while (i.hasNext()) {
+		i.next();
+		GeometryMesh* mesh = i.value();
+		if (mesh->vao != nullptr) {
+			mesh->vao->destroy();
+			delete mesh->vao;
+		}
+		mesh->vertices.destroy();
+		mesh->indices.destroy();
+		delete mesh;
+	}
+	meshes.clear();
+
+	if (stream_vao != nullptr) {
+		stream_vao->destroy();
+		delete stream_vao;
+		stream_vao = nullptr;
+	}
+	stream.destroy();
+}
+
+void bind_geometry_attributes(QOpenGLShaderProgram* program) {
+	program->bindAttributeLocation("a_position", GEOMETRY_POSITION_ATTRIBUTE);
+	program->bindAttributeLocation("a_texcoord", GEOMETRY_TEXCOORD_ATTRIBUTE);
+}
+
+void draw_unit_mesh(QOpenGLShaderProgram* program, const QMatrix4x4& mvp, int grid_size) {
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	QOpenGLFunctions* f = ctx->functions();
+	GeometryMesh* mesh = GeometryCache::get(ctx)->get_mesh(grid_size);
+
+	program->setUniformValue(GEOMETRY_MVP_UNIFORM, mvp);
+
+	if (mesh->vao != nullptr) {
+		mesh->vao->bind();
+	} else {
+		mesh->vertices.bind();
+		if (mesh->index_count > 0) mesh->indices.bind();
+		set_vertex_attributes(f, true);
+	}
+
+	if (mesh->index_count > 0) {
+		f->glDrawElements(GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_SHORT, nullptr);
+	} else {
+		f->glDrawArrays(GL_TRIANGLE_FAN, 0, mesh->vertex_count);
+	}
+
+	if (mesh->vao != nullptr) {
+		mesh->vao->release();
+	} else {
+		unset_vertex_attributes(f);
+		mesh->vertices.release();
+		if (mesh->index_count > 0) mesh->indices.release();
+	}
+}
+
+QOpenGLShaderProgram* get_composite_program() {
+	return get_shader_program_from_source("composite", composite_vert_source, composite_frag_source);
+}
+
+void draw_composite(GLuint texture, const QVector2D* corners, const QVector2D* tex_corners, const QMatrix4x4& mvp, float opacity, int grid_size) {
+	QOpenGLShaderProgram* program = get_composite_program();
+	if (program == nullptr || !program->bind()) {
+		qWarning() << "Composite shader is unavailable, clip was not drawn";
+		return;
+	}
+
+	program->setUniformValue("image", 0);
+	program->setUniformValue("opacity", opacity);
+	program->setUniformValueArray("corners", corners, 4);
+	program->setUniformValueArray("tex_corners", tex_corners, 4);
+
+	QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+	f->glBindTexture(GL_TEXTURE_2D, texture);
+	draw_unit_mesh(program, mvp, grid_size);
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+
+	program->release();
+}
+
+void draw_texture(GLuint texture, const QMatrix4x4& mvp) {
+	const QVector2D unit_corners[4] = {QVector2D(0, 0), QVector2D(1, 0), QVector2D(1, 1), QVector2D(0, 1)};
+	draw_composite(texture, unit_corners, unit_corners, mvp, 1.0f, 1);
+}
+
+void draw_texture(GLuint texture, const GLTextureCoords& coords, const QMatrix4x4& mvp, float opacity) {
+	const QVector2D corners[4] = {
+		QVector2D(coords.vertexTopLeftX, coords.vertexTopLeftY),
+		QVector2D(coords.vertexTopRightX, coords.vertexTopRightY),
+		QVector2D(coords.vertexBottomRightX, coords.vertexBottomRightY),
+		QVector2D(coords.vertexBottomLeftX, coords.vertexBottomLeftY)
+	};
+	const QVector2D tex_corners[4] = {
+		QVector2D(coords.textureTopLeftX, coords.textureTopLeftY),
+		QVector2D(coords.textureTopRightX, coords.textureTopRightY),
+		QVector2D(coords.textureBottomRightX, coords.textureBottomRightY),
+		QVector2D(coords.textureBottomLeftX, coords.textureBottomLeftY)
+	};
+	draw_composite(texture, corners, tex_corners, mvp, opacity, coords.grid_size);
+}
+
+void draw_flat_shape(GLenum mode, const QVector<QVector2D>& points, const QMatrix4x4& mvp, const QColor& color) {
+	if (points.isEmpty()) return;
+
+	QOpenGLShaderProgram* program = get_shader_program_from_source("flat", flat_vert_source, flat_frag_source);
+	if (program == nullptr || !program->bind()) return;
+
+	program->setUniformValue(GEOMETRY_MVP_UNIFORM, mvp);
+	program->setUniformValue("color", color);
+
+	// pad to the shared vertex layout so the stream buffer works with the same attribute setup
+	QVector<GLfloat> vertices;
+	vertices.reserve(points.size() * GEOMETRY_VERTEX_SIZE);
+	for (int i=0;i<points.size();i++) {
+		vertices << points.at(i).x() << points.at(i).y() << 0 << 0;
+	}
+
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	QOpenGLFunctions* f = ctx->functions();
+	GeometryCache* cache = GeometryCache::get(ctx);
+	QOpenGLVertexArrayObject* vao = cache->get_stream_vao();
+
+	if (vao != nullptr) vao->bind();
+	cache->stream.bind();
+	cache->stream.allocate(vertices.constData(), vertices.size() * sizeof(GLfloat));
+	if (vao == nullptr) set_vertex_attributes(f, false);
+
+	f->glDrawArrays(mode, 0, points.size());
+
+	if (vao != nullptr) {
+		vao->release();
+	} else {
+		unset_vertex_attributes(f);
+	}
+	cache->stream.release();
+
+	program->release();
+}
@@ -0,0 +1,73 @@
+#ifndef GLGEOMETRY_H
+#define GLGEOMETRY_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QVector2D>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+class QOpenGLVertexArrayObject;
+class QColor;
+struct GLTextureCoords;
+
+// attribute slots every shader program is linked with (see bind_geometry_attributes)
+#define GEOMETRY_POSITION_ATTRIBUTE 0
+#define GEOMETRY_TEXCOORD_ATTRIBUTE 1
+
+#define GEOMETRY_MVP_UNIFORM "mvp_matrix"
+
+struct GeometryMesh {
+	QOpenGLBuffer vertices;
+	QOpenGLBuffer indices;
+	QOpenGLVertexArrayObject* vao;
+	int vertex_count;
+	int index_count;
+};
+
+/*
+ * Vertex buffers owned by one GL context: subdivided unit quads (one per grid size) that clips are drawn
+ * with, and a scratch buffer for overlays. Created on first use and freed with the context.
+ */
+class GeometryCache : public QObject {
+	Q_OBJECT
+public:
+	GeometryCache(QOpenGLContext* ctx);
+	~GeometryCache();
+	static GeometryCache* get(QOpenGLContext* ctx);
+	GeometryMesh* get_mesh(int grid_size);
+	QOpenGLVertexArrayObject* get_stream_vao();
+	QOpenGLBuffer stream;
+private slots:
+	void destroy_buffers();
+private:
+	QHash<int, GeometryMesh*> meshes;
+	QOpenGLVertexArrayObject* stream_vao;
+};
+
+// binds a_position and a_texcoord to the slots above, call before linking
+void bind_geometry_attributes(QOpenGLShaderProgram* program);
+
+/*
+ * Draws the unit square from (0,0) top left to (1,1) bottom right with a bound program, split into
+ * grid_size x grid_size cells. Texture coordinates match the positions. The single quad is drawn as a fan
+ * of top left, top right, bottom right, bottom left so shaders can rely on gl_VertexID.
+ */
+void draw_unit_mesh(QOpenGLShaderProgram* program, const QMatrix4x4& mvp, int grid_size = 1);
+
+// draws a texture over the unit square with the shared composite program
+void draw_texture(GLuint texture, const QMatrix4x4& mvp);
+
+/*
+ * Draws a texture over a clip's corner coordinates, transformed by mvp and faded by opacity. The composite
+ * program maps the cached unit mesh onto the corners, so no vertices are rebuilt per frame.
+ */
+void draw_texture(GLuint texture, const GLTextureCoords& coords, const QMatrix4x4& mvp, float opacity);
+
+// draws untextured lines or polygons in a flat color (overlays, gizmos)
+void draw_flat_shape(GLenum mode, const QVector<QVector2D>& points, const QMatrix4x4& mvp, const QColor& color);
+
+#endif // GLGEOMETRY_H
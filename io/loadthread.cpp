@@ -3,6 +3,9 @@
 #include "mainwindow.h"
 #include "panels/panels.h"
 #include "panels/effectcontrols.h"
+#include "panels/viewer.h"
+#include "ui/viewerwidget.h"
+#include "playback/renderthread.h"
 #include "panels/project.h"
 #include "project/footage.h"
 #include "io/config.h"
@@ -18,6 +21,7 @@
 #include "debug.h"
 
 #include <QFile>
+#include <QApplication>
 #include <QMessageBox>
 #include <QTreeWidgetItem>
 
@@ -33,8 +37,11 @@ LoadThread::LoadThread(LoadDialog* l, bool a) : ld(l), autorecovery(a), cancelle
 	connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
 	connect(this, SIGNAL(success()), this, SLOT(success_func()));
 	connect(this, SIGNAL(error()), this, SLOT(error_func()));
-	connect(this, SIGNAL(start_create_dual_transition(const TransitionData*,Clip*,Clip*,const EffectMeta*)), this, SLOT(create_dual_transition(const TransitionData*,Clip*,Clip*,const EffectMeta*)));
-	connect(this, SIGNAL(start_create_effect_ui(QXmlStreamReader*, Clip*, int, const QString*, const EffectMeta*, long, bool)), this, SLOT(create_effect_ui(QXmlStreamReader*, Clip*, int, const QString*, const EffectMeta*, long, bool)));
+}
+
+// effects are built here but live on the GUI thread, which creates their widgets on demand
+void move_effect_to_gui_thread(Effect* e) {
+	e->moveToThread(QApplication::instance()->thread());
 }
 
 const EffectMeta* get_meta_from_name(const QString& name) {
@@ -78,434 +85,401 @@ void LoadThread::load_effect(QXmlStreamReader& stream, Clip* c) {
 
 	QString tag = stream.name().toString();
 
-	int type;
-	if (tag == "opening") {
-		type = TA_OPENING_TRANSITION;
-	} else if (tag == "closing") {
-		type = TA_CLOSING_TRANSITION;
+	if (tag == "opening" || tag == "closing") {
+		int transition_index = create_transition(c, nullptr, meta);
+		Transition* t = c->sequence->transitions.at(transition_index);
+		if (effect_length > -1) t->set_length(effect_length);
+		t->set_enabled(effect_enabled);
+		t->load(stream);
+		move_effect_to_gui_thread(t);
+
+		if (tag == "opening") {
+			c->opening_transition = transition_index;
+		} else {
+			c->closing_transition = transition_index;
+		}
 	} else {
-		type = TA_NO_TRANSITION;
-	}
+		Effect* e;
+		if (meta == nullptr) {
+			// create void effect
+			e = new VoidEffect(c, effect_name);
+		} else {
+			e = create_effect(c, meta);
+		}
+		e->set_enabled(effect_enabled);
+		e->load(stream);
+		move_effect_to_gui_thread(e);
 
-	emit start_create_effect_ui(&stream, c, type, &effect_name, meta, effect_length, effect_enabled);
-	waitCond.wait(&mutex);
+		c->effects.append(e);
+	}
 }
 
 void LoadThread::read_next(QXmlStreamReader &stream) {
 	stream.readNext();
-	update_current_element_count(stream);
+	if (stream.isStartElement()) update_progress(stream);
 }
 
-void LoadThread::read_next_start_element(QXmlStreamReader &stream) {
-	stream.readNextStartElement();
-	update_current_element_count(stream);
+void LoadThread::update_progress(QXmlStreamReader &stream) {
+	// progress is measured by how far into the file the reader is, so no pre-pass is needed to count elements
+	qint64 size = stream.device()->size();
+	if (size > 0) {
+		int progress = int((stream.device()->pos() * 100) / size);
+		if (progress != last_progress) {
+			last_progress = progress;
+			emit report_progress(progress);
+		}
+	}
 }
 
-void LoadThread::update_current_element_count(QXmlStreamReader &stream) {
-	if (is_element(stream)) {
-		current_element_count++;
-		report_progress((current_element_count * 100) / total_element_count);
+bool LoadThread::load_version(QXmlStreamReader& stream) {
+	int proj_version = stream.readElementText().toInt();
+	if (proj_version < MIN_SAVE_VERSION && proj_version > SAVE_VERSION) {
+        if (QMessageBox::warning(
+                    mainWindow,
+                    tr("Version Mismatch"),
+                    tr("This project was saved in a different version of Olive and may not be fully compatible with this version. Would you like to attempt loading it anyway?"),
+                    QMessageBox::Yes,
+                    QMessageBox::No) == QMessageBox::No) {
+			show_err = false;
+			return false;
+		}
 	}
+	return true;
 }
 
-bool LoadThread::is_element(QXmlStreamReader &stream) {
-	return stream.isStartElement()
-			&& (stream.name() == "folder"
-			|| stream.name() == "footage"
-			|| stream.name() == "sequence"
-			|| stream.name() == "clip"
-			|| stream.name() == "effect");
+void LoadThread::load_folder(QXmlStreamReader& stream) {
+	Media* folder = panel_project->new_folder(nullptr);
+	folder->temp_id2 = 0;
+	for (int j=0;j<stream.attributes().size();j++) {
+		const QXmlStreamAttribute& attr = stream.attributes().at(j);
+		if (attr.name() == "id") {
+			folder->temp_id = attr.value().toInt();
+		} else if (attr.name() == "name") {
+			folder->set_name(attr.value().toString());
+		} else if (attr.name() == "parent") {
+			folder->temp_id2 = attr.value().toInt();
+		}
+	}
+	loaded_folders.append(folder);
+	folder_map.insert(folder->temp_id, folder);
 }
 
-bool LoadThread::load_worker(QFile& f, QXmlStreamReader& stream, int type) {
-	f.seek(0);
-	stream.setDevice(stream.device());
-
-	QString root_search;
-	QString child_search;
-
-	switch (type) {
-	case LOAD_TYPE_VERSION:
-		root_search = "version";
-		break;
-	case LOAD_TYPE_URL:
-		root_search = "url";
-		break;
-	case MEDIA_TYPE_FOLDER:
-		root_search = "folders";
-		child_search = "folder";
-		break;
-	case MEDIA_TYPE_FOOTAGE:
-		root_search = "media";
-		child_search = "footage";
-		break;
-	case MEDIA_TYPE_SEQUENCE:
-		root_search = "sequences";
-		child_search = "sequence";
-		break;
-	}
+void LoadThread::load_footage(QXmlStreamReader& stream) {
+	Media* item = new Media(0);
+	Footage* m = new Footage();
 
-	show_err = true;
+	m->using_inout = false;
 
-	while (!stream.atEnd() && !cancelled) {
-		read_next_start_element(stream);
-		if (stream.name() == root_search) {
-			if (type == LOAD_TYPE_VERSION) {
-				int proj_version = stream.readElementText().toInt();
-				if (proj_version < MIN_SAVE_VERSION && proj_version > SAVE_VERSION) {
-                    if (QMessageBox::warning(
-                                mainWindow,
-                                tr("Version Mismatch"),
-                                tr("This project was saved in a different version of Olive and may not be fully compatible with this version. Would you like to attempt loading it anyway?"),
-                                QMessageBox::Yes,
-                                QMessageBox::No) == QMessageBox::No) {
-						show_err = false;
-						return false;
-					}
-				}
-			} else if (type == LOAD_TYPE_URL) {
-				internal_proj_url = stream.readElementText();
-				internal_proj_dir = QFileInfo(internal_proj_url).absoluteDir();
-			} else {
-				while (!cancelled && !stream.atEnd() && !(stream.name() == root_search && stream.isEndElement())) {
-					read_next(stream);
-					if (stream.name() == child_search && stream.isStartElement()) {
-						switch (type) {
-						case MEDIA_TYPE_FOLDER:
-						{
-							Media* folder = panel_project->new_folder(nullptr);
-							folder->temp_id2 = 0;
-							for (int j=0;j<stream.attributes().size();j++) {
-								const QXmlStreamAttribute& attr = stream.attributes().at(j);
-								if (attr.name() == "id") {
-									folder->temp_id = attr.value().toInt();
-								} else if (attr.name() == "name") {
-									folder->set_name(attr.value().toString());
-								} else if (attr.name() == "parent") {
-									folder->temp_id2 = attr.value().toInt();
-								}
-							}
-							loaded_folders.append(folder);
-						}
-							break;
-						case MEDIA_TYPE_FOOTAGE:
-						{
-							int folder = 0;
-
-							Media* item = new Media(0);
-							Footage* m = new Footage();
-
-							m->using_inout = false;
-
-							for (int j=0;j<stream.attributes().size();j++) {
-								const QXmlStreamAttribute& attr = stream.attributes().at(j);
-								if (attr.name() == "id") {
-									m->save_id = attr.value().toInt();
-								} else if (attr.name() == "folder") {
-									folder = attr.value().toInt();
-								} else if (attr.name() == "name") {
-									m->name = attr.value().toString();
-								} else if (attr.name() == "url") {
-									m->url = attr.value().toString();
-
-									if (!QFileInfo::exists(m->url)) { // if path is not absolute
-										QString proj_dir_test = proj_dir.absoluteFilePath(m->url);
-										QString internal_proj_dir_test = internal_proj_dir.absoluteFilePath(m->url);
-
-										if (QFileInfo::exists(proj_dir_test)) { // if path is relative to the project's current dir
-											m->url = proj_dir_test;
-											qInfo() << "Matched" << attr.value().toString() << "relative to project's current directory";
-										} else if (QFileInfo::exists(internal_proj_dir_test)) { // if path is relative to the last directory the project was saved in
-											m->url = internal_proj_dir_test;
-											qInfo() << "Matched" << attr.value().toString() << "relative to project's internal directory";
-										} else if (m->url.contains('%')) {
-											// hack for image sequences (qt won't be able to find the URL with %, but ffmpeg may)
-											m->url = internal_proj_dir_test;
-											qInfo() << "Guess image sequence" << attr.value().toString() << "path to project's internal directory";
-										} else {
-											qInfo() << "Failed to match" << attr.value().toString() << "to file";
-										}
-									} else {
-										qInfo() << "Matched" << attr.value().toString() << "with absolute path";
-									}
-								} else if (attr.name() == "duration") {
-									m->length = attr.value().toLongLong();
-								} else if (attr.name() == "using_inout") {
-									m->using_inout = (attr.value() == "1");
-								} else if (attr.name() == "in") {
-									m->in = attr.value().toLong();
-								} else if (attr.name() == "out") {
-									m->out = attr.value().toLong();
-								} else if (attr.name() == "speed") {
-									m->speed = attr.value().toDouble();
-								}
-							}
+	// temp_id2 holds the parent folder until the folders are attached after the pass
+	item->temp_id2 = 0;
 
-							item->set_footage(m);
+	for (int j=0;j<stream.attributes().size();j++) {
+		const QXmlStreamAttribute& attr = stream.attributes().at(j);
+		if (attr.name() == "id") {
+			m->save_id = attr.value().toInt();
+		} else if (attr.name() == "folder") {
+			item->temp_id2 = attr.value().toInt();
+		} else if (attr.name() == "name") {
+			m->name = attr.value().toString();
+		} else if (attr.name() == "url") {
+			// resolved once the whole file has been read, see resolve_footage_url()
+			m->url = attr.value().toString();
+		} else if (attr.name() == "duration") {
+			m->length = attr.value().toLongLong();
+		} else if (attr.name() == "using_inout") {
+			m->using_inout = (attr.value() == "1");
+		} else if (attr.name() == "in") {
+			m->in = attr.value().toLong();
+		} else if (attr.name() == "out") {
+			m->out = attr.value().toLong();
+		} else if (attr.name() == "speed") {
+			m->speed = attr.value().toDouble();
+		}
+	}
 
-							if (folder == 0) {
-								project_model.appendChild(nullptr, item);
-							} else {
-								find_loaded_folder_by_id(folder)->appendChild(item);
-							}
+	item->set_footage(m);
 
-							// analyze media to see if it's the same
-							loaded_media_items.append(item);
-						}
-							break;
-						case MEDIA_TYPE_SEQUENCE:
-						{
-							Media* parent = nullptr;
-							Sequence* s = new Sequence();
-
-							// load attributes about sequence
-							for (int j=0;j<stream.attributes().size();j++) {
-								const QXmlStreamAttribute& attr = stream.attributes().at(j);
-								if (attr.name() == "name") {
-									s->name = attr.value().toString();
-								} else if (attr.name() == "folder") {
-									int folder = attr.value().toInt();
-									if (folder > 0) parent = find_loaded_folder_by_id(folder);
-								} else if (attr.name() == "id") {
-									s->save_id = attr.value().toInt();
-								} else if (attr.name() == "width") {
-									s->width = attr.value().toInt();
-								} else if (attr.name() == "height") {
-									s->height = attr.value().toInt();
-								} else if (attr.name() == "framerate") {
-									s->frame_rate = attr.value().toDouble();
-								} else if (attr.name() == "afreq") {
-									s->audio_frequency = attr.value().toInt();
-								} else if (attr.name() == "alayout") {
-									s->audio_layout = attr.value().toInt();
-								} else if (attr.name() == "open") {
-									open_seq = s;
-								} else if (attr.name() == "workarea") {
-									s->using_workarea = (attr.value() == "1");
-								} else if (attr.name() == "workareaEnabled") {
-									s->enable_workarea = (attr.value() == "1");
-								} else if (attr.name() == "workareaIn") {
-									s->workarea_in = attr.value().toLong();
-								} else if (attr.name() == "workareaOut") {
-									s->workarea_out = attr.value().toLong();
-								}
-							}
+	// analyze media to see if it's the same
+	loaded_media_items.append(item);
+	footage_map.insert(m->save_id, item);
+}
 
-							QVector<TransitionData> transition_data;
-
-							// load all clips and clip information
-							while (!cancelled && !(stream.name() == child_search && stream.isEndElement()) && !stream.atEnd()) {
-								read_next_start_element(stream);
-								if (stream.name() == "marker" && stream.isStartElement()) {
-									Marker m;
-									for (int j=0;j<stream.attributes().size();j++) {
-										const QXmlStreamAttribute& attr = stream.attributes().at(j);
-										if (attr.name() == "frame") {
-											m.frame = attr.value().toLong();
-										} else if (attr.name() == "name") {
-											m.name = attr.value().toString();
-										}
-									}
-									s->markers.append(m);
-								} else if (stream.name() == "transition" && stream.isStartElement()) {
-									TransitionData td;
-									td.otc = nullptr;
-									td.ctc = nullptr;
-									for (int j=0;j<stream.attributes().size();j++) {
-										const QXmlStreamAttribute& attr = stream.attributes().at(j);
-										if (attr.name() == "id") {
-											td.id = attr.value().toInt();
-										} else if (attr.name() == "name") {
-											td.name = attr.value().toString();
-										} else if (attr.name() == "length") {
-											td.length = attr.value().toLong();
-										}
-									}
-									transition_data.append(td);
-								} else if (stream.name() == "clip" && stream.isStartElement()) {
-									int media_type = -1;
-									int media_id, stream_id;
-									Clip* c = new Clip(s);
-
-									// backwards compatibility code
-									c->autoscale = false;
-
-									c->media = nullptr;
-
-									for (int j=0;j<stream.attributes().size();j++) {
-										const QXmlStreamAttribute& attr = stream.attributes().at(j);
-										if (attr.name() == "name") {
-											c->name = attr.value().toString();
-										} else if (attr.name() == "enabled") {
-											c->enabled = (attr.value() == "1");
-										} else if (attr.name() == "id") {
-											c->load_id = attr.value().toInt();
-										} else if (attr.name() == "clipin") {
-											c->clip_in = attr.value().toLong();
-										} else if (attr.name() == "in") {
-											c->timeline_in = attr.value().toLong();
-										} else if (attr.name() == "out") {
-											c->timeline_out = attr.value().toLong();
-										} else if (attr.name() == "track") {
-											c->track = attr.value().toInt();
-										} else if (attr.name() == "r") {
-											c->color_r = attr.value().toInt();
-										} else if (attr.name() == "g") {
-											c->color_g = attr.value().toInt();
-										} else if (attr.name() == "b") {
-											c->color_b = attr.value().toInt();
-										} else if (attr.name() == "autoscale") {
-											c->autoscale = (attr.value() == "1");
-										} else if (attr.name() == "media") {
-											media_type = MEDIA_TYPE_FOOTAGE;
-											media_id = attr.value().toInt();
-										} else if (attr.name() == "stream") {
-											stream_id = attr.value().toInt();
-										} else if (attr.name() == "speed") {
-											c->speed = attr.value().toDouble();
-										} else if (attr.name() == "maintainpitch") {
-											c->maintain_audio_pitch = (attr.value() == "1");
-										} else if (attr.name() == "reverse") {
-											c->reverse = (attr.value() == "1");
-										} else if (attr.name() == "opening") {
-											c->opening_transition = attr.value().toInt();
-										} else if (attr.name() == "closing") {
-											c->closing_transition = attr.value().toInt();
-										} else if (attr.name() == "sequence") {
-											media_type = MEDIA_TYPE_SEQUENCE;
-
-											// since we haven't finished loading sequences, we defer linking this until later
-											c->media = nullptr;
-											c->media_stream = attr.value().toInt();
-											loaded_clips.append(c);
-										}
-									}
+void LoadThread::resolve_footage_url(Footage* m) {
+	QString url = m->url;
+	if (!QFileInfo::exists(url)) { // if path is not absolute
+		QString proj_dir_test = proj_dir.absoluteFilePath(url);
+		QString internal_proj_dir_test = internal_proj_dir.absoluteFilePath(url);
+
+		if (QFileInfo::exists(proj_dir_test)) { // if path is relative to the project's current dir
+			m->url = proj_dir_test;
+			qInfo() << "Matched" << url << "relative to project's current directory";
+		} else if (QFileInfo::exists(internal_proj_dir_test)) { // if path is relative to the last directory the project was saved in
+			m->url = internal_proj_dir_test;
+			qInfo() << "Matched" << url << "relative to project's internal directory";
+		} else if (url.contains('%')) {
+			// hack for image sequences (qt won't be able to find the URL with %, but ffmpeg may)
+			m->url = internal_proj_dir_test;
+			qInfo() << "Guess image sequence" << url << "path to project's internal directory";
+		} else {
+			qInfo() << "Failed to match" << url << "to file";
+		}
+	} else {
+		qInfo() << "Matched" << url << "with absolute path";
+	}
+}
 
-									// set media and media stream
-									switch (media_type) {
-									case MEDIA_TYPE_FOOTAGE:
-										if (media_id >= 0) {
-											for (int j=0;j<loaded_media_items.size();j++) {
-												Footage* m = loaded_media_items.at(j)->to_footage();
-												if (m->save_id == media_id) {
-													c->media = loaded_media_items.at(j);
-													c->media_stream = stream_id;
-													break;
-												}
-											}
-										}
-										break;
-									}
+bool LoadThread::load_sequence(QXmlStreamReader& stream) {
+	int folder = 0;
+	Sequence* s = new Sequence();
 
-									// load links and effects
-									while (!cancelled && !(stream.name() == "clip" && stream.isEndElement()) && !stream.atEnd()) {
-										read_next(stream);
-										if (stream.isStartElement()) {
-											if (stream.name() == "linked") {
-												while (!cancelled && !(stream.name() == "linked" && stream.isEndElement()) && !stream.atEnd()) {
-													read_next(stream);
-													if (stream.name() == "link" && stream.isStartElement()) {
-														for (int k=0;k<stream.attributes().size();k++) {
-															const QXmlStreamAttribute& link_attr = stream.attributes().at(k);
-															if (link_attr.name() == "id") {
-																c->linked.append(link_attr.value().toInt());
-																break;
-															}
-														}
-													}
-												}
-												if (cancelled) return false;
-											} else if (stream.isStartElement() && (stream.name() == "effect" || stream.name() == "opening" || stream.name() == "closing")) {
-												// "opening" and "closing" are backwards compatibility code
-												load_effect(stream, c);
-											}
-										}
-									}
-									if (cancelled) return false;
+	// load attributes about sequence
+	for (int j=0;j<stream.attributes().size();j++) {
+		const QXmlStreamAttribute& attr = stream.attributes().at(j);
+		if (attr.name() == "name") {
+			s->name = attr.value().toString();
+		} else if (attr.name() == "folder") {
+			folder = attr.value().toInt();
+		} else if (attr.name() == "id") {
+			s->save_id = attr.value().toInt();
+		} else if (attr.name() == "width") {
+			s->width = attr.value().toInt();
+		} else if (attr.name() == "height") {
+			s->height = attr.value().toInt();
+		} else if (attr.name() == "framerate") {
+			s->frame_rate = attr.value().toDouble();
+		} else if (attr.name() == "afreq") {
+			s->audio_frequency = attr.value().toInt();
+		} else if (attr.name() == "alayout") {
+			s->audio_layout = attr.value().toInt();
+		} else if (attr.name() == "open") {
+			open_seq = s;
+		} else if (attr.name() == "workarea") {
+			s->using_workarea = (attr.value() == "1");
+		} else if (attr.name() == "workareaEnabled") {
+			s->enable_workarea = (attr.value() == "1");
+		} else if (attr.name() == "workareaIn") {
+			s->workarea_in = attr.value().toLong();
+		} else if (attr.name() == "workareaOut") {
+			s->workarea_out = attr.value().toLong();
+		}
+	}
 
-									s->clips.append(c);
-								}
-							}
-							if (cancelled) return false;
-
-							// correct links, clip IDs, transitions
-							for (int i=0;i<s->clips.size();i++) {
-								// correct links
-								Clip* correct_clip = s->clips.at(i);
-								for (int j=0;j<correct_clip->linked.size();j++) {
-									bool found = false;
-									for (int k=0;k<s->clips.size();k++) {
-										if (s->clips.at(k)->load_id == correct_clip->linked.at(j)) {
-											correct_clip->linked[j] = k;
-											found = true;
-											break;
-										}
-									}
-									if (!found) {
-										correct_clip->linked.removeAt(j);
-										j--;
-                                        if (QMessageBox::warning(mainWindow,
-                                                                 tr("Invalid Clip Link"),
-                                                                 tr("This project contains an invalid clip link. It may be corrupt. Would you like to continue loading it?"),
-                                                                 QMessageBox::Yes,
-                                                                 QMessageBox::No) == QMessageBox::No) {
-											delete s;
-											return false;
-										}
-									}
-								}
+	QVector<TransitionData> transition_data;
+	QHash<int, int> transition_map;
+	QHash<int, int> clip_map;
+
+	// load all clips and clip information
+	while (!cancelled && !(stream.name() == "sequence" && stream.isEndElement()) && !stream.atEnd()) {
+		read_next(stream);
+		if (stream.name() == "marker" && stream.isStartElement()) {
+			Marker m;
+			for (int j=0;j<stream.attributes().size();j++) {
+				const QXmlStreamAttribute& attr = stream.attributes().at(j);
+				if (attr.name() == "frame") {
+					m.frame = attr.value().toLong();
+				} else if (attr.name() == "name") {
+					m.name = attr.value().toString();
+				}
+			}
+			s->markers.append(m);
+		} else if (stream.name() == "transition" && stream.isStartElement()) {
+			TransitionData td;
+			td.otc = nullptr;
+			td.ctc = nullptr;
+			for (int j=0;j<stream.attributes().size();j++) {
+				const QXmlStreamAttribute& attr = stream.attributes().at(j);
+				if (attr.name() == "id") {
+					td.id = attr.value().toInt();
+				} else if (attr.name() == "name") {
+					td.name = attr.value().toString();
+				} else if (attr.name() == "length") {
+					td.length = attr.value().toLong();
+				}
+			}
+			transition_map.insert(td.id, transition_data.size());
+			transition_data.append(td);
+		} else if (stream.name() == "clip" && stream.isStartElement()) {
+			int media_id = -1;
+			int stream_id = -1;
+			bool footage_clip = false;
+			Clip* c = new Clip(s);
+
+			// backwards compatibility code
+			c->autoscale = false;
+
+			c->media = nullptr;
+
+			for (int j=0;j<stream.attributes().size();j++) {
+				const QXmlStreamAttribute& attr = stream.attributes().at(j);
+				if (attr.name() == "name") {
+					c->name = attr.value().toString();
+				} else if (attr.name() == "enabled") {
+					c->enabled = (attr.value() == "1");
+				} else if (attr.name() == "id") {
+					c->load_id = attr.value().toInt();
+				} else if (attr.name() == "clipin") {
+					c->clip_in = attr.value().toLong();
+				} else if (attr.name() == "in") {
+					c->timeline_in = attr.value().toLong();
+				} else if (attr.name() == "out") {
+					c->timeline_out = attr.value().toLong();
+				} else if (attr.name() == "track") {
+					c->track = attr.value().toInt();
+				} else if (attr.name() == "r") {
+					c->color_r = attr.value().toInt();
+				} else if (attr.name() == "g") {
+					c->color_g = attr.value().toInt();
+				} else if (attr.name() == "b") {
+					c->color_b = attr.value().toInt();
+				} else if (attr.name() == "autoscale") {
+					c->autoscale = (attr.value() == "1");
+				} else if (attr.name() == "media") {
+					footage_clip = true;
+					media_id = attr.value().toInt();
+				} else if (attr.name() == "stream") {
+					stream_id = attr.value().toInt();
+				} else if (attr.name() == "speed") {
+					c->speed = attr.value().toDouble();
+				} else if (attr.name() == "maintainpitch") {
+					c->maintain_audio_pitch = (attr.value() == "1");
+				} else if (attr.name() == "reverse") {
+					c->reverse = (attr.value() == "1");
+				} else if (attr.name() == "opening") {
+					c->opening_transition = attr.value().toInt();
+				} else if (attr.name() == "closing") {
+					c->closing_transition = attr.value().toInt();
+				} else if (attr.name() == "sequence") {
+					// since we haven't finished loading sequences, we defer linking this until later
+					c->media = nullptr;
+					c->media_stream = attr.value().toInt();
+					loaded_clips.append(c);
+				}
+			}
 
-								// re-link clips to transitions
-								if (correct_clip->opening_transition > -1) {
-									for (int j=0;j<transition_data.size();j++) {
-										if (transition_data.at(j).id == correct_clip->opening_transition) {
-											transition_data[j].otc = correct_clip;
-										}
-									}
-								}
-								if (correct_clip->closing_transition > -1) {
-									for (int j=0;j<transition_data.size();j++) {
-										if (transition_data.at(j).id == correct_clip->closing_transition) {
-											transition_data[j].ctc = correct_clip;
-										}
-									}
-								}
-							}
+			// set media and media stream
+			if (footage_clip && media_id >= 0) {
+				c->media_stream = stream_id;
+				c->media = footage_map.value(media_id, nullptr);
+				if (c->media == nullptr) {
+					// footage is normally saved before sequences, but fix it up later if it wasn't
+					pending_footage_clips.append(qMakePair(c, media_id));
+				}
+			}
 
-							// create transitions
-							for (int i=0;i<transition_data.size();i++) {
-								const TransitionData& td = transition_data.at(i);
-								Clip* primary = td.otc;
-								Clip* secondary = td.ctc;
-								if (primary != nullptr || secondary != nullptr) {
-									if (primary == nullptr) {
-										primary = secondary;
-										secondary = nullptr;
-									}
-									const EffectMeta* meta = get_meta_from_name(td.name);
-									if (meta == nullptr) {
-										qWarning() << "Failed to link transition with name:" << td.name;
-										if (td.otc != nullptr) td.otc->opening_transition = -1;
-										if (td.ctc != nullptr) td.ctc->closing_transition = -1;
-									} else {
-										emit start_create_dual_transition(&td, primary, secondary, meta);
-
-										waitCond.wait(&mutex);
+			// load links and effects
+			while (!cancelled && !(stream.name() == "clip" && stream.isEndElement()) && !stream.atEnd()) {
+				read_next(stream);
+				if (stream.isStartElement()) {
+					if (stream.name() == "linked") {
+						while (!cancelled && !(stream.name() == "linked" && stream.isEndElement()) && !stream.atEnd()) {
+							read_next(stream);
+							if (stream.name() == "link" && stream.isStartElement()) {
+								for (int k=0;k<stream.attributes().size();k++) {
+									const QXmlStreamAttribute& link_attr = stream.attributes().at(k);
+									if (link_attr.name() == "id") {
+										c->linked.append(link_attr.value().toInt());
+										break;
 									}
 								}
 							}
-
-							Media* m = panel_project->new_sequence(nullptr, s, false, parent);
-
-							loaded_sequences.append(m);
-						}
-							break;
 						}
+						if (cancelled) return false;
+					} else if (stream.isStartElement() && (stream.name() == "effect" || stream.name() == "opening" || stream.name() == "closing")) {
+						// "opening" and "closing" are backwards compatibility code
+						load_effect(stream, c);
 					}
 				}
-				if (cancelled) return false;
 			}
-			break;
+			if (cancelled) return false;
+
+			clip_map.insert(c->load_id, s->clips.size());
+			s->clips.append(c);
+		}
+	}
+	if (cancelled) return false;
+
+	// correct links, clip IDs, transitions
+	for (int i=0;i<s->clips.size();i++) {
+		// correct links
+		Clip* correct_clip = s->clips.at(i);
+		for (int j=0;j<correct_clip->linked.size();j++) {
+			int index = clip_map.value(correct_clip->linked.at(j), -1);
+			if (index > -1) {
+				correct_clip->linked[j] = index;
+			} else {
+				correct_clip->linked.removeAt(j);
+				j--;
+                if (QMessageBox::warning(mainWindow,
+                                         tr("Invalid Clip Link"),
+                                         tr("This project contains an invalid clip link. It may be corrupt. Would you like to continue loading it?"),
+                                         QMessageBox::Yes,
+                                         QMessageBox::No) == QMessageBox::No) {
+					delete s;
+					return false;
+				}
+			}
+		}
+
+		// re-link clips to transitions
+		if (correct_clip->opening_transition > -1) {
+			int index = transition_map.value(correct_clip->opening_transition, -1);
+			if (index > -1) transition_data[index].otc = correct_clip;
+		}
+		if (correct_clip->closing_transition > -1) {
+			int index = transition_map.value(correct_clip->closing_transition, -1);
+			if (index > -1) transition_data[index].ctc = correct_clip;
+		}
+	}
+
+	// create transitions
+	for (int i=0;i<transition_data.size();i++) {
+		const TransitionData& td = transition_data.at(i);
+		Clip* primary = td.otc;
+		Clip* secondary = td.ctc;
+		if (primary != nullptr || secondary != nullptr) {
+			if (primary == nullptr) {
+				primary = secondary;
+				secondary = nullptr;
+			}
+			const EffectMeta* meta = get_meta_from_name(td.name);
+			if (meta == nullptr) {
+				qWarning() << "Failed to link transition with name:" << td.name;
+				if (td.otc != nullptr) td.otc->opening_transition = -1;
+				if (td.ctc != nullptr) td.ctc->closing_transition = -1;
+			} else {
+				int transition_index = create_transition(primary, secondary, meta);
+				Transition* t = primary->sequence->transitions.at(transition_index);
+				t->set_length(td.length);
+				move_effect_to_gui_thread(t);
+				if (td.otc != nullptr) td.otc->opening_transition = transition_index;
+				if (td.ctc != nullptr) td.ctc->closing_transition = transition_index;
+			}
+		}
+	}
+
+	// the sequence is added to the project once its parent folder is guaranteed to exist
+	loaded_sequences.append(qMakePair(s, folder));
+
+	return true;
+}
+
+bool LoadThread::load_project(QXmlStreamReader& stream) {
+	// single pass over the file, everything that refers forward is fixed up afterwards in attach_loaded_items()
+	while (!cancelled && !stream.atEnd()) {
+		read_next(stream);
+		if (stream.isStartElement()) {
+			if (stream.name() == "version") {
+				if (!load_version(stream)) return false;
+			} else if (stream.name() == "url") {
+				internal_proj_url = stream.readElementText();
+				internal_proj_dir = QFileInfo(internal_proj_url).absoluteDir();
+			} else if (stream.name() == "folder") {
+				load_folder(stream);
+			} else if (stream.name() == "footage") {
+				load_footage(stream);
+			} else if (stream.name() == "sequence") {
+				if (!load_sequence(stream)) return false;
+			}
 		}
 	}
 	return !cancelled;
@@ -513,18 +487,48 @@ bool LoadThread::load_worker(QFile& f, QXmlStreamReader& stream, int type) {
 
 Media* LoadThread::find_loaded_folder_by_id(int id) {
 	if (id == 0) return nullptr;
-	for (int j=0;j<loaded_folders.size();j++) {
-		Media* parent_item = loaded_folders.at(j);
-		if (parent_item->temp_id == id) {
-			return parent_item;
+	return folder_map.value(id, nullptr);
+}
+
+void LoadThread::attach_loaded_items() {
+	// organize folders
+	for (int i=0;i<loaded_folders.size();i++) {
+		Media* folder = loaded_folders.at(i);
+		Media* parent = find_loaded_folder_by_id(folder->temp_id2);
+		if (parent == nullptr) {
+			project_model.appendChild(nullptr, folder);
+		} else {
+			parent->appendChild(folder);
 		}
 	}
-	return nullptr;
+
+	// place footage in its folders
+	for (int i=0;i<loaded_media_items.size();i++) {
+		Media* item = loaded_media_items.at(i);
+		resolve_footage_url(item->to_footage());
+
+		Media* parent = find_loaded_folder_by_id(item->temp_id2);
+		if (parent == nullptr) {
+			project_model.appendChild(nullptr, item);
+		} else {
+			parent->appendChild(item);
+		}
+	}
+
+	// link clips whose footage appeared after them in the file
+	for (int i=0;i<pending_footage_clips.size();i++) {
+		pending_footage_clips.at(i).first->media = footage_map.value(pending_footage_clips.at(i).second, nullptr);
+	}
+
+	// add sequences to the project
+	for (int i=0;i<loaded_sequences.size();i++) {
+		Sequence* s = loaded_sequences.at(i).first;
+		Media* m = panel_project->new_sequence(nullptr, s, false, find_loaded_folder_by_id(loaded_sequences.at(i).second));
+		sequence_map.insert(s->save_id, m);
+	}
 }
 
 void LoadThread::run() {
-	mutex.lock();
-
 	QFile file(project_url);
 	if (!file.open(QIODevice::ReadOnly)) {
 		qCritical() << "Could not open file";
@@ -542,9 +546,9 @@ void LoadThread::run() {
 
 	QXmlStreamReader stream(&file);
 
-	bool cont = false;
 	error_str.clear();
 	show_err = true;
+	last_progress = -1;
 
 	// temp variables for loading (unnecessary?)
 	open_seq = nullptr;
@@ -552,49 +556,15 @@ void LoadThread::run() {
 	loaded_media_items.clear();
 	loaded_clips.clear();
 	loaded_sequences.clear();
+	pending_footage_clips.clear();
+	folder_map.clear();
+	footage_map.clear();
+	sequence_map.clear();
 
-	// get "element" count
-	current_element_count = 0;
-	total_element_count = 0;
-	while (!cancelled && !stream.atEnd()) {
-		stream.readNextStartElement();
-		if (is_element(stream)) {
-			total_element_count++;
-		}
-	}
-	cont = !cancelled;
-
-	// find project file version
-	cont = load_worker(file, stream, LOAD_TYPE_VERSION);
+	bool cont = load_project(stream);
 
-	// find project's internal URL
-	cont = load_worker(file, stream, LOAD_TYPE_URL);
-
-	// load folders first
-	if (cont) {
-		cont = load_worker(file, stream, MEDIA_TYPE_FOLDER);
-	}
-
-	// load media
-	if (cont) {
-		// since folders loaded correctly, organize them appropriately
-		for (int i=0;i<loaded_folders.size();i++) {
-			Media* folder = loaded_folders.at(i);
-			int parent = folder->temp_id2;
-			if (folder->temp_id2 == 0) {
-				project_model.appendChild(nullptr, folder);
-			} else {
-				find_loaded_folder_by_id(parent)->appendChild(folder);
-			}
-		}
-
-		cont = load_worker(file, stream, MEDIA_TYPE_FOOTAGE);
-	}
-
-	// load sequences
-	if (cont) {
-		cont = load_worker(file, stream, MEDIA_TYPE_SEQUENCE);
-	}
+	// attach whatever was loaded so it gets cleaned up with the project if loading failed
+	attach_loaded_items();
 
 	if (!cancelled) {
 		if (!cont) {
@@ -609,12 +579,10 @@ void LoadThread::run() {
 		} else {
 			// attach nested sequence clips to their sequences
 			for (int i=0;i<loaded_clips.size();i++) {
-				for (int j=0;j<loaded_sequences.size();j++) {
-					if (loaded_clips.at(i)->media == nullptr && loaded_clips.at(i)->media_stream == loaded_sequences.at(j)->to_sequence()->save_id) {
-						loaded_clips.at(i)->media = loaded_sequences.at(j);
-						loaded_clips.at(i)->refresh();
-						break;
-					}
+				Clip* c = loaded_clips.at(i);
+				if (c->media == nullptr) {
+					c->media = sequence_map.value(c->media_stream, nullptr);
+					if (c->media != nullptr) c->refresh();
 				}
 			}
 		}
@@ -629,12 +597,9 @@ void LoadThread::run() {
 	}
 
 	file.close();
-
-	mutex.unlock();
 }
 
 void LoadThread::cancel() {
-	waitCond.wakeAll();
 	cancelled = true;
 }
 
@@ -674,76 +639,36 @@ void LoadThread::success_func() {
 	}
 
 	mainWindow->setWindowModified(autorecovery);
+	precompile_shaders();
 	if (open_seq != nullptr) set_sequence(open_seq);
 	update_ui(false);
 }
 
-void LoadThread::create_effect_ui(
-		QXmlStreamReader* stream,
-		Clip* c,
-		int type,
-		const QString* effect_name,
-		const EffectMeta* meta,
-		long effect_length,
-		bool effect_enabled)
-{
-	/* This is extremely hacky - prepare yourself.
-	 *
-	 * When moving project loading to a separate thread, it was soon discovered
-	 * that effects wouldn't load correctly anymore. They were actually still
-	 * "functional", but there were no controls appearing in EffectControls.
-	 *
-	 * Turns out since Effect creates its UI in its constructor, the UI was
-	 * created in this thread rather than the main GUI thread, which is a big
-	 * no-no. Unfortunately the design of Effect does not separate UI and data,
-	 * so having the UI set up was integral to creating annd loading the effect.
-	 *
-	 * Therefore, rather than rewrite the class (I just rewrote QTreeWidget to
-	 * QTreeView with a custom model/item so I'm exhausted), for
-	 * quick-n-dirty-ness, I made LoadThread offload the effect creation to the
-	 * main thread (and since the effect loads data from the same XML stream,
-	 * the LoadThread has to wait for the effect to finish before it can
-	 * continue.
-	 *
-	 * Sorry. I'll fix it one day.
-	 */
-
-	if (cancelled) return;
-	if (type == TA_NO_TRANSITION) {
-		if (meta == nullptr) {
-			// create void effect
-			VoidEffect* ve = new VoidEffect(c, *effect_name);
-			ve->set_enabled(effect_enabled);
-			ve->load(*stream);
-			c->effects.append(ve);
-		} else {
-			Effect* e = create_effect(c, meta);
-			e->set_enabled(effect_enabled);
-			e->load(*stream);
-
-			c->effects.append(e);
+void LoadThread::precompile_shaders() {
+	// compile effect shaders now rather than on the first frame that needs them. the viewer composites in its render
+	// thread's context, so that's where the programs have to be built
+	RenderThread* renderer = panel_sequence_viewer->viewer_widget->renderer;
+	if (renderer == nullptr) return;
+
+	QVector< QPair<QString, QString> > shaders;
+	QString vert, frag;
+	for (int i=0;i<loaded_sequences.size();i++) {
+		Sequence* s = loaded_sequences.at(i).first;
+		for (int j=0;j<s->clips.size();j++) {
+			Clip* c = s->clips.at(j);
+			if (c == nullptr) continue;
+			for (int k=0;k<c->effects.size();k++) {
+				if (c->effects.at(k)->get_shader_files(vert, frag) && !shaders.contains(qMakePair(vert, frag))) {
+					shaders.append(qMakePair(vert, frag));
+				}
+			}
 		}
-	} else {
-		int transition_index = create_transition(c, nullptr, meta);
-		Transition* t = c->sequence->transitions.at(transition_index);
-		if (effect_length > -1) t->set_length(effect_length);
-		t->set_enabled(effect_enabled);
-		t->load(*stream);
-
-		if (type == TA_OPENING_TRANSITION) {
-			c->opening_transition = transition_index;
-		} else {
-			c->closing_transition = transition_index;
+		for (int j=0;j<s->transitions.size();j++) {
+			Transition* t = s->transitions.at(j);
+			if (t != nullptr && t->get_shader_files(vert, frag) && !shaders.contains(qMakePair(vert, frag))) {
+				shaders.append(qMakePair(vert, frag));
+			}
 		}
 	}
-
-	waitCond.wakeAll();
-}
-
-void LoadThread::create_dual_transition(const TransitionData* td, Clip* primary, Clip* secondary, const EffectMeta* meta) {
-	int transition_index = create_transition(primary, secondary, meta);
-	primary->sequence->transitions.at(transition_index)->set_length(td->length);
-	if (td->otc != nullptr) td->otc->opening_transition = transition_index;
-	if (td->ctc != nullptr) td->ctc->closing_transition = transition_index;
-	waitCond.wakeAll();
+	renderer->precompile(shaders);
 }
@@ -4,16 +4,14 @@
 #include <QThread>
 #include <QDir>
 #include <QXmlStreamReader>
-#include <QMutex>
-#include <QWaitCondition>
+#include <QHash>
+#include <QPair>
 
 class Media;
 struct Footage;
 struct Clip;
 struct Sequence;
 class LoadDialog;
-struct TransitionData;
-struct EffectMeta;
 
 class LoadThread : public QThread
 {
@@ -25,24 +23,26 @@ public:
 signals:
 	void success();
 	void error();
-	void start_create_effect_ui(QXmlStreamReader* stream, Clip* c, int type, const QString *effect_name, const EffectMeta* meta, long effect_length, bool effect_enabled);
-	void start_create_dual_transition(const TransitionData* td, Clip* primary, Clip* secondary, const EffectMeta* meta);
 	void report_progress(int p);
 private slots:
 	void error_func();
 	void success_func();
-	void create_effect_ui(QXmlStreamReader* stream, Clip* c, int type, const QString *effect_name, const EffectMeta* meta, long effect_length, bool effect_enabled);
-	void create_dual_transition(const TransitionData* td, Clip* primary, Clip* secondary, const EffectMeta* meta);
 private:
 	LoadDialog* ld;
 	bool autorecovery;
 
-	bool load_worker(QFile& f, QXmlStreamReader& stream, int type);
+	bool load_project(QXmlStreamReader& stream);
+	bool load_version(QXmlStreamReader& stream);
+	void load_folder(QXmlStreamReader& stream);
+	void load_footage(QXmlStreamReader& stream);
+	bool load_sequence(QXmlStreamReader& stream);
 	void load_effect(QXmlStreamReader& stream, Clip* c);
+	void resolve_footage_url(Footage* m);
+	void attach_loaded_items();
+	void precompile_shaders();
 
 	void read_next(QXmlStreamReader& stream);
-	void read_next_start_element(QXmlStreamReader& stream);
-	void update_current_element_count(QXmlStreamReader& stream);
+	void update_progress(QXmlStreamReader& stream);
 
 	Sequence* open_seq;
 	QVector<Media*> loaded_media_items;
@@ -52,18 +52,16 @@ private:
 	bool show_err;
 	QString error_str;
 
-	bool is_element(QXmlStreamReader& stream);
-
 	QVector<Media*> loaded_folders;
 	QVector<Clip*> loaded_clips;
-	QVector<Media*> loaded_sequences;
+	QVector< QPair<Sequence*, int> > loaded_sequences;
+	QVector< QPair<Clip*, int> > pending_footage_clips;
+	QHash<int, Media*> folder_map;
+	QHash<int, Media*> footage_map;
+	QHash<int, Media*> sequence_map;
 	Media* find_loaded_folder_by_id(int id);
 
-	int current_element_count;
-	int total_element_count;
-
-	QMutex mutex;
-	QWaitCondition waitCond;
+	int last_progress;
 
 	bool cancelled;
 	bool xml_error;
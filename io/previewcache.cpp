@@ -0,0 +1,377 @@
+#include "previewcache.h"
+
+#include <QDateTime>
+#include <QSaveFile>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QMutexLocker>
+#include <QVector>
+#include <QPair>
+
+#include <algorithm>
+#include <cstddef>
+
+#include "debug.h"
+
+#define PREVIEW_CACHE_MAGIC "OLVPRVWC"
+#define PREVIEW_CACHE_VERSION 1
+#define PREVIEW_CACHE_RECORD_MAGIC 0x5256504F // "OPVR"
+
+// only bother compacting when there's at least this much dead space in the file
+#define PREVIEW_CACHE_MIN_COMPACT 16777216
+
+PreviewCache preview_cache;
+
+struct PreviewCacheHeader {
+	char magic[8];
+	quint32 version;
+	quint32 reserved;
+};
+
+struct PreviewCacheRecord {
+	quint32 magic;
+	quint32 key_size;
+	qint64 data_size;
+	qint64 last_used;
+	quint8 dead;
+	quint8 reserved[7];
+};
+
+PreviewCache::PreviewCache() :
+	map(nullptr),
+	map_size(0),
+	live_bytes(0),
+	dead_bytes(0),
+	budget(0)
+{}
+
+PreviewCache::~PreviewCache() {
+	close();
+}
+
+bool PreviewCache::open(const QString& filename, qint64 b) {
+	QWriteLocker locker(&lock);
+
+	file_name = filename;
+	budget = b;
+
+	file.setFileName(file_name);
+	if (!file.open(QFile::ReadWrite)) {
+		qWarning() << "Failed to open preview cache" << file_name;
+		return false;
+	}
+
+	// start over if the file is new or was written by an incompatible version
+	PreviewCacheHeader header;
+	bool valid = (file.read(reinterpret_cast<char*>(&header), sizeof(header)) == sizeof(header)
+				  && memcmp(header.magic, PREVIEW_CACHE_MAGIC, sizeof(header.magic)) == 0
+				  && header.version == PREVIEW_CACHE_VERSION);
+	if (!valid) {
+		memcpy(header.magic, PREVIEW_CACHE_MAGIC, sizeof(header.magic));
+		header.version = PREVIEW_CACHE_VERSION;
+		header.reserved = 0;
+		file.resize(0);
+		file.seek(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.flush();
+	}
+
+	remap();
+	scan();
+	evict();
+
+	return true;
+}
+
+void PreviewCache::close() {
+	QWriteLocker locker(&lock);
+	if (file.isOpen()) {
+		flush_usage();
+		if (map != nullptr) {
+			file.unmap(map);
+			map = nullptr;
+			map_size = 0;
+		}
+		file.close();
+	}
+	clear_index();
+}
+
+void PreviewCache::set_budget(qint64 bytes) {
+	QWriteLocker locker(&lock);
+	budget = bytes;
+	if (file.isOpen()) evict();
+}
+
+qint64 PreviewCache::get_size() {
+	QReadLocker locker(&lock);
+	return live_bytes;
+}
+
+bool PreviewCache::contains(const QString& hash, char type, int stream) {
+	QReadLocker locker(&lock);
+	return index.contains(make_key(hash, type, stream));
+}
+
+bool PreviewCache::read(const QString& hash, char type, int stream, QByteArray& data) {
+	QReadLocker locker(&lock);
+
+	Entry* e = index.value(make_key(hash, type, stream));
+	if (e == nullptr) return false;
+
+	if (map != nullptr) {
+		data = QByteArray(reinterpret_cast<const char*>(map + e->data_offset), e->data_size);
+	} else {
+		QMutexLocker file_locker(&file_lock);
+		file.seek(e->data_offset);
+		data = file.read(e->data_size);
+		if (data.size() != e->data_size) return false;
+	}
+
+	usage_lock.lock();
+	e->last_used = QDateTime::currentMSecsSinceEpoch();
+	usage_lock.unlock();
+
+	return true;
+}
+
+void PreviewCache::write(const QString& hash, char type, int stream, const QByteArray& data) {
+	QWriteLocker locker(&lock);
+	if (!file.isOpen()) return;
+
+	QByteArray key = make_key(hash, type, stream);
+
+	// replacing a record just orphans the old one, compact() reclaims the space later
+	Entry* old = index.take(key);
+	if (old != nullptr) {
+		mark_dead(old);
+		delete old;
+	}
+
+	PreviewCacheRecord record;
+	memset(&record, 0, sizeof(record));
+	record.magic = PREVIEW_CACHE_RECORD_MAGIC;
+	record.key_size = key.size();
+	record.data_size = data.size();
+	record.last_used = QDateTime::currentMSecsSinceEpoch();
+
+	Entry* e = new Entry();
+	e->offset = file.size();
+	e->data_offset = e->offset + sizeof(record) + key.size();
+	e->data_size = data.size();
+	e->record_size = e->data_offset + e->data_size - e->offset;
+	e->last_used = record.last_used;
+
+	file.seek(e->offset);
+	if (file.write(reinterpret_cast<const char*>(&record), sizeof(record)) != sizeof(record)
+			|| file.write(key) != key.size()
+			|| file.write(data) != data.size()) {
+		qWarning() << "Failed to write to preview cache";
+		file.resize(e->offset);
+		delete e;
+		return;
+	}
+	file.flush();
+
+	index.insert(key, e);
+	live_bytes += e->record_size;
+
+	remap();
+	evict();
+}
+
+QByteArray PreviewCache::make_key(const QString& hash, char type, int stream) {
+	QByteArray key = hash.toLatin1();
+	key.append(type);
+	key.append(QByteArray::number(stream));
+	return key;
+}
+
+void PreviewCache::remap() {
+	if (map != nullptr) {
+		file.unmap(map);
+		map = nullptr;
+	}
+	map_size = file.size();
+	map = file.map(0, map_size);
+	if (map == nullptr) {
+		// fall back to regular reads (e.g. address space exhausted on 32-bit builds)
+		map_size = 0;
+	}
+}
+
+void PreviewCache::scan() {
+	clear_index();
+
+	qint64 file_size = file.size();
+	qint64 offset = sizeof(PreviewCacheHeader);
+	while (offset + (qint64) sizeof(PreviewCacheRecord) <= file_size) {
+		PreviewCacheRecord record;
+		if (map != nullptr) {
+			memcpy(&record, map + offset, sizeof(record));
+		} else {
+			file.seek(offset);
+			file.read(reinterpret_cast<char*>(&record), sizeof(record));
+		}
+
+		qint64 record_size = sizeof(record) + record.key_size + record.data_size;
+		if (record.magic != PREVIEW_CACHE_RECORD_MAGIC || record.data_size < 0 || offset + record_size > file_size) {
+			// most likely a write that was interrupted, drop everything from here on
+			qWarning() << "Preview cache is truncated at" << offset << "- discarding remainder";
+			break;
+		}
+
+		if (record.dead) {
+			dead_bytes += record_size;
+		} else {
+			QByteArray key;
+			if (map != nullptr) {
+				key = QByteArray(reinterpret_cast<const char*>(map + offset + sizeof(record)), record.key_size);
+			} else {
+				key = file.read(record.key_size);
+			}
+
+			Entry* e = new Entry();
+			e->offset = offset;
+			e->record_size = record_size;
+			e->data_offset = offset + sizeof(record) + record.key_size;
+			e->data_size = record.data_size;
+			e->last_used = record.last_used;
+
+			Entry* old = index.value(key);
+			if (old != nullptr) {
+				mark_dead(old);
+				delete old;
+			}
+			index.insert(key, e);
+			live_bytes += record_size;
+		}
+
+		offset += record_size;
+	}
+
+	if (offset < file_size) {
+		file.resize(offset);
+		remap();
+	}
+}
+
+void PreviewCache::mark_dead(Entry* e) {
+	quint8 dead = 1;
+	file.seek(e->offset + offsetof(PreviewCacheRecord, dead));
+	file.write(reinterpret_cast<const char*>(&dead), sizeof(dead));
+	live_bytes -= e->record_size;
+	dead_bytes += e->record_size;
+}
+
+void PreviewCache::evict() {
+	if (budget > 0 && live_bytes > budget) {
+		// drop the least recently used records until we're back under budget
+		QVector< QPair<qint64, QByteArray> > usage;
+		usage.reserve(index.size());
+		for (QHash<QByteArray, Entry*>::const_iterator it = index.constBegin();it != index.constEnd();it++) {
+			usage.append(QPair<qint64, QByteArray>(it.value()->last_used, it.key()));
+		}
+		std::sort(usage.begin(), usage.end());
+
+		int evicted = 0;
+		for (int i=0;i<usage.size() && live_bytes > budget;i++) {
+			Entry* e = index.take(usage.at(i).second);
+			mark_dead(e);
+			delete e;
+			evicted++;
+		}
+		file.flush();
+
+		dout << "[INFO] Evicted" << evicted << "records from preview cache";
+	}
+
+	if (dead_bytes > PREVIEW_CACHE_MIN_COMPACT && dead_bytes > live_bytes) {
+		compact();
+	}
+}
+
+void PreviewCache::compact() {
+	// copy every live record into a fresh file that atomically replaces the old one, which stays as it was if
+	// anything fails
+	QSaveFile compacted(file_name);
+	if (!compacted.open(QFile::WriteOnly)) {
+		qWarning() << "Failed to compact preview cache";
+		return;
+	}
+
+	PreviewCacheHeader header;
+	memcpy(header.magic, PREVIEW_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PREVIEW_CACHE_VERSION;
+	header.reserved = 0;
+	compacted.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	bool ok = true;
+	for (QHash<QByteArray, Entry*>::iterator it = index.begin();it != index.end() && ok;it++) {
+		Entry* e = it.value();
+
+		PreviewCacheRecord record;
+		memset(&record, 0, sizeof(record));
+		record.magic = PREVIEW_CACHE_RECORD_MAGIC;
+		record.key_size = it.key().size();
+		record.data_size = e->data_size;
+		record.last_used = e->last_used;
+
+		QByteArray data;
+		if (map != nullptr) {
+			data = QByteArray::fromRawData(reinterpret_cast<const char*>(map + e->data_offset), e->data_size);
+		} else {
+			file.seek(e->data_offset);
+			data = file.read(e->data_size);
+		}
+
+		qint64 new_offset = compacted.pos();
+		ok = (compacted.write(reinterpret_cast<const char*>(&record), sizeof(record)) == sizeof(record)
+			  && compacted.write(it.key()) == it.key().size()
+			  && compacted.write(data) == data.size());
+
+		e->offset = new_offset;
+		e->data_offset = new_offset + sizeof(record) + record.key_size;
+	}
+
+	// the old file can't be replaced while it's open on every platform
+	if (map != nullptr) {
+		file.unmap(map);
+		map = nullptr;
+	}
+	file.close();
+
+	if (ok) {
+		ok = compacted.commit();
+	} else {
+		compacted.cancelWriting();
+	}
+
+	file.setFileName(file_name);
+	file.open(QFile::ReadWrite);
+	remap();
+
+	if (ok) {
+		dead_bytes = 0;
+	} else {
+		// offsets no longer match whatever is on disk, so rebuild the index from the file
+		qWarning() << "Failed to compact preview cache";
+		scan();
+	}
+}
+
+void PreviewCache::flush_usage() {
+	// persist last used times so eviction order survives restarts
+	for (QHash<QByteArray, Entry*>::const_iterator it = index.constBegin();it != index.constEnd();it++) {
+		file.seek(it.value()->offset + offsetof(PreviewCacheRecord, last_used));
+		file.write(reinterpret_cast<const char*>(&it.value()->last_used), sizeof(qint64));
+	}
+	file.flush();
+}
+
+void PreviewCache::clear_index() {
+	qDeleteAll(index);
+	index.clear();
+	live_bytes = 0;
+	dead_bytes = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef PREVIEWCACHE_H
+#define PREVIEWCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QFile>
+#include <QMutex>
+#include <QReadWriteLock>
+
+#define PREVIEW_CACHE_FILENAME "previews.cache"
+
+#define PREVIEW_CACHE_THUMBNAIL 't'
+#define PREVIEW_CACHE_WAVEFORM 'w'
+#define PREVIEW_CACHE_SEEK_INDEX 'k'
+
+/*
+ * Single-file store for everything PreviewGenerator produces (thumbnails, waveform mipmaps and keyframe
+ * indexes). Records are appended to one file that is memory-mapped for reading, an in-memory index gives
+ * cheap existence checks, and the least recently used records are evicted once the store exceeds its budget.
+ * Safe to use from any number of preview jobs at once.
+ */
+class PreviewCache {
+public:
+	PreviewCache();
+	~PreviewCache();
+
+	bool open(const QString& filename, qint64 budget);
+	void close();
+	void set_budget(qint64 bytes);
+	qint64 get_size();
+
+	bool contains(const QString& hash, char type, int stream);
+	bool read(const QString& hash, char type, int stream, QByteArray& data);
+	void write(const QString& hash, char type, int stream, const QByteArray& data);
+private:
+	struct Entry {
+		qint64 offset;
+		qint64 record_size;
+		qint64 data_offset;
+		qint64 data_size;
+		qint64 last_used;
+	};
+
+	QByteArray make_key(const QString& hash, char type, int stream);
+	void remap();
+	void scan();
+	void mark_dead(Entry* e);
+	void evict();
+	void compact();
+	void flush_usage();
+	void clear_index();
+
+	QString file_name;
+	QFile file;
+	uchar* map;
+	qint64 map_size;
+	QHash<QByteArray, Entry*> index;
+	qint64 live_bytes;
+	qint64 dead_bytes;
+	qint64 budget;
+
+	// guards the file and index, reads share it and writes/eviction take it exclusively
+	QReadWriteLock lock;
+
+	// guards last_used stamps, which readers update while sharing the lock above
+	QMutex usage_lock;
+
+	// guards file reads when the store couldn't be mapped
+	QMutex file_lock;
+};
+
+extern PreviewCache preview_cache;
+
+#endif // PREVIEWCACHE_H
@@ -6,17 +6,22 @@
 #include "panels/project.h"
 #include "io/config.h"
 #include "io/path.h"
+#include "io/previewcache.h"
 #include "debug.h"
 
 #include <QPainter>
 #include <QPixmap>
 #include <QtMath>
 #include <QTreeWidgetItem>
-#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 #include <QCryptographicHash>
 #include <QFile>
 #include <QDir>
 #include <QDateTime>
+#include <QDataStream>
+
+#include <algorithm>
 
 #define WAVEFORM_RESOLUTION 64
 
@@ -27,25 +32,147 @@ extern "C" {
 #include <libswresample/swresample.h>
 }
 
-QSemaphore sem(5); // only 5 preview generators can run at one time
+static QThreadPool* create_preview_pool() {
+	QThreadPool* pool = new QThreadPool();
+	pool->setMaxThreadCount(QThread::idealThreadCount());
+	return pool;
+}
+
+QThreadPool* get_preview_pool() {
+	static QThreadPool* preview_pool = create_preview_pool();
+	return preview_pool;
+}
+
+QThreadPool* get_probe_pool() {
+	static QThreadPool* probe_pool = create_preview_pool();
+	return probe_pool;
+}
+
+// pulls the next decoded frame of a single stream, returns false at the end of the stream or on error
+static bool decode_next_frame(AVFormatContext* fmt_ctx, AVCodecContext* codec_ctx, int stream_index, AVPacket* packet, AVFrame* frame, bool* flushing) {
+	while (true) {
+		int receive_ret = avcodec_receive_frame(codec_ctx, frame);
+		if (receive_ret == 0) return true;
+		if (receive_ret != AVERROR(EAGAIN) || *flushing) return false;
+
+		int read_ret = av_read_frame(fmt_ctx, packet);
+		if (read_ret < 0) {
+			if (read_ret != AVERROR_EOF) qCritical() << "Failed to read packet for preview generation" << read_ret;
+
+			// drain whatever the decoder is still holding on to
+			*flushing = true;
+			avcodec_send_packet(codec_ctx, nullptr);
+		} else {
+			if (packet->stream_index == stream_index) {
+				int send_ret = avcodec_send_packet(codec_ctx, packet);
+				if (send_ret < 0 && send_ret != AVERROR(EAGAIN)) {
+					qCritical() << "Failed to send packet for preview generation - aborting" << send_ret;
+					av_packet_unref(packet);
+					return false;
+				}
+			}
+			av_packet_unref(packet);
+		}
+	}
+}
+
+// thumbnails are stored raw so loading them back is a memcpy rather than a PNG decode
+static QByteArray serialize_thumbnail(const QImage& img) {
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << (qint32) img.width() << (qint32) img.height() << (qint32) img.bytesPerLine();
+	stream.writeRawData(reinterpret_cast<const char*>(img.constBits()), img.bytesPerLine()*img.height());
+	return data;
+}
+
+static bool deserialize_thumbnail(const QByteArray& data, QImage& img) {
+	QDataStream stream(data);
+	qint32 width, height, bytes_per_line;
+	stream >> width >> height >> bytes_per_line;
+	if (stream.status() != QDataStream::Ok || width <= 0 || height <= 0) return false;
+	img = QImage(width, height, QImage::Format_RGBA8888);
+	if (img.bytesPerLine() != bytes_per_line) return false;
+	return (stream.readRawData(reinterpret_cast<char*>(img.bits()), bytes_per_line*height) == bytes_per_line*height);
+}
+
+static QByteArray serialize_waveform(const FootageStream& ms) {
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << (qint32) (ms.audio_preview_mipmaps.size() + 1);
+	stream << (qint32) ms.audio_preview.size();
+	stream.writeRawData(ms.audio_preview.constData(), ms.audio_preview.size());
+	for (int i=0;i<ms.audio_preview_mipmaps.size();i++) {
+		const QVector<char>& level = ms.audio_preview_mipmaps.at(i);
+		stream << (qint32) level.size();
+		stream.writeRawData(level.constData(), level.size());
+	}
+	return data;
+}
+
+static bool deserialize_waveform(const QByteArray& data, FootageStream& ms) {
+	QDataStream stream(data);
+	qint32 level_count;
+	stream >> level_count;
+	if (stream.status() != QDataStream::Ok || level_count < 1) return false;
+	ms.audio_preview_mipmaps.resize(level_count - 1);
+	for (int i=0;i<level_count;i++) {
+		QVector<char>& level = (i == 0) ? ms.audio_preview : ms.audio_preview_mipmaps[i-1];
+		qint32 size;
+		stream >> size;
+		if (stream.status() != QDataStream::Ok || size < 0) return false;
+		level.resize(size);
+		if (stream.readRawData(level.data(), size) != size) return false;
+	}
+	return true;
+}
+
+PreviewJob::PreviewJob(PreviewGenerator* g, FootageStream* s, int t) :
+	gen(g),
+	stream(s),
+	type(t)
+{
+}
+
+void PreviewJob::run() {
+	// once started the job can't be re-queued or pulled anymore
+	gen->jobs_lock.lock();
+	gen->jobs.removeOne(this);
+	gen->jobs_lock.unlock();
+
+	if (!gen->cancelled) {
+		switch (type) {
+		case PREVIEW_JOB_THUMBNAIL: gen->generate_thumbnail(stream); break;
+		case PREVIEW_JOB_WAVEFORM: gen->generate_waveform(stream); break;
+		case PREVIEW_JOB_SEEK_INDEX: gen->generate_seek_index(stream); break;
+		}
+	}
+	gen->job_finished();
+}
+
+int PreviewJob::get_priority(int generator_priority) {
+	// seek indexes aren't visible, so they yield to thumbnails and waveforms
+	return (type == PREVIEW_JOB_SEEK_INDEX) ? generator_priority - 1 : generator_priority;
+}
 
 PreviewGenerator::PreviewGenerator(Media* i, Footage* m, bool r) :
-	QThread(0),
 	fmt_ctx(nullptr),
 	media(i),
 	footage(m),
 	retrieve_duration(false),
 	contains_still_image(false),
 	replace(r),
-	cancelled(false)
+	cancelled(false),
+	error(false),
+	priority(PREVIEW_PRIORITY_NORMAL),
+	pending(1),
+	done(false)
 {
-	data_path = get_data_path() + "/previews";
-	QDir data_dir(data_path);
-	if (!data_dir.exists()) {
-		data_dir.mkpath(".");
-	}
+	// released with deleteLater() once the last job is done
+	setAutoDelete(false);
+}
 
-	connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
+void PreviewGenerator::start() {
+	get_probe_pool()->start(this, priority);
 }
 
 void PreviewGenerator::parse_media() {
@@ -96,7 +223,7 @@ void PreviewGenerator::parse_media() {
 				ms.video_width = fmt_ctx->streams[i]->codecpar->width;
 				ms.video_height = fmt_ctx->streams[i]->codecpar->height;
 
-				// default value, we get the true value later in generate_waveform()
+				// default value, we get the true value later in generate_thumbnail()
 				ms.video_auto_interlacing = VIDEO_PROGRESSIVE;
 				ms.video_interlacing = VIDEO_PROGRESSIVE;
 
@@ -130,59 +257,109 @@ void PreviewGenerator::parse_media() {
 	}
 }
 
-bool PreviewGenerator::retrieve_preview(const QString& hash) {
-	// returns true if generate_waveform must be run, false if we got all previews from cached files
-	if (retrieve_duration) {
-		//dout << "[NOTE] " << media->name << "needs to retrieve duration";
-		return true;
+void PreviewGenerator::retrieve_duration_from_packets() {
+	// demux (but don't decode) the whole file and use the furthest timestamp of any stream as the duration
+	int64_t* stream_end = new int64_t[fmt_ctx->nb_streams];
+	int64_t* packet_counts = new int64_t[fmt_ctx->nb_streams]{0};
+	for (unsigned int i=0;i<fmt_ctx->nb_streams;i++) {
+		stream_end[i] = AV_NOPTS_VALUE;
 	}
 
+	AVPacket* packet = av_packet_alloc();
+	while (!cancelled && av_read_frame(fmt_ctx, packet) >= 0) {
+		int64_t ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+		if (ts != AV_NOPTS_VALUE) {
+			ts += packet->duration;
+			if (stream_end[packet->stream_index] == AV_NOPTS_VALUE || ts > stream_end[packet->stream_index]) {
+				stream_end[packet->stream_index] = ts;
+			}
+		}
+		packet_counts[packet->stream_index]++;
+		av_packet_unref(packet);
+	}
+	av_packet_free(&packet);
+
+	footage->length = 0;
+	for (unsigned int i=0;i<fmt_ctx->nb_streams;i++) {
+		AVStream* stream = fmt_ctx->streams[i];
+		int64_t stream_length = 0;
+		if (stream_end[i] != AV_NOPTS_VALUE) {
+			int64_t start = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+			stream_length = av_rescale_q(stream_end[i] - start, stream->time_base, AV_TIME_BASE_Q);
+		} else if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && stream->avg_frame_rate.num > 0) {
+			// no usable timestamps, fall back to counting packets
+			stream_length = (double) packet_counts[i] / av_q2d(stream->avg_frame_rate) * AV_TIME_BASE;
+		}
+		footage->length = qMax(footage->length, stream_length);
+	}
+
+	delete [] packet_counts;
+	delete [] stream_end;
+}
+
+bool PreviewGenerator::retrieve_preview(const QString& hash) {
+	// returns true if any stream still needs something generated, false if we got everything from the cache
 	bool found = true;
+	QByteArray data;
+	missing_seek_indexes.clear();
 	for (int i=0;i<footage->video_tracks.size();i++) {
 		FootageStream& ms = footage->video_tracks[i];
-		QString thumb_path = get_thumbnail_path(hash, ms);
-		QFile f(thumb_path);
-		if (f.exists() && ms.video_preview.load(thumb_path)) {
-			//dout << "loaded thumb" << ms->file_index << "from" << thumb_path;
+		if (preview_cache.read(hash, PREVIEW_CACHE_THUMBNAIL, ms.file_index, data)
+				&& deserialize_thumbnail(data, ms.video_preview)) {
 			ms.make_square_thumb();
 			ms.preview_done = true;
 		} else {
+			ms.preview_done = false;
 			found = false;
-			break;
+		}
+
+		if (!ms.infinite_length) {
+			if (preview_cache.read(hash, PREVIEW_CACHE_SEEK_INDEX, ms.file_index, data)) {
+				QDataStream stream(data);
+				stream >> ms.keyframe_index;
+			} else {
+				missing_seek_indexes.append(&ms);
+				found = false;
+			}
 		}
 	}
 	for (int i=0;i<footage->audio_tracks.size();i++) {
 		FootageStream& ms = footage->audio_tracks[i];
-		QString waveform_path = get_waveform_path(hash, ms);
-		QFile f(waveform_path);
-		if (f.exists()) {
-			//dout << "loaded wave" << ms->file_index << "from" << waveform_path;
-			f.open(QFile::ReadOnly);
-			QByteArray data = f.readAll();
-			ms.audio_preview.resize(data.size());
-			for (int j=0;j<data.size();j++) {
-				// faster way?
-				ms.audio_preview[j] = data.at(j);
-			}
+		if (preview_cache.read(hash, PREVIEW_CACHE_WAVEFORM, ms.file_index, data)
+				&& deserialize_waveform(data, ms)) {
 			ms.preview_done = true;
-			f.close();
 		} else {
+			ms.audio_preview.clear();
+			ms.audio_preview_mipmaps.clear();
+			ms.preview_done = false;
 			found = false;
-			break;
 		}
 	}
-	if (!found) {
-		for (int i=0;i<footage->video_tracks.size();i++) {
-			FootageStream& ms = footage->video_tracks[i];
-			ms.preview_done = false;
+	return !found;
+}
+
+void PreviewGenerator::save_previews(const QString& hash) {
+	for (int i=0;i<footage->video_tracks.size();i++) {
+		const FootageStream& ms = footage->video_tracks.at(i);
+		if (ms.preview_done && !preview_cache.contains(hash, PREVIEW_CACHE_THUMBNAIL, ms.file_index)) {
+			preview_cache.write(hash, PREVIEW_CACHE_THUMBNAIL, ms.file_index, serialize_thumbnail(ms.video_preview));
 		}
-		for (int i=0;i<footage->audio_tracks.size();i++) {
-			FootageStream& ms = footage->audio_tracks[i];
-			ms.audio_preview.clear();
-			ms.preview_done = false;
+	}
+	for (int i=0;i<missing_seek_indexes.size();i++) {
+		const FootageStream* ms = missing_seek_indexes.at(i);
+		QByteArray data;
+		QDataStream stream(&data, QIODevice::WriteOnly);
+		stream << ms->keyframe_index;
+		preview_cache.write(hash, PREVIEW_CACHE_SEEK_INDEX, ms->file_index, data);
+	}
+	for (int i=0;i<footage->audio_tracks.size();i++) {
+		const FootageStream& ms = footage->audio_tracks.at(i);
+
+		// a stream that couldn't be decoded is tried again next time instead of keeping an empty waveform
+		if (ms.preview_done && !ms.audio_preview.isEmpty() && !preview_cache.contains(hash, PREVIEW_CACHE_WAVEFORM, ms.file_index)) {
+			preview_cache.write(hash, PREVIEW_CACHE_WAVEFORM, ms.file_index, serialize_waveform(ms));
 		}
 	}
-	return !found;
 }
 
 void PreviewGenerator::finalize_media() {
@@ -197,228 +374,236 @@ void PreviewGenerator::finalize_media() {
 		} else {
 			emit set_icon(ICON_TYPE_VIDEO, replace);
 		}
+	}
+}
 
-		/*if (!contains_still_image || media->audio_tracks.size() > 0) {
-			double frame_rate = 30;
-			if (!contains_still_image && media->video_tracks.size() > 0) frame_rate = media->video_tracks.at(0)->video_frame_rate;
-			item->setText(1, frame_to_timecode(media->get_length_in_frames(frame_rate), config.timecode_view, frame_rate));
+void PreviewGenerator::generate_previews() {
+	// every stream gets its own job so a long waveform never holds up a thumbnail
+	jobs_lock.lock();
+	for (int i=0;i<footage->video_tracks.size();i++) {
+		if (!footage->video_tracks.at(i).preview_done) {
+			jobs.append(new PreviewJob(this, &footage->video_tracks[i], PREVIEW_JOB_THUMBNAIL));
+		}
+	}
+	for (int i=0;i<missing_seek_indexes.size();i++) {
+		jobs.append(new PreviewJob(this, missing_seek_indexes.at(i), PREVIEW_JOB_SEEK_INDEX));
+	}
+	for (int i=0;i<footage->audio_tracks.size();i++) {
+		if (!footage->audio_tracks.at(i).preview_done) {
+			jobs.append(new PreviewJob(this, &footage->audio_tracks[i], PREVIEW_JOB_WAVEFORM));
+		}
+	}
+	pending.fetchAndAddOrdered(jobs.size());
+	for (int i=0;i<jobs.size();i++) {
+		get_preview_pool()->start(jobs.at(i), jobs.at(i)->get_priority(priority));
+	}
+	jobs_lock.unlock();
+}
 
-			if (media->video_tracks.size() > 0) {
-				item->setText(2, QString::number(frame_rate) + " FPS");
-			} else {
-				item->setText(2, QString::number(media->audio_tracks.at(0)->audio_frequency) + " Hz");
-			}
-		}*/
+bool PreviewGenerator::open_stream_decoder(int file_index, AVFormatContext** stream_fmt_ctx, AVCodecContext** codec_ctx, bool open_codec) {
+	// each job demuxes the file separately so no two jobs ever share a format context
+	*stream_fmt_ctx = nullptr;
+	*codec_ctx = nullptr;
+
+	QByteArray ba = footage->url.toUtf8();
+	if (avformat_open_input(stream_fmt_ctx, ba.constData(), nullptr, nullptr) != 0) {
+		return false;
+	}
+	if (avformat_find_stream_info(*stream_fmt_ctx, nullptr) < 0
+			|| file_index >= (int) (*stream_fmt_ctx)->nb_streams) {
+		avformat_close_input(stream_fmt_ctx);
+		return false;
+	}
+
+	// have the demuxer skip every stream this job isn't interested in
+	for (unsigned int i=0;i<(*stream_fmt_ctx)->nb_streams;i++) {
+		if ((int) i != file_index) (*stream_fmt_ctx)->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	if (!open_codec) return true;
+
+	AVStream* stream = (*stream_fmt_ctx)->streams[file_index];
+	AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+	if (codec == nullptr) {
+		avformat_close_input(stream_fmt_ctx);
+		return false;
+	}
+
+	*codec_ctx = avcodec_alloc_context3(codec);
+	avcodec_parameters_to_context(*codec_ctx, stream->codecpar);
+	if (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && (*codec_ctx)->channel_layout == 0) {
+		(*codec_ctx)->channel_layout = av_get_default_channel_layout(stream->codecpar->channels);
+	}
+	if (avcodec_open2(*codec_ctx, codec, nullptr) < 0) {
+		avcodec_free_context(codec_ctx);
+		avformat_close_input(stream_fmt_ctx);
+		return false;
 	}
+
+	return true;
 }
 
-void PreviewGenerator::generate_waveform() {
-	SwsContext* sws_ctx;
-	SwrContext* swr_ctx;
-	AVFrame* temp_frame = av_frame_alloc();
-	AVCodecContext** codec_ctx = new AVCodecContext* [fmt_ctx->nb_streams];
-	int64_t* media_lengths = new int64_t[fmt_ctx->nb_streams]{0};
-	for (unsigned int i=0;i<fmt_ctx->nb_streams;i++) {
-		codec_ctx[i] = nullptr;
-		if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO || fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-			AVCodec* codec = avcodec_find_decoder(fmt_ctx->streams[i]->codecpar->codec_id);
-			if (codec != nullptr) {
-				codec_ctx[i] = avcodec_alloc_context3(codec);
-				avcodec_parameters_to_context(codec_ctx[i], fmt_ctx->streams[i]->codecpar);
-				avcodec_open2(codec_ctx[i], codec, nullptr);
-				if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && codec_ctx[i]->channel_layout == 0) {
-					codec_ctx[i]->channel_layout = av_get_default_channel_layout(fmt_ctx->streams[i]->codecpar->channels);
-				}
-			}
-		}
+void PreviewGenerator::generate_thumbnail(FootageStream* s) {
+	AVFormatContext* stream_fmt_ctx;
+	AVCodecContext* codec_ctx;
+	if (!open_stream_decoder(s->file_index, &stream_fmt_ctx, &codec_ctx)) {
+		qCritical() << "Failed to open stream" << s->file_index << "of file" << footage->name << "for thumbnail generation";
+		return;
 	}
 
 	AVPacket* packet = av_packet_alloc();
-	bool done = true;
-
-	bool end_of_file = false;
+	AVFrame* temp_frame = av_frame_alloc();
+	bool flushing = false;
+
+	// the thumbnail only needs the first frame, so stop decoding as soon as we have one
+	if (!cancelled && decode_next_frame(stream_fmt_ctx, codec_ctx, s->file_index, packet, temp_frame, &flushing)) {
+		int dstH = 120;
+		int dstW = dstH * ((float)temp_frame->width/(float)temp_frame->height);
+		QImage thumbnail(dstW, dstH, QImage::Format_RGBA8888);
+		uint8_t* data = thumbnail.bits();
+
+		SwsContext* sws_ctx = sws_getContext(
+				temp_frame->width,
+				temp_frame->height,
+				static_cast<AVPixelFormat>(temp_frame->format),
+				dstW,
+				dstH,
+				static_cast<AVPixelFormat>(AV_PIX_FMT_RGBA),
+				SWS_FAST_BILINEAR,
+				nullptr,
+				nullptr,
+				nullptr
+			);
+
+		int linesize[AV_NUM_DATA_POINTERS];
+		linesize[0] = thumbnail.bytesPerLine();
+		sws_scale(sws_ctx, temp_frame->data, temp_frame->linesize, 0, temp_frame->height, &data, linesize);
+		sws_freeContext(sws_ctx);
+
+		s->video_preview = thumbnail;
+		s->make_square_thumb();
+
+		// is video interlaced?
+		s->video_auto_interlacing = (temp_frame->interlaced_frame) ? ((temp_frame->top_field_first) ? VIDEO_TOP_FIELD_FIRST : VIDEO_BOTTOM_FIELD_FIRST) : VIDEO_PROGRESSIVE;
+		s->video_interlacing = s->video_auto_interlacing;
+
+		s->preview_done = true;
+	}
 
-	// get the ball rolling
-	do {
-		av_read_frame(fmt_ctx, packet);
-	} while (codec_ctx[packet->stream_index] == nullptr);
-	avcodec_send_packet(codec_ctx[packet->stream_index], packet);
+	av_frame_free(&temp_frame);
+	av_packet_free(&packet);
+	avcodec_free_context(&codec_ctx);
+	avformat_close_input(&stream_fmt_ctx);
+}
 
-	while (!end_of_file) {
-		while (codec_ctx[packet->stream_index] == nullptr || avcodec_receive_frame(codec_ctx[packet->stream_index], temp_frame) == AVERROR(EAGAIN)) {
-			av_packet_unref(packet);
-			int read_ret = av_read_frame(fmt_ctx, packet);
+void PreviewGenerator::generate_waveform(FootageStream* s) {
+	AVFormatContext* stream_fmt_ctx;
+	AVCodecContext* codec_ctx;
+	if (!open_stream_decoder(s->file_index, &stream_fmt_ctx, &codec_ctx)) {
+		qCritical() << "Failed to open stream" << s->file_index << "of file" << footage->name << "for waveform generation";
+		s->preview_done = true;
+		return;
+	}
 
-			//dout << "read frame for" << footage->name << footage->url << read_ret << "retrieve_duration:" << retrieve_duration << "eof:" << end_of_file << "packet pts:" << packet->pts;
+	AVPacket* packet = av_packet_alloc();
+	AVFrame* temp_frame = av_frame_alloc();
+	AVFrame* swr_frame = av_frame_alloc();
+	SwrContext* swr_ctx = nullptr;
+	bool flushing = false;
 
-			if (read_ret < 0) {
-				end_of_file = true;
-				if (read_ret != AVERROR_EOF) qCritical() << "Failed to read packet for preview generation" << read_ret;
-				break;
-			}
-			if (codec_ctx[packet->stream_index] != nullptr) {
-				int send_ret = avcodec_send_packet(codec_ctx[packet->stream_index], packet);
-				if (send_ret < 0 && send_ret != AVERROR(EAGAIN)) {
-					qCritical() << "Failed to send packet for preview generation - aborting" << send_ret;
-					end_of_file = true;
-					break;
-				}
-			}
+	while (!cancelled && decode_next_frame(stream_fmt_ctx, codec_ctx, s->file_index, packet, temp_frame, &flushing)) {
+		if (temp_frame->channel_layout == 0) {
+			temp_frame->channel_layout = av_get_default_channel_layout(temp_frame->channels);
 		}
-		if (!end_of_file) {
-			FootageStream* s = footage->get_stream_from_file_index(fmt_ctx->streams[packet->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO, packet->stream_index);
-			if (s != nullptr) {
-				if (fmt_ctx->streams[packet->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-					if (!s->preview_done) {
-						int dstH = 120;
-						int dstW = dstH * ((float)temp_frame->width/(float)temp_frame->height);
-						uint8_t* data = new uint8_t[dstW*dstH*4];
-
-						sws_ctx = sws_getContext(
-								temp_frame->width,
-								temp_frame->height,
-								static_cast<AVPixelFormat>(temp_frame->format),
-								dstW,
-								dstH,
-								static_cast<AVPixelFormat>(AV_PIX_FMT_RGBA),
-								SWS_FAST_BILINEAR,
-								nullptr,
-								nullptr,
-								nullptr
-							);
-
-						int linesize[AV_NUM_DATA_POINTERS];
-						linesize[0] = dstW*4;
-						sws_scale(sws_ctx, temp_frame->data, temp_frame->linesize, 0, temp_frame->height, &data, linesize);
-
-						s->video_preview = QImage(data, dstW, dstH, linesize[0], QImage::Format_RGBA8888);
-						s->make_square_thumb();
-
-						// is video interlaced?
-						s->video_auto_interlacing = (temp_frame->interlaced_frame) ? ((temp_frame->top_field_first) ? VIDEO_TOP_FIELD_FIRST : VIDEO_BOTTOM_FIELD_FIRST) : VIDEO_PROGRESSIVE;
-						s->video_interlacing = s->video_auto_interlacing;
-
-						s->preview_done = true;
-
-						sws_freeContext(sws_ctx);
-
-						if (!retrieve_duration) {
-							avcodec_close(codec_ctx[packet->stream_index]);
-							codec_ctx[packet->stream_index] = nullptr;
-						}
-					}
-					media_lengths[packet->stream_index]++;
-				} else if (fmt_ctx->streams[packet->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-					int interval = qFloor((temp_frame->sample_rate/WAVEFORM_RESOLUTION)/4)*4;
-
-					AVFrame* swr_frame = av_frame_alloc();
-					swr_frame->channel_layout = temp_frame->channel_layout;
-					swr_frame->sample_rate = temp_frame->sample_rate;
-					swr_frame->format = AV_SAMPLE_FMT_S16P;
-
-					swr_ctx = swr_alloc_set_opts(
-								nullptr,
-								temp_frame->channel_layout,
-								static_cast<AVSampleFormat>(swr_frame->format),
-								temp_frame->sample_rate,
-								temp_frame->channel_layout,
-								static_cast<AVSampleFormat>(temp_frame->format),
-								temp_frame->sample_rate,
-								0,
-								nullptr
-							);
-
-					swr_init(swr_ctx);
-
-					swr_convert_frame(swr_ctx, swr_frame, temp_frame);
-
-					// TODO implement a way to terminate this if the user suddenly closes the project while the waveform is being generated
-					int sample_size = av_get_bytes_per_sample(static_cast<AVSampleFormat>(swr_frame->format));
-					int nb_bytes = swr_frame->nb_samples * sample_size;
-					int byte_interval = interval * sample_size;
-					for (int i=0;i<nb_bytes;i+=byte_interval) {
-						for (int j=0;j<swr_frame->channels;j++) {
-							qint16 min = 0;
-							qint16 max = 0;
-							for (int k=0;k<byte_interval;k+=sample_size) {
-								if (i+k < nb_bytes) {
-									qint16 sample = ((swr_frame->data[j][i+k+1] << 8) | swr_frame->data[j][i+k]);
-									if (sample > max) {
-										max = sample;
-									} else if (sample < min) {
-										min = sample;
-									}
-								} else {
-									break;
-								}
-							}
-							s->audio_preview.append(min >> 8);
-							s->audio_preview.append(max >> 8);
-							if (cancelled) break;
-						}
-					}
 
-					swr_free(&swr_ctx);
-					av_frame_unref(swr_frame);
-					av_frame_free(&swr_frame);
-
-					if (cancelled) {
-						end_of_file = true;
-						break;
-					}
-				}
-			}
+		int interval = qFloor((temp_frame->sample_rate/WAVEFORM_RESOLUTION)/4)*4;
+
+		swr_frame->channel_layout = temp_frame->channel_layout;
+		swr_frame->sample_rate = temp_frame->sample_rate;
+		swr_frame->format = AV_SAMPLE_FMT_S16P;
+
+		// the stream's format doesn't change between frames, so one resampler serves the whole job
+		if (swr_ctx == nullptr) {
+			swr_ctx = swr_alloc_set_opts(
+						nullptr,
+						temp_frame->channel_layout,
+						static_cast<AVSampleFormat>(swr_frame->format),
+						temp_frame->sample_rate,
+						temp_frame->channel_layout,
+						static_cast<AVSampleFormat>(temp_frame->format),
+						temp_frame->sample_rate,
+						0,
+						nullptr
+					);
+
+			swr_init(swr_ctx);
+		}
 
-			// check if we've got all our previews
-			if (retrieve_duration) {
-				done = false;
-			} else if (footage->audio_tracks.size() == 0) {
-				done = true;
-				for (int i=0;i<footage->video_tracks.size();i++) {
-					if (!footage->video_tracks.at(i).preview_done) {
-						done = false;
+		swr_convert_frame(swr_ctx, swr_frame, temp_frame);
+
+		int sample_size = av_get_bytes_per_sample(static_cast<AVSampleFormat>(swr_frame->format));
+		int nb_bytes = swr_frame->nb_samples * sample_size;
+		int byte_interval = interval * sample_size;
+		for (int i=0;i<nb_bytes;i+=byte_interval) {
+			for (int j=0;j<swr_frame->channels;j++) {
+				qint16 min = 0;
+				qint16 max = 0;
+				for (int k=0;k<byte_interval;k+=sample_size) {
+					if (i+k < nb_bytes) {
+						qint16 sample = ((swr_frame->data[j][i+k+1] << 8) | swr_frame->data[j][i+k]);
+						if (sample > max) {
+							max = sample;
+						} else if (sample < min) {
+							min = sample;
+						}
+					} else {
 						break;
 					}
 				}
-				if (done) {
-					end_of_file = true;
-					break;
-				}
+				s->audio_preview.append(min >> 8);
+				s->audio_preview.append(max >> 8);
+				if (cancelled) break;
 			}
-			av_packet_unref(packet);
 		}
+
+		av_frame_unref(swr_frame);
+		av_frame_unref(temp_frame);
 	}
-	for (int i=0;i<footage->audio_tracks.size();i++) {
-		footage->audio_tracks[i].preview_done = true;
-	}
+
+	s->make_waveform_mipmaps();
+	s->preview_done = true;
+
+	if (swr_ctx != nullptr) swr_free(&swr_ctx);
+	av_frame_free(&swr_frame);
 	av_frame_free(&temp_frame);
 	av_packet_free(&packet);
-	for (unsigned int i=0;i<fmt_ctx->nb_streams;i++) {
-		if (codec_ctx[i] != nullptr) {
-			avcodec_close(codec_ctx[i]);
-		}
+	avcodec_free_context(&codec_ctx);
+	avformat_close_input(&stream_fmt_ctx);
+}
+
+void PreviewGenerator::generate_seek_index(FootageStream* s) {
+	AVFormatContext* stream_fmt_ctx;
+	AVCodecContext* codec_ctx;
+	if (!open_stream_decoder(s->file_index, &stream_fmt_ctx, &codec_ctx, false)) {
+		qCritical() << "Failed to open stream" << s->file_index << "of file" << footage->name << "for seek index generation";
+		return;
 	}
-	if (retrieve_duration) {
-		footage->length = 0;
-		int maximum_stream = 0;
-		for (unsigned int i=0;i<fmt_ctx->nb_streams;i++) {
-			if (media_lengths[i] > media_lengths[maximum_stream]) {
-				maximum_stream = i;
-			}
+
+	// demux only, the packet flags are all we need to know where keyframes are
+	QVector<qint64> keyframes;
+	AVPacket* packet = av_packet_alloc();
+	while (!cancelled && av_read_frame(stream_fmt_ctx, packet) >= 0) {
+		if (packet->stream_index == s->file_index && (packet->flags & AV_PKT_FLAG_KEY)) {
+			int64_t ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+			if (ts != AV_NOPTS_VALUE) keyframes.append(ts);
 		}
-		footage->length = (double) media_lengths[maximum_stream] / av_q2d(fmt_ctx->streams[maximum_stream]->avg_frame_rate) * AV_TIME_BASE; // TODO redo with PTS
-		finalize_media();
+		av_packet_unref(packet);
 	}
-	delete [] media_lengths;
-	delete [] codec_ctx;
-}
-
-QString PreviewGenerator::get_thumbnail_path(const QString& hash, const FootageStream& ms) {
-	return data_path + "/" + hash + "t" + QString::number(ms.file_index);
-}
+	av_packet_free(&packet);
+	avformat_close_input(&stream_fmt_ctx);
 
-QString PreviewGenerator::get_waveform_path(const QString& hash, const FootageStream& ms) {
-	return data_path + "/" + hash + "w" + QString::number(ms.file_index);
+	std::sort(keyframes.begin(), keyframes.end());
+	s->keyframe_index = keyframes;
 }
 
 void PreviewGenerator::run() {
@@ -430,7 +615,7 @@ void PreviewGenerator::run() {
 	strcpy(filename, ba.data());
 
 	QString errorStr;
-	bool error = false;
+
 	int errCode = avformat_open_input(&fmt_ctx, filename, nullptr, nullptr);
 	if(errCode != 0) {
 		char err[1024];
@@ -448,51 +633,100 @@ void PreviewGenerator::run() {
 			av_dump_format(fmt_ctx, 0, filename, 0);
 			parse_media();
 
-			// see if we already have data for this
-			QFileInfo file_info(footage->url);
-			QString cache_file = footage->url.mid(footage->url.lastIndexOf('/')+1) + QString::number(file_info.size()) + QString::number(file_info.lastModified().toMSecsSinceEpoch());
-			//dout << "using hash" << cache_file;
-			QString hash = QCryptographicHash::hash(cache_file.toUtf8(), QCryptographicHash::Md5).toHex();
-
-			if (retrieve_preview(hash)) {
-				sem.acquire();
-
-				generate_waveform();
-
-				// save preview to file
-				for (int i=0;i<footage->video_tracks.size();i++) {
-					FootageStream& ms = footage->video_tracks[i];
-					ms.video_preview.save(get_thumbnail_path(hash, ms), "PNG");
-					//dout << "saved" << ms->file_index << "thumbnail to" << get_thumbnail_path(hash, ms);
-				}
-				for (int i=0;i<footage->audio_tracks.size();i++) {
-					FootageStream& ms = footage->audio_tracks[i];
-					QFile f(get_waveform_path(hash, ms));
-					f.open(QFile::WriteOnly);
-					f.write(ms.audio_preview.constData(), ms.audio_preview.size());
-					f.close();
-					//dout << "saved" << ms->file_index << "waveform to" << get_waveform_path(hash, ms);
-				}
-
-				sem.release();
+			if (retrieve_duration) {
+				retrieve_duration_from_packets();
+				finalize_media();
 			}
 		}
 		avformat_close_input(&fmt_ctx);
 	}
 
+	if (!error && !cancelled) {
+		// see if we already have data for this
+		QFileInfo file_info(footage->url);
+		QString cache_file = footage->url.mid(footage->url.lastIndexOf('/')+1) + QString::number(file_info.size()) + QString::number(file_info.lastModified().toMSecsSinceEpoch());
+		//dout << "using hash" << cache_file;
+		QString hash = QCryptographicHash::hash(cache_file.toUtf8(), QCryptographicHash::Md5).toHex();
+
+		if (retrieve_preview(hash)) {
+			save_hash = hash;
+			generate_previews();
+		}
+	}
+
 	if (error) {
 		media->update_tooltip(errorStr);
 		emit set_icon(ICON_TYPE_ERROR, replace);
 		footage->invalid = true;
 		footage->ready_lock.unlock();
-	} else {
-		media->update_tooltip();
 	}
 
 	delete [] filename;
+
+	// the jobs carry on without us, this has to be the last thing run() does with the generator
+	job_finished();
+}
+
+void PreviewGenerator::job_finished() {
+	if (!pending.deref()) finish();
+}
+
+void PreviewGenerator::finish() {
+	if (!cancelled && !save_hash.isEmpty()) {
+		save_previews(save_hash);
+	}
+	if (!error) media->update_tooltip();
 	footage->preview_gen = nullptr;
+
+	done_lock.lock();
+	done = true;
+	done_cond.wakeAll();
+	done_lock.unlock();
+
+	deleteLater();
+}
+
+void PreviewGenerator::wait() {
+	QMutexLocker locker(&done_lock);
+	while (!done) {
+		done_cond.wait(&done_lock);
+	}
+}
+
+void PreviewGenerator::set_priority(int p) {
+	priority = p;
+}
+
+void PreviewGenerator::prioritize() {
+	// re-queue any job that hasn't started yet ahead of the jobs of media that isn't on screen
+	QMutexLocker locker(&jobs_lock);
+	if (priority == PREVIEW_PRIORITY_VISIBLE) return;
+	priority = PREVIEW_PRIORITY_VISIBLE;
+	for (int i=0;i<jobs.size();i++) {
+		if (get_preview_pool()->tryTake(jobs.at(i))) {
+			get_preview_pool()->start(jobs.at(i), jobs.at(i)->get_priority(priority));
+		}
+	}
 }
 
 void PreviewGenerator::cancel() {
 	cancelled = true;
+
+	// jobs that haven't started yet can simply be pulled from the pool
+	QVector<PreviewJob*> taken;
+	jobs_lock.lock();
+	for (int i=0;i<jobs.size();i++) {
+		if (get_preview_pool()->tryTake(jobs.at(i))) {
+			taken.append(jobs.at(i));
+			jobs.removeAt(i);
+			i--;
+		}
+	}
+	jobs_lock.unlock();
+
+	// taken jobs are ours to delete, and count as finished
+	for (int i=0;i<taken.size();i++) {
+		delete taken.at(i);
+		job_finished();
+	}
 }
@@ -1,32 +1,82 @@
 #ifndef PREVIEWGENERATOR_H
 #define PREVIEWGENERATOR_H
 
-#include <QThread>
-#include <QSemaphore>
+#include <QObject>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QVector>
 
 #define ICON_TYPE_VIDEO 0
 #define ICON_TYPE_AUDIO 1
 #define ICON_TYPE_IMAGE 2
 #define ICON_TYPE_ERROR 3
 
+#define PREVIEW_PRIORITY_NORMAL 0
+#define PREVIEW_PRIORITY_VISIBLE 1
+
+#define PREVIEW_JOB_THUMBNAIL 0
+#define PREVIEW_JOB_WAVEFORM 1
+#define PREVIEW_JOB_SEEK_INDEX 2
+
 struct Footage;
 struct FootageStream;
 struct AVFormatContext;
+struct AVCodecContext;
 class Media;
+class QThreadPool;
+class PreviewGenerator;
+
+// shared pool that runs every thumbnail/waveform job, sized to the machine
+QThreadPool* get_preview_pool();
+
+// pool that opens and probes imported files, only demuxes as many files at once as we have cores
+QThreadPool* get_probe_pool();
+
+class PreviewJob : public QRunnable {
+public:
+	PreviewJob(PreviewGenerator* g, FootageStream* s, int t);
+	void run();
+	int get_priority(int generator_priority);
 
-class PreviewGenerator : public QThread
+	PreviewGenerator* gen;
+	FootageStream* stream;
+	int type;
+};
+
+/*
+ * Probes an imported file on the probe pool, then queues its preview jobs and returns without waiting on them. The
+ * last job to finish saves the previews and releases the generator, so no thread ever sits blocked on a file.
+ */
+class PreviewGenerator : public QObject, public QRunnable
 {
     Q_OBJECT
 public:
 	PreviewGenerator(Media*, Footage*, bool);
+	void start();
     void run();
 	void cancel();
+	void wait();
+	void prioritize();
+	void set_priority(int p);
 signals:
 	void set_icon(int, bool);
 private:
+	friend class PreviewJob;
+
+	void job_finished();
+	void finish();
+
     void parse_media();
+	void retrieve_duration_from_packets();
 	bool retrieve_preview(const QString &hash);
-    void generate_waveform();
+	void generate_previews();
+	void save_previews(const QString& hash);
+	bool open_stream_decoder(int file_index, AVFormatContext** stream_fmt_ctx, AVCodecContext** codec_ctx, bool open_codec = true);
+	void generate_thumbnail(FootageStream* s);
+	void generate_waveform(FootageStream* s);
+	void generate_seek_index(FootageStream* s);
 	void finalize_media();
     AVFormatContext* fmt_ctx;
     Media* media;
@@ -35,9 +85,20 @@ private:
 	bool contains_still_image;
 	bool replace;
 	bool cancelled;
-	QString data_path;
-    QString get_thumbnail_path(const QString &hash, const FootageStream &ms);
-    QString get_waveform_path(const QString& hash, const FootageStream &ms);
+	bool error;
+	int priority;
+	QString save_hash;
+
+	// jobs that haven't started yet, each job removes itself once it runs
+	QVector<PreviewJob*> jobs;
+	QVector<FootageStream*> missing_seek_indexes;
+	QMutex jobs_lock;
+
+	// queued jobs plus the probe itself, whoever takes it to zero finishes the generator
+	QAtomicInt pending;
+	QMutex done_lock;
+	QWaitCondition done_cond;
+	bool done;
 };
 
 #endif // PREVIEWGENERATOR_H
@@ -0,0 +1,91 @@
+#include "projectsnapshot.h"
+
+#include <QBuffer>
+#include <QXmlStreamWriter>
+
+#include "project/effect.h"
+
+ProjectSnapshotElement::ProjectSnapshotElement(const QString& n) :
+	name(n),
+	field(false),
+	field_type(0)
+{}
+
+ProjectSnapshotElement::~ProjectSnapshotElement() {
+	qDeleteAll(children);
+}
+
+ProjectSnapshotElement* ProjectSnapshotElement::add_child(const QString& n) {
+	ProjectSnapshotElement* child = new ProjectSnapshotElement(n);
+	children.append(child);
+	return child;
+}
+
+void ProjectSnapshotElement::set_attribute(const QString& n, const QString& value) {
+	attributes.append(QPair<QString, QString>(n, value));
+}
+
+void ProjectSnapshotElement::set_text(const QString& t) {
+	text = t;
+}
+
+void ProjectSnapshotElement::set_raw(const QByteArray& r) {
+	raw = r;
+}
+
+void ProjectSnapshotElement::set_field(int type, const QVariant& value, const QVector<EffectKeyframe>& keys) {
+	field = true;
+	field_type = type;
+	field_value = value;
+	keyframes = keys;
+}
+
+void ProjectSnapshotElement::write(QXmlStreamWriter& stream) const {
+	stream.writeStartElement(name);
+	for (int i=0;i<attributes.size();i++) {
+		stream.writeAttribute(attributes.at(i).first, attributes.at(i).second);
+	}
+
+	if (field) {
+		stream.writeAttribute("value", save_data_to_string(field_type, field_value));
+		for (int i=0;i<keyframes.size();i++) {
+			const EffectKeyframe& key = keyframes.at(i);
+			stream.writeStartElement("key");
+			stream.writeAttribute("value", save_data_to_string(field_type, key.data));
+			stream.writeAttribute("frame", QString::number(key.time));
+			stream.writeAttribute("type", QString::number(key.type));
+			stream.writeAttribute("prehx", QString::number(key.pre_handle_x));
+			stream.writeAttribute("prehy", QString::number(key.pre_handle_y));
+			stream.writeAttribute("posthx", QString::number(key.post_handle_x));
+			stream.writeAttribute("posthy", QString::number(key.post_handle_y));
+			stream.writeEndElement(); // key
+		}
+	}
+
+	for (int i=0;i<children.size();i++) {
+		children.at(i)->write(stream);
+	}
+
+	if (!text.isEmpty()) stream.writeCharacters(text);
+
+	// the writer has closed every tag before this, so the passage lands inside the element
+	if (!raw.isEmpty()) stream.device()->write(raw);
+
+	stream.writeEndElement();
+}
+
+QByteArray ProjectSnapshotElement::to_document() const {
+	QByteArray data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+
+	QXmlStreamWriter stream(&buffer);
+	stream.setAutoFormatting(true);
+	stream.writeStartDocument(); // doc
+	write(stream);
+	stream.writeEndDocument(); // doc
+
+	buffer.close();
+
+	return data;
+}
@@ -0,0 +1,55 @@
+#ifndef PROJECTSNAPSHOT_H
+#define PROJECTSNAPSHOT_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVariant>
+#include <QVector>
+#include <QList>
+#include <QPair>
+
+#include "project/keyframe.h"
+
+class QXmlStreamWriter;
+
+/*
+ * One element of the project file, captured on the GUI thread and written out by the project writer. Capturing
+ * only copies the few attributes each element has, field values and keyframes are held as shared copies of the
+ * field's own (copy-on-write) vectors and are turned into text by write(), so saving a keyframe heavy project
+ * doesn't cost the GUI thread more than walking its clips and effects.
+ */
+class ProjectSnapshotElement {
+public:
+	ProjectSnapshotElement(const QString& n);
+	~ProjectSnapshotElement();
+
+	ProjectSnapshotElement* add_child(const QString& n);
+	void set_attribute(const QString& n, const QString& value);
+	void set_text(const QString& t);
+
+	// written verbatim after the children, for passages kept from a file as they were
+	void set_raw(const QByteArray& r);
+
+	// a field's value attribute and its keyframes as <key> children, written before any other children
+	void set_field(int type, const QVariant& value, const QVector<EffectKeyframe>& keys);
+
+	void write(QXmlStreamWriter& stream) const;
+
+	// the whole document, with this element as its root
+	QByteArray to_document() const;
+private:
+	Q_DISABLE_COPY(ProjectSnapshotElement)
+
+	QString name;
+	QVector< QPair<QString, QString> > attributes;
+	QList<ProjectSnapshotElement*> children;
+	QString text;
+	QByteArray raw;
+
+	bool field;
+	int field_type;
+	QVariant field_value;
+	QVector<EffectKeyframe> keyframes;
+};
+
+#endif // PROJECTSNAPSHOT_H
@@ -0,0 +1,277 @@
+#include "shadercache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLExtraFunctions>
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include "io/path.h"
+#include "io/glgeometry.h"
+#include "debug.h"
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#define SHADER_CACHE_VERSION 2
+
+bool supports_program_binaries(QOpenGLContext* ctx) {
+	bool supported;
+	if (ctx->isOpenGLES()) {
+		supported = (ctx->format().majorVersion() >= 3);
+	} else {
+		supported = (ctx->format().version() >= qMakePair(4, 1) || ctx->hasExtension("GL_ARB_get_program_binary"));
+	}
+	if (supported) {
+		GLint formats = 0;
+		ctx->functions()->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = (formats > 0);
+	}
+	return supported;
+}
+
+// binaries are only valid for the exact sources and driver that produced them
+QString get_binary_filename(QOpenGLContext* ctx, const QByteArray& vert_source, const QByteArray& frag_source) {
+	QString dir = get_data_path();
+	if (dir.isEmpty()) return QString();
+
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	hash.addData(QByteArray::number(SHADER_CACHE_VERSION));
+	QOpenGLFunctions* f = ctx->functions();
+	hash.addData(reinterpret_cast<const char*>(f->glGetString(GL_VENDOR)));
+	hash.addData(reinterpret_cast<const char*>(f->glGetString(GL_RENDERER)));
+	hash.addData(reinterpret_cast<const char*>(f->glGetString(GL_VERSION)));
+	hash.addData(vert_source);
+	hash.addData(QByteArray(1, '\0'));
+	hash.addData(frag_source);
+	return dir + "/" + SHADER_CACHE_DIR + "/" + hash.result().toHex() + ".bin";
+}
+
+bool load_program_binary(QOpenGLShaderProgram* program, const QString& filename) {
+	QFile file(filename);
+	if (!file.open(QFile::ReadOnly)) return false;
+
+	QDataStream stream(&file);
+	quint32 format;
+	QByteArray binary;
+	stream >> format >> binary;
+	if (stream.status() != QDataStream::Ok || binary.isEmpty()) return false;
+
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+	f->glProgramBinary(program->programId(), GLenum(format), binary.constData(), binary.size());
+
+	// link() only checks the link status when the program has no shaders attached
+	return program->link();
+}
+
+void save_program_binary(QOpenGLShaderProgram* program, const QString& filename) {
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+	GLint length = 0;
+	f->glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	QByteArray binary(length, 0);
+	GLenum format;
+	f->glGetProgramBinary(program->programId(), length, &length, &format, binary.data());
+	binary.resize(length);
+
+	QDir().mkpath(QFileInfo(filename).absolutePath());
+	QSaveFile file(filename);
+	if (file.open(QFile::WriteOnly)) {
+		QDataStream stream(&file);
+		stream << quint32(format) << binary;
+		if (!file.commit()) {
+			qWarning() << "Failed to save shader binary" << filename;
+		}
+	}
+}
+
+QByteArray read_shader_source(const QString& filename) {
+	QFile file(filename);
+	if (file.open(QFile::ReadOnly)) {
+		return file.readAll();
+	}
+	qWarning() << "Failed to read shader" << filename;
+	return QByteArray();
+}
+
+// programs are stored as children of their context, named after the shaders they were built from
+QOpenGLShaderProgram* find_shader_program(QOpenGLContext* ctx, const QString& key) {
+	return ctx->findChild<QOpenGLShaderProgram*>(key, Qt::FindDirectChildrenOnly);
+}
+
+QOpenGLShaderProgram* build_shader_program(QOpenGLContext* ctx, const QString& key, const QByteArray& vert_source, const QByteArray& frag_source) {
+	QOpenGLShaderProgram* program = new QOpenGLShaderProgram(ctx);
+	program->setObjectName(key);
+	program->create();
+
+	bool binaries = supports_program_binaries(ctx);
+	QString binary_filename;
+	if (binaries) {
+		binary_filename = get_binary_filename(ctx, vert_source, frag_source);
+		if (!binary_filename.isEmpty() && load_program_binary(program, binary_filename)) {
+			qInfo() << "Loaded shader program from binary" << key;
+			return program;
+		}
+	}
+
+	bool glsl_compiled = true;
+	if (!vert_source.isEmpty()) {
+		if (program->addShaderFromSourceCode(QOpenGLShader::Vertex, vert_source)) {
+			qInfo() << "Vertex shader added successfully";
+		} else {
+			glsl_compiled = false;
+			qWarning() << "Vertex shader could not be added";
+		}
+	}
+	if (!frag_source.isEmpty()) {
+		if (program->addShaderFromSourceCode(QOpenGLShader::Fragment, frag_source)) {
+			qInfo() << "Fragment shader added successfully";
+		} else {
+			glsl_compiled = false;
+			qWarning() << "Fragment shader could not be added";
+		}
+	}
+	if (glsl_compiled) {
+		bind_geometry_attributes(program);
+		if (binaries) ctx->extraFunctions()->glProgramParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		if (program->link()) {
+			qInfo() << "Shader program linked successfully";
+			if (!binary_filename.isEmpty()) save_program_binary(program, binary_filename);
+		} else {
+			qWarning() << "Shader program failed to link";
+		}
+	}
+
+	return program;
+}
+
+QOpenGLShaderProgram* get_shader_program(const QString& vert_file, const QString& frag_file) {
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	if (ctx == nullptr) return nullptr;
+
+	QString key = vert_file + "|" + frag_file;
+	QOpenGLShaderProgram* program = find_shader_program(ctx, key);
+	if (program == nullptr) {
+		QByteArray vert_source, frag_source;
+		if (!vert_file.isEmpty()) vert_source = read_shader_source(vert_file);
+		if (!frag_file.isEmpty()) frag_source = read_shader_source(frag_file);
+		program = build_shader_program(ctx, key, vert_source, frag_source);
+	}
+	return program;
+}
+
+QOpenGLShaderProgram* get_shader_program_from_source(const QString& key, const QByteArray& vert_source, const QByteArray& frag_source) {
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	if (ctx == nullptr) return nullptr;
+
+	QOpenGLShaderProgram* program = find_shader_program(ctx, key);
+	if (program == nullptr) {
+		program = build_shader_program(ctx, key, vert_source, frag_source);
+	}
+	return program;
+}
+
+QString get_fused_uniform_prefix(int stage) {
+	return QString("fx%1_").arg(stage);
+}
+
+QString strip_shader_comments(const QString& source) {
+	QString stripped = source;
+	stripped.remove(QRegularExpression("/\\*.*?\\*/", QRegularExpression::DotMatchesEverythingOption));
+	stripped.remove(QRegularExpression("//[^\n]*"));
+	stripped.remove(QRegularExpression("^\\s*#[^\n]*", QRegularExpression::MultilineOption));
+	return stripped;
+}
+
+/* Turns a pointwise effect shader into a stage of a fused shader: the texture sampler, varyings and main()
+ * are dropped, and every global (uniforms, constants, functions including process()) gets the stage's prefix
+ * so stages can't collide with each other.
+ */
+bool append_fused_stage(QString& fused, const QString& source, int stage) {
+	QString stripped = strip_shader_comments(source);
+	QString prefix = get_fused_uniform_prefix(stage);
+
+	QStringList kept;
+	QStringList globals;
+	bool has_process = false;
+
+	// split into top level declarations and function definitions
+	QRegularExpression function_name("^\\w+\\s+(\\w+)\\s*\\(");
+	QRegularExpression variable_name("^(?:(?:uniform|const)\\s+)?\\w+\\s+(\\w+)");
+	int depth = 0;
+	int item_start = 0;
+	for (int i=0;i<stripped.size();i++) {
+		QChar c = stripped.at(i);
+		if (c == '{') {
+			depth++;
+		} else if (c == '}') {
+			depth--;
+		}
+		if (depth == 0 && (c == ';' || c == '}')) {
+			QString item = stripped.mid(item_start, i - item_start + 1).trimmed();
+			item_start = i + 1;
+
+			if (item.startsWith("varying") || item.startsWith("uniform sampler2D")) continue;
+
+			QRegularExpressionMatch match = function_name.match(item);
+			if (match.hasMatch()) {
+				if (match.captured(1) == "main") continue;
+				if (match.captured(1) == "process") has_process = true;
+			} else {
+				match = variable_name.match(item);
+			}
+			if (match.hasMatch()) globals.append(match.captured(1));
+			kept.append(item);
+		}
+	}
+
+	if (!has_process) return false;
+
+	QString stage_source = kept.join("\n");
+	for (int i=0;i<globals.size();i++) {
+		stage_source.replace(QRegularExpression("(?<![\\w.])" + globals.at(i) + "\\b"), prefix + globals.at(i));
+	}
+	fused += stage_source + "\n\n";
+	return true;
+}
+
+QOpenGLShaderProgram* get_fused_shader_program(const QString& vert_file, const QStringList& frag_files) {
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	if (ctx == nullptr) return nullptr;
+
+	QString key = vert_file + "|" + frag_files.join("+");
+	QOpenGLShaderProgram* program = find_shader_program(ctx, key);
+	if (program == nullptr) {
+		QString fused = "#version 110\n\nuniform sampler2D myTexture;\nvarying vec2 vTexCoord;\n\n";
+		QString main_body = "\tvec4 color = texture2D(myTexture, vTexCoord);\n";
+		for (int i=0;i<frag_files.size();i++) {
+			if (!append_fused_stage(fused, QString::fromUtf8(read_shader_source(frag_files.at(i))), i)) {
+				qWarning() << "Shader" << frag_files.at(i) << "is marked pointwise but has no process() function";
+
+				// cache an unlinked program so callers fall back to separate passes without retrying
+				program = new QOpenGLShaderProgram(ctx);
+				program->setObjectName(key);
+				return program;
+			}
+			main_body += "\tcolor = " + get_fused_uniform_prefix(i) + "process(color);\n";
+		}
+		fused += "void main(void) {\n" + main_body + "\tgl_FragColor = color;\n}\n";
+
+		program = build_shader_program(ctx, key, read_shader_source(vert_file), fused.toUtf8());
+	}
+	return program;
+}
@@ -0,0 +1,31 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+class QOpenGLShaderProgram;
+
+#define SHADER_CACHE_DIR "shadercache"
+
+/*
+ * Linked shader programs shared by every effect that uses the same shader files. Programs belong to the GL
+ * context that's current when they're requested and are freed along with it. When the driver supports program
+ * binaries, linked programs are also stored in the data directory so later sessions can skip compiling.
+ * Returns nullptr without a current context; the returned program may have failed to link (see isLinked()).
+ */
+QOpenGLShaderProgram* get_shader_program(const QString& vert_file, const QString& frag_file);
+
+// same as above for shaders built into the program, identified by key
+QOpenGLShaderProgram* get_shader_program_from_source(const QString& key, const QByteArray& vert_source, const QByteArray& frag_source);
+
+/*
+ * Same as above for a chain of pointwise effect shaders (declared with pointwise="true" in the effect XML)
+ * generated into a single fragment shader that runs them in order. Each shader provides
+ * "vec4 process(vec4 color)"; its uniforms are renamed with get_fused_uniform_prefix() for its stage.
+ */
+QOpenGLShaderProgram* get_fused_shader_program(const QString& vert_file, const QStringList& frag_files);
+QString get_fused_uniform_prefix(int stage);
+
+#endif // SHADERCACHE_H
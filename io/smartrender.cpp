@@ -0,0 +1,324 @@
+#include "smartrender.h"
+
+#include <QCoreApplication>
+
+#include <algorithm>
+
+#include "project/sequence.h"
+#include "project/clip.h"
+#include "project/footage.h"
+#include "project/media.h"
+#include "project/effect.h"
+#include "debug.h"
+
+extern "C" {
+	#include <libavformat/avformat.h>
+	#include <libavcodec/avcodec.h>
+}
+
+static bool open_source(Clip* c, AVFormatContext** fmt_ctx, AVStream** stream) {
+	*fmt_ctx = nullptr;
+	*stream = nullptr;
+
+	QByteArray ba = c->media->to_footage()->url.toUtf8();
+	if (avformat_open_input(fmt_ctx, ba.constData(), nullptr, nullptr) != 0) {
+		return false;
+	}
+	if (avformat_find_stream_info(*fmt_ctx, nullptr) < 0
+			|| c->media_stream >= (int) (*fmt_ctx)->nb_streams) {
+		avformat_close_input(fmt_ctx);
+		return false;
+	}
+
+	// only the clip's stream is copied
+	for (unsigned int i=0;i<(*fmt_ctx)->nb_streams;i++) {
+		if ((int) i != c->media_stream) (*fmt_ctx)->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	*stream = (*fmt_ctx)->streams[c->media_stream];
+	return true;
+}
+
+// same mapping playback uses, clips that are copied always run at normal speed
+static int64_t clip_frame_to_pts(long frame, double frame_rate, AVStream* stream) {
+	return qRound64((double) frame / frame_rate * av_q2d(av_inv_q(stream->time_base))) + qMax((int64_t) 0, stream->start_time);
+}
+
+static long pts_to_clip_frame(int64_t pts, double frame_rate, AVStream* stream) {
+	return qRound64((double) (pts - qMax((int64_t) 0, stream->start_time)) * av_q2d(stream->time_base) * frame_rate);
+}
+
+// keyframes that don't land exactly on a sequence frame can't start or end a copy
+static bool keyframe_on_frame(int64_t pts, double frame_rate, AVStream* stream) {
+	return (clip_frame_to_pts(pts_to_clip_frame(pts, frame_rate, stream), frame_rate, stream) == pts);
+}
+
+// whether the clip looks in the export exactly like its source frames would
+static bool clip_can_be_copied(Clip* c, Sequence* s, AVCodecContext* encoder) {
+	if (c->media == nullptr || c->media->get_type() != MEDIA_TYPE_FOOTAGE) return false;
+
+	Footage* f = c->media->to_footage();
+	if (!f->ready || f->invalid) return false;
+
+	const FootageStream* ms = f->get_stream_from_file_index(true, c->media_stream);
+	if (ms == nullptr
+			|| ms->infinite_length
+			|| ms->keyframe_index.isEmpty()
+			|| ms->video_interlacing != VIDEO_PROGRESSIVE) {
+		return false;
+	}
+
+	if (!qFuzzyCompare(c->speed, 1.0) || !qFuzzyCompare(f->speed, 1.0) || c->reverse) return false;
+	if (c->opening_transition > -1 || c->closing_transition > -1) return false;
+
+	for (int i=0;i<c->effects.size();i++) {
+		if (!c->effects.at(i)->is_passthrough()) return false;
+	}
+
+	if (ms->video_width != s->width || ms->video_height != s->height
+			|| encoder->width != s->width || encoder->height != s->height) {
+		return false;
+	}
+
+	return (qFuzzyCompare(ms->video_frame_rate, s->frame_rate)
+			&& qFuzzyCompare(av_q2d(encoder->framerate), s->frame_rate));
+}
+
+// whether the source's packets can be put between packets from the encoder
+static bool source_matches_encoder(AVStream* stream, AVCodecContext* encoder) {
+	AVCodecParameters* par = stream->codecpar;
+	return (par->video_delay == 0
+			&& par->extradata_size == encoder->extradata_size
+			&& (encoder->extradata_size == 0 || memcmp(par->extradata, encoder->extradata, encoder->extradata_size) == 0));
+}
+
+static void append_run(QVector<SmartRenderRun>& runs, long start, long end, Clip* c, int64_t source_start, int64_t source_end) {
+	if (end <= start) return;
+
+	// neighbouring rendered frames are encoded together
+	if (c == nullptr && !runs.isEmpty() && runs.last().clip == nullptr && runs.last().end == start) {
+		runs.last().end = end;
+		return;
+	}
+
+	SmartRenderRun run;
+	run.start = start;
+	run.end = end;
+	run.clip = c;
+	run.source_start = source_start;
+	run.source_end = source_end;
+	runs.append(run);
+}
+
+QVector<SmartRenderRun> plan_smart_render(Sequence* s, long start, long end, AVCodecContext* encoder) {
+	QVector<SmartRenderRun> runs;
+	QVector<bool> matches_encoder;
+
+	// the picture can only change where a video clip starts or ends
+	QVector<long> edges;
+	edges.append(start);
+	edges.append(end);
+	for (int i=0;i<s->clips.size();i++) {
+		Clip* c = s->clips.at(i);
+		if (c != nullptr && c->track < 0 && c->enabled) {
+			if (c->timeline_in > start && c->timeline_in < end) edges.append(c->timeline_in);
+			if (c->timeline_out > start && c->timeline_out < end) edges.append(c->timeline_out);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	for (int i=0;i<edges.size()-1;i++) {
+		long a = edges.at(i);
+		long b = edges.at(i+1);
+
+		// anything but a single clip has to be composited
+		Clip* only = nullptr;
+		int count = 0;
+		for (int j=0;j<s->clips.size();j++) {
+			Clip* c = s->clips.at(j);
+			if (c != nullptr && c->track < 0 && c->enabled && c->timeline_in < b && c->timeline_out > a) {
+				only = c;
+				count++;
+			}
+		}
+
+		AVFormatContext* fmt_ctx = nullptr;
+		AVStream* stream = nullptr;
+		if (count != 1 || !clip_can_be_copied(only, s, encoder) || !open_source(only, &fmt_ctx, &stream)) {
+			append_run(runs, a, b, nullptr, 0, 0);
+			continue;
+		}
+
+		if (stream->codecpar->codec_id != encoder->codec_id || stream->codecpar->format != encoder->pix_fmt) {
+			avformat_close_input(&fmt_ctx);
+			append_run(runs, a, b, nullptr, 0, 0);
+			continue;
+		}
+
+		const QVector<qint64>& keyframes = only->media->to_footage()->get_stream_from_file_index(true, only->media_stream)->keyframe_index;
+		long offset = only->timeline_in - only->clip_in;
+		long first = a - offset;
+		long last = b - offset;
+
+		// copies start on the first keyframe inside the interval
+		int start_key = -1;
+		int64_t from = clip_frame_to_pts(first, s->frame_rate, stream);
+		for (int j=0;j<keyframes.size();j++) {
+			if (keyframes.at(j) >= from && keyframe_on_frame(keyframes.at(j), s->frame_rate, stream)) {
+				start_key = j;
+				break;
+			}
+		}
+
+		// and stop before the last one, unless the interval runs to the end of the source
+		long copy_start = 0;
+		long copy_end = 0;
+		int64_t source_end = 0;
+		if (start_key > -1) {
+			copy_start = pts_to_clip_frame(keyframes.at(start_key), s->frame_rate, stream);
+			if (last >= only->getMaximumLength()) {
+				copy_end = last;
+				source_end = INT64_MAX;
+			} else {
+				for (int j=keyframes.size()-1;j>start_key;j--) {
+					long frame = pts_to_clip_frame(keyframes.at(j), s->frame_rate, stream);
+					if (frame <= last && keyframe_on_frame(keyframes.at(j), s->frame_rate, stream)) {
+						copy_end = frame;
+						source_end = keyframes.at(j);
+						break;
+					}
+				}
+			}
+		}
+
+		if (start_key > -1 && copy_start < copy_end) {
+			append_run(runs, a, copy_start + offset, nullptr, 0, 0);
+			append_run(runs, copy_start + offset, copy_end + offset, only, keyframes.at(start_key), source_end);
+			matches_encoder.resize(runs.size());
+			matches_encoder.last() = source_matches_encoder(stream, encoder);
+			append_run(runs, copy_end + offset, b, nullptr, 0, 0);
+		} else {
+			append_run(runs, a, b, nullptr, 0, 0);
+		}
+
+		avformat_close_input(&fmt_ctx);
+	}
+
+	// one run covering everything gets the source's stream headers, anything mixed with encoded frames has to decode
+	// with the encoder's
+	if (runs.size() > 1) {
+		matches_encoder.resize(runs.size());
+		QVector<SmartRenderRun> mixed;
+		for (int i=0;i<runs.size();i++) {
+			const SmartRenderRun& run = runs.at(i);
+			if (run.clip != nullptr && !matches_encoder.at(i)) {
+				qInfo() << "Smart render can't copy" << run.clip->name << "between encoded frames, its stream headers differ from the encoder's";
+			}
+			if (run.clip == nullptr || !matches_encoder.at(i)) {
+				append_run(mixed, run.start, run.end, nullptr, 0, 0);
+			} else {
+				mixed.append(run);
+			}
+		}
+		runs = mixed;
+	}
+
+	int copied = 0;
+	for (int i=0;i<runs.size();i++) {
+		if (runs.at(i).clip != nullptr) copied++;
+	}
+	qInfo() << "Smart render planned" << copied << "copied runs out of" << runs.size();
+
+	return runs;
+}
+
+bool get_smart_render_parameters(const SmartRenderRun& run, AVCodecParameters* par) {
+	AVFormatContext* fmt_ctx;
+	AVStream* stream;
+	if (!open_source(run.clip, &fmt_ctx, &stream)) return false;
+
+	bool ok = (avcodec_parameters_copy(par, stream->codecpar) >= 0);
+	par->codec_tag = 0;
+
+	avformat_close_input(&fmt_ctx);
+	return ok;
+}
+
+bool copy_smart_render_run(const SmartRenderRun& run, long export_start, AVFormatContext* ofmt_ctx, AVStream* ost, AVCodecContext* encoder, int64_t& last_dts, QString& error) {
+	AVFormatContext* fmt_ctx;
+	AVStream* stream;
+	if (!open_source(run.clip, &fmt_ctx, &stream)) {
+		qCritical() << "Failed to open source for smart render" << run.clip->name;
+		error = QCoreApplication::translate("ExportThread", "could not open %1 to copy it").arg(run.clip->name);
+		return false;
+	}
+
+	int ret = av_seek_frame(fmt_ctx, stream->index, run.source_start, AVSEEK_FLAG_BACKWARD);
+	if (ret < 0) {
+		qCritical() << "Failed to seek source for smart render" << ret;
+		error = QCoreApplication::translate("ExportThread", "could not seek %1 to copy it (%2)").arg(run.clip->name, QString::number(ret));
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+
+	// where the run starts in the output
+	int64_t offset = av_rescale_q(run.start - export_start, encoder->time_base, ost->time_base);
+
+	bool started = false;
+	bool ok = true;
+	AVPacket* packet = av_packet_alloc();
+	while (ok && av_read_frame(fmt_ctx, packet) >= 0) {
+		if (packet->stream_index != stream->index) {
+			av_packet_unref(packet);
+			continue;
+		}
+
+		int64_t ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+		bool key = (packet->flags & AV_PKT_FLAG_KEY);
+		if (!started && key && ts == run.source_start) started = true;
+		if (!started) {
+			av_packet_unref(packet);
+			continue;
+		}
+		if (key && ts >= run.source_end) {
+			av_packet_unref(packet);
+			break;
+		}
+
+		if (packet->pts != AV_NOPTS_VALUE) packet->pts = av_rescale_q(packet->pts - run.source_start, stream->time_base, ost->time_base) + offset;
+		if (packet->dts != AV_NOPTS_VALUE) packet->dts = av_rescale_q(packet->dts - run.source_start, stream->time_base, ost->time_base) + offset;
+		packet->duration = av_rescale_q(packet->duration, stream->time_base, ost->time_base);
+		packet->stream_index = ost->index;
+		packet->pos = -1;
+
+		// the muxer would reject it anyway, this way the error says why
+		if (packet->dts != AV_NOPTS_VALUE) {
+			if (packet->dts <= last_dts) {
+				qCritical() << "Smart render packet goes back in time" << packet->dts << last_dts;
+				error = QCoreApplication::translate("ExportThread", "copied frames from %1 overlap the previous ones, try again without smart render").arg(run.clip->name);
+				ok = false;
+				av_packet_unref(packet);
+				break;
+			}
+			last_dts = packet->dts;
+		}
+
+		ret = av_interleaved_write_frame(ofmt_ctx, packet);
+		if (ret < 0) {
+			qCritical() << "Failed to write copied packet." << ret;
+			error = QCoreApplication::translate("ExportThread", "failed to write video packet (%1)").arg(QString::number(ret));
+			ok = false;
+		}
+	}
+	av_packet_free(&packet);
+	avformat_close_input(&fmt_ctx);
+
+	if (ok && !started) {
+		qCritical() << "Smart render never reached the source keyframe" << run.source_start;
+		error = QCoreApplication::translate("ExportThread", "could not find the frames to copy from %1").arg(run.clip->name);
+		ok = false;
+	}
+
+	return ok;
+}
@@ -0,0 +1,48 @@
+#ifndef SMARTRENDER_H
+#define SMARTRENDER_H
+
+#include <QVector>
+#include <QString>
+
+struct Clip;
+struct Sequence;
+struct AVCodecContext;
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVStream;
+
+extern "C" {
+	#include <libavutil/avutil.h>
+}
+
+struct SmartRenderRun {
+	long start; // first sequence frame
+	long end; // sequence frame after the last one
+
+	// clip whose source packets are copied, nullptr if the frames are rendered
+	Clip* clip;
+
+	// keyframes the copy starts at and stops before, in the source stream's time base, source_end is INT64_MAX
+	// to copy to the end of the stream
+	int64_t source_start;
+	int64_t source_end;
+};
+
+/*
+ * Splits an export range into frames that have to be rendered and whole GOPs of single, untouched clips whose
+ * packets can be copied instead of decoded and encoded again. A clip making up the whole range is copied with its own
+ * stream headers. Anywhere else its packets have to decode with the encoder's headers, so a clip is only copied if
+ * its headers are exactly the encoder's and it doesn't reorder frames, which in practice means footage exported
+ * earlier with the same settings. Long-GOP footage from cameras or other encoders is rendered in full then. Where a
+ * copied clip's cut lands inside a GOP, the frames from the cut to the next keyframe (and from the last keyframe to
+ * the cut at the end) are a rendered run of their own, encoded before the copy carries on from the keyframe.
+ */
+QVector<SmartRenderRun> plan_smart_render(Sequence* s, long start, long end, AVCodecContext* encoder);
+
+// stream parameters of a run's source, for exports that are nothing but that run
+bool get_smart_render_parameters(const SmartRenderRun& run, AVCodecParameters* par);
+
+// copies a run's packets into the output, shifted to where the run starts in it, last_dts is in ost's time base
+bool copy_smart_render_run(const SmartRenderRun& run, long export_start, AVFormatContext* ofmt_ctx, AVStream* ost, AVCodecContext* encoder, int64_t& last_dts, QString& error);
+
+#endif // SMARTRENDER_H
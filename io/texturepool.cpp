@@ -0,0 +1,261 @@
+#include "texturepool.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+
+#include "debug.h"
+
+#define TEXTURE_POOL_DEFAULT_BUDGET 1073741824 // 1 GiB
+
+// guards every pool's lists, the pool and owner registries and the stats
+QMutex texture_pool_lock;
+QVector<TexturePool*> texture_pools;
+QHash<void*, TexturePool*> texture_pool_owners;
+TexturePoolStats texture_pool_stats = {TEXTURE_POOL_DEFAULT_BUDGET, 0, 0, 0, 0, 0, 0, 0};
+
+// framebuffers get a zero format so they never match a texture
+quint64 get_pool_key(int width, int height, int format) {
+	return (quint64(format & 0xFFFF) << 40) | (quint64(width & 0xFFFFF) << 20) | quint64(height & 0xFFFFF);
+}
+
+// estimated bytes per pixel, 3 channel formats are padded to 4 by most drivers
+int get_texture_format_size(QOpenGLTexture::TextureFormat format) {
+	switch (format) {
+	case QOpenGLTexture::R8_UNorm: return 1;
+	case QOpenGLTexture::RG8_UNorm: return 2;
+	case QOpenGLTexture::RGBA16F: return 8;
+	case QOpenGLTexture::RGBA32F: return 16;
+	default: return 4;
+	}
+}
+
+TexturePool::TexturePool(QOpenGLContext* ctx) :
+	QObject(ctx),
+	idle_bytes(0),
+	trim_requested(0)
+{
+	// objects have to be freed while the context still exists
+	connect(ctx, SIGNAL(aboutToBeDestroyed()), this, SLOT(destroy_all()));
+
+	QMutexLocker locker(&texture_pool_lock);
+	texture_pools.append(this);
+}
+
+TexturePool::~TexturePool() {
+	destroy_all();
+
+	QMutexLocker locker(&texture_pool_lock);
+	texture_pools.removeOne(this);
+}
+
+TexturePool* TexturePool::get(QOpenGLContext* ctx) {
+	TexturePool* pool = ctx->findChild<TexturePool*>(QString(), Qt::FindDirectChildrenOnly);
+	if (pool == nullptr) pool = new TexturePool(ctx);
+	return pool;
+}
+
+bool TexturePool::take_idle(quint64 key, Entry& e) {
+	QMutexLocker locker(&texture_pool_lock);
+	for (int i=idle.size()-1;i>=0;i--) {
+		if (idle.at(i).key == key) {
+			e = idle.takeAt(i);
+			idle_bytes -= e.size;
+			texture_pool_stats.idle_bytes -= e.size;
+			texture_pool_stats.reuses++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TexturePool::add_in_use(const Entry& e) {
+	QMutexLocker locker(&texture_pool_lock);
+	in_use.append(e);
+	texture_pool_stats.used_bytes += e.size;
+	texture_pool_stats.peak_bytes = qMax(texture_pool_stats.peak_bytes, texture_pool_stats.used_bytes + texture_pool_stats.idle_bytes);
+}
+
+void TexturePool::free_entry(const Entry& e) {
+	delete e.fbo;
+	delete e.texture;
+}
+
+QOpenGLFramebufferObject* TexturePool::acquire_framebuffer(int width, int height) {
+	if (trim_requested.load()) trim();
+
+	quint64 key = get_pool_key(width, height, 0);
+	Entry e;
+	if (!take_idle(key, e)) {
+		e.key = key;
+		e.size = qint64(width) * height * 4;
+		trim(e.size);
+
+		e.texture = nullptr;
+		e.fbo = new QOpenGLFramebufferObject(width, height);
+
+		QMutexLocker locker(&texture_pool_lock);
+		texture_pool_owners.insert(e.fbo, this);
+		texture_pool_stats.allocations++;
+	}
+	add_in_use(e);
+	return e.fbo;
+}
+
+QOpenGLTexture* TexturePool::acquire_texture(int width, int height, QOpenGLTexture::TextureFormat format, QOpenGLTexture::PixelFormat pixel_format) {
+	if (trim_requested.load()) trim();
+
+	quint64 key = get_pool_key(width, height, format);
+	Entry e;
+	if (!take_idle(key, e)) {
+		e.key = key;
+		e.size = qint64(width) * height * get_texture_format_size(format);
+		trim(e.size);
+
+		e.fbo = nullptr;
+		e.texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+		e.texture->setSize(width, height);
+		e.texture->setFormat(format);
+		e.texture->setMipLevels(1);
+		e.texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+		e.texture->allocateStorage(pixel_format, QOpenGLTexture::UInt8);
+
+		QMutexLocker locker(&texture_pool_lock);
+		texture_pool_owners.insert(e.texture, this);
+		texture_pool_stats.allocations++;
+	}
+	add_in_use(e);
+	return e.texture;
+}
+
+void TexturePool::release(void* object) {
+	QMutexLocker locker(&texture_pool_lock);
+	for (int i=0;i<in_use.size();i++) {
+		const Entry& e = in_use.at(i);
+		if (e.fbo == object || e.texture == object) {
+			texture_pool_stats.used_bytes -= e.size;
+			texture_pool_stats.idle_bytes += e.size;
+			idle_bytes += e.size;
+			idle.append(in_use.takeAt(i));
+			return;
+		}
+	}
+}
+
+void TexturePool::trim(qint64 extra_bytes) {
+	QList<Entry> evicted;
+
+	texture_pool_lock.lock();
+	trim_requested.store(0);
+	while (!idle.isEmpty() && texture_pool_stats.used_bytes + texture_pool_stats.idle_bytes + extra_bytes > texture_pool_stats.budget) {
+		Entry e = idle.takeFirst();
+		idle_bytes -= e.size;
+		texture_pool_stats.idle_bytes -= e.size;
+		texture_pool_stats.evictions++;
+		texture_pool_owners.remove((e.fbo != nullptr) ? static_cast<void*>(e.fbo) : static_cast<void*>(e.texture));
+		evicted.append(e);
+	}
+
+	// what's left idle belongs to other contexts, which free it themselves on their next acquire
+	if (texture_pool_stats.used_bytes + texture_pool_stats.idle_bytes + extra_bytes > texture_pool_stats.budget) {
+		for (int i=0;i<texture_pools.size();i++) {
+			if (texture_pools.at(i) != this && texture_pools.at(i)->idle_bytes > 0) {
+				texture_pools.at(i)->trim_requested.store(1);
+			}
+		}
+	}
+
+	qint64 needed = texture_pool_stats.used_bytes + extra_bytes;
+	bool over = (extra_bytes > 0 && needed > texture_pool_stats.budget);
+	if (over) texture_pool_stats.over_budget++;
+	texture_pool_lock.unlock();
+
+	for (int i=0;i<evicted.size();i++) {
+		free_entry(evicted.at(i));
+	}
+
+	if (over) {
+		// frames still have to render, so the allocation goes ahead
+		qWarning() << "GPU memory budget exceeded by a frame that needs" << needed / 1048576 << "MiB";
+	}
+}
+
+void TexturePool::destroy_all() {
+	texture_pool_lock.lock();
+	QList<Entry> entries = idle + in_use;
+	idle_bytes = 0;
+	for (int i=0;i<idle.size();i++) {
+		texture_pool_stats.idle_bytes -= idle.at(i).size;
+	}
+	for (int i=0;i<in_use.size();i++) {
+		texture_pool_stats.used_bytes -= in_use.at(i).size;
+	}
+	for (int i=0;i<entries.size();i++) {
+		texture_pool_owners.remove((entries.at(i).fbo != nullptr) ? static_cast<void*>(entries.at(i).fbo) : static_cast<void*>(entries.at(i).texture));
+	}
+	idle.clear();
+	in_use.clear();
+	texture_pool_lock.unlock();
+
+	// anything still lent out dies with the context, clips are closed before their viewer's context goes away
+	for (int i=0;i<entries.size();i++) {
+		free_entry(entries.at(i));
+	}
+}
+
+QOpenGLFramebufferObject* acquire_framebuffer(int width, int height) {
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	if (ctx == nullptr) return nullptr;
+	return TexturePool::get(ctx)->acquire_framebuffer(width, height);
+}
+
+QOpenGLTexture* acquire_texture(int width, int height, QOpenGLTexture::TextureFormat format, QOpenGLTexture::PixelFormat pixel_format) {
+	QOpenGLContext* ctx = QOpenGLContext::currentContext();
+	if (ctx == nullptr) return nullptr;
+	return TexturePool::get(ctx)->acquire_texture(width, height, format, pixel_format);
+}
+
+void release_pooled_object(void* object) {
+	texture_pool_lock.lock();
+	TexturePool* pool = texture_pool_owners.value(object);
+	texture_pool_lock.unlock();
+
+	if (pool != nullptr) pool->release(object);
+}
+
+void release_framebuffer(QOpenGLFramebufferObject* fbo) {
+	release_pooled_object(fbo);
+}
+
+void release_texture(QOpenGLTexture* texture) {
+	release_pooled_object(texture);
+}
+
+void set_texture_pool_budget(qint64 bytes) {
+	// idle objects over the new budget are freed by each pool's next allocation
+	QMutexLocker locker(&texture_pool_lock);
+	texture_pool_stats.budget = bytes;
+	for (int i=0;i<texture_pools.size();i++) {
+		texture_pools.at(i)->trim_requested.store(1);
+	}
+}
+
+TexturePoolStats get_texture_pool_stats() {
+	QMutexLocker locker(&texture_pool_lock);
+	return texture_pool_stats;
+}
+
+QString get_texture_pool_summary() {
+	TexturePoolStats s = get_texture_pool_stats();
+	return QString("GPU memory pool: %1 MiB in use, %2 MiB idle, %3 MiB budget, %4 MiB peak - %5 reused, %6 allocated, %7 evicted, %8 over budget")
+			.arg(s.used_bytes / 1048576)
+			.arg(s.idle_bytes / 1048576)
+			.arg(s.budget / 1048576)
+			.arg(s.peak_bytes / 1048576)
+			.arg(s.reuses)
+			.arg(s.allocations)
+			.arg(s.evictions)
+			.arg(s.over_budget);
+}
@@ -0,0 +1,79 @@
+#ifndef TEXTUREPOOL_H
+#define TEXTUREPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QAtomicInt>
+#include <QOpenGLTexture>
+
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+
+struct TexturePoolStats {
+	qint64 budget;
+	qint64 used_bytes; // currently lent out
+	qint64 idle_bytes; // allocated and waiting to be reused
+	qint64 peak_bytes;
+	int reuses;
+	int allocations;
+	int evictions;
+	int over_budget; // allocations made past the budget because what's lent out already fills it
+};
+
+/*
+ * Render targets and textures owned by one GL context, keyed by size and format. Clips borrow their
+ * framebuffers for the frame they're composited in and their upload texture while they're open, and hand
+ * them back instead of deleting them, so opening clips and drawing frames doesn't allocate on the GPU once
+ * the pool is warm. Idle objects are freed least recently used first whenever the pools would otherwise
+ * exceed the budget shared by all contexts. Objects can only be freed in their own context, so a pool that still
+ * doesn't fit after freeing its own idle objects has the other pools free theirs on their next acquire. Only
+ * objects that are lent out can take the pools past the budget, frames still have to render.
+ */
+class TexturePool : public QObject {
+	Q_OBJECT
+public:
+	TexturePool(QOpenGLContext* ctx);
+	~TexturePool();
+	static TexturePool* get(QOpenGLContext* ctx);
+
+	QOpenGLFramebufferObject* acquire_framebuffer(int width, int height);
+	QOpenGLTexture* acquire_texture(int width, int height, QOpenGLTexture::TextureFormat format, QOpenGLTexture::PixelFormat pixel_format);
+	void release(void* object);
+
+	// frees idle objects until the pools fit the budget, requires this pool's context to be current
+	void trim(qint64 extra_bytes = 0);
+private slots:
+	void destroy_all();
+private:
+	struct Entry {
+		QOpenGLFramebufferObject* fbo;
+		QOpenGLTexture* texture;
+		quint64 key;
+		qint64 size;
+	};
+
+	bool take_idle(quint64 key, Entry& e);
+	void add_in_use(const Entry& e);
+	void free_entry(const Entry& e);
+
+	// least recently released at the front
+	QList<Entry> idle;
+	QList<Entry> in_use;
+	qint64 idle_bytes;
+	// set by other pools that couldn't fit the budget on their own
+	QAtomicInt trim_requested;
+};
+
+// borrows from the pool of the current context, never returns nullptr while a context is current
+QOpenGLFramebufferObject* acquire_framebuffer(int width, int height);
+QOpenGLTexture* acquire_texture(int width, int height, QOpenGLTexture::TextureFormat format, QOpenGLTexture::PixelFormat pixel_format);
+
+// hands an object back to the pool it came from, safe without a current context
+void release_framebuffer(QOpenGLFramebufferObject* fbo);
+void release_texture(QOpenGLTexture* texture);
+
+void set_texture_pool_budget(qint64 bytes);
+TexturePoolStats get_texture_pool_stats();
+QString get_texture_pool_summary();
+
+#endif // TEXTUREPOOL_H
@@ -0,0 +1,72 @@
+#include "textureupload.h"
+
+#include <QOpenGLContext>
+
+#include "debug.h"
+
+TextureUploadRing::TextureUploadRing() :
+	current(0),
+	mapped(false),
+	unsupported(false)
+{
+	for (int i=0;i<TEXTURE_UPLOAD_RING_SIZE;i++) {
+		buffers[i] = QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+		buffers[i].setUsagePattern(QOpenGLBuffer::StreamDraw);
+	}
+}
+
+TextureUploadRing::~TextureUploadRing() {
+	// freed by Qt once a context of the group is current again if there isn't one now
+	for (int i=0;i<TEXTURE_UPLOAD_RING_SIZE;i++) {
+		buffers[i].destroy();
+	}
+}
+
+uchar* TextureUploadRing::map(int size) {
+	if (!unsupported) {
+		current = (current + 1) % TEXTURE_UPLOAD_RING_SIZE;
+		QOpenGLBuffer& buffer = buffers[current];
+
+		if (!buffer.isCreated() && !buffer.create()) {
+			qWarning() << "Pixel buffers are unavailable, uploading frames directly";
+			unsupported = true;
+		} else {
+			buffer.bind();
+
+			// reallocating orphans the old storage, so this never waits for a transfer still reading it
+			buffer.allocate(size);
+			void* ptr = buffer.mapRange(0, size, QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidateBuffer);
+			if (ptr == nullptr) ptr = buffer.map(QOpenGLBuffer::WriteOnly);
+			buffer.release();
+
+			if (ptr != nullptr) {
+				mapped = true;
+				return static_cast<uchar*>(ptr);
+			}
+
+			qWarning() << "Pixel buffers can't be mapped, uploading frames directly";
+			buffer.destroy();
+			unsupported = true;
+		}
+	}
+
+	mapped = false;
+	if (staging.size() < size) staging.resize(size);
+	return reinterpret_cast<uchar*>(staging.data());
+}
+
+void TextureUploadRing::upload(QOpenGLTexture* texture, QOpenGLTexture::PixelFormat format) {
+	if (mapped) {
+		QOpenGLBuffer& buffer = buffers[current];
+		buffer.bind();
+		buffer.unmap();
+
+		// with an unpack buffer bound, the data pointer is an offset into it and the call returns immediately
+		texture->setData(0, format, QOpenGLTexture::UInt8, static_cast<const void*>(nullptr));
+
+		buffer.release();
+		mapped = false;
+	} else {
+		texture->setData(0, format, QOpenGLTexture::UInt8, staging.constData());
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef TEXTUREUPLOAD_H
+#define TEXTUREUPLOAD_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLTexture>
+#include <QByteArray>
+
+// enough buffers that the driver can still be reading the last two frames while the next one is written
+#define TEXTURE_UPLOAD_RING_SIZE 3
+
+/*
+ * Streams frames into a texture through a ring of pixel unpack buffers. map() hands out write-only memory in the
+ * next buffer of the ring, which the caller fills with a finished frame before upload() queues the transfer. Reading
+ * it back is slow or undefined, so CPU image effects run on a copy of the frame that's then written here. The GL thread never waits for the copy to reach the texture and never touches a
+ * buffer the driver may still be reading. Falls back to a reused staging buffer where pixel buffers can't be
+ * mapped. Must be used on the thread of the context the texture belongs to.
+ */
+class TextureUploadRing {
+public:
+	TextureUploadRing();
+	~TextureUploadRing();
+
+	uchar* map(int size);
+	void upload(QOpenGLTexture* texture, QOpenGLTexture::PixelFormat format);
+private:
+	QOpenGLBuffer buffers[TEXTURE_UPLOAD_RING_SIZE];
+	int current;
+	bool mapped;
+	bool unsupported;
+	QByteArray staging;
+};
+
+#endif // TEXTUREUPLOAD_H
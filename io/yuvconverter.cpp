@@ -0,0 +1,214 @@
+#include "yuvconverter.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QVector3D>
+
+#include "io/shadercache.h"
+#include "io/glgeometry.h"
+#include "debug.h"
+
+extern "C" {
+	#include <libavutil/common.h>
+	#include <libavutil/frame.h>
+	#include <libavutil/pixdesc.h>
+}
+
+#ifndef GL_RGBA16
+#define GL_RGBA16 0x805B
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+
+const char* const yuv_vert_source =
+		"#version 110\n"
+		"\n"
+		"attribute vec2 a_position;\n"
+		"attribute vec2 a_texcoord;\n"
+		"\n"
+		"uniform mat4 mvp_matrix;\n"
+		"\n"
+		"varying vec2 vTexCoord;\n"
+		"\n"
+		"void main() {\n"
+		"	vTexCoord = a_texcoord;\n"
+		"	gl_Position = mvp_matrix * vec4(a_position, 0.0, 1.0);\n"
+		"}\n";
+
+// writes one plane's integer code, scaled to what the render target stores
+const char* const yuv_frag_source =
+		"#version 110\n"
+		"\n"
+		"uniform sampler2D image;\n"
+		"uniform vec3 weights;\n"
+		"uniform float code_offset;\n"
+		"uniform float code_scale;\n"
+		"uniform float code_max;\n"
+		"uniform float storage_max;\n"
+		"\n"
+		"varying vec2 vTexCoord;\n"
+		"\n"
+		"void main(void) {\n"
+		"	vec3 rgb = texture2D(image, vTexCoord).rgb;\n"
+		"	float code = clamp(floor(code_offset + dot(weights, rgb) * code_scale + 0.5), 0.0, code_max);\n"
+		"	gl_FragColor = vec4(code / storage_max, 0.0, 0.0, 1.0);\n"
+		"}\n";
+
+static bool is_full_range(int pix_fmt) {
+	return (pix_fmt == AV_PIX_FMT_YUVJ420P || pix_fmt == AV_PIX_FMT_YUVJ422P || pix_fmt == AV_PIX_FMT_YUVJ444P);
+}
+
+bool can_convert_on_gpu(int pix_fmt) {
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(pix_fmt));
+	if (desc == nullptr) return false;
+
+	// three planes of little endian samples, no alpha, no palette and no more than 4:2:0 subsampling
+	return (desc->nb_components == 3
+			&& (desc->flags & AV_PIX_FMT_FLAG_PLANAR)
+			&& !(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_ALPHA))
+			&& desc->log2_chroma_w <= 1
+			&& desc->log2_chroma_h <= 1
+			&& (desc->comp[0].depth == 8 || desc->comp[0].depth == 10)
+			&& desc->comp[1].plane == 1
+			&& desc->comp[2].plane == 2);
+}
+
+int get_export_colorspace(int height) {
+	return (height > 576) ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+}
+
+YUVConverter::YUVConverter() :
+	initialized(false),
+	single_channel(false)
+{
+	for (int i=0;i<3;i++) {
+		planes[i] = nullptr;
+	}
+}
+
+YUVConverter::~YUVConverter() {
+	if (planes[0] != nullptr) qWarning() << "YUV converter was deleted without freeing its planes";
+}
+
+void YUVConverter::destroy() {
+	for (int i=0;i<3;i++) {
+		delete planes[i];
+		planes[i] = nullptr;
+	}
+}
+
+bool YUVConverter::convert(GLuint texture, AVFrame* frame) {
+	if (!initialized) {
+		initializeOpenGLFunctions();
+
+		// one channel targets need GL 3.0 or ARB_texture_rg, older contexts store the code in the red of RGBA
+		QOpenGLContext* ctx = QOpenGLContext::currentContext();
+		single_channel = (!ctx->isOpenGLES()
+						  && (ctx->format().majorVersion() >= 3 || ctx->hasExtension("GL_ARB_texture_rg")));
+
+		initialized = true;
+	}
+
+	QOpenGLShaderProgram* program = get_shader_program_from_source("yuv", yuv_vert_source, yuv_frag_source);
+	if (program == nullptr || !program->bind()) {
+		qWarning() << "YUV conversion shader is unavailable";
+		return false;
+	}
+
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+	int depth = desc->comp[0].depth;
+	bool full_range = is_full_range(frame->format);
+	double depth_scale = (1 << (depth - 8));
+	double code_max = (1 << depth) - 1;
+
+	double kr, kb;
+	if (get_export_colorspace(frame->height) == AVCOL_SPC_BT709) {
+		kr = 0.2126;
+		kb = 0.0722;
+	} else {
+		kr = 0.299;
+		kb = 0.114;
+	}
+	double kg = 1.0 - kr - kb;
+
+	// Y, Cb and Cr, with Cb and Cr from -0.5 to 0.5
+	QVector3D weights[3] = {
+		QVector3D(kr, kg, kb),
+		QVector3D(-kr, -kg, 1.0 - kb) / (2.0 * (1.0 - kb)),
+		QVector3D(1.0 - kr, -kg, -kb) / (2.0 * (1.0 - kr))
+	};
+
+	// the unit square covers the whole target without flipping, the frame is already composited top row first
+	QMatrix4x4 mvp;
+	mvp.ortho(0, 1, 0, 1, -1, 1);
+
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// 10-bit codes are stored as 16-bit integers, which is also how the frame holds them
+	GLenum storage;
+	if (single_channel) {
+		storage = (depth > 8) ? GL_R16 : GL_R8;
+	} else {
+		storage = (depth > 8) ? GL_RGBA16 : GL_RGBA8;
+	}
+	GLenum type = (depth > 8) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+	int bytes = (depth > 8) ? 2 : 1;
+
+	program->setUniformValue("image", 0);
+	program->setUniformValue("code_max", GLfloat(code_max));
+	program->setUniformValue("storage_max", GLfloat((depth > 8) ? 65535.0 : 255.0));
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (int i=0;i<3;i++) {
+		int width = (i == 0) ? frame->width : AV_CEIL_RSHIFT(frame->width, desc->log2_chroma_w);
+		int height = (i == 0) ? frame->height : AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+
+		if (planes[i] == nullptr
+				|| planes[i]->width() != width
+				|| planes[i]->height() != height
+				|| planes[i]->format().internalTextureFormat() != storage) {
+			delete planes[i];
+			planes[i] = new QOpenGLFramebufferObject(width, height, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, storage);
+		}
+
+		double offset = 0;
+		double scale = code_max;
+		if (!full_range) {
+			scale = ((i == 0) ? 219 : 224) * depth_scale;
+			offset = ((i == 0) ? 16 : 128) * depth_scale;
+		} else if (i > 0) {
+			offset = 128 * depth_scale;
+		}
+		program->setUniformValue("weights", weights[i]);
+		program->setUniformValue("code_offset", GLfloat(offset));
+		program->setUniformValue("code_scale", GLfloat(scale));
+
+		planes[i]->bind();
+		glViewport(0, 0, width, height);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		draw_unit_mesh(program, mvp);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glPixelStorei(GL_PACK_ROW_LENGTH, frame->linesize[i] / bytes);
+		glReadPixels(0, 0, width, height, GL_RED, type, frame->data[i]);
+		planes[i]->release();
+	}
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	program->release();
+	if (blend) glEnable(GL_BLEND);
+
+	return true;
+}
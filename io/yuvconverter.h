@@ -0,0 +1,36 @@
+#ifndef YUVCONVERTER_H
+#define YUVCONVERTER_H
+
+#include <QOpenGLFunctions>
+
+class QOpenGLFramebufferObject;
+struct AVFrame;
+
+// planar YUV formats exports can have the render thread convert to before reading frames back
+bool can_convert_on_gpu(int pix_fmt);
+
+// matrix exported YUV is encoded with, BT.709 for HD and up, BT.601 below, as an AVColorSpace
+int get_export_colorspace(int height);
+
+/*
+ * Converts a composited frame into an encoder's planes on the GPU. Each plane is drawn at its own size into a
+ * single channel render target (RGBA where the context has none) and read back straight into the frame, so exports
+ * read back only what the encoder needs instead of full RGBA and skip sws_scale. 10-bit codes are only as precise as
+ * the texture they're converted from, see RenderThread::render_planes(). Belongs to the context that's current when
+ * convert() is first called, destroy() has to be called with it current too.
+ */
+class YUVConverter : protected QOpenGLFunctions {
+public:
+	YUVConverter();
+	~YUVConverter();
+
+	// scales texture to the frame's size, the frame's format has to pass can_convert_on_gpu()
+	bool convert(GLuint texture, AVFrame* frame);
+	void destroy();
+private:
+	QOpenGLFramebufferObject* planes[3];
+	bool initialized;
+	bool single_channel;
+};
+
+#endif // YUVCONVERTER_H
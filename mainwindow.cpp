@@ -2,6 +2,8 @@
 
 #include "io/config.h"
 #include "io/path.h"
+#include "io/previewcache.h"
+#include "io/texturepool.h"
 
 #include "project/footage.h"
 #include "project/sequence.h"
@@ -142,7 +144,6 @@ MainWindow::MainWindow(QWidget *parent, const QString &an) :
 		QDir dir(data_dir);
 		dir.mkpath(".");
 		if (dir.exists()) {
-			qint64 a_month_ago = QDateTime::currentMSecsSinceEpoch() - 2592000000;
 			qint64 a_week_ago = QDateTime::currentMSecsSinceEpoch() - 604800000;
 
 			// TODO put delete functions in another thread?
@@ -159,19 +160,19 @@ MainWindow::MainWindow(QWidget *parent, const QString &an) :
 			}
 			if (deleted_ars > 0) qInfo() << "Deleted" << deleted_ars << "autorecovery" << ((deleted_ars == 1) ? "file that was" : "files that were") << "older than 7 days";
 
-			// delete previews older than 30 days
+			// delete loose preview files left over from before the preview cache, it manages its own eviction
 			QDir preview_dir = QDir(data_dir + "/previews");
 			if (preview_dir.exists()) {
 				deleted_ars = 0;
 				QStringList old_prevs = preview_dir.entryList(QDir::Files);
 				for (int i=0;i<old_prevs.size();i++) {
-					QString file_name = preview_dir.absolutePath() + "/" + old_prevs.at(i);
-					qint64 file_time = QFileInfo(file_name).lastRead().toMSecsSinceEpoch();
-					if (file_time < a_month_ago) {
-						if (QFile(file_name).remove()) deleted_ars++;
+					if (!old_prevs.at(i).startsWith(PREVIEW_CACHE_FILENAME)) {
+						if (QFile(preview_dir.absolutePath() + "/" + old_prevs.at(i)).remove()) deleted_ars++;
 					}
 				}
-				if (deleted_ars > 0) qInfo() << "Deleted" << deleted_ars << "preview" << ((deleted_ars == 1) ? "file that was" : "files that were") << "last read over 30 days ago";
+				if (deleted_ars > 0) qInfo() << "Deleted" << deleted_ars << "legacy preview" << ((deleted_ars == 1) ? "file" : "files");
+			} else {
+				preview_dir.mkpath(".");
 			}
 
 			// search for open recents list
@@ -205,6 +206,12 @@ MainWindow::MainWindow(QWidget *parent, const QString &an) :
 		}
 	}
 
+	if (!data_dir.isEmpty()) {
+		preview_cache.open(data_dir + "/previews/" + PREVIEW_CACHE_FILENAME, qint64(config.preview_cache_size) * 1048576);
+	}
+
+	set_texture_pool_budget(qint64(config.gpu_memory_budget) * 1048576);
+
 	alloc_panels(this);
 
 	QStatusBar* statusBar = new QStatusBar(this);
@@ -213,6 +220,9 @@ MainWindow::MainWindow(QWidget *parent, const QString &an) :
 
 	setup_menus();
 
+	autorecovery_edit_count = 0;
+	autorecovery_saved_edit_count = -1;
+
 	if (!data_dir.isEmpty()) {
 		// detect auto-recovery file
 		autorecovery_filename = data_dir + "/autorecovery.ove";
@@ -222,6 +232,7 @@ MainWindow::MainWindow(QWidget *parent, const QString &an) :
 				open_project_worker(autorecovery_filename, true);
 			}
 		}
+		connect(&undo_stack, SIGNAL(indexChanged(int)), this, SLOT(count_autorecovery_edit()));
 		autorecovery_timer.setInterval(60000);
 		QObject::connect(&autorecovery_timer, SIGNAL(timeout()), this, SLOT(autorecover_interval()));
 		autorecovery_timer.start();
@@ -502,12 +513,17 @@ void MainWindow::new_project() {
 }
 
 void MainWindow::autorecover_interval() {
-	if (!rendering && isWindowModified()) {
+	// skip the snapshot entirely if nothing was edited since the last one
+	if (!rendering && isWindowModified() && autorecovery_edit_count != autorecovery_saved_edit_count) {
 		panel_project->save_project(true);
-		qInfo() << "Auto-recovery project saved";
+		autorecovery_saved_edit_count = autorecovery_edit_count;
 	}
 }
 
+void MainWindow::count_autorecovery_edit() {
+	autorecovery_edit_count++;
+}
+
 bool MainWindow::save_project_as() {
 	QString fn = QFileDialog::getSaveFileName(this, tr("Save Project As..."), "", OLIVE_FILE_FILTER);
 	if (!fn.isEmpty()) {
@@ -976,6 +992,8 @@ void MainWindow::closeEvent(QCloseEvent *e) {
 
 		QString data_dir = get_data_path();
 		QString config_dir = get_config_path();
+		panel_project->wait_for_project_writes();
+
 		if (!data_dir.isEmpty() && !autorecovery_filename.isEmpty()) {
 			if (QFile::exists(autorecovery_filename)) {
 				QFile::rename(autorecovery_filename, autorecovery_filename + "." + QDateTime::currentDateTimeUtc().toString("yyyyMMddHHmmss"));
@@ -997,6 +1015,8 @@ void MainWindow::closeEvent(QCloseEvent *e) {
 			save_shortcuts(config_dir + "/shortcuts");
 		}
 
+		preview_cache.close();
+
 		stop_audio();
 
 		e->accept();
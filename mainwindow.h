@@ -43,6 +43,7 @@ protected:
 
 private slots:
 	void clear_undo_stack();
+	void count_autorecovery_edit();
 
 	void show_about();
 	void show_debug_log();
@@ -196,6 +197,9 @@ private:
 
 	bool enable_launch_with_project;
 
+	int autorecovery_edit_count;
+	int autorecovery_saved_edit_count;
+
 	QString appName;
 };
 
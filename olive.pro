@@ -59,9 +59,22 @@ SOURCES += \
     ui/collapsiblewidget.cpp \
     panels/panels.cpp \
     playback/cacher.cpp \
+    playback/drawpacket.cpp \
+    playback/renderthread.cpp \
     io/exportthread.cpp \
+    io/exportsegment.cpp \
+    io/exportstill.cpp \
+    io/exportfeed.cpp \
+    io/smartrender.cpp \
+    io/audiomixdown.cpp \
+    io/yuvconverter.cpp \
     ui/timelineheader.cpp \
     io/previewgenerator.cpp \
+    io/previewcache.cpp \
+    io/shadercache.cpp \
+    io/glgeometry.cpp \
+    io/texturepool.cpp \
+    io/textureupload.cpp \
     ui/labelslider.cpp \
     dialogs/preferencesdialog.cpp \
     ui/audiomonitor.cpp \
@@ -81,6 +94,7 @@ SOURCES += \
     io/crc32.cpp \
     project/projectmodel.cpp \
     io/loadthread.cpp \
+    io/projectsnapshot.cpp \
     dialogs/loaddialog.cpp \
     debug.cpp \
     io/path.cpp \
@@ -98,9 +112,11 @@ SOURCES += \
     effects/internal/exponentialfadetransition.cpp \
     effects/internal/logarithmicfadetransition.cpp \
     effects/internal/cornerpineffect.cpp \
+    effects/internal/blureffect.cpp \
     io/math.cpp \
     io/qpainterwrapper.cpp \
     project/effect.cpp \
+    project/superimposerenderer.cpp \
     project/transition.cpp \
     project/effectrow.cpp \
     project/effectfield.cpp \
@@ -149,10 +165,23 @@ HEADERS += \
     ui/collapsiblewidget.h \
     panels/panels.h \
     playback/cacher.h \
+    playback/drawpacket.h \
+    playback/renderthread.h \
     io/exportthread.h \
+    io/exportsegment.h \
+    io/exportstill.h \
+    io/exportfeed.h \
+    io/smartrender.h \
+    io/audiomixdown.h \
+    io/yuvconverter.h \
     ui/timelinetools.h \
     ui/timelineheader.h \
     io/previewgenerator.h \
+    io/previewcache.h \
+    io/shadercache.h \
+    io/glgeometry.h \
+    io/texturepool.h \
+    io/textureupload.h \
     ui/labelslider.h \
     dialogs/preferencesdialog.h \
     ui/audiomonitor.h \
@@ -173,6 +202,7 @@ HEADERS += \
     io/crc32.h \
     project/projectmodel.h \
     io/loadthread.h \
+    io/projectsnapshot.h \
     dialogs/loaddialog.h \
     debug.h \
     io/path.h \
@@ -190,9 +220,11 @@ HEADERS += \
     effects/internal/exponentialfadetransition.h \
     effects/internal/logarithmicfadetransition.h \
     effects/internal/cornerpineffect.h \
+    effects/internal/blureffect.h \
     io/math.h \
     io/qpainterwrapper.h \
     project/effect.h \
+    project/superimposerenderer.h \
     project/transition.h \
     project/effectrow.h \
     project/effectfield.h \
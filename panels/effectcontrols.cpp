@@ -14,6 +14,8 @@
 
 #include "panels/panels.h"
 #include "project/effect.h"
+#include "project/effectrow.h"
+#include "project/effectfield.h"
 #include "project/clip.h"
 #include "project/transition.h"
 #include "ui/collapsiblewidget.h"
@@ -28,6 +30,7 @@
 #include "ui/timelineheader.h"
 #include "ui/keyframeview.h"
 #include "ui/resizablescrollbar.h"
+#include "playback/playback.h"
 #include "debug.h"
 
 EffectControls::EffectControls(QWidget *parent) :
@@ -99,10 +102,32 @@ void EffectControls::menu_select(QAction* q) {
 }
 
 void EffectControls::update_keyframes() {
+	update_field_values();
 	headers->update_zoom(zoom);
 	keyframeView->update();
 }
 
+void EffectControls::update_field_values() {
+	// keyframed fields are moved to the playhead here, rendering only reads them
+	if (sequence == nullptr) return;
+
+	for (int i=0;i<selected_clips.size();i++) {
+		Clip* c = sequence->clips.at(selected_clips.at(i));
+		if (c == nullptr) continue;
+
+		double timecode = get_timecode(c, sequence->playhead);
+		for (int j=0;j<c->effects.size();j++) {
+			Effect* e = c->effects.at(j);
+			for (int k=0;k<e->row_count();k++) {
+				EffectRow* row = e->row(k);
+				for (int l=0;l<row->fieldCount();l++) {
+					row->field(l)->validate_keyframe_data(timecode);
+				}
+			}
+		}
+	}
+}
+
 void EffectControls::delete_selected_keyframes() {
 	keyframeView->delete_selected_keyframes();
 }
@@ -117,7 +142,7 @@ void EffectControls::copy(bool del) {
 			Clip* c = sequence->clips.at(selected_clips.at(i));
 			for (int j=0;j<c->effects.size();j++) {
 				Effect* effect = c->effects.at(j);
-				if (effect->container->selected) {
+				if (effect->get_container()->selected) {
 					if (!cleared) {
 						clear_clipboard();
 						cleared = true;
@@ -243,8 +268,8 @@ void EffectControls::deselect_all_effects(QWidget* sender) {
 	for (int i=0;i<selected_clips.size();i++) {
 		Clip* c = sequence->clips.at(selected_clips.at(i));
 		for (int j=0;j<c->effects.size();j++) {
-			if (c->effects.at(j)->container != sender) {
-				c->effects.at(j)->container->header_click(false, false);
+			if (c->effects.at(j)->get_container() != sender) {
+				c->effects.at(j)->get_container()->header_click(false, false);
 			}
 		}
 	}
@@ -252,7 +277,7 @@ void EffectControls::deselect_all_effects(QWidget* sender) {
 }
 
 void EffectControls::open_effect(QVBoxLayout* layout, Effect* e) {
-	CollapsibleWidget* container = e->container;
+	CollapsibleWidget* container = e->get_container();
 	layout->addWidget(container);
 	connect(container, SIGNAL(deselect_others(QWidget*)), this, SLOT(deselect_all_effects(QWidget*)));
 }
@@ -479,7 +504,7 @@ void EffectControls::delete_effects() {
 			Clip* c = sequence->clips.at(selected_clips.at(i));
 			for (int j=0;j<c->effects.size();j++) {
 				Effect* effect = c->effects.at(j);
-				if (effect->container->selected) {
+				if (effect->get_container()->selected) {
 					command->clips.append(c);
 					command->fx.append(j);
 				}
@@ -535,7 +560,7 @@ bool EffectControls::is_focused() {
 		Clip* c = sequence->clips.at(selected_clips.at(i));
 		if (c != nullptr) {
 			for (int j=0;j<c->effects.size();j++) {
-				if (c->effects.at(j)->container->is_focused()) {
+				if (c->effects.at(j)->get_container()->is_focused()) {
 					return true;
 				}
 			}
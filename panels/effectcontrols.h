@@ -73,6 +73,7 @@ private:
 	void show_effect_menu(int type, int subtype);
 	void load_effects();
 	void load_keyframes();
+	void update_field_values();
     void open_effect(QVBoxLayout* hlayout, Effect* e);
 
 	void setup_ui();
@@ -175,7 +175,7 @@ void GraphEditor::set_row(EffectRow *r) {
 				slider_proxies.append(slider);
 				value_layout->addWidget(slider);
 
-				slider_proxy_sources.append(static_cast<LabelSlider*>(field->ui_element));
+				slider_proxy_sources.append(static_cast<LabelSlider*>(field->get_ui_element()));
 
 				found_vals = true;
 			}
@@ -21,6 +21,7 @@
 #include "dialogs/mediapropertiesdialog.h"
 #include "dialogs/loaddialog.h"
 #include "io/clipboard.h"
+#include "io/projectsnapshot.h"
 #include "project/media.h"
 #include "ui/sourcetable.h"
 #include "ui/sourceiconview.h"
@@ -38,11 +39,16 @@
 #include <QPushButton>
 #include <QInputDialog>
 #include <QSortFilterProxyModel>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
 #include <QXmlStreamReader>
-#include <QXmlStreamWriter>
+#include <QSharedPointer>
 #include <QSizePolicy>
 #include <QVBoxLayout>
 #include <QMenu>
+#include <QScrollBar>
 
 extern "C" {
 	#include <libavformat/avformat.h>
@@ -176,6 +182,16 @@ Project::Project(QWidget *parent) :
 	connect(directory_up, SIGNAL(clicked(bool)), this, SLOT(go_up_dir()));
 	connect(icon_view, SIGNAL(changed_root()), this, SLOT(set_up_dir_enabled()));
 
+	// bump previews of whatever scrolls into view ahead of the rest of the import, once scrolling settles
+	preview_priority_timer = new QTimer(this);
+	preview_priority_timer->setSingleShot(true);
+	preview_priority_timer->setInterval(PREVIEW_PRIORITY_DELAY);
+	connect(preview_priority_timer, SIGNAL(timeout()), this, SLOT(prioritize_visible_previews()));
+	connect(tree_view->verticalScrollBar(), SIGNAL(valueChanged(int)), preview_priority_timer, SLOT(start()));
+	connect(tree_view, SIGNAL(expanded(const QModelIndex&)), preview_priority_timer, SLOT(start()));
+	connect(icon_view->verticalScrollBar(), SIGNAL(valueChanged(int)), preview_priority_timer, SLOT(start()));
+	connect(icon_view, SIGNAL(changed_root()), preview_priority_timer, SLOT(start()));
+
 	//retranslateUi(Project);
 	setWindowTitle(tr("Project"));
 
@@ -600,9 +616,53 @@ void Project::start_preview_generator(Media* item, bool replacing) {
 	QMetaObject::invokeMethod(throbber, "start", Qt::QueuedConnection);
 
 	PreviewGenerator* pg = new PreviewGenerator(item, item->to_footage(), replacing);
+	pg->moveToThread(QApplication::instance()->thread());
 	item->to_footage()->preview_gen = pg;
+
+	// widgets can only be queried from the GUI thread (the load thread also starts generators)
+	if (QThread::currentThread() == thread() && is_media_visible(item)) {
+		pg->set_priority(PREVIEW_PRIORITY_VISIBLE);
+	}
+
 	connect(pg, SIGNAL(set_icon(int, bool)), throbber, SLOT(stop(int, bool)));
-	pg->start(QThread::LowPriority);
+	pg->start();
+}
+
+bool Project::is_media_visible(Media* m) {
+	QModelIndex index = sorter->mapFromSource(project_model.create_index(m->row(), 0, m));
+	QAbstractItemView* view = sources_common->view;
+	return index.isValid()
+			&& view->isVisible()
+			&& view->visualRect(index).intersects(view->viewport()->rect());
+}
+
+static void prioritize_preview(Media* m) {
+	if (m != nullptr && m->get_type() == MEDIA_TYPE_FOOTAGE && m->to_footage()->preview_gen != nullptr) {
+		m->to_footage()->preview_gen->prioritize();
+	}
+}
+
+void Project::prioritize_visible_previews() {
+	QAbstractItemView* view = sources_common->view;
+	if (!view->isVisible()) return;
+	QRect viewport = view->viewport()->rect();
+
+	if (view == tree_view) {
+		// rows from the top of the viewport down until one is below it
+		QModelIndex index = tree_view->indexAt(viewport.topLeft());
+		while (index.isValid() && tree_view->visualRect(index).top() <= viewport.bottom()) {
+			prioritize_preview(item_to_media(index));
+			index = tree_view->indexBelow(index);
+		}
+	} else {
+		// icons are laid out in row order, so only the current folder is walked and it stops past the viewport
+		QModelIndex root = icon_view->rootIndex();
+		for (int i=0;i<sorter->rowCount(root);i++) {
+			QRect rect = icon_view->visualRect(sorter->index(i, 0, root));
+			if (rect.top() > viewport.bottom()) break;
+			if (rect.intersects(viewport)) prioritize_preview(item_to_media(sorter->index(i, 0, root)));
+		}
+	}
 }
 
 void Project::process_file_list(QStringList& files, bool recursive, Media* replace, Media* parent) {
@@ -889,7 +949,7 @@ void Project::load_project(bool autorecovery) {
 	ld.exec();
 }
 
-void Project::save_folder(QXmlStreamWriter& stream, int type, bool set_ids_only, const QModelIndex& parent) {
+void Project::save_folder(ProjectSnapshotElement* parent_element, int type, bool set_ids_only, const QModelIndex& parent) {
 	for (int i=0;i<project_model.rowCount(parent);i++) {
 		const QModelIndex& item = project_model.index(i, 0, parent);
 		Media* m = project_model.getItem(item);
@@ -901,15 +961,14 @@ void Project::save_folder(QXmlStreamWriter& stream, int type, bool set_ids_only,
 					folder_id++;
 				} else {
 					// if we're saving folders, save the folder
-					stream.writeStartElement("folder");
-					stream.writeAttribute("name", m->get_name());
-					stream.writeAttribute("id", QString::number(m->temp_id));
+					ProjectSnapshotElement* folder_element = parent_element->add_child("folder");
+					folder_element->set_attribute("name", m->get_name());
+					folder_element->set_attribute("id", QString::number(m->temp_id));
 					if (!item.parent().isValid()) {
-						stream.writeAttribute("parent", "0");
+						folder_element->set_attribute("parent", "0");
 					} else {
-						stream.writeAttribute("parent", QString::number(project_model.getItem(item.parent())->temp_id));
+						folder_element->set_attribute("parent", QString::number(project_model.getItem(item.parent())->temp_id));
 					}
-					stream.writeEndElement();
 				}
 				// save_folder(stream, item, type, set_ids_only);
 			} else {
@@ -917,36 +976,33 @@ void Project::save_folder(QXmlStreamWriter& stream, int type, bool set_ids_only,
 				if (type == MEDIA_TYPE_FOOTAGE) {
 					Footage* f = m->to_footage();
 					f->save_id = media_id;
-					stream.writeStartElement("footage");
-					stream.writeAttribute("id", QString::number(media_id));
-					stream.writeAttribute("folder", QString::number(folder));
-					stream.writeAttribute("name", f->name);
-					stream.writeAttribute("url", proj_dir.relativeFilePath(f->url));
-					stream.writeAttribute("duration", QString::number(f->length));
-					stream.writeAttribute("using_inout", QString::number(f->using_inout));
-					stream.writeAttribute("in", QString::number(f->in));
-					stream.writeAttribute("out", QString::number(f->out));
-					stream.writeAttribute("speed", QString::number(f->speed));
+					ProjectSnapshotElement* footage_element = parent_element->add_child("footage");
+					footage_element->set_attribute("id", QString::number(media_id));
+					footage_element->set_attribute("folder", QString::number(folder));
+					footage_element->set_attribute("name", f->name);
+					footage_element->set_attribute("url", proj_dir.relativeFilePath(f->url));
+					footage_element->set_attribute("duration", QString::number(f->length));
+					footage_element->set_attribute("using_inout", QString::number(f->using_inout));
+					footage_element->set_attribute("in", QString::number(f->in));
+					footage_element->set_attribute("out", QString::number(f->out));
+					footage_element->set_attribute("speed", QString::number(f->speed));
 					for (int j=0;j<f->video_tracks.size();j++) {
 						const FootageStream& ms = f->video_tracks.at(j);
-						stream.writeStartElement("video");
-						stream.writeAttribute("id", QString::number(ms.file_index));
-						stream.writeAttribute("width", QString::number(ms.video_width));
-						stream.writeAttribute("height", QString::number(ms.video_height));
-						stream.writeAttribute("framerate", QString::number(ms.video_frame_rate, 'f', 10));
-						stream.writeAttribute("infinite", QString::number(ms.infinite_length));
-						stream.writeEndElement();
+						ProjectSnapshotElement* stream_element = footage_element->add_child("video");
+						stream_element->set_attribute("id", QString::number(ms.file_index));
+						stream_element->set_attribute("width", QString::number(ms.video_width));
+						stream_element->set_attribute("height", QString::number(ms.video_height));
+						stream_element->set_attribute("framerate", QString::number(ms.video_frame_rate, 'f', 10));
+						stream_element->set_attribute("infinite", QString::number(ms.infinite_length));
 					}
 					for (int j=0;j<f->audio_tracks.size();j++) {
 						const FootageStream& ms = f->audio_tracks.at(j);
-						stream.writeStartElement("audio");
-						stream.writeAttribute("id", QString::number(ms.file_index));
-						stream.writeAttribute("channels", QString::number(ms.audio_channels));
-						stream.writeAttribute("layout", QString::number(ms.audio_layout));
-						stream.writeAttribute("frequency", QString::number(ms.audio_frequency));
-						stream.writeEndElement();
+						ProjectSnapshotElement* stream_element = footage_element->add_child("audio");
+						stream_element->set_attribute("id", QString::number(ms.file_index));
+						stream_element->set_attribute("channels", QString::number(ms.audio_channels));
+						stream_element->set_attribute("layout", QString::number(ms.audio_layout));
+						stream_element->set_attribute("frequency", QString::number(ms.audio_frequency));
 					}
-					stream.writeEndElement();
 					media_id++;
 				} else if (type == MEDIA_TYPE_SEQUENCE) {
 					Sequence* s = m->to_sequence();
@@ -954,155 +1010,207 @@ void Project::save_folder(QXmlStreamWriter& stream, int type, bool set_ids_only,
 						s->save_id = sequence_id;
 						sequence_id++;
 					} else {
-						stream.writeStartElement("sequence");
-						stream.writeAttribute("id", QString::number(s->save_id));
-						stream.writeAttribute("folder", QString::number(folder));
-						stream.writeAttribute("name", s->name);
-						stream.writeAttribute("width", QString::number(s->width));
-						stream.writeAttribute("height", QString::number(s->height));
-						stream.writeAttribute("framerate", QString::number(s->frame_rate, 'f', 10));
-						stream.writeAttribute("afreq", QString::number(s->audio_frequency));
-						stream.writeAttribute("alayout", QString::number(s->audio_layout));
+						ProjectSnapshotElement* sequence_element = parent_element->add_child("sequence");
+						sequence_element->set_attribute("id", QString::number(s->save_id));
+						sequence_element->set_attribute("folder", QString::number(folder));
+						sequence_element->set_attribute("name", s->name);
+						sequence_element->set_attribute("width", QString::number(s->width));
+						sequence_element->set_attribute("height", QString::number(s->height));
+						sequence_element->set_attribute("framerate", QString::number(s->frame_rate, 'f', 10));
+						sequence_element->set_attribute("afreq", QString::number(s->audio_frequency));
+						sequence_element->set_attribute("alayout", QString::number(s->audio_layout));
 						if (s == sequence) {
-							stream.writeAttribute("open", "1");
+							sequence_element->set_attribute("open", "1");
 						}
-						stream.writeAttribute("workarea", QString::number(s->using_workarea));
-						stream.writeAttribute("workareaEnabled", QString::number(s->enable_workarea));
-						stream.writeAttribute("workareaIn", QString::number(s->workarea_in));
-						stream.writeAttribute("workareaOut", QString::number(s->workarea_out));
+						sequence_element->set_attribute("workarea", QString::number(s->using_workarea));
+						sequence_element->set_attribute("workareaEnabled", QString::number(s->enable_workarea));
+						sequence_element->set_attribute("workareaIn", QString::number(s->workarea_in));
+						sequence_element->set_attribute("workareaOut", QString::number(s->workarea_out));
 
 						for (int j=0;j<s->transitions.size();j++) {
 							Transition* t = s->transitions.at(j);
 							if (t != nullptr) {
-								stream.writeStartElement("transition");
-								stream.writeAttribute("id", QString::number(j));
-								stream.writeAttribute("length", QString::number(t->get_true_length()));
-								t->save(stream);
-								stream.writeEndElement(); // transition
+								ProjectSnapshotElement* transition_element = sequence_element->add_child("transition");
+								transition_element->set_attribute("id", QString::number(j));
+								transition_element->set_attribute("length", QString::number(t->get_true_length()));
+								t->save(transition_element);
 							}
 						}
 
 						for (int j=0;j<s->clips.size();j++) {
 							Clip* c = s->clips.at(j);
 							if (c != nullptr) {
-								stream.writeStartElement("clip"); // clip
-								stream.writeAttribute("id", QString::number(j));
-								stream.writeAttribute("enabled", QString::number(c->enabled));
-								stream.writeAttribute("name", c->name);
-								stream.writeAttribute("clipin", QString::number(c->clip_in));
-								stream.writeAttribute("in", QString::number(c->timeline_in));
-								stream.writeAttribute("out", QString::number(c->timeline_out));
-								stream.writeAttribute("track", QString::number(c->track));
-								stream.writeAttribute("opening", QString::number(c->opening_transition));
-								stream.writeAttribute("closing", QString::number(c->closing_transition));
-
-								stream.writeAttribute("r", QString::number(c->color_r));
-								stream.writeAttribute("g", QString::number(c->color_g));
-								stream.writeAttribute("b", QString::number(c->color_b));
-
-								stream.writeAttribute("autoscale", QString::number(c->autoscale));
-								stream.writeAttribute("speed", QString::number(c->speed, 'f', 10));
-								stream.writeAttribute("maintainpitch", QString::number(c->maintain_audio_pitch));
-								stream.writeAttribute("reverse", QString::number(c->reverse));
+								ProjectSnapshotElement* clip_element = sequence_element->add_child("clip");
+								clip_element->set_attribute("id", QString::number(j));
+								clip_element->set_attribute("enabled", QString::number(c->enabled));
+								clip_element->set_attribute("name", c->name);
+								clip_element->set_attribute("clipin", QString::number(c->clip_in));
+								clip_element->set_attribute("in", QString::number(c->timeline_in));
+								clip_element->set_attribute("out", QString::number(c->timeline_out));
+								clip_element->set_attribute("track", QString::number(c->track));
+								clip_element->set_attribute("opening", QString::number(c->opening_transition));
+								clip_element->set_attribute("closing", QString::number(c->closing_transition));
+
+								clip_element->set_attribute("r", QString::number(c->color_r));
+								clip_element->set_attribute("g", QString::number(c->color_g));
+								clip_element->set_attribute("b", QString::number(c->color_b));
+
+								clip_element->set_attribute("autoscale", QString::number(c->autoscale));
+								clip_element->set_attribute("speed", QString::number(c->speed, 'f', 10));
+								clip_element->set_attribute("maintainpitch", QString::number(c->maintain_audio_pitch));
+								clip_element->set_attribute("reverse", QString::number(c->reverse));
 
 								if (c->media != nullptr) {
-									stream.writeAttribute("type", QString::number(c->media->get_type()));
+									clip_element->set_attribute("type", QString::number(c->media->get_type()));
 									switch (c->media->get_type()) {
 									case MEDIA_TYPE_FOOTAGE:
-										stream.writeAttribute("media", QString::number(c->media->to_footage()->save_id));
-										stream.writeAttribute("stream", QString::number(c->media_stream));
+										clip_element->set_attribute("media", QString::number(c->media->to_footage()->save_id));
+										clip_element->set_attribute("stream", QString::number(c->media_stream));
 										break;
 									case MEDIA_TYPE_SEQUENCE:
-										stream.writeAttribute("sequence", QString::number(c->media->to_sequence()->save_id));
+										clip_element->set_attribute("sequence", QString::number(c->media->to_sequence()->save_id));
 										break;
 									}
 								}
 
-								stream.writeStartElement("linked"); // linked
+								ProjectSnapshotElement* linked_element = clip_element->add_child("linked");
 								for (int k=0;k<c->linked.size();k++) {
-									stream.writeStartElement("link"); // link
-									stream.writeAttribute("id", QString::number(c->linked.at(k)));
-									stream.writeEndElement(); // link
+									linked_element->add_child("link")->set_attribute("id", QString::number(c->linked.at(k)));
 								}
-								stream.writeEndElement(); // linked
 
 								for (int k=0;k<c->effects.size();k++) {
-									stream.writeStartElement("effect"); // effect
-									c->effects.at(k)->save(stream);
-									stream.writeEndElement(); // effect
+									c->effects.at(k)->save(clip_element->add_child("effect"));
 								}
-
-								stream.writeEndElement(); // clip
 							}
 						}
 						for (int j=0;j<s->markers.size();j++) {
-							stream.writeStartElement("marker");
-							stream.writeAttribute("frame", QString::number(s->markers.at(j).frame));
-							stream.writeAttribute("name", s->markers.at(j).name);
-							stream.writeEndElement();
+							ProjectSnapshotElement* marker_element = sequence_element->add_child("marker");
+							marker_element->set_attribute("frame", QString::number(s->markers.at(j).frame));
+							marker_element->set_attribute("name", s->markers.at(j).name);
 						}
-						stream.writeEndElement();
 					}
 				}
 			}
 		}
 
 		if (m->get_type() == MEDIA_TYPE_FOLDER) {
-			save_folder(stream, type, set_ids_only, item);
+			save_folder(parent_element, type, set_ids_only, item);
 		}
 	}
 }
 
-void Project::save_project(bool autorecovery) {
-	folder_id = 1;
-	media_id = 1;
-	sequence_id = 1;
+// writes to disk are atomic (temp file + rename) so a crash mid-write never leaves a truncated project behind
+bool write_project_file(const QString& filename, const QByteArray& data) {
+	QSaveFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qCritical() << "Could not open file" << filename;
+		return false;
+	}
+	file.write(data);
+	if (!file.commit()) {
+		qCritical() << "Could not write file" << filename << file.errorString();
+		return false;
+	}
+	return true;
+}
 
-	QFile file(autorecovery ? autorecovery_filename : project_url);
-	if (!file.open(QIODevice::WriteOnly/* | QIODevice::Text*/)) {
-		qCritical() << "Could not open file";
-		return;
+// single thread so project writes never race each other and land in the order they were asked for
+QThreadPool* get_project_write_pool() {
+	static QThreadPool* pool = nullptr;
+	if (pool == nullptr) {
+		pool = new QThreadPool();
+		pool->setMaxThreadCount(1);
 	}
+	return pool;
+}
 
-	QXmlStreamWriter stream(&file);
-	stream.setAutoFormatting(true);
-	stream.writeStartDocument(); // doc
+QMutex autorecovery_lock;
+QSharedPointer<ProjectSnapshotElement> autorecovery_snapshot;
+
+// only the newest autorecovery snapshot is written if they back up
+class AutorecoveryWriter : public QRunnable {
+public:
+	AutorecoveryWriter(const QString& fn) : filename(fn) {}
+	void run() {
+		autorecovery_lock.lock();
+		QSharedPointer<ProjectSnapshotElement> snapshot = autorecovery_snapshot;
+		autorecovery_snapshot.clear();
+		autorecovery_lock.unlock();
+
+		if (!snapshot.isNull() && write_project_file(filename, snapshot->to_document())) {
+			qInfo() << "Auto-recovery project saved";
+		}
+	}
+private:
+	QString filename;
+};
+
+// serializes and writes a snapshot, then reports back to the GUI thread
+class ProjectWriter : public QRunnable {
+public:
+	ProjectWriter(const QString& fn, const QSharedPointer<ProjectSnapshotElement>& s) : filename(fn), snapshot(s) {}
+	void run() {
+		bool ok = write_project_file(filename, snapshot->to_document());
+		QMetaObject::invokeMethod(panel_project, "project_written", Qt::QueuedConnection, Q_ARG(bool, ok));
+	}
+private:
+	QString filename;
+	QSharedPointer<ProjectSnapshotElement> snapshot;
+};
 
-	stream.writeStartElement("project"); // project
+QSharedPointer<ProjectSnapshotElement> Project::snapshot_project() {
+	folder_id = 1;
+	media_id = 1;
+	sequence_id = 1;
 
-	stream.writeTextElement("version", QString::number(SAVE_VERSION));
+	QSharedPointer<ProjectSnapshotElement> project_element(new ProjectSnapshotElement("project"));
 
-	stream.writeTextElement("url", project_url);
+	project_element->add_child("version")->set_text(QString::number(SAVE_VERSION));
+
+	project_element->add_child("url")->set_text(project_url);
 	proj_dir = QFileInfo(project_url).absoluteDir();
 
-	save_folder(stream, MEDIA_TYPE_FOLDER, true);
+	save_folder(project_element.data(), MEDIA_TYPE_FOLDER, true);
 
-	stream.writeStartElement("folders"); // folders
-	save_folder(stream, MEDIA_TYPE_FOLDER, false);
-	stream.writeEndElement(); // folders
+	save_folder(project_element->add_child("folders"), MEDIA_TYPE_FOLDER, false);
 
-	stream.writeStartElement("media"); // media
-	save_folder(stream, MEDIA_TYPE_FOOTAGE, false);
-	stream.writeEndElement(); // media
+	save_folder(project_element->add_child("media"), MEDIA_TYPE_FOOTAGE, false);
 
-	save_folder(stream, MEDIA_TYPE_SEQUENCE, true);
+	save_folder(project_element.data(), MEDIA_TYPE_SEQUENCE, true);
 
-	stream.writeStartElement("sequences"); // sequences
-	save_folder(stream, MEDIA_TYPE_SEQUENCE, false);
-	stream.writeEndElement();// sequences
+	save_folder(project_element->add_child("sequences"), MEDIA_TYPE_SEQUENCE, false);
 
-	stream.writeEndElement(); // project
+	return project_element;
+}
 
-	stream.writeEndDocument(); // doc
+void Project::save_project(bool autorecovery) {
+	if (autorecovery) {
+		// only the snapshot is taken on the GUI thread, turning it into XML and writing it happens in the background
+		QSharedPointer<ProjectSnapshotElement> snapshot = snapshot_project();
 
-	file.close();
+		autorecovery_lock.lock();
+		bool queued = !autorecovery_snapshot.isNull();
+		autorecovery_snapshot = snapshot;
+		autorecovery_lock.unlock();
+
+		if (!queued) get_project_write_pool()->start(new AutorecoveryWriter(autorecovery_filename));
+	} else {
+		// the snapshot is what gets saved, so the project counts as saved as of now even though it's written later
+		get_project_write_pool()->start(new ProjectWriter(project_url, snapshot_project()));
 
-	if (!autorecovery) {
 		add_recent_project(project_url);
 		mainWindow->setWindowModified(false);
 	}
 }
 
+void Project::project_written(bool ok) {
+	if (!ok) mainWindow->setWindowModified(true);
+}
+
+void Project::wait_for_project_writes() {
+	get_project_write_pool()->waitForDone();
+}
+
 void Project::update_view_type() {
 	tree_view->setVisible(config.project_view_type == PROJECT_VIEW_TREE);
 	icon_view_container->setVisible(config.project_view_type == PROJECT_VIEW_ICON);
@@ -5,6 +5,7 @@
 #include <QVector>
 #include <QTimer>
 #include <QDir>
+#include <QSharedPointer>
 
 #include "project/projectmodel.h"
 
@@ -15,7 +16,7 @@ class Timeline;
 class Viewer;
 class SourceTable;
 class Media;
-class QXmlStreamWriter;
+class ProjectSnapshotElement;
 class QXmlStreamReader;
 class QFile;
 class QSortFilterProxyModel;
@@ -24,8 +25,8 @@ class SourceIconView;
 class QPushButton;
 class SourcesCommon;
 
-#define LOAD_TYPE_VERSION 69
-#define LOAD_TYPE_URL 70
+// milliseconds scrolling has to stop for before visible previews are bumped
+#define PREVIEW_PRIORITY_DELAY 150
 
 extern QString autorecovery_filename;
 extern QString project_url;
@@ -57,6 +58,7 @@ public:
 	void new_project();
 	void load_project(bool autorecovery);
 	void save_project(bool autorecovery);
+	void wait_for_project_writes();
 
 	Media* new_folder(QString name);
 	Media* item_to_media(const QModelIndex& index);
@@ -76,6 +78,7 @@ public:
 	QModelIndexList get_current_selected();
 
 	void start_preview_generator(Media* item, bool replacing);
+	bool is_media_visible(Media* m);
 	void get_all_media_from_table(QList<Media *> &items, QList<Media *> &list, int type = -1);
 
 	QWidget* toolbar_widget;
@@ -87,8 +90,10 @@ public slots:
 	void replace_selected_file();
 	void replace_clip_media();
 	void open_properties();
+	void prioritize_visible_previews();
 private:
-	void save_folder(QXmlStreamWriter& stream, int type, bool set_ids_only, const QModelIndex &parent = QModelIndex());
+	void save_folder(ProjectSnapshotElement* parent_element, int type, bool set_ids_only, const QModelIndex &parent = QModelIndex());
+	QSharedPointer<ProjectSnapshotElement> snapshot_project();
 	int folder_id;
 	int media_id;
 	int sequence_id;
@@ -97,6 +102,7 @@ private:
 	QDir proj_dir;
 	QWidget* icon_view_container;
 	QPushButton* directory_up;
+	QTimer* preview_priority_timer;
 private slots:
 	void update_view_type();
 	void set_icon_view();
@@ -106,6 +112,7 @@ private slots:
 	void set_up_dir_enabled();
 	void go_up_dir();
 	void make_new_menu();
+	void project_written(bool ok);
 };
 
 class MediaThrobber : public QObject {
@@ -12,6 +12,7 @@
 #include "playback/audio.h"
 #include "panels/panels.h"
 #include "panels/viewer.h"
+#include "ui/viewerwidget.h"
 #include "project/media.h"
 #include "io/config.h"
 #include "debug.h"
@@ -414,9 +415,17 @@ void cache_audio_worker(Clip* c, bool scrubbing, QVector<Clip*>& nests) {
 	QMetaObject::invokeMethod(panel_sequence_viewer, "play_wake", Qt::QueuedConnection);
 }
 
-void cache_video_worker(Clip* c, long playhead) {
+static void wake_viewers() {
+	QMetaObject::invokeMethod(panel_footage_viewer->viewer_widget, "frame_decoded", Qt::QueuedConnection);
+	QMetaObject::invokeMethod(panel_sequence_viewer->viewer_widget, "frame_decoded", Qt::QueuedConnection);
+}
+
+void cache_video_worker(Clip* c, long playhead, bool seeking) {
 	int read_ret, send_ret, retr_ret;
 
+	// after a seek, the viewer is woken for the first frame so it can show it as a preview, and again for the exact one
+	bool preview_shown = !seeking;
+
 	int64_t target_pts = seconds_to_timestamp(c, playhead_to_clip_seconds(c, playhead));
 
 	int limit = c->max_queue_size;
@@ -445,10 +454,6 @@ void cache_video_worker(Clip* c, long playhead) {
 			smallest_pts = target_pts;
 		}
 
-		if (c->multithreaded && c->cacher->interrupt) { // ignore interrupts for now
-			c->cacher->interrupt = false;
-		}
-
 		while (true) {
 			AVFrame* frame = av_frame_alloc();
 
@@ -456,7 +461,10 @@ void cache_video_worker(Clip* c, long playhead) {
 			const FootageStream* ms = media->get_stream_from_file_index(true, c->media_stream);
 
 			while ((retr_ret = av_buffersink_get_frame(c->buffersink_ctx, frame)) == AVERROR(EAGAIN)) {
-				if (c->multithreaded && c->cacher->interrupt) return; // abort
+				if (c->multithreaded && c->cacher->seek_pending()) { // abort
+					av_frame_free(&frame);
+					return;
+				}
 
 				AVFrame* send_frame = c->frame;
 //				qint64 time = QDateTime::currentMSecsSinceEpoch();
@@ -487,6 +495,10 @@ void cache_video_worker(Clip* c, long playhead) {
 				} else {
 					if (read_ret == AVERROR_EOF) {
 						c->reached_end = true;
+					} else if (read_ret == AVERROR_EXIT) {
+						// a newer seek came in
+						av_frame_free(&frame);
+						return;
 					} else {
 						qCritical() << "Failed to read frame." << read_ret;
 					}
@@ -511,6 +523,12 @@ void cache_video_worker(Clip* c, long playhead) {
 					c->queue_lock.lock();
 					c->queue.append(frame);
 
+					if (seeking && (!preview_shown || frame->pts >= target_pts)) {
+						if (frame->pts >= target_pts) seeking = false;
+						preview_shown = true;
+						if (c->multithreaded) wake_viewers();
+					}
+
 					if (!ms->infinite_length && !reverse && c->queue.size() == limit) {
 						// see if we got the frame we needed (used for speed ups primarily)
 						bool found = false;
@@ -532,7 +550,7 @@ void cache_video_worker(Clip* c, long playhead) {
 				}
 			}
 
-			if (c->multithreaded && c->cacher->interrupt) { // abort
+			if (c->multithreaded && c->cacher->seek_pending()) { // abort
 				return;
 			}
 		}
@@ -559,6 +577,9 @@ void reset_cache(Clip* c, long target_frame) {
 			if (c->stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
 				// clear current queue
 				c->queue_clear();
+				c->queue_lock.lock();
+				c->queue_seek_playhead = target_frame;
+				c->queue_lock.unlock();
 
 				// seeks to nearest keyframe (target_frame represents internal clip frame)
 				int64_t target_ts = seconds_to_timestamp(c, playhead_to_clip_seconds(c, target_frame));
@@ -577,7 +598,8 @@ void reset_cache(Clip* c, long target_frame) {
 						av_frame_unref(c->frame);
 						int ret = retrieve_next_frame(c, c->frame);
 						if (ret < 0) {
-							qWarning() << "Seeking terminated prematurely";
+							// AVERROR_EXIT means a newer seek replaced this one
+							if (ret != AVERROR_EXIT) qWarning() << "Seeking terminated prematurely";
 							break;
 						}
 						if (c->frame->pts <= target_ts) {
@@ -620,7 +642,48 @@ void reset_cache(Clip* c, long target_frame) {
 	}
 }
 
-Cacher::Cacher(Clip* c) : clip(c) {}
+Cacher::Cacher(Clip* c) :
+	clip(c),
+	has_request(false),
+	caching(true),
+	seek_waiting(0)
+{}
+
+void Cacher::request(long playhead, bool reset, bool scrubbing, const QVector<Clip*>& nests) {
+	QMutexLocker locker(&request_lock);
+	next.reset = (reset || (has_request && next.reset));
+	next.playhead = playhead;
+	next.scrubbing = scrubbing;
+	next.nests = nests;
+	has_request = true;
+	if (reset) seek_waiting.storeRelease(1);
+	request_cond.wakeAll();
+}
+
+void Cacher::stop() {
+	QMutexLocker locker(&request_lock);
+	caching = false;
+	seek_waiting.storeRelease(1);
+	request_cond.wakeAll();
+}
+
+bool Cacher::seek_pending() {
+	return (seek_waiting.loadAcquire() != 0);
+}
+
+bool Cacher::take_request(CacheRequest* r) {
+	QMutexLocker locker(&request_lock);
+	while (caching && !has_request) {
+		request_cond.wait(&request_lock);
+	}
+	if (!caching) return false;
+	*r = next;
+	has_request = false;
+
+	// the newest seek is the one about to be handled
+	seek_waiting.storeRelease(0);
+	return true;
+}
 
 AVSampleFormat sample_format = AV_SAMPLE_FMT_S16;
 
@@ -892,7 +955,7 @@ void cache_clip_worker(Clip* clip, long playhead, bool reset, bool scrubbing, QV
 		}
 	} else if (clip->media->get_type() == MEDIA_TYPE_FOOTAGE) {
 		if (clip->stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-			cache_video_worker(clip, playhead);
+			cache_video_worker(clip, playhead, reset);
 		} else if (clip->stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
 			cache_audio_worker(clip, scrubbing, nests);
 		}
@@ -927,25 +990,18 @@ void Cacher::run() {
 	clip->lock.lock();
 	clip->finished_opening = false;
 	clip->open = true;
-	caching = true;
-	interrupt = false;
 
 	open_clip_worker(clip);
 
-	while (caching) {
-		clip->can_cache.wait(&clip->lock);
-		if (!caching) {
-			break;
-		} else {
-			while (true) {
-				cache_clip_worker(clip, playhead, reset, scrubbing, nests);
-				if (clip->multithreaded && clip->cacher->interrupt && clip->track < 0) {
-					clip->cacher->interrupt = false;
-				} else {
-					break;
-				}
-			}
-		}
+	// the clip's lock is free while waiting, so it tells others whether the cacher is busy
+	CacheRequest r;
+	while (true) {
+		clip->lock.unlock();
+		bool ok = take_request(&r);
+		clip->lock.lock();
+		if (!ok) break;
+
+		cache_clip_worker(clip, r.playhead, r.reset, r.scrubbing, r.nests);
 	}
 
 	close_clip_worker(clip);
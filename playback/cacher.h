@@ -3,8 +3,20 @@
 
 #include <QThread>
 #include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
 
 struct Clip;
+struct AVFrame;
+
+// what a cacher is asked to do next
+struct CacheRequest {
+	long playhead;
+	bool reset;
+	bool scrubbing;
+	QVector<Clip*> nests;
+};
 
 class Cacher : public QThread
 {
@@ -13,21 +25,34 @@ public:
 	Cacher(Clip* c);
     void run();
 
-	bool caching;
+	// replaces whatever was asked for before if it hasn't been picked up yet, a reset stays a reset until it is.
+	// A reset also makes a video decode in flight give up at its next packet
+	void request(long playhead, bool reset, bool scrubbing, const QVector<Clip*>& nests);
 
-	// must be set before caching
-	long playhead;
-	bool reset;
-    bool scrubbing;
-    bool interrupt;
-	QVector<Clip*> nests;
+	// closes the clip once the current request is done
+	void stop();
 
+	// whether a newer seek is waiting, cheap enough to check for every packet
+	bool seek_pending();
 private:
+	bool take_request(CacheRequest* r);
+
 	Clip* clip;
+
+	// one slot, the latest request wins
+	QMutex request_lock;
+	QWaitCondition request_cond;
+	CacheRequest next;
+	bool has_request;
+	bool caching;
+	QAtomicInt seek_waiting;
 };
 
 void open_clip_worker(Clip* clip);
 void cache_clip_worker(Clip* clip, long playhead, bool reset, bool scrubbing, QVector<Clip *> nest);
 void close_clip_worker(Clip* clip);
 
+// runs a block of a clip's audio through its effects, its transitions and those of the sequences it's nested in
+void apply_audio_effects(Clip* c, double timecode_start, AVFrame* frame, int nb_bytes, QVector<Clip*> nests);
+
 #endif // CACHER_H
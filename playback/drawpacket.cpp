@@ -0,0 +1,170 @@
+#include "drawpacket.h"
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+#include "playback/playback.h"
+#include "project/clip.h"
+#include "project/sequence.h"
+#include "project/effect.h"
+#include "project/transition.h"
+
+// packet whose values the field getters on this thread read, see DrawPacketScope
+static thread_local const ClipDrawPacket* current_draw_packet = nullptr;
+
+// shared by the thread composing the frame and the pool workers helping it
+struct DrawPacketBatch {
+	ClipDrawPacket* packets;
+	int count;
+	QAtomicInt next;
+	QSemaphore done;
+};
+
+static void prepare_transition_coords(ClipDrawPacket& p, Transition* t, double progress, int data, GLTextureCoords& coords) {
+	if (t != nullptr && t->is_enabled() && t->enable_coords) t->process_coords(progress, coords, data);
+	p.coords.append(coords);
+}
+
+void prepare_draw_packet(ClipDrawPacket& p) {
+	Clip* c = p.clip;
+	Transition* opening = (p.opening_progress >= 0) ? c->get_opening_transition() : nullptr;
+	Transition* closing = (p.closing_progress >= 0) ? c->get_closing_transition() : nullptr;
+
+	for (int i=0;i<c->effects.size();i++) {
+		c->effects.at(i)->prepare_values(p.timecode, p.values);
+	}
+	if (opening != nullptr) opening->prepare_values(p.opening_progress, p.values);
+	if (closing != nullptr) closing->prepare_values(p.closing_progress, p.values);
+
+	// everything below reads the values gathered above
+	DrawPacketScope scope(&p);
+
+	for (int i=0;i<c->effects.size();i++) {
+		c->effects.at(i)->prepare_superimpose(p.timecode);
+	}
+	if (opening != nullptr) opening->prepare_superimpose(p.opening_progress);
+	if (closing != nullptr) closing->prepare_superimpose(p.closing_progress);
+
+	if (!p.coords.isEmpty()) {
+		GLTextureCoords coords = p.coords.first();
+		for (int i=0;i<c->effects.size();i++) {
+			Effect* e = c->effects.at(i);
+			if (e->is_enabled() && e->enable_coords) e->process_coords(p.timecode, coords, TA_NO_TRANSITION);
+			p.coords.append(coords);
+		}
+		prepare_transition_coords(p, opening, p.opening_progress, TA_OPENING_TRANSITION, coords);
+		prepare_transition_coords(p, closing, p.closing_progress, TA_CLOSING_TRANSITION, coords);
+	}
+}
+
+void prepare_next_draw_packets(DrawPacketBatch* batch) {
+	int i;
+	while ((i = batch->next.fetchAndAddOrdered(1)) < batch->count) {
+		prepare_draw_packet(batch->packets[i]);
+		batch->done.release();
+	}
+}
+
+class DrawPacketJob : public QRunnable {
+public:
+	DrawPacketJob(QSharedPointer<DrawPacketBatch> b) : batch(b) {}
+	void run() {
+		prepare_next_draw_packets(batch.data());
+	}
+private:
+	// a job that only starts after the frame was drawn finds nothing left and never touches the packets
+	QSharedPointer<DrawPacketBatch> batch;
+};
+
+ClipDrawPacket create_draw_packet(Clip* c, Sequence* s, long playhead) {
+	ClipDrawPacket p;
+	p.clip = c;
+	p.timecode = get_timecode(c, playhead);
+	p.opening_progress = -1;
+	p.closing_progress = -1;
+
+	Transition* t = c->get_opening_transition();
+	if (t != nullptr) {
+		long transition_progress = playhead - c->get_timeline_in_with_transition();
+		if (transition_progress < t->get_length()) {
+			p.opening_progress = (double)transition_progress/(double)t->get_length();
+		}
+	}
+
+	t = c->get_closing_transition();
+	if (t != nullptr) {
+		long transition_progress = playhead - (c->get_timeline_out_with_transition() - t->get_length());
+		if (transition_progress >= 0 && transition_progress < t->get_length()) {
+			p.closing_progress = (double)transition_progress/(double)t->get_length();
+		}
+	}
+
+	if (c->track < 0) {
+		int video_width = c->getWidth();
+		int video_height = c->getHeight();
+
+		// set up default coords
+		GLTextureCoords coords;
+		coords.grid_size = 1;
+		coords.vertexTopLeftX = coords.vertexBottomLeftX = -video_width/2;
+		coords.vertexTopLeftY = coords.vertexTopRightY = -video_height/2;
+		coords.vertexTopRightX = coords.vertexBottomRightX = video_width/2;
+		coords.vertexBottomLeftY = coords.vertexBottomRightY = video_height/2;
+		coords.vertexBottomLeftZ = coords.vertexBottomRightZ = coords.vertexTopLeftZ = coords.vertexTopRightZ = 1;
+		coords.textureTopLeftY = coords.textureTopRightY = coords.textureTopLeftX = coords.textureBottomLeftX = 0.0;
+		coords.textureBottomLeftY = coords.textureBottomRightY = coords.textureTopRightX = coords.textureBottomRightX = 1.0;
+		coords.textureTopLeftQ = coords.textureTopRightQ = coords.textureTopLeftQ = coords.textureBottomLeftQ = 1;
+		coords.opacity = 1.0f;
+		coords.custom_blend = false;
+
+		// set up autoscale
+		if (c->autoscale && (video_width != s->width && video_height != s->height)) {
+			float width_multiplier = float(s->width) / float(video_width);
+			float height_multiplier = float(s->height) / float(video_height);
+			float scale_multiplier = qMin(width_multiplier, height_multiplier);
+			coords.matrix.scale(scale_multiplier, scale_multiplier, 1);
+		}
+
+		p.coords.append(coords);
+	}
+
+	return p;
+}
+
+void prepare_draw_packets(QVector<ClipDrawPacket>& packets) {
+	if (packets.isEmpty()) return;
+
+	QSharedPointer<DrawPacketBatch> batch(new DrawPacketBatch());
+	batch->packets = packets.data();
+	batch->count = packets.size();
+
+	// the calling thread works through the packets too, so a busy pool never stalls the frame
+	int helpers = qMin(packets.size(), QThreadPool::globalInstance()->maxThreadCount()) - 1;
+	for (int i=0;i<helpers;i++) {
+		QThreadPool::globalInstance()->start(new DrawPacketJob(batch));
+	}
+
+	prepare_next_draw_packets(batch.data());
+	batch->done.acquire(batch->count);
+}
+
+DrawPacketScope::DrawPacketScope(const ClipDrawPacket* p) : previous(current_draw_packet) {
+	current_draw_packet = p;
+}
+
+DrawPacketScope::~DrawPacketScope() {
+	current_draw_packet = previous;
+}
+
+bool get_draw_packet_value(const EffectField* field, double timecode, QVariant& value) {
+	if (current_draw_packet == nullptr) return false;
+
+	QHash<const EffectField*, PreparedFieldValue>::const_iterator it = current_draw_packet->values.constFind(field);
+	if (it == current_draw_packet->values.constEnd() || it.value().timecode != timecode) return false;
+
+	value = it.value().value;
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef DRAWPACKET_H
+#define DRAWPACKET_H
+
+#include <QVector>
+#include <QHash>
+
+#include "project/effect.h"
+
+struct Clip;
+struct Sequence;
+
+/*
+ * Everything a clip needs for one frame that can be worked out without GL: the timecodes its effects and
+ * transitions are drawn at, their keyframed values, where the clip ends up after each effect and any superimposed
+ * images. compose_sequence() prepares the packets of all active clips across the thread pool before it issues a
+ * single GL call, so drawing only reads them back. A packet isn't changed once it's prepared and the fields it
+ * was prepared from are never written to. Packets are prepared under render_lock, which keyframe edits take too.
+ */
+struct ClipDrawPacket {
+	Clip* clip;
+	double timecode;
+
+	// progress through the clip's transitions, or -1 if the frame isn't in them
+	double opening_progress;
+	double closing_progress;
+
+	// keyframed values of the fields of the clip's effects and transitions
+	QHash<const EffectField*, PreparedFieldValue> values;
+
+	// video clips only: coords[0] places the clip in the sequence, coords[j+1] is where effect j leaves it, followed
+	// by where the opening and closing transitions leave it
+	QVector<GLTextureCoords> coords;
+};
+
+ClipDrawPacket create_draw_packet(Clip* c, Sequence* s, long playhead);
+void prepare_draw_packets(QVector<ClipDrawPacket>& packets);
+
+// field getters on this thread read their values from the packet for as long as the scope lives
+class DrawPacketScope {
+public:
+	DrawPacketScope(const ClipDrawPacket* p);
+	~DrawPacketScope();
+private:
+	const ClipDrawPacket* previous;
+};
+
+// false if the packet drawn on this thread has no value for the field at timecode
+bool get_draw_packet_value(const EffectField* field, double timecode, QVariant& value);
+
+#endif // DRAWPACKET_H
@@ -5,6 +5,7 @@
 #include "project/footage.h"
 #include "playback/audio.h"
 #include "playback/cacher.h"
+#include "playback/renderthread.h"
 #include "panels/panels.h"
 #include "panels/timeline.h"
 #include "panels/viewer.h"
@@ -13,6 +14,8 @@
 #include "project/media.h"
 #include "io/config.h"
 #include "io/avtogl.h"
+#include "io/texturepool.h"
+#include "io/textureupload.h"
 #include "debug.h"
 
 extern "C" {
@@ -25,6 +28,7 @@ extern "C" {
 
 #include <QtMath>
 #include <QObject>
+#include <QDateTime>
 #include <QOpenGLTexture>
 #include <QOpenGLPixelTransferOptions>
 #include <QOpenGLFramebufferObject>
@@ -33,9 +37,15 @@ extern "C" {
 //#define GCF_DEBUG
 #endif
 
-bool texture_failed = false;
 bool rendering = false;
 
+// how long seeks took to show their frame
+QMutex seek_latency_lock;
+qint64 seek_latency_last = -1;
+qint64 seek_latency_max = 0;
+qint64 seek_latency_total = 0;
+long seek_count = 0;
+
 bool clip_uses_cacher(Clip* clip) {
 	return (clip->media == nullptr && clip->track >= 0) || (clip->media != nullptr && clip->media->get_type() == MEDIA_TYPE_FOOTAGE);
 }
@@ -62,9 +72,12 @@ void open_clip(Clip* clip, bool multithreaded) {
 }
 
 void close_clip(Clip* clip, bool wait) {
-	// destroy opengl texture in main thread
+	// the render thread may be drawing the clip
+	QMutexLocker locker(&render_lock);
+
+	// hand opengl objects back to the pool for the next clip
 	if (clip->texture != nullptr) {
-		delete clip->texture;
+		release_texture(clip->texture);
 		clip->texture = nullptr;
 	}
 
@@ -72,17 +85,15 @@ void close_clip(Clip* clip, bool wait) {
 		if (clip->effects.at(i)->is_open()) clip->effects.at(i)->close();
 	}
 
-	if (clip->fbo != nullptr) {
-		delete clip->fbo[0];
-		delete clip->fbo[1];
-		delete [] clip->fbo;
-		clip->fbo = nullptr;
-	}
+	release_clip_buffers(clip);
+
+	delete clip->upload_ring;
+	clip->upload_ring = nullptr;
+	av_frame_free(&clip->effect_frame);
 
 	if (clip_uses_cacher(clip)) {
 		if (clip->multithreaded) {
-			clip->cacher->caching = false;
-			clip->can_cache.wakeAll();
+			clip->cacher->stop();
 			if (wait) {
 				clip->open_lock.lock();
 				clip->open_lock.unlock();
@@ -100,25 +111,57 @@ void close_clip(Clip* clip, bool wait) {
 
 void cache_clip(Clip* clip, long playhead, bool reset, bool scrubbing, QVector<Clip*>& nests) {
 	if (clip_uses_cacher(clip)) {
-		if (clip->multithreaded) {
-			clip->cacher->playhead = playhead;
-			clip->cacher->reset = reset;
-			clip->cacher->nests = nests;
-			clip->cacher->scrubbing = scrubbing;
-			if (reset && clip->queue.size() > 0) clip->cacher->interrupt = true;
+		if (clip->track < 0) {
+			// asking again for the frame a seek is already decoding doesn't start it over, until the playhead moves
+			if (reset && playhead == clip->seek_playhead) {
+				reset = false;
+			} else if (reset) {
+				clip->seek_playhead = playhead;
+				clip->seek_time = QDateTime::currentMSecsSinceEpoch();
+			} else if (playhead != clip->seek_playhead) {
+				clip->seek_playhead = -1;
+			}
+		}
 
-			clip->can_cache.wakeAll();
+		if (clip->multithreaded) {
+			clip->cacher->request(playhead, reset, scrubbing, nests);
 		} else {
 			cache_clip_worker(clip, playhead, reset, scrubbing, nests);
 		}
 	}
 }
 
+void release_clip_buffers(Clip* clip) {
+	if (clip->fbo != nullptr) {
+		release_framebuffer(clip->fbo[0]);
+		release_framebuffer(clip->fbo[1]);
+		delete [] clip->fbo;
+		clip->fbo = nullptr;
+	}
+}
+
+void record_seek_latency(qint64 ms) {
+	QMutexLocker locker(&seek_latency_lock);
+	seek_latency_last = ms;
+	seek_latency_max = qMax(seek_latency_max, ms);
+	seek_latency_total += ms;
+	seek_count++;
+}
+
+QString get_seek_latency_summary() {
+	QMutexLocker locker(&seek_latency_lock);
+	return QString("Seek latency: %1 ms last, %2 ms average, %3 ms max over %4 seeks")
+			.arg(seek_latency_last)
+			.arg((seek_count > 0) ? seek_latency_total / seek_count : 0)
+			.arg(seek_latency_max)
+			.arg(seek_count);
+}
+
 double get_timecode(Clip* c, long playhead) {
 	return ((double)(playhead-c->get_timeline_in_with_transition()+c->get_clip_in_with_transition())/(double)c->sequence->frame_rate);
 }
 
-void get_clip_frame(Clip* c, long playhead) {
+void get_clip_frame(Clip* c, long playhead, bool& texture_failed) {
 	if (c->finished_opening) {
 		const FootageStream* ms = c->media->to_footage()->get_stream_from_file_index(c->track < 0, c->media_stream);
 
@@ -133,6 +176,7 @@ void get_clip_frame(Clip* c, long playhead) {
 
 		bool reset = false;
 		bool cache = true;
+		bool preview = false;
 
 		c->queue_lock.lock();
 		if (c->queue.size() > 0) {
@@ -217,21 +261,29 @@ void get_clip_frame(Clip* c, long playhead) {
 #endif
 							c->reached_end = false;
 							cache = false;
-						} else if (target_pts != c->last_invalid_ts && (target_pts < target_frame->pts || pts_diff > second_pts)) {
+						} else if (target_pts < target_frame->pts || pts_diff > second_pts) {
 
 #ifdef GCF_DEBUG
 							dout << "GCF ==> RESET" << target_pts << "(" << target_frame->pts << "-" << target_frame->pts+target_frame->pkt_duration << ")";
 #endif
-							if (!config.fast_seeking) target_frame = nullptr;
+							// frames decoded since this seek's reset preview it, older ones only do with fast seeking
+							if (c->queue_seek_playhead == playhead && target_pts > target_frame->pts) {
+								preview = true;
+							} else if (config.fast_seeking) {
+								preview = true;
+							} else {
+								target_frame = nullptr;
+							}
 							reset = true;
-							c->last_invalid_ts = target_pts;
 						} else {
 #ifdef GCF_DEBUG
 							dout << "GCF ==> WAIT - target pts:" << target_pts << "closest frame:" << target_frame->pts;
 #endif
 							if (c->queue.size() >= c->max_queue_size) c->queue_remove_earliest();
 							c->ignore_reverse = true;
-							target_frame = nullptr;
+
+							// show the closest earlier frame until the exact one is decoded
+							preview = true;
 						}
 					}
 				}
@@ -240,48 +292,79 @@ void get_clip_frame(Clip* c, long playhead) {
 			reset = true;
 		}
 
-		if (target_frame == nullptr || reset) {
-			// reset cache
+		if (target_frame == nullptr || reset || preview) {
+			// reset cache, a preview still counts as incomplete so it's replaced once the exact frame is decoded
 			texture_failed = true;
 			qInfo() << "Frame queue couldn't keep up - either the user seeked or the system is overloaded (queue size:" << c->queue.size() << ")";
+		} else if (c->seek_time >= 0) {
+			// the frame the last seek was for is here
+			record_seek_latency(QDateTime::currentMSecsSinceEpoch() - c->seek_time);
+			c->seek_time = -1;
 		}
 
-		if (target_frame != nullptr) {
-			int nb_components = av_pix_fmt_desc_get(static_cast<enum AVPixelFormat>(c->pix_fmt))->nb_components;
-			glPixelStorei(GL_UNPACK_ROW_LENGTH, target_frame->linesize[0]/nb_components);
-
-			bool copied = false;
-			uint8_t* data = target_frame->data[0];
-			int frame_size;
-
-			for (int i=0;i<c->effects.size();i++) {
-				Effect* e = c->effects.at(i);
-				if (e->enable_image) {
-					if (!copied) {
-						frame_size = target_frame->linesize[0]*target_frame->height;
-						data = new uint8_t[frame_size];
-						memcpy(data, target_frame->data[0], frame_size);
-						copied = true;
-					}
-					e->process_image(get_timecode(c, playhead), data, frame_size);
-				}
-			}
-
-			c->texture->setData(0, get_gl_pix_fmt_from_av(c->pix_fmt), QOpenGLTexture::UInt8, data);
+		// keep a reference so the frame can be copied after the queue is unlocked, even if the cacher drops it
+		AVFrame* upload_frame = nullptr;
+		if (target_frame != nullptr) upload_frame = av_frame_clone(target_frame);
 
-			if (copied) delete [] data;
+		c->queue_lock.unlock();
 
-			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		if (upload_frame != nullptr) {
+			upload_clip_frame(c, upload_frame, get_timecode(c, playhead));
+			av_frame_free(&upload_frame);
 		}
 
-		c->queue_lock.unlock();
-
 		// get more frames
 		QVector<Clip*> empty;
 		if (cache) cache_clip(c, playhead, reset, false, empty);
 	}
 }
 
+void upload_clip_frame(Clip* c, AVFrame* frame, double timecode) {
+	bool image_effects = false;
+	for (int i=0;i<c->effects.size();i++) {
+		if (c->effects.at(i)->enable_image) {
+			image_effects = true;
+			break;
+		}
+	}
+
+	AVFrame* source = frame;
+	if (image_effects) {
+		// image effects work in place on a writable frame that the clip keeps for as long as it's open
+		if (c->effect_frame == nullptr
+				|| c->effect_frame->width != frame->width
+				|| c->effect_frame->height != frame->height
+				|| c->effect_frame->format != frame->format) {
+			av_frame_free(&c->effect_frame);
+			c->effect_frame = av_frame_alloc();
+			c->effect_frame->width = frame->width;
+			c->effect_frame->height = frame->height;
+			c->effect_frame->format = frame->format;
+			av_frame_get_buffer(c->effect_frame, 32);
+		}
+		av_frame_copy(c->effect_frame, frame);
+
+		int frame_size = c->effect_frame->linesize[0]*c->effect_frame->height;
+		for (int i=0;i<c->effects.size();i++) {
+			Effect* e = c->effects.at(i);
+			if (e->enable_image) {
+				e->process_image(timecode, c->effect_frame->data[0], frame_size);
+			}
+		}
+		source = c->effect_frame;
+	}
+
+	if (c->upload_ring == nullptr) c->upload_ring = new TextureUploadRing();
+
+	int frame_size = source->linesize[0]*source->height;
+	memcpy(c->upload_ring->map(frame_size), source->data[0], frame_size);
+
+	int nb_components = av_pix_fmt_desc_get(static_cast<enum AVPixelFormat>(c->pix_fmt))->nb_components;
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, source->linesize[0]/nb_components);
+	c->upload_ring->upload(c->texture, get_gl_pix_fmt_from_av(c->pix_fmt));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
 long playhead_to_clip_frame(Clip* c, long playhead) {
 	return (qMax(0L, playhead - c->get_timeline_in_with_transition()) + c->get_clip_in_with_transition());
 }
@@ -310,6 +393,9 @@ int retrieve_next_frame(Clip* c, AVFrame* f) {
 	// do we need to retrieve a new packet for a new frame?
 	av_frame_unref(f);
 	while ((receive_ret = avcodec_receive_frame(c->codecCtx, f)) == AVERROR(EAGAIN)) {
+		// a newer seek makes this frame pointless, so give up before decoding another packet
+		if (c->track < 0 && c->multithreaded && c->cacher->seek_pending()) return AVERROR_EXIT;
+
 		int read_ret = 0;
 		do {
 			if (c->pkt_written) {
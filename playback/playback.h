@@ -3,24 +3,31 @@
 
 #include <QVector>
 #include <QMutex>
+#include <QString>
 
 struct Clip;
 struct ClipCache;
 struct Sequence;
 struct AVFrame;
 
-extern bool texture_failed;
 extern bool rendering;
 
 bool clip_uses_cacher(Clip* clip);
 void open_clip(Clip* clip, bool multithreaded);
 void cache_clip(Clip* clip, long playhead, bool reset, bool scrubbing, QVector<Clip *> &nests);
 void close_clip(Clip* clip, bool wait);
+void release_clip_buffers(Clip* clip);
 void cache_audio_worker(Clip* c, bool write_A);
-void cache_video_worker(Clip* c, long playhead);
+void cache_video_worker(Clip* c, long playhead, bool seeking);
 void handle_media(Sequence* sequence, long playhead, bool multithreaded);
 void reset_cache(Clip* c, long target_frame);
-void get_clip_frame(Clip* c, long playhead);
+// sets texture_failed if the frame shown isn't the exact one for the playhead
+void get_clip_frame(Clip* c, long playhead, bool& texture_failed);
+
+// time from a seek being asked for to its frame being shown, summarized for the debug log
+void record_seek_latency(qint64 ms);
+QString get_seek_latency_summary();
+void upload_clip_frame(Clip* c, AVFrame* frame, double timecode);
 double get_timecode(Clip* c, long playhead);
 
 long playhead_to_clip_frame(Clip* c, long playhead);
@@ -0,0 +1,820 @@
+#include "renderthread.h"
+
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+
+#include "panels/panels.h"
+#include "panels/timeline.h"
+#include "project/sequence.h"
+#include "project/clip.h"
+#include "project/effect.h"
+#include "project/transition.h"
+#include "project/footage.h"
+#include "project/media.h"
+#include "playback/playback.h"
+#include "playback/audio.h"
+#include "playback/drawpacket.h"
+#include "io/config.h"
+#include "io/avtogl.h"
+#include "io/shadercache.h"
+#include "io/glgeometry.h"
+#include "io/texturepool.h"
+#include "ui/collapsiblewidget.h"
+#include "ui/timelinewidget.h"
+#include "debug.h"
+
+extern "C" {
+	#include <libavformat/avformat.h>
+	#include <libavutil/pixdesc.h>
+}
+
+#ifndef GL_RGBA16
+#define GL_RGBA16 0x805B
+#endif
+
+#define GL_DEFAULT_BLEND glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE);
+
+QMutex render_lock(QMutex::Recursive);
+
+RenderThread::RenderThread() :
+	ctx(nullptr),
+	surface(nullptr),
+	running(true),
+	painting(false),
+	paint_seq(nullptr),
+	paint_audio(false),
+	paint_queued(false),
+	image_seq(nullptr),
+	image_audio(false),
+	image_pixels(nullptr),
+	image_row_pixels(0),
+	image_planes(nullptr),
+	image_queued(false),
+	image_done(false),
+	image_complete(false),
+	image_fbo(nullptr),
+	deep_images(true),
+	front_frame(-1),
+	displayed_frame(-1),
+	target_fbo(nullptr),
+	readback(false),
+	render_video(true),
+	gizmos(nullptr),
+	drawn_gizmos(false),
+	texture_failed(false),
+	force_quit(0)
+{
+	for (int i=0;i<RENDER_THREAD_FRAME_COUNT;i++) {
+		frames[i] = nullptr;
+		frame_gizmos[i] = nullptr;
+	}
+}
+
+RenderThread::~RenderThread() {
+	stop();
+	delete ctx;
+	delete surface;
+}
+
+void RenderThread::set_up(QOpenGLContext* share) {
+	// offscreen surfaces have to be created on the GUI thread
+	surface = new QOffscreenSurface();
+	surface->setFormat(share->format());
+	surface->create();
+
+	ctx = new QOpenGLContext();
+	ctx->setFormat(share->format());
+	ctx->setShareContext(share);
+	if (!ctx->create()) {
+		qCritical() << "Failed to create render context";
+	}
+	ctx->moveToThread(this);
+}
+
+void RenderThread::stop() {
+	queue_lock.lock();
+	running = false;
+	force_quit.store(1);
+	wait_cond.wakeAll();
+	queue_lock.unlock();
+
+	wait();
+}
+
+// the effect whose gizmos each selected video clip shows, the selection is only read on the GUI thread
+static void collect_gizmo_effects(Sequence* s, QHash<Clip*, Effect*>& gizmos, QVector<Sequence*>& visited) {
+	if (visited.contains(s)) return;
+	visited.append(s);
+
+	for (int i=0;i<s->clips.size();i++) {
+		Clip* c = s->clips.at(i);
+		if (c == nullptr || c->track >= 0) continue;
+
+		if (c->media != nullptr && c->media->get_type() == MEDIA_TYPE_SEQUENCE) {
+			collect_gizmo_effects(c->media->to_sequence(), gizmos, visited);
+		}
+
+		Effect* first_gizmo_effect = nullptr;
+		Effect* selected_effect = nullptr;
+		for (int j=0;j<c->effects.size();j++) {
+			Effect* e = c->effects.at(j);
+			if (e->are_gizmos_enabled()) {
+				if (first_gizmo_effect == nullptr) first_gizmo_effect = e;
+				if (e->has_container() && e->get_container()->selected) selected_effect = e;
+			}
+		}
+
+		if (selected_effect != nullptr) {
+			gizmos.insert(c, selected_effect);
+		} else if (panel_timeline->is_clip_selected(c, true)) {
+			gizmos.insert(c, first_gizmo_effect);
+		}
+	}
+}
+
+void RenderThread::paint(Sequence* s, bool render_audio) {
+	// export drives the playhead and renders every frame itself, the viewer shows those instead
+	if (rendering) return;
+
+	QHash<Clip*, Effect*> gizmo_effects;
+	QVector<Sequence*> visited;
+	collect_gizmo_effects(s, gizmo_effects, visited);
+
+	QMutexLocker locker(&queue_lock);
+	paint_seq = s;
+	paint_audio = render_audio;
+	paint_gizmos = gizmo_effects;
+	paint_queued = true;
+	wait_cond.wakeAll();
+}
+
+void RenderThread::discard() {
+	// must not be called while holding render_lock, the frame being drawn needs it to finish
+	QMutexLocker locker(&queue_lock);
+	paint_queued = false;
+	while (painting) {
+		idle_cond.wait(&queue_lock);
+	}
+	front_frame = -1;
+}
+
+bool RenderThread::render_image(Sequence* s, bool render_audio, uchar* pixels, int row_pixels) {
+	QMutexLocker locker(&queue_lock);
+	if (!running) return false;
+
+	image_seq = s;
+	image_audio = render_audio;
+	image_pixels = pixels;
+	image_row_pixels = row_pixels;
+	image_planes = nullptr;
+	image_queued = true;
+	image_done = false;
+	force_quit.store(0);
+	wait_cond.wakeAll();
+
+	while (!image_done) {
+		image_cond.wait(&queue_lock);
+	}
+	return image_complete;
+}
+
+bool RenderThread::render_planes(Sequence* s, AVFrame* frame) {
+	QMutexLocker locker(&queue_lock);
+	if (!running) return false;
+
+	image_seq = s;
+	image_audio = false;
+	image_pixels = nullptr;
+	image_row_pixels = 0;
+	image_planes = frame;
+	image_queued = true;
+	image_done = false;
+	force_quit.store(0);
+	wait_cond.wakeAll();
+
+	while (!image_done) {
+		image_cond.wait(&queue_lock);
+	}
+	return image_complete;
+}
+
+void RenderThread::precompile(const QVector< QPair<QString, QString> >& shaders) {
+	if (shaders.isEmpty()) return;
+
+	QMutexLocker locker(&queue_lock);
+	precompile_queue += shaders;
+	wait_cond.wakeAll();
+}
+
+void RenderThread::cancel() {
+	force_quit.store(1);
+}
+
+GLuint RenderThread::get_frame_texture() {
+	QMutexLocker locker(&queue_lock);
+	displayed_frame = front_frame;
+	if (displayed_frame < 0) return 0;
+	return frames[displayed_frame]->texture();
+}
+
+Effect* RenderThread::get_frame_gizmos() {
+	QMutexLocker locker(&queue_lock);
+	if (displayed_frame < 0) return nullptr;
+	return frame_gizmos[displayed_frame];
+}
+
+int RenderThread::get_free_frame() {
+	for (int i=0;i<RENDER_THREAD_FRAME_COUNT;i++) {
+		if (i != front_frame && i != displayed_frame) return i;
+	}
+	return 0;
+}
+
+void RenderThread::run() {
+	if (ctx == nullptr || !ctx->makeCurrent(surface)) {
+		qCritical() << "Failed to make render context current";
+		queue_lock.lock();
+		running = false;
+		image_done = true;
+		image_complete = false;
+		image_cond.wakeAll();
+		queue_lock.unlock();
+		return;
+	}
+	initializeOpenGLFunctions();
+
+	queue_lock.lock();
+	while (running) {
+		if (image_queued) {
+			image_queued = false;
+			Sequence* s = image_seq;
+			bool render_audio = image_audio;
+			uchar* pixels = image_pixels;
+			int row_pixels = image_row_pixels;
+			AVFrame* planes = image_planes;
+			queue_lock.unlock();
+
+			// exports with more than 8 bits per sample blend their clips into a 16-bit frame
+			GLenum image_format = QOpenGLFramebufferObjectFormat().internalTextureFormat();
+			if (deep_images && planes != nullptr && av_pix_fmt_desc_get(static_cast<AVPixelFormat>(planes->format))->comp[0].depth > 8) {
+				image_format = GL_RGBA16;
+			}
+
+			if (image_fbo == nullptr
+					|| image_fbo->width() != s->width
+					|| image_fbo->height() != s->height
+					|| image_fbo->format().internalTextureFormat() != image_format) {
+				delete image_fbo;
+				image_fbo = new QOpenGLFramebufferObject(s->width, s->height, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, image_format);
+				if (!image_fbo->isValid()) {
+					qWarning() << "16-bit frames aren't supported, 10-bit export will be composited at 8 bits";
+					deep_images = false;
+					delete image_fbo;
+					image_fbo = new QOpenGLFramebufferObject(s->width, s->height);
+				}
+			}
+
+			// images are read back top row first, as encoders and image files expect
+			readback = true;
+
+			// audio only, video clips aren't decoded or drawn
+			render_video = (pixels != nullptr || planes != nullptr);
+			bool complete = compose_frame(s, render_audio, image_fbo);
+			if (complete && pixels != nullptr) {
+				image_fbo->bind();
+				glReadPixels(0, 0, row_pixels, s->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+				image_fbo->release();
+			} else if (complete && planes != nullptr) {
+				complete = yuv_converter.convert(image_fbo->texture(), planes);
+			}
+
+			// export renders with the viewer's thread, so the viewer follows the exported frames rather than freezing
+			if (complete && rendering && render_video) show_image(s);
+
+			queue_lock.lock();
+			image_complete = complete;
+			image_done = true;
+			image_cond.wakeAll();
+		} else if (!precompile_queue.isEmpty()) {
+			QVector< QPair<QString, QString> > shaders = precompile_queue;
+			precompile_queue.clear();
+			queue_lock.unlock();
+
+			for (int i=0;i<shaders.size();i++) {
+				get_shader_program(shaders.at(i).first, shaders.at(i).second);
+			}
+
+			queue_lock.lock();
+		} else if (paint_queued) {
+			paint_queued = false;
+			painting = true;
+			Sequence* s = paint_seq;
+			bool render_audio = paint_audio;
+			gizmo_candidates = paint_gizmos;
+			int target = get_free_frame();
+			queue_lock.unlock();
+
+			if (frames[target] == nullptr || frames[target]->width() != s->width || frames[target]->height() != s->height) {
+				delete frames[target];
+				frames[target] = new QOpenGLFramebufferObject(s->width, s->height);
+			}
+
+			readback = false;
+			render_video = true;
+			bool complete = compose_frame(s, render_audio, frames[target]);
+
+			// the viewer's context draws the frame next and wouldn't wait for this context's commands on its own
+			glFinish();
+
+			queue_lock.lock();
+			front_frame = target;
+			frame_gizmos[target] = drawn_gizmos ? gizmos : nullptr;
+			painting = false;
+			idle_cond.wakeAll();
+			emit ready(complete);
+		} else {
+			wait_cond.wait(&queue_lock);
+		}
+	}
+
+	// nothing will pick up an image that was still waiting
+	image_done = true;
+	image_complete = false;
+	image_cond.wakeAll();
+	queue_lock.unlock();
+
+	for (int i=0;i<RENDER_THREAD_FRAME_COUNT;i++) {
+		delete frames[i];
+		frames[i] = nullptr;
+	}
+	delete image_fbo;
+	image_fbo = nullptr;
+	yuv_converter.destroy();
+
+	ctx->doneCurrent();
+	ctx->moveToThread(QCoreApplication::instance()->thread());
+}
+
+void RenderThread::show_image(Sequence* s) {
+	queue_lock.lock();
+	int target = get_free_frame();
+	queue_lock.unlock();
+
+	if (frames[target] == nullptr || frames[target]->width() != s->width || frames[target]->height() != s->height) {
+		delete frames[target];
+		frames[target] = new QOpenGLFramebufferObject(s->width, s->height);
+	}
+
+	// image_fbo is upside down for readback, flip it back
+	QMatrix4x4 flip_matrix;
+	flip_matrix.ortho(0, 1, 1, 0, -1, 1);
+
+	frames[target]->bind();
+	glViewport(0, 0, s->width, s->height);
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+	draw_texture(image_fbo->texture(), flip_matrix);
+	frames[target]->release();
+	glFinish();
+
+	queue_lock.lock();
+	front_frame = target;
+	frame_gizmos[target] = nullptr;
+	queue_lock.unlock();
+
+	emit ready(true);
+}
+
+bool RenderThread::compose_frame(Sequence* s, bool render_audio, QOpenGLFramebufferObject* target) {
+	target_fbo = target;
+	gizmos = nullptr;
+	drawn_gizmos = false;
+
+	bool loop = false;
+	do {
+		loop = false;
+
+		// edits wait for the frame to be drawn instead of changing the sequence under it
+		render_lock.lock();
+
+		target->bind();
+		glViewport(0, 0, s->width, s->height);
+		glClearColor(0, 0, 0, 1);
+		glEnable(GL_BLEND);
+
+		texture_failed = false;
+
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		// compose video preview
+		glClearColor(0, 0, 0, 0);
+
+		QVector<Clip*> nests;
+		compose_sequence(s, nests, render_audio);
+
+		glDisable(GL_BLEND);
+		target->release();
+
+		render_lock.unlock();
+
+		// exported frames and stills wait for every clip's footage
+		if (texture_failed && readback && force_quit.load() == 0) {
+			qInfo() << "Texture failed - looping";
+			loop = true;
+		}
+	} while (loop);
+
+	target_fbo = nullptr;
+	return !texture_failed;
+}
+
+GLuint RenderThread::draw_clip(QOpenGLFramebufferObject* fbo, GLuint texture, bool clear, QOpenGLShaderProgram* program) {
+	QMatrix4x4 clip_matrix;
+	clip_matrix.ortho(0, 1, 0, 1, -1, 1);
+
+	fbo->bind();
+
+	if (clear) glClear(GL_COLOR_BUFFER_BIT);
+
+	// get current blend mode
+	GLint src_rgb, src_alpha, dst_rgb, dst_alpha;
+	glGetIntegerv(GL_BLEND_SRC_RGB, &src_rgb);
+	glGetIntegerv(GL_BLEND_SRC_ALPHA, &src_alpha);
+	glGetIntegerv(GL_BLEND_DST_RGB, &dst_rgb);
+	glGetIntegerv(GL_BLEND_DST_ALPHA, &dst_alpha);
+
+	GL_DEFAULT_BLEND
+
+	if (program == nullptr) {
+		// plain copy
+		draw_texture(texture, clip_matrix);
+	} else {
+		// effect shader, already bound by the caller
+		glBindTexture(GL_TEXTURE_2D, texture);
+		draw_unit_mesh(program, clip_matrix);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	fbo->release();
+
+	// restore previous blendFunc
+	glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+
+	if (target_fbo != nullptr) target_fbo->bind();
+
+	return fbo->texture();
+}
+
+void RenderThread::set_texture_filtering(GLuint texture, bool mipmapped) {
+	// clip buffers are normally sampled texel for texel
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (mipmapped) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	} else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RenderThread::process_effect(Clip* c, Effect* e, double timecode, GLTextureCoords& coords, GLuint& composite_texture, bool& fbo_switcher, int data) {
+	// coords were already worked out in the clip's draw packet
+	if (e->is_enabled()) {
+		if ((e->enable_shader && shaders_are_enabled) || e->enable_superimpose) {
+			e->startEffect();
+			if ((e->enable_shader && shaders_are_enabled) && e->is_glsl_linked()) {
+				for (int i=0;i<e->getIterations();i++) {
+					e->process_shader(timecode, coords, i);
+
+					GLuint source_texture = composite_texture;
+					if (e->enable_mipmaps) set_texture_filtering(source_texture, true);
+					composite_texture = draw_clip(c->fbo[fbo_switcher], source_texture, true, e->get_glsl_program());
+					if (e->enable_mipmaps) set_texture_filtering(source_texture, false);
+
+					fbo_switcher = !fbo_switcher;
+				}
+			}
+			if (e->enable_superimpose) {
+				GLuint superimpose_texture = e->process_superimpose(timecode);
+				if (superimpose_texture == 0) {
+					qWarning() << "Superimpose texture was nullptr, retrying...";
+					texture_failed = true;
+				} else {
+					composite_texture = draw_clip(c->fbo[!fbo_switcher], superimpose_texture, false);
+				}
+			}
+			e->endEffect();
+		}
+	}
+}
+
+void RenderThread::process_fused_effects(Clip* c, const QVector<Effect*>& fx, double timecode, GLTextureCoords& coords, GLuint& composite_texture, bool& fbo_switcher) {
+	if (fx.isEmpty()) return;
+
+	QOpenGLShaderProgram* program = nullptr;
+	if (fx.size() > 1) {
+		QStringList frag_files;
+		for (int i=0;i<fx.size();i++) {
+			frag_files.append(fx.at(i)->get_frag_file());
+		}
+		program = get_fused_shader_program(fx.first()->get_vert_file(), frag_files);
+	}
+
+	if (program == nullptr || !program->isLinked()) {
+		// nothing to fuse or the fused shader couldn't be built, fall back to one pass per effect
+		for (int i=0;i<fx.size();i++) {
+			process_effect(c, fx.at(i), timecode, coords, composite_texture, fbo_switcher, TA_NO_TRANSITION);
+		}
+		return;
+	}
+
+	program->bind();
+	for (int i=0;i<fx.size();i++) {
+		fx.at(i)->set_shader_uniforms(program, timecode, get_fused_uniform_prefix(i));
+	}
+	composite_texture = draw_clip(c->fbo[fbo_switcher], composite_texture, true, program);
+	fbo_switcher = !fbo_switcher;
+	program->release();
+}
+
+int motion_blur_prog = 0;
+int motion_blur_lim = 4;
+
+GLuint RenderThread::compose_sequence(Sequence* seq, QVector<Clip*>& nests, bool render_audio) {
+	Sequence* s = seq;
+	long playhead = s->playhead;
+
+	if (!nests.isEmpty()) {
+		for (int i=0;i<nests.size();i++) {
+			s = nests.at(i)->media->to_sequence();
+			playhead += nests.at(i)->clip_in - nests.at(i)->get_timeline_in_with_transition();
+			playhead = refactor_frame_number(playhead, nests.at(i)->sequence->frame_rate, s->frame_rate);
+		}
+
+		if (nests.last()->fbo != nullptr) {
+			nests.last()->fbo[0]->bind();
+			glClear(GL_COLOR_BUFFER_BIT);
+			nests.last()->fbo[0]->release();
+		}
+	}
+
+	int audio_track_count = 0;
+
+	QVector<Clip*> current_clips;
+
+	for (int i=0;i<s->clips.size();i++) {
+		Clip* c = s->clips.at(i);
+
+		// if clip starts within one second and/or hasn't finished yet
+		if (c != nullptr && (render_video || c->track >= 0)) {
+			if (!(!nests.isEmpty() && !same_sign(c->track, nests.last()->track))) {
+				bool clip_is_active = false;
+
+				if (c->media != nullptr && c->media->get_type() == MEDIA_TYPE_FOOTAGE) {
+					Footage* m = c->media->to_footage();
+					if (!m->invalid && !(c->track >= 0 && !is_audio_device_set())) {
+						if (m->ready) {
+							const FootageStream* ms = m->get_stream_from_file_index(c->track < 0, c->media_stream);
+							if (ms != nullptr && is_clip_active(c, playhead)) {
+								// if thread is already working, we don't want to touch this,
+								// but we also don't want to hang the UI thread
+								if (!c->open) {
+									open_clip(c, !rendering);
+								}
+								clip_is_active = true;
+								if (c->track >= 0) audio_track_count++;
+							} else if (c->open) {
+								close_clip(c, false);
+							}
+						} else {
+							//qWarning() << "Media '" + m->name + "' was not ready, retrying...";
+							texture_failed = true;
+						}
+					}
+				} else {
+					if (is_clip_active(c, playhead)) {
+						if (!c->open) open_clip(c, !rendering);
+						clip_is_active = true;
+					} else if (c->open) {
+						close_clip(c, false);
+					}
+				}
+				if (clip_is_active) {
+					bool added = false;
+					for (int j=0;j<current_clips.size();j++) {
+						if (current_clips.at(j)->track < c->track) {
+							current_clips.insert(j, c);
+							added = true;
+							break;
+						}
+					}
+					if (!added) {
+						current_clips.append(c);
+					}
+				}
+			}
+		}
+	}
+
+	// work out everything the clips need that isn't GL across the thread pool first, so the loop below only submits
+	QVector<ClipDrawPacket> packets;
+	for (int i=0;i<current_clips.size();i++) {
+		packets.append(create_draw_packet(current_clips.at(i), s, playhead));
+	}
+	prepare_draw_packets(packets);
+
+	int half_width = s->width/2;
+	int half_height = s->height/2;
+	if (readback || !nests.isEmpty()) half_height = -half_height; // invert vertical
+
+	QMatrix4x4 projection;
+	projection.ortho(-half_width, half_width, half_height, -half_height, -1, 10);
+
+	for (int i=0;i<current_clips.size();i++) {
+		GL_DEFAULT_BLEND
+
+		Clip* c = current_clips.at(i);
+		const ClipDrawPacket& packet = packets.at(i);
+		DrawPacketScope scope(&packet);
+
+		if (c->media != nullptr && c->media->get_type() == MEDIA_TYPE_FOOTAGE && !c->finished_opening) {
+			qWarning() << "Tried to display clip" << i << "but it's closed";
+			texture_failed = true;
+		} else {
+			if (c->track < 0) {
+				GLuint textureID = 0;
+				int video_width = c->getWidth();
+				int video_height = c->getHeight();
+
+				if (c->media != nullptr) {
+					switch (c->media->get_type()) {
+					case MEDIA_TYPE_FOOTAGE:
+						// set up opengl texture
+						if (c->texture == nullptr) {
+							c->texture = acquire_texture(c->stream->codecpar->width, c->stream->codecpar->height, get_gl_tex_fmt_from_av(c->pix_fmt), get_gl_pix_fmt_from_av(c->pix_fmt));
+						}
+						get_clip_frame(c, playhead, texture_failed);
+						textureID = c->texture->textureId();
+						break;
+					case MEDIA_TYPE_SEQUENCE:
+						textureID = -1;
+						break;
+					}
+				}
+
+				if (textureID == 0 && c->media != nullptr) {
+					qWarning() << "Texture hasn't been created yet";
+					texture_failed = true;
+				} else if (playhead >= c->get_timeline_in_with_transition()) {
+					// borrow buffers for this frame, they go back to the pool once the clip is composited
+					if (c->fbo == nullptr) {
+						c->fbo = new QOpenGLFramebufferObject* [2];
+						c->fbo[0] = acquire_framebuffer(video_width, video_height);
+						c->fbo[1] = acquire_framebuffer(video_width, video_height);
+					}
+
+					// clear fbos
+					/*c->fbo[0]->bind();
+					glClear(GL_COLOR_BUFFER_BIT);
+					c->fbo[0]->release();
+					c->fbo[1]->bind();
+					glClear(GL_COLOR_BUFFER_BIT);
+					c->fbo[1]->release();*/
+
+					bool fbo_switcher = false;
+
+					glViewport(0, 0, video_width, video_height);
+
+					GLuint composite_texture;
+
+					if (c->media == nullptr) {
+						c->fbo[fbo_switcher]->bind();
+						glClear(GL_COLOR_BUFFER_BIT);
+						c->fbo[fbo_switcher]->release();
+						composite_texture = c->fbo[fbo_switcher]->texture();
+					} else {
+						// for nested sequences
+						if (c->media->get_type()== MEDIA_TYPE_SEQUENCE) {
+							nests.append(c);
+							textureID = compose_sequence(seq, nests, render_audio);
+							nests.removeLast();
+							fbo_switcher = true;
+						}
+
+						composite_texture = draw_clip(c->fbo[fbo_switcher], textureID, true);
+					}
+
+					fbo_switcher = !fbo_switcher;
+
+					GLTextureCoords coords = packet.coords.first();
+
+					// EFFECT CODE START
+					double timecode = packet.timecode;
+
+					// runs of pointwise shader effects are drawn together in one pass
+					QVector<Effect*> fused_effects;
+
+					for (int j=0;j<c->effects.size();j++) {
+						Effect* e = c->effects.at(j);
+						if (e->is_enabled() && e->can_fuse_shader()) {
+							fused_effects.append(e);
+						} else {
+							if (e->is_enabled()) {
+								process_fused_effects(c, fused_effects, timecode, coords, composite_texture, fbo_switcher);
+								fused_effects.clear();
+							}
+							coords = packet.coords.at(j+1);
+							process_effect(c, e, timecode, coords, composite_texture, fbo_switcher, TA_NO_TRANSITION);
+						}
+					}
+
+					process_fused_effects(c, fused_effects, timecode, coords, composite_texture, fbo_switcher);
+
+					// decided when the frame was queued, an effect removed since then doesn't show its gizmos
+					if (!readback && gizmo_candidates.contains(c)) {
+						Effect* candidate = gizmo_candidates.value(c);
+						if (candidate == nullptr || c->effects.contains(candidate)) gizmos = candidate;
+					}
+
+					coords = packet.coords.at(c->effects.size()+1);
+					if (packet.opening_progress >= 0) {
+						process_effect(c, c->get_opening_transition(), packet.opening_progress, coords, composite_texture, fbo_switcher, TA_OPENING_TRANSITION);
+					}
+
+					coords = packet.coords.at(c->effects.size()+2);
+					if (packet.closing_progress >= 0) {
+						process_effect(c, c->get_closing_transition(), packet.closing_progress, coords, composite_texture, fbo_switcher, TA_CLOSING_TRANSITION);
+					}
+					// EFFECT CODE END
+
+					if (!nests.isEmpty()) {
+						nests.last()->fbo[0]->bind();
+					}
+					glViewport(0, 0, s->width, s->height);
+
+					glBindTexture(GL_TEXTURE_2D, composite_texture);
+					glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+					glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+					glBindTexture(GL_TEXTURE_2D, 0);
+
+					if (coords.custom_blend) glBlendFunc(coords.blend_src, coords.blend_dst);
+
+					QMatrix4x4 clip_mvp = projection * coords.matrix;
+					draw_texture(composite_texture, coords, clip_mvp, coords.opacity);
+
+					if (gizmos != nullptr && !drawn_gizmos) {
+						gizmos->gizmo_draw(timecode, coords); // set correct gizmo coords
+						gizmos->gizmo_world_to_screen(clip_mvp);
+
+						drawn_gizmos = true;
+					}
+
+					if (!nests.isEmpty()) {
+						nests.last()->fbo[0]->release();
+						if (target_fbo != nullptr) target_fbo->bind();
+					}
+
+					release_clip_buffers(c);
+
+					/*GLfloat motion_blur_frac = (GLfloat) motion_blur_prog / (GLfloat) motion_blur_lim;
+					if (motion_blur_prog == 0) {
+						glAccum(GL_LOAD, motion_blur_frac);
+					} else {
+						glAccum(GL_ACCUM, motion_blur_frac);
+					}
+					motion_blur_prog++;*/
+				}
+			} else {
+				if (render_audio || (config.enable_audio_scrubbing && audio_scrub)) {
+					if (c->media != nullptr && c->media->get_type() == MEDIA_TYPE_SEQUENCE) {
+						nests.append(c);
+						compose_sequence(seq, nests, render_audio);
+						nests.removeLast();
+					} else {
+						if (c->lock.tryLock()) {
+							// clip is not caching, start caching audio
+							cache_clip(c, playhead, c->audio_reset, !render_audio, nests);
+							c->lock.unlock();
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (audio_track_count == 0) {
+		emit wake_playback();
+	}
+
+	if (!nests.isEmpty() && nests.last()->fbo != nullptr) {
+		// returns nested clip's texture
+		return nests.last()->fbo[0]->texture();
+	}
+
+	return 0;
+}
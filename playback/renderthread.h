@@ -0,0 +1,135 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <QAtomicInt>
+#include <QString>
+#include <QOpenGLFunctions>
+
+#include "io/yuvconverter.h"
+
+class QOpenGLContext;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+class Effect;
+struct Clip;
+struct Sequence;
+struct GLTextureCoords;
+struct AVFrame;
+
+// a finished frame, the one on screen and the one being drawn
+#define RENDER_THREAD_FRAME_COUNT 3
+
+// held while a frame is composited, anything changing sequences or closing their clips takes it first
+extern QMutex render_lock;
+
+/*
+ * Composites sequences in its own offscreen context, shared with the viewer it belongs to. Viewers queue frames
+ * with paint() and draw the texture of the latest finished one when ready() arrives, so the GUI thread never waits
+ * on compositing. render_image() composites a complete frame and reads it back for export and saving stills,
+ * blocking only the thread that asked for it.
+ */
+class RenderThread : public QThread, QOpenGLFunctions {
+	Q_OBJECT
+public:
+	RenderThread();
+	~RenderThread();
+	void run();
+
+	// creates the context, has to be called on the GUI thread before start()
+	void set_up(QOpenGLContext* share);
+	void stop();
+
+	// newer frames replace any that haven't started yet, ignored while exporting as the viewer shows the exported
+	// frames then. has to be called on the GUI thread, which clips show gizmos is taken from the selection here
+	void paint(Sequence* s, bool render_audio);
+
+	// drops queued and finished frames before their clips are closed, waits for the one being drawn
+	void discard();
+
+	// waits for footage until the frame is complete, pixels can be nullptr to only render audio, which skips video
+	// clips entirely
+	bool render_image(Sequence* s, bool render_audio, uchar* pixels, int row_pixels);
+
+	// same as above, converted on the GPU into the planes of a frame in a format can_convert_on_gpu() accepts and
+	// scaled to its size. Frames over 8 bits per sample are blended at 16 bits where the context can render to them,
+	// but footage and effect buffers are still 8-bit, so 10-bit exports only gain precision where clips are blended
+	bool render_planes(Sequence* s, AVFrame* frame);
+
+	// compiles shader programs (vertex and fragment file) in this thread's context before any frame needs them
+	void precompile(const QVector< QPair<QString, QString> >& shaders);
+
+	// gives up on the frame waiting for footage
+	void cancel();
+
+	// latest finished frame, safe to draw until the next call, 0 if there isn't one yet
+	GLuint get_frame_texture();
+	Effect* get_frame_gizmos();
+signals:
+	void ready(bool complete);
+	void wake_playback();
+private:
+	bool compose_frame(Sequence* s, bool render_audio, QOpenGLFramebufferObject* target);
+	void show_image(Sequence* s);
+	GLuint compose_sequence(Sequence* seq, QVector<Clip *> &nests, bool render_audio);
+	GLuint draw_clip(QOpenGLFramebufferObject *clip, GLuint texture, bool clear, QOpenGLShaderProgram* program = nullptr);
+	void set_texture_filtering(GLuint texture, bool mipmapped);
+	void process_effect(Clip* c, Effect* e, double timecode, GLTextureCoords& coords, GLuint& composite_texture, bool& fbo_switcher, int data);
+	void process_fused_effects(Clip* c, const QVector<Effect*>& fx, double timecode, GLTextureCoords& coords, GLuint& composite_texture, bool& fbo_switcher);
+	int get_free_frame();
+
+	QOpenGLContext* ctx;
+	QOffscreenSurface* surface;
+
+	// guards the requests, the frames and the flags below
+	QMutex queue_lock;
+	QWaitCondition wait_cond;
+	QWaitCondition image_cond;
+	QWaitCondition idle_cond;
+	bool running;
+	bool painting;
+
+	Sequence* paint_seq;
+	bool paint_audio;
+	QHash<Clip*, Effect*> paint_gizmos;
+	bool paint_queued;
+
+	Sequence* image_seq;
+	bool image_audio;
+	uchar* image_pixels;
+	int image_row_pixels;
+	AVFrame* image_planes;
+	bool image_queued;
+	bool image_done;
+	bool image_complete;
+	QOpenGLFramebufferObject* image_fbo;
+	bool deep_images;
+
+	QVector< QPair<QString, QString> > precompile_queue;
+	YUVConverter yuv_converter;
+
+	QOpenGLFramebufferObject* frames[RENDER_THREAD_FRAME_COUNT];
+	Effect* frame_gizmos[RENDER_THREAD_FRAME_COUNT];
+	int front_frame;
+	int displayed_frame;
+
+	// only used on the render thread
+	QOpenGLFramebufferObject* target_fbo;
+	bool readback;
+	bool render_video;
+	Effect* gizmos;
+	QHash<Clip*, Effect*> gizmo_candidates;
+	bool drawn_gizmos;
+	bool texture_failed;
+
+	// set from other threads to give up on a frame waiting for footage
+	QAtomicInt force_quit;
+};
+
+#endif // RENDERTHREAD_H
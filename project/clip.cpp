@@ -38,6 +38,8 @@ Clip::Clip(Sequence* s) :
 	use_existing_frame(false),
 	filter_graph(nullptr),
 	fbo(nullptr),
+	upload_ring(nullptr),
+	effect_frame(nullptr),
 	opts(nullptr)
 {
 	pkt = av_packet_alloc();
@@ -91,7 +93,9 @@ void Clip::reset() {
 	codec = nullptr;
 	codecCtx = nullptr;
 	texture = nullptr;
-	last_invalid_ts = -1;
+	seek_playhead = -1;
+	seek_time = -1;
+	queue_seek_playhead = -1;
 }
 
 void Clip::reset_audio() {
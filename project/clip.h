@@ -30,6 +30,7 @@ struct AVFilterGraph;
 struct AVFilterContext;
 struct AVDictionary;
 class QOpenGLTexture;
+class TextureUploadRing;
 
 struct Clip
 {
@@ -106,13 +107,17 @@ struct Clip
 	bool use_existing_frame;
     bool multithreaded;
 	Cacher* cacher;
-    QWaitCondition can_cache;
 	int max_queue_size;
 	QVector<AVFrame*> queue;
 	QMutex queue_lock;
     QMutex lock;
 	QMutex open_lock;
-    int64_t last_invalid_ts;
+	// playhead of the last seek while the playhead stays there, -1 once it moves, and when it was asked for or -1
+	// once its frame was shown
+	long seek_playhead;
+	qint64 seek_time;
+	// playhead the cacher last cleared the queue and seeked for, read and written under queue_lock
+	long queue_seek_playhead;
 
 	// converters/filters
 	AVFilterGraph* filter_graph;
@@ -123,6 +128,8 @@ struct Clip
 	QOpenGLFramebufferObject** fbo;
     QOpenGLTexture* texture;
 	long texture_frame;
+	TextureUploadRing* upload_ring;
+	AVFrame* effect_frame;
 
 	// audio playback variables
 	int64_t reverse_target;
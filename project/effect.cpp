@@ -14,6 +14,8 @@
 #include "ui/checkboxex.h"
 #include "debug.h"
 #include "io/path.h"
+#include "io/shadercache.h"
+#include "io/projectsnapshot.h"
 #include "mainwindow.h"
 #include "io/math.h"
 #include "transition.h"
@@ -28,6 +30,7 @@
 #include "effects/internal/paneffect.h"
 #include "effects/internal/shakeeffect.h"
 #include "effects/internal/cornerpineffect.h"
+#include "effects/internal/blureffect.h"
 #ifdef _WIN32
 #include "effects/internal/vsthostwin.h"
 #endif
@@ -36,7 +39,6 @@
 #include <QCheckBox>
 #include <QGridLayout>
 #include <QXmlStreamReader>
-#include <QXmlStreamWriter>
 #include <QMessageBox>
 #include <QOpenGLContext>
 #include <QDir>
@@ -66,6 +68,8 @@ Effect* create_effect(Clip* c, const EffectMeta* em) {
 		case EFFECT_INTERNAL_SHAKE: return new ShakeEffect(c, em);
 		case EFFECT_INTERNAL_CORNERPIN: return new CornerPinEffect(c, em);
 		case EFFECT_INTERNAL_FILLLEFTRIGHT: return new FillLeftRightEffect(c, em);
+		case EFFECT_INTERNAL_GAUSSIANBLUR: return new BlurEffect(c, em, BLUR_TYPE_GAUSSIAN);
+		case EFFECT_INTERNAL_BOXBLUR: return new BlurEffect(c, em, BLUR_TYPE_BOX);
 #ifdef _WIN32
 		case EFFECT_INTERNAL_VST: return new VSTHostWin(c, em);
 #endif
@@ -142,6 +146,15 @@ void load_internal_effects() {
 	em.internal = EFFECT_INTERNAL_SHAKE;
 	effects.append(em);
 
+	em.name = "Gaussian Blur";
+	em.category = "Blur";
+	em.internal = EFFECT_INTERNAL_GAUSSIANBLUR;
+	effects.append(em);
+
+	em.name = "Box Blur";
+	em.internal = EFFECT_INTERNAL_BOXBLUR;
+	effects.append(em);
+
 	em.name = "Text";
 	em.category = "Render";
 	em.internal = EFFECT_INTERNAL_TEXT;
@@ -269,27 +282,25 @@ Effect::Effect(Clip* c, const EffectMeta *em) :
 	enable_coords(false),
 	enable_superimpose(false),
 	enable_image(false),
+	enable_mipmaps(false),
+	pointwise(false),
 	glslProgram(nullptr),
 	texture(nullptr),
 	enable_always_update(false),
+	superimpose_renderer(nullptr),
 	isOpen(false),
+	reopen_requested(false),
+	enabled(true),
+	iterations(1),
+	ui_layout(nullptr),
+	ui(nullptr),
 	bound(false)
 {
-	// set up base UI
-	container = new CollapsibleWidget();
-	connect(container->enabled_check, SIGNAL(clicked(bool)), this, SLOT(field_changed()));
-	ui = new QWidget();
-	ui_layout = new QGridLayout();
-	ui_layout->setSpacing(4);
-	ui->setLayout(ui_layout);
-	container->setContents(ui);
-
-	connect(container->title_bar, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(show_context_menu(const QPoint&)));
+	// widgets are created on demand by get_container(), so effects can be built on any thread
+	container = nullptr;
 
 	if (em != nullptr) {
-		// set up UI from effect file
-		container->setText(em->name);
-
+		// set up rows from effect file
 		if (!em->filename.isEmpty()) {
 			QFile effect_file(em->filename);
 			if (effect_file.open(QFile::ReadOnly)) {
@@ -447,6 +458,10 @@ Effect::Effect(Clip* c, const EffectMeta *em) :
 								vertPath = attr.value().toString();
 							} else if (attr.name() == "frag") {
 								fragPath = attr.value().toString();
+							} else if (attr.name() == "pointwise") {
+								pointwise = (attr.value() == "true");
+							} else if (attr.name() == "iterations") {
+								setIterations(attr.value().toInt());
 							}
 						}
 					}/* else if (reader.name() == "superimpose" && reader.isStartElement()) {
@@ -482,7 +497,9 @@ Effect::~Effect() {
 		close();
 	}
 
-	//delete container;
+	if (container != nullptr) {
+		container->deleteLater();
+	}
 
 	for (int i=0;i<rows.size();i++) {
 		delete rows.at(i);
@@ -490,6 +507,9 @@ Effect::~Effect() {
 	for (int i=0;i<gizmos.size();i++) {
 		delete gizmos.at(i);
 	}
+
+	// jobs still painting on workers hold their own frames
+	delete superimpose_renderer;
 }
 
 void Effect::copy_field_keyframes(Effect* e) {
@@ -507,7 +527,7 @@ void Effect::copy_field_keyframes(Effect* e) {
 }
 
 EffectRow* Effect::add_row(const QString& name, bool savable, bool keyframable) {
-	EffectRow* row = new EffectRow(this, savable, ui_layout, name, rows.size(), keyframable);
+	EffectRow* row = new EffectRow(this, savable, name, keyframable);
 	rows.append(row);
 	return row;
 }
@@ -534,9 +554,45 @@ int Effect::gizmo_count(){
 	return gizmos.size();
 }
 
+CollapsibleWidget* Effect::get_container() {
+	if (container == nullptr) {
+		container = new CollapsibleWidget();
+		container->enabled_check->setChecked(enabled);
+		connect(container->enabled_check, SIGNAL(clicked(bool)), this, SLOT(set_enabled(bool)));
+		connect(container->enabled_check, SIGNAL(clicked(bool)), this, SLOT(field_changed()));
+		ui = new QWidget();
+		ui_layout = new QGridLayout();
+		ui_layout->setSpacing(4);
+		ui->setLayout(ui_layout);
+		container->setContents(ui);
+
+		connect(container->title_bar, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(show_context_menu(const QPoint&)));
+
+		if (meta != nullptr) {
+			container->setText(meta->name);
+		}
+
+		for (int i=0;i<rows.size();i++) {
+			rows.at(i)->create_ui(ui_layout, i);
+		}
+
+		setup_ui();
+	}
+	return container;
+}
+
+bool Effect::has_container() {
+	return (container != nullptr);
+}
+
+void Effect::setup_ui() {}
+
 void Effect::refresh() {}
 
 void Effect::field_changed() {
+	// fields are also set while a project loads on its own thread, the viewer updates once it's done
+	if (QThread::currentThread() != QApplication::instance()->thread()) return;
+
 	panel_sequence_viewer->viewer_widget->update();
 	panel_graph_editor->update_panel();
 }
@@ -604,11 +660,18 @@ int Effect::get_index_in_clip() {
 }
 
 bool Effect::is_enabled() {
-	return container->enabled_check->isChecked();
+	return enabled;
+}
+
+bool Effect::is_passthrough() {
+	return !enabled;
 }
 
 void Effect::set_enabled(bool b) {
-	container->enabled_check->setChecked(b);
+	enabled = b;
+	if (container != nullptr) {
+		container->enabled_check->setChecked(b);
+	}
 }
 
 QVariant load_data_from_string(int type, const QString& string) {
@@ -732,34 +795,22 @@ void Effect::load(QXmlStreamReader& stream) {
 
 void Effect::custom_load(QXmlStreamReader &) {}
 
-void Effect::save(QXmlStreamWriter& stream) {
-	stream.writeAttribute("name", meta->name);
-	stream.writeAttribute("enabled", QString::number(is_enabled()));
+void Effect::save(ProjectSnapshotElement* element) {
+	element->set_attribute("name", meta->name);
+	element->set_attribute("enabled", QString::number(is_enabled()));
 
 	for (int i=0;i<rows.size();i++) {
 		EffectRow* row = rows.at(i);
 		if (row->savable) {
-			stream.writeStartElement("row"); // row
+			ProjectSnapshotElement* row_element = element->add_child("row");
 			for (int j=0;j<row->fieldCount();j++) {
 				EffectField* field = row->field(j);
-				stream.writeStartElement("field"); // field
-				stream.writeAttribute("id", field->id);
-				stream.writeAttribute("value", save_data_to_string(field->type, field->get_current_data()));
-				for (int k=0;k<field->keyframes.size();k++) {
-					const EffectKeyframe& key = field->keyframes.at(k);
-					stream.writeStartElement("key");
-					stream.writeAttribute("value", save_data_to_string(field->type, key.data));
-					stream.writeAttribute("frame", QString::number(key.time));
-					stream.writeAttribute("type", QString::number(key.type));
-					stream.writeAttribute("prehx", QString::number(key.pre_handle_x));
-					stream.writeAttribute("prehy", QString::number(key.pre_handle_y));
-					stream.writeAttribute("posthx", QString::number(key.post_handle_x));
-					stream.writeAttribute("posthy", QString::number(key.post_handle_y));
-					stream.writeEndElement(); // key
-				}
-				stream.writeEndElement(); // field
+				ProjectSnapshotElement* field_element = row_element->add_child("field");
+				field_element->set_attribute("id", field->id);
+
+				// keyframes are shared with the field rather than copied, and written out by the project writer
+				field_element->set_field(field->type, field->get_current_data(), field->keyframes);
 			}
-			stream.writeEndElement(); // row
 		}
 	}
 }
@@ -785,6 +836,17 @@ void Effect::validate_meta_path() {
 	}
 }
 
+QOpenGLShaderProgram* Effect::get_cached_program() {
+	return get_shader_program(get_vert_file(), get_frag_file());
+}
+
+bool Effect::get_shader_files(QString& vert, QString& frag) {
+	if (!shaders_are_enabled || !enable_shader) return false;
+	vert = get_vert_file();
+	frag = get_frag_file();
+	return true;
+}
+
 void Effect::open() {
 	if (isOpen) {
 		qWarning() << "Tried to open an effect that was already open";
@@ -794,32 +856,7 @@ void Effect::open() {
 		if (QOpenGLContext::currentContext() == nullptr) {
 			qWarning() << "No current context to create a shader program for - will retry next repaint";
 		} else {
-			glslProgram = new QOpenGLShaderProgram();
-			validate_meta_path();
-			bool glsl_compiled = true;
-			if (!vertPath.isEmpty()) {
-				if (glslProgram->addShaderFromSourceFile(QOpenGLShader::Vertex, meta->path + "/" + vertPath)) {
-					qInfo() << "Vertex shader added successfully";
-				} else {
-					glsl_compiled = false;
-					qWarning() << "Vertex shader could not be added";
-				}
-			}
-			if (!fragPath.isEmpty()) {
-				if (glslProgram->addShaderFromSourceFile(QOpenGLShader::Fragment, meta->path + "/" + fragPath)) {
-					qInfo() << "Fragment shader added successfully";
-				} else {
-					glsl_compiled = false;
-					qWarning() << "Fragment shader could not be added";
-				}
-			}
-			if (glsl_compiled) {
-				if (glslProgram->link()) {
-					qInfo() << "Shader program linked successfully";
-				} else {
-					qWarning() << "Shader program failed to link";
-				}
-			}
+			glslProgram = get_cached_program();
 			isOpen = true;
 		}
 	} else {
@@ -836,10 +873,10 @@ void Effect::close() {
 		qWarning() << "Tried to close an effect that was already closed";
 	}
 	delete_texture();
-	if (glslProgram != nullptr) {
-		delete glslProgram;
-		glslProgram = nullptr;
-	}
+
+	// the program is shared with other instances and owned by the shader cache
+	glslProgram = nullptr;
+
 	isOpen = false;
 }
 
@@ -847,8 +884,28 @@ bool Effect::is_glsl_linked() {
 	return glslProgram != nullptr && glslProgram->isLinked();
 }
 
+QOpenGLShaderProgram* Effect::get_glsl_program() {
+	return glslProgram;
+}
+
+int Effect::getIterations() {
+	return iterations;
+}
+
+void Effect::setIterations(int i) {
+	iterations = qMax(1, i);
+}
+
+void Effect::request_reopen() {
+	reopen_requested = true;
+}
+
 void Effect::startEffect() {
-	if (!isOpen) {
+	if (reopen_requested) {
+		reopen_requested = false;
+		if (isOpen) close();
+		open();
+	} else if (!isOpen) {
 		open();
 		qWarning() << "Tried to start a closed effect - opening";
 	}
@@ -873,9 +930,28 @@ Effect* Effect::copy(Clip* c) {
 	return copy;
 }
 
-void Effect::process_shader(double timecode, GLTextureCoords&) {
-	glslProgram->setUniformValue("resolution", parent_clip->getWidth(), parent_clip->getHeight());
-	glslProgram->setUniformValue("time", GLfloat(timecode));
+bool Effect::can_fuse_shader() {
+	return shaders_are_enabled && enable_shader && pointwise && iterations == 1 && !enable_coords && !enable_superimpose;
+}
+
+QString Effect::get_vert_file() {
+	validate_meta_path();
+	return vertPath.isEmpty() ? QString() : meta->path + "/" + vertPath;
+}
+
+QString Effect::get_frag_file() {
+	validate_meta_path();
+	return fragPath.isEmpty() ? QString() : meta->path + "/" + fragPath;
+}
+
+void Effect::process_shader(double timecode, GLTextureCoords&, int iteration) {
+	set_shader_uniforms(glslProgram, timecode, QString());
+	if (iterations > 1) glslProgram->setUniformValue("iteration", iteration);
+}
+
+void Effect::set_shader_uniforms(QOpenGLShaderProgram* program, double timecode, const QString& prefix) {
+	program->setUniformValue((prefix + "resolution").toUtf8().constData(), parent_clip->getWidth(), parent_clip->getHeight());
+	program->setUniformValue((prefix + "time").toUtf8().constData(), GLfloat(timecode));
 
 	for (int i=0;i<rows.size();i++) {
 		EffectRow* row = rows.at(i);
@@ -884,11 +960,11 @@ void Effect::process_shader(double timecode, GLTextureCoords&) {
 			if (!field->id.isEmpty()) {
 				switch (field->type) {
 				case EFFECT_FIELD_DOUBLE:
-					glslProgram->setUniformValue(field->id.toUtf8().constData(), GLfloat(field->get_double_value(timecode)));
+					program->setUniformValue((prefix + field->id).toUtf8().constData(), GLfloat(field->get_double_value(timecode)));
 					break;
 				case EFFECT_FIELD_COLOR:
-					glslProgram->setUniformValue(
-								field->id.toUtf8().constData(),
+					program->setUniformValue(
+								(prefix + field->id).toUtf8().constData(),
 								GLfloat(field->get_color_value(timecode).redF()),
 								GLfloat(field->get_color_value(timecode).greenF()),
 								GLfloat(field->get_color_value(timecode).blueF())
@@ -896,10 +972,10 @@ void Effect::process_shader(double timecode, GLTextureCoords&) {
 					break;
 				case EFFECT_FIELD_STRING: break; // can you even send a string to a uniform value?
 				case EFFECT_FIELD_BOOL:
-					glslProgram->setUniformValue(field->id.toUtf8().constData(), field->get_bool_value(timecode));
+					program->setUniformValue((prefix + field->id).toUtf8().constData(), field->get_bool_value(timecode));
 					break;
 				case EFFECT_FIELD_COMBO:
-					glslProgram->setUniformValue(field->id.toUtf8().constData(), field->get_combo_index(timecode));
+					program->setUniformValue((prefix + field->id).toUtf8().constData(), field->get_combo_index(timecode));
 					break;
 				case EFFECT_FIELD_FONT: break; // can you even send a string to a uniform value?
 				case EFFECT_FIELD_FILE: break; // can you even send a string to a uniform value?
@@ -912,6 +988,8 @@ void Effect::process_shader(double timecode, GLTextureCoords&) {
 void Effect::process_coords(double, GLTextureCoords&, int) {}
 
 GLuint Effect::process_superimpose(double timecode) {
+	if (superimpose_renderer != nullptr) return process_superimpose_frame(timecode);
+
 	bool recreate_texture = false;
 	int width = parent_clip->getWidth();
 	int height = parent_clip->getHeight();
@@ -938,6 +1016,83 @@ GLuint Effect::process_superimpose(double timecode) {
 	return 0;
 }
 
+void Effect::prepare_values(double timecode, QHash<const EffectField*, PreparedFieldValue>& values) {
+	if (!is_enabled()) return;
+
+	PreparedFieldValue v;
+	v.timecode = timecode;
+	for (int i=0;i<row_count();i++) {
+		EffectRow* crow = row(i);
+		for (int j=0;j<crow->fieldCount();j++) {
+			if (crow->field(j)->prepare_value(timecode, v.value)) values.insert(crow->field(j), v);
+		}
+	}
+}
+
+void Effect::prepare_superimpose(double timecode) {
+	if (!is_enabled()) return;
+
+	if (enable_superimpose && superimpose_renderer != nullptr) {
+		superimpose_renderer->get(get_superimpose_params(timecode, 0, true), QSize(parent_clip->getWidth(), parent_clip->getHeight()));
+	}
+}
+
+QVariantList Effect::get_superimpose_params(double, int, bool) {
+	return QVariantList();
+}
+
+GLuint Effect::process_superimpose_frame(double timecode) {
+	if (texture == nullptr) return 0;
+
+	QSize size(parent_clip->getWidth(), parent_clip->getHeight());
+
+	if (!texture->isStorageAllocated() || texture->width() != size.width() || texture->height() != size.height()) {
+		delete_texture();
+		texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+		texture->setSize(size.width(), size.height());
+		texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+		texture->setMipLevels(1);
+		texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+		texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+
+		// only the area each frame draws on is uploaded from here on, so the rest has to start out transparent
+		QByteArray blank(size.width()*size.height()*4, 0);
+		texture->setData(0, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, blank.constData());
+	}
+
+	QVariantList params = get_superimpose_params(timecode, 0, false);
+	if (superimpose_frame.isNull() || superimpose_frame->size != size || superimpose_frame->params != params) {
+		upload_superimpose_frame(superimpose_renderer->get(params, size));
+	}
+
+	// paint the next frame on a worker while this one is composited
+	superimpose_renderer->prefetch(get_superimpose_params(timecode + 1.0/parent_clip->sequence->frame_rate, 1, true), size);
+
+	return texture->textureId();
+}
+
+void Effect::upload_superimpose_frame(SuperimposeFramePtr frame) {
+	QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+	QRect rect(frame->offset, frame->patch.size());
+
+	texture->bind();
+
+	// clear whatever the last frame drew outside of this one
+	if (!superimpose_rect.isEmpty() && !rect.contains(superimpose_rect)) {
+		QByteArray blank(superimpose_rect.width()*superimpose_rect.height()*4, 0);
+		f->glTexSubImage2D(GL_TEXTURE_2D, 0, superimpose_rect.x(), superimpose_rect.y(), superimpose_rect.width(), superimpose_rect.height(), GL_RGBA, GL_UNSIGNED_BYTE, blank.constData());
+	}
+
+	if (!frame->patch.isNull()) {
+		f->glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), rect.width(), rect.height(), GL_RGBA, GL_UNSIGNED_BYTE, frame->patch.constBits());
+	}
+
+	texture->release();
+
+	superimpose_frame = frame;
+	superimpose_rect = rect;
+}
+
 void Effect::process_audio(double, double, quint8*, int, int) {}
 
 void Effect::gizmo_draw(double, GLTextureCoords &) {}
@@ -969,20 +1124,12 @@ void Effect::gizmo_move(EffectGizmo* gizmo, int x_movement, int y_movement, doub
 	}
 }
 
-void Effect::gizmo_world_to_screen() {
-	GLfloat view_val[16];
-	GLfloat projection_val[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, view_val);
-	glGetFloatv(GL_PROJECTION_MATRIX, projection_val);
-
-	QMatrix4x4 view_matrix(view_val);
-	QMatrix4x4 projection_matrix(projection_val);
-
+void Effect::gizmo_world_to_screen(const QMatrix4x4& mvp) {
 	for (int i=0;i<gizmos.size();i++) {
 		EffectGizmo* g = gizmos.at(i);
 
 		for (int j=0;j<g->get_point_count();j++) {
-			QVector4D screen_pos = QVector4D(g->world_pos[j].x(), g->world_pos[j].y(), 0, 1.0) * (view_matrix * projection_matrix);
+			QVector4D screen_pos = mvp * QVector4D(g->world_pos[j].x(), g->world_pos[j].y(), 0, 1.0);
 
 			int adjusted_sx1 = qRound(((screen_pos.x()*0.5f)+0.5f)*parent_clip->sequence->width);
 			int adjusted_sy1 = qRound((1.0f-((screen_pos.y()*0.5f)+0.5f))*parent_clip->sequence->height);
@@ -1045,7 +1192,7 @@ bool Effect::valueHasChanged(double timecode) {
 		for (int i=0;i<row_count();i++) {
 			EffectRow* crow = row(i);
 			for (int j=0;j<crow->fieldCount();j++) {
-				cachedValues.append(crow->field(j)->get_current_data());
+				cachedValues.append(crow->field(j)->validate_keyframe_data(timecode, true));
 			}
 		}
 		return true;
@@ -1056,11 +1203,11 @@ bool Effect::valueHasChanged(double timecode) {
 			EffectRow* crow = row(i);
 			for (int j=0;j<crow->fieldCount();j++) {
 				EffectField* field = crow->field(j);
-				field->validate_keyframe_data(timecode);
-				if (cachedValues.at(index) != field->get_current_data()) {
+				QVariant value = field->validate_keyframe_data(timecode, true);
+				if (cachedValues.at(index) != value) {
 					changed = true;
 				}
-				cachedValues[index] = field->get_current_data();
+				cachedValues[index] = value;
 				index++;
 			}
 		}
@@ -1073,6 +1220,8 @@ void Effect::delete_texture() {
 		delete texture;
 		texture = nullptr;
 	}
+	superimpose_frame.clear();
+	superimpose_rect = QRect();
 }
 
 qint16 mix_audio_sample(qint16 a, qint16 b) {
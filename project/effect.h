@@ -8,6 +8,7 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
+#include <QMatrix4x4>
 #include <QMutex>
 #include <QThread>
 class QLabel;
@@ -19,7 +20,7 @@ class QMouseEvent;
 
 struct Clip;
 class QXmlStreamReader;
-class QXmlStreamWriter;
+class ProjectSnapshotElement;
 class Effect;
 class EffectRow;
 class CheckboxEx;
@@ -65,7 +66,9 @@ const EffectMeta* get_internal_meta(int internal_id, int type);
 #define EFFECT_INTERNAL_FILLLEFTRIGHT 10
 #define EFFECT_INTERNAL_VST 11
 #define EFFECT_INTERNAL_CORNERPIN 12
-#define EFFECT_INTERNAL_COUNT 13
+#define EFFECT_INTERNAL_GAUSSIANBLUR 13
+#define EFFECT_INTERNAL_BOXBLUR 14
+#define EFFECT_INTERNAL_COUNT 15
 
 #define KEYFRAME_TYPE_LINEAR 0
 #define KEYFRAME_TYPE_BEZIER 1
@@ -99,13 +102,27 @@ struct GLTextureCoords {
 	float textureBottomLeftX;
 	float textureBottomLeftY;
 	float textureBottomLeftQ;
+
+	// transform and fade applied when the clip is composited, in place of the fixed-function matrix and color
+	QMatrix4x4 matrix;
+	float opacity;
+
+	// blend function the clip is composited with, effects set it here rather than in GL so coords can be worked
+	// out off the GL thread
+	bool custom_blend;
+	GLenum blend_src;
+	GLenum blend_dst;
 };
 
 qint16 mix_audio_sample(qint16 a, qint16 b);
 
+// a field value as it's stored in the project file
+QString save_data_to_string(int type, const QVariant& data);
+
 #include "effectfield.h"
 #include "effectrow.h"
 #include "effectgizmo.h"
+#include "superimposerenderer.h"
 
 class Effect : public QObject {
 	Q_OBJECT
@@ -116,7 +133,10 @@ public:
 	const EffectMeta* meta;
 	int id;
 	QString name;
-	CollapsibleWidget* container;
+
+	// builds the effect's widgets the first time it's shown in the effect controls
+	CollapsibleWidget* get_container();
+	bool has_container();
 
 	EffectRow* add_row(const QString &name, bool savable = true, bool keyframable = true);
 	EffectRow* row(int i);
@@ -127,7 +147,9 @@ public:
 	int gizmo_count();
 
 	bool is_enabled();
-	void set_enabled(bool b);
+
+	// leaves every frame of the clip exactly as it was, so export can copy the clip's packets instead
+	virtual bool is_passthrough();
 
 	virtual void refresh();
 
@@ -136,13 +158,20 @@ public:
 
     virtual void load(QXmlStreamReader& stream);
 	virtual void custom_load(QXmlStreamReader& stream);
-	virtual void save(QXmlStreamWriter& stream);
+	// captures the effect into its <effect> element, called on the GUI thread when the project is saved
+	virtual void save(ProjectSnapshotElement* element);
 
 	// glsl handling
 	bool is_open();
 	void open();
 	void close();
+	// closes and opens the effect again the next time it's drawn, on the thread its GL objects belong to. call with
+	// render_lock held
+	void request_reopen();
 	bool is_glsl_linked();
+	QOpenGLShaderProgram* get_glsl_program();
+	// shader files to compile ahead of the first frame, false if the effect doesn't draw with shaders
+	bool get_shader_files(QString& vert, QString& frag);
 	virtual void startEffect();
 	virtual void endEffect();
 
@@ -151,29 +180,48 @@ public:
 	bool enable_superimpose;
 	bool enable_image;
 
+	// input texture is linearly filtered and mipmapped while the shader runs, for kernels that read between texels
+	bool enable_mipmaps;
+
+	// shader only works on the pixel it's given, so it can be fused with its neighbours into one pass
+	bool pointwise;
+	bool can_fuse_shader();
+	QString get_vert_file();
+	QString get_frag_file();
+	void set_shader_uniforms(QOpenGLShaderProgram* program, double timecode, const QString& prefix);
+
 	int getIterations();
 	void setIterations(int i);
 
 	const char* ffmpeg_filter;
 
 	virtual void process_image(double timecode, uint8_t* data, int size);
-	virtual void process_shader(double timecode, GLTextureCoords&);
+	virtual void process_shader(double timecode, GLTextureCoords&, int iteration);
 	virtual void process_coords(double timecode, GLTextureCoords& coords, int data);
 	virtual GLuint process_superimpose(double timecode);
+
+	// evaluate keyframes and paint superimposed frames ahead of drawing at timecode, safe on any thread
+	void prepare_values(double timecode, QHash<const EffectField*, PreparedFieldValue>& values);
+	void prepare_superimpose(double timecode);
 	virtual void process_audio(double timecode_start, double timecode_end, quint8* samples, int nb_bytes, int channel_count);
 
 	virtual void gizmo_draw(double timecode, GLTextureCoords& coords);
 	void gizmo_move(EffectGizmo* sender, int x_movement, int y_movement, double timecode, bool done);
-	void gizmo_world_to_screen();
+	void gizmo_world_to_screen(const QMatrix4x4& mvp);
 	bool are_gizmos_enabled();
 public slots:
 	void field_changed();
+	void set_enabled(bool b);
 private slots:
 	void show_context_menu(const QPoint&);
 	void delete_self();
 	void move_up();
 	void move_down();
 protected:
+	// called once the base widgets and rows exist, for effects that need extra widgets
+	virtual void setup_ui();
+	CollapsibleWidget* container;
+
 	// glsl effect
 	QOpenGLShaderProgram* glslProgram;
 	QString vertPath;
@@ -183,6 +231,11 @@ protected:
 	QImage img;
 	QOpenGLTexture* texture;
 
+	// superimpose effects that set a renderer are painted from snapshots of their values instead of redraw(),
+	// lookahead is how many frames after the one being drawn timecode is
+	SuperimposeRenderer* superimpose_renderer;
+	virtual QVariantList get_superimpose_params(double timecode, int lookahead, bool async);
+
 	// enable effect to update constantly
 	bool enable_always_update;
 private:
@@ -190,6 +243,9 @@ private:
 	QString script;
 
 	bool isOpen;
+	bool reopen_requested;
+	bool enabled;
+	int iterations;
 	QVector<EffectRow*> rows;
 	QVector<EffectGizmo*> gizmos;
 	QGridLayout* ui_layout;
@@ -201,8 +257,16 @@ private:
 	bool valueHasChanged(double timecode);
 	QVector<QVariant> cachedValues;
 	void delete_texture();
+	GLuint process_superimpose_frame(double timecode);
+	void upload_superimpose_frame(SuperimposeFramePtr frame);
+
+	// frame currently in the texture and the area of the texture it covers
+	SuperimposeFramePtr superimpose_frame;
+	QRect superimpose_rect;
+
 	int get_index_in_clip();
 	void validate_meta_path();
+	QOpenGLShaderProgram* get_cached_program();
 };
 
 class EffectInit : public QThread {
@@ -14,97 +14,186 @@
 #include "project/undo.h"
 #include "project/clip.h"
 #include "project/sequence.h"
+#include "playback/drawpacket.h"
 
 #include "io/math.h"
 #include <QDateTime>
+#include <QThread>
 
 #include "debug.h"
 
 EffectField::EffectField(EffectRow *parent, int t, const QString &i) :
+	QObject(parent),
 	parent_row(parent),
 	type(t),
-	id(i)
+	id(i),
+	ui_element(nullptr),
+	enabled(true),
+	value_set(false),
+	default_value(0),
+	min_enabled(false),
+	min_value(0),
+	max_enabled(false),
+	max_value(0),
+	display_type(LABELSLIDER_NORMAL),
+	frame_rate(30)
 {
 	switch (t) {
-	case EFFECT_FIELD_DOUBLE:
-	{
-		LabelSlider* ls = new LabelSlider();
-		ui_element = ls;
-		connect(ls, SIGNAL(valueChanged()), this, SLOT(ui_element_change()));
-		connect(ls, SIGNAL(clicked()), this, SIGNAL(clicked()));
+	case EFFECT_FIELD_DOUBLE: data = 0.0; break;
+	case EFFECT_FIELD_COLOR: data = QColor(Qt::white); break;
+	case EFFECT_FIELD_STRING: data = QString(); break;
+	case EFFECT_FIELD_BOOL: data = false; break;
+	case EFFECT_FIELD_COMBO: data = 0; break;
+	case EFFECT_FIELD_FONT: data = QString(); break;
+	case EFFECT_FIELD_FILE: data = QString(); break;
 	}
-		break;
-	case EFFECT_FIELD_COLOR:
-	{
-		ColorButton* cb = new ColorButton();
-		ui_element = cb;
-		connect(cb, SIGNAL(color_changed()), this, SLOT(ui_element_change()));
+	previous_data = data;
+}
+
+QWidget* EffectField::get_ui_element() {
+	if (ui_element == nullptr) {
+		switch (type) {
+		case EFFECT_FIELD_DOUBLE:
+		{
+			LabelSlider* ls = new LabelSlider();
+			ls->set_frame_rate(frame_rate);
+			ls->set_display_type(display_type);
+			if (min_enabled) ls->set_minimum_value(min_value);
+			if (max_enabled) ls->set_maximum_value(max_value);
+			ls->set_default_value(default_value);
+			ui_element = ls;
+			connect(ls, SIGNAL(valueChanged()), this, SLOT(ui_element_change()));
+			connect(ls, SIGNAL(clicked()), this, SIGNAL(clicked()));
+		}
+			break;
+		case EFFECT_FIELD_COLOR:
+		{
+			ColorButton* cb = new ColorButton();
+			ui_element = cb;
+			connect(cb, SIGNAL(color_changed()), this, SLOT(ui_element_change()));
+		}
+			break;
+		case EFFECT_FIELD_STRING:
+		{
+			TextEditEx* edit = new TextEditEx();
+			edit->setUndoRedoEnabled(true);
+			ui_element = edit;
+			connect(edit, SIGNAL(textChanged()), this, SLOT(ui_element_change()));
+		}
+			break;
+		case EFFECT_FIELD_BOOL:
+		{
+			CheckboxEx* cb = new CheckboxEx();
+			ui_element = cb;
+			connect(cb, SIGNAL(clicked(bool)), this, SLOT(ui_element_change()));
+		}
+			break;
+		case EFFECT_FIELD_COMBO:
+		{
+			ComboBoxEx* cb = new ComboBoxEx();
+			for (int i=0;i<combo_names.size();i++) {
+				cb->addItem(combo_names.at(i), combo_data.at(i));
+			}
+			ui_element = cb;
+			connect(cb, SIGNAL(activated(int)), this, SLOT(ui_element_change()));
+		}
+			break;
+		case EFFECT_FIELD_FONT:
+		{
+			FontCombobox* fcb = new FontCombobox();
+			ui_element = fcb;
+			connect(fcb, SIGNAL(activated(int)), this, SLOT(ui_element_change()));
+		}
+			break;
+		case EFFECT_FIELD_FILE:
+		{
+			EmbeddedFileChooser* efc = new EmbeddedFileChooser();
+			ui_element = efc;
+			connect(efc, SIGNAL(changed()), this, SLOT(ui_element_change()));
+		}
+			break;
+		}
+		update_ui_element();
+		if (type == EFFECT_FIELD_DOUBLE) static_cast<LabelSlider*>(ui_element)->set_previous_value();
+		ui_element->setEnabled(enabled);
 	}
-		break;
+	return ui_element;
+}
+
+bool EffectField::has_ui_element() {
+	return (ui_element != nullptr);
+}
+
+void EffectField::update_ui_element() {
+	if (ui_element == nullptr) return;
+
+	QVariant v = get_current_data();
+	switch (type) {
+	case EFFECT_FIELD_DOUBLE: static_cast<LabelSlider*>(ui_element)->set_value(v.toDouble(), false); break;
+	case EFFECT_FIELD_COLOR: static_cast<ColorButton*>(ui_element)->set_color(v.value<QColor>()); break;
 	case EFFECT_FIELD_STRING:
 	{
-		TextEditEx* edit = new TextEditEx();
-		edit->setUndoRedoEnabled(true);
-		ui_element = edit;
-		connect(edit, SIGNAL(textChanged()), this, SLOT(ui_element_change()));
-	}
-		break;
-	case EFFECT_FIELD_BOOL:
-	{
-		CheckboxEx* cb = new CheckboxEx();
-		ui_element = cb;
-		connect(cb, SIGNAL(clicked(bool)), this, SLOT(ui_element_change()));
-		connect(cb, SIGNAL(toggled(bool)), this, SIGNAL(toggled(bool)));
-	}
-		break;
-	case EFFECT_FIELD_COMBO:
-	{
-		ComboBoxEx* cb = new ComboBoxEx();
-		ui_element = cb;
-		connect(cb, SIGNAL(activated(int)), this, SLOT(ui_element_change()));
+		TextEditEx* edit = static_cast<TextEditEx*>(ui_element);
+		if (edit->getPlainTextEx() != v.toString()) edit->setPlainTextEx(v.toString());
 	}
 		break;
+	case EFFECT_FIELD_BOOL: static_cast<QCheckBox*>(ui_element)->setChecked(v.toBool()); break;
+	case EFFECT_FIELD_COMBO: static_cast<ComboBoxEx*>(ui_element)->setCurrentIndexEx(v.toInt()); break;
 	case EFFECT_FIELD_FONT:
-	{
-		FontCombobox* fcb = new FontCombobox();
-		ui_element = fcb;
-		connect(fcb, SIGNAL(activated(int)), this, SLOT(ui_element_change()));
-	}
+		if (!v.toString().isEmpty()) static_cast<FontCombobox*>(ui_element)->setCurrentTextEx(v.toString());
 		break;
 	case EFFECT_FIELD_FILE:
-	{
-		EmbeddedFileChooser* efc = new EmbeddedFileChooser();
-		ui_element = efc;
-		connect(efc, SIGNAL(changed()), this, SLOT(ui_element_change()));
-	}
+		// the chooser reports programmatic changes as edits, which would push an undo command
+		ui_element->blockSignals(true);
+		static_cast<EmbeddedFileChooser*>(ui_element)->setFilename(v.toString());
+		ui_element->blockSignals(false);
 		break;
 	}
 }
 
-QVariant EffectField::get_previous_data() {
-	switch (type) {
-	case EFFECT_FIELD_DOUBLE: return static_cast<LabelSlider*>(ui_element)->getPreviousValue();
-	case EFFECT_FIELD_COLOR: return static_cast<ColorButton*>(ui_element)->getPreviousValue();
-	case EFFECT_FIELD_STRING: return static_cast<TextEditEx*>(ui_element)->getPreviousValue();
-	case EFFECT_FIELD_BOOL: return !static_cast<QCheckBox*>(ui_element)->isChecked();
-	case EFFECT_FIELD_COMBO: return static_cast<ComboBoxEx*>(ui_element)->getPreviousIndex();
-	case EFFECT_FIELD_FONT: return static_cast<FontCombobox*>(ui_element)->getPreviousValue();
-	case EFFECT_FIELD_FILE: return static_cast<EmbeddedFileChooser*>(ui_element)->getPreviousValue();
+void EffectField::set_data(const QVariant &v) {
+	QVariant value = v;
+	if (type == EFFECT_FIELD_DOUBLE) {
+		double d = value.toDouble();
+		if (min_enabled && d < min_value) {
+			d = min_value;
+		} else if (max_enabled && d > max_value) {
+			d = max_value;
+		}
+		value = d;
+		value_set = true;
 	}
-	return QVariant();
+
+	data_lock.lock();
+	bool toggle = (type == EFFECT_FIELD_BOOL && data.toBool() != value.toBool());
+	previous_data = data;
+	data = value;
+	data_lock.unlock();
+
+	update_ui_element();
+
+	// checkbox signals aren't relied on for this since the checkbox may not exist
+	if (toggle) emit toggled(value.toBool());
+
+	// setting a file always reloaded whatever depends on it (e.g. VST plugins)
+	if (type == EFFECT_FIELD_FILE) emit changed();
+}
+
+QVariant EffectField::get_previous_data() {
+	QMutexLocker locker(&data_lock);
+	return previous_data;
+}
+
+void EffectField::set_previous_data() {
+	data_lock.lock();
+	previous_data = data;
+	data_lock.unlock();
+	if (ui_element != nullptr && type == EFFECT_FIELD_DOUBLE) static_cast<LabelSlider*>(ui_element)->set_previous_value();
 }
 
 QVariant EffectField::get_current_data() {
-	switch (type) {
-	case EFFECT_FIELD_DOUBLE: return static_cast<LabelSlider*>(ui_element)->value();
-	case EFFECT_FIELD_COLOR: return static_cast<ColorButton*>(ui_element)->get_color();
-	case EFFECT_FIELD_STRING: return static_cast<TextEditEx*>(ui_element)->getPlainTextEx();
-	case EFFECT_FIELD_BOOL: return static_cast<QCheckBox*>(ui_element)->isChecked();
-	case EFFECT_FIELD_COMBO: return static_cast<ComboBoxEx*>(ui_element)->currentIndex();
-	case EFFECT_FIELD_FONT: return static_cast<FontCombobox*>(ui_element)->currentText();
-	case EFFECT_FIELD_FILE: return static_cast<EmbeddedFileChooser*>(ui_element)->getFilename();
-	}
-	return QVariant();
+	QMutexLocker locker(&data_lock);
+	return data;
 }
 
 double EffectField::frameToTimecode(long frame) {
@@ -115,16 +204,8 @@ long EffectField::timecodeToFrame(double timecode) {
 	return qRound(timecode * parent_row->parent_effect->parent_clip->sequence->frame_rate);
 }
 
-void EffectField::set_current_data(const QVariant& data) {
-	switch (type) {
-	case EFFECT_FIELD_DOUBLE: return static_cast<LabelSlider*>(ui_element)->set_value(data.toDouble(), false);
-	case EFFECT_FIELD_COLOR: return static_cast<ColorButton*>(ui_element)->set_color(data.value<QColor>());
-	case EFFECT_FIELD_STRING: return static_cast<TextEditEx*>(ui_element)->setPlainTextEx(data.toString());
-	case EFFECT_FIELD_BOOL: return static_cast<QCheckBox*>(ui_element)->setChecked(data.toBool());
-	case EFFECT_FIELD_COMBO: return static_cast<ComboBoxEx*>(ui_element)->setCurrentIndexEx(data.toInt());
-	case EFFECT_FIELD_FONT: return static_cast<FontCombobox*>(ui_element)->setCurrentTextEx(data.toString());
-	case EFFECT_FIELD_FILE: return static_cast<EmbeddedFileChooser*>(ui_element)->setFilename(data.toString());
-	}
+void EffectField::set_current_data(const QVariant& v) {
+	set_data(v);
 }
 
 void EffectField::get_keyframe_data(double timecode, int &before, int &after, double &progress) {
@@ -167,108 +248,132 @@ bool EffectField::hasKeyframes() {
 	return (parent_row->isKeyframing() && keyframes.size() > 0);
 }
 
-QVariant EffectField::validate_keyframe_data(double timecode, bool async) {
-	if (hasKeyframes()) {
-		int before_keyframe;
-		int after_keyframe;
-		double progress;
-		get_keyframe_data(timecode, before_keyframe, after_keyframe, progress);
+QVariant EffectField::interpolate_keyframes(double timecode) {
+	int before_keyframe;
+	int after_keyframe;
+	double progress;
+	get_keyframe_data(timecode, before_keyframe, after_keyframe, progress);
 
-		const QVariant& before_data = keyframes.at(before_keyframe).data;
-		switch (type) {
-		case EFFECT_FIELD_DOUBLE:
-		{
-			double value;
-			if (before_keyframe == after_keyframe) {
-				value = keyframes.at(before_keyframe).data.toDouble();
-			} else {
-				const EffectKeyframe& before_key = keyframes.at(before_keyframe);
-				const EffectKeyframe& after_key = keyframes.at(after_keyframe);
-
-				double before_dbl = before_key.data.toDouble();
-				double after_dbl = after_key.data.toDouble();
-
-				if (before_key.type == KEYFRAME_TYPE_HOLD) {
-					// hold
-					value = before_dbl;
-				} else if (before_key.type == KEYFRAME_TYPE_BEZIER || after_key.type == KEYFRAME_TYPE_BEZIER) {
-					// bezier interpolation
-					if (before_key.type == KEYFRAME_TYPE_BEZIER && after_key.type == KEYFRAME_TYPE_BEZIER) {
-						// cubic bezier
-						double t = cubic_t_from_x(timecode*parent_row->parent_effect->parent_clip->sequence->frame_rate, before_key.time, before_key.time+before_key.post_handle_x, after_key.time+after_key.pre_handle_x, after_key.time);
-						value = cubic_from_t(before_dbl, before_dbl+before_key.post_handle_y, after_dbl+after_key.pre_handle_y, after_dbl, t);
-					} else if (after_key.type == KEYFRAME_TYPE_LINEAR) { // quadratic bezier
-						// last keyframe is the bezier one
-						double t = quad_t_from_x(timecode*parent_row->parent_effect->parent_clip->sequence->frame_rate, before_key.time, before_key.time+before_key.post_handle_x, after_key.time);
-						value = quad_from_t(before_dbl, before_dbl+before_key.post_handle_y, after_dbl, t);
-					} else {
-						// this keyframe is the bezier one
-						double t = quad_t_from_x(timecode*parent_row->parent_effect->parent_clip->sequence->frame_rate, before_key.time, after_key.time+after_key.pre_handle_x, after_key.time);
-						value = quad_from_t(before_dbl, after_dbl+after_key.pre_handle_y, after_dbl, t);
-					}
+	const QVariant& before_data = keyframes.at(before_keyframe).data;
+	switch (type) {
+	case EFFECT_FIELD_DOUBLE:
+	{
+		double value;
+		if (before_keyframe == after_keyframe) {
+			value = keyframes.at(before_keyframe).data.toDouble();
+		} else {
+			const EffectKeyframe& before_key = keyframes.at(before_keyframe);
+			const EffectKeyframe& after_key = keyframes.at(after_keyframe);
+
+			double before_dbl = before_key.data.toDouble();
+			double after_dbl = after_key.data.toDouble();
+
+			if (before_key.type == KEYFRAME_TYPE_HOLD) {
+				// hold
+				value = before_dbl;
+			} else if (before_key.type == KEYFRAME_TYPE_BEZIER || after_key.type == KEYFRAME_TYPE_BEZIER) {
+				// bezier interpolation
+				if (before_key.type == KEYFRAME_TYPE_BEZIER && after_key.type == KEYFRAME_TYPE_BEZIER) {
+					// cubic bezier
+					double t = cubic_t_from_x(timecode*parent_row->parent_effect->parent_clip->sequence->frame_rate, before_key.time, before_key.time+before_key.post_handle_x, after_key.time+after_key.pre_handle_x, after_key.time);
+					value = cubic_from_t(before_dbl, before_dbl+before_key.post_handle_y, after_dbl+after_key.pre_handle_y, after_dbl, t);
+				} else if (after_key.type == KEYFRAME_TYPE_LINEAR) { // quadratic bezier
+					// last keyframe is the bezier one
+					double t = quad_t_from_x(timecode*parent_row->parent_effect->parent_clip->sequence->frame_rate, before_key.time, before_key.time+before_key.post_handle_x, after_key.time);
+					value = quad_from_t(before_dbl, before_dbl+before_key.post_handle_y, after_dbl, t);
 				} else {
-					// linear
-					value = double_lerp(before_dbl, after_dbl, progress);
+					// this keyframe is the bezier one
+					double t = quad_t_from_x(timecode*parent_row->parent_effect->parent_clip->sequence->frame_rate, before_key.time, after_key.time+after_key.pre_handle_x, after_key.time);
+					value = quad_from_t(before_dbl, after_dbl+after_key.pre_handle_y, after_dbl, t);
 				}
-			}
-			if (async) {
-				return value;
-			}
-			static_cast<LabelSlider*>(ui_element)->set_value(value, false);
-		}
-			break;
-		case EFFECT_FIELD_COLOR:
-		{
-			QColor value;
-			if (before_keyframe == after_keyframe) {
-				value = keyframes.at(before_keyframe).data.value<QColor>();
 			} else {
-				QColor before_data = keyframes.at(before_keyframe).data.value<QColor>();
-				QColor after_data = keyframes.at(after_keyframe).data.value<QColor>();
-				value = QColor(lerp(before_data.red(), after_data.red(), progress), lerp(before_data.green(), after_data.green(), progress), lerp(before_data.blue(), after_data.blue(), progress));
-			}
-			if (async) {
-				return value;
+				// linear
+				value = double_lerp(before_dbl, after_dbl, progress);
 			}
-			static_cast<ColorButton*>(ui_element)->set_color(value);
 		}
-			break;
-		case EFFECT_FIELD_STRING:
-			if (async) {
-				return before_data;
-			}
-			static_cast<TextEditEx*>(ui_element)->setPlainTextEx(before_data.toString());
-			break;
-		case EFFECT_FIELD_BOOL:
-			if (async) {
-				return before_data;
-			}
-			static_cast<QCheckBox*>(ui_element)->setChecked(before_data.toBool());
-			break;
-		case EFFECT_FIELD_COMBO:
-			if (async) {
-				return before_data;
-			}
-			static_cast<ComboBoxEx*>(ui_element)->setCurrentIndexEx(before_data.toInt());
-			break;
-		case EFFECT_FIELD_FONT:
-			if (async) {
-				return before_data;
-			}
-			static_cast<FontCombobox*>(ui_element)->setCurrentTextEx(before_data.toString());
-			break;
-		case EFFECT_FIELD_FILE:
-			if (async) {
-				return before_data;
-			}
-			static_cast<EmbeddedFileChooser*>(ui_element)->setFilename(before_data.toString());
-			break;
+		return value;
+	}
+	case EFFECT_FIELD_COLOR:
+	{
+		QColor value;
+		if (before_keyframe == after_keyframe) {
+			value = keyframes.at(before_keyframe).data.value<QColor>();
+		} else {
+			QColor before_data = keyframes.at(before_keyframe).data.value<QColor>();
+			QColor after_data = keyframes.at(after_keyframe).data.value<QColor>();
+			value = QColor(lerp(before_data.red(), after_data.red(), progress), lerp(before_data.green(), after_data.green(), progress), lerp(before_data.blue(), after_data.blue(), progress));
 		}
+		return value;
 	}
-	return QVariant();
+	}
+	return before_data;
+}
+
+QVariant EffectField::validate_keyframe_data(double timecode, bool async) {
+	if (!hasKeyframes()) return get_current_data();
+
+	// values prepared for the frame being drawn on this thread are used as they are
+	QVariant value;
+	if (!get_draw_packet_value(this, timecode, value)) value = interpolate_keyframes(timecode);
+
+	// only the GUI thread makes the evaluated value the current one so the controls follow the playhead, rendering
+	// never writes to the field
+	if (!async && QThread::currentThread() == thread()) {
+		data_lock.lock();
+		data = value;
+		data_lock.unlock();
+		update_ui_element();
+	}
+	return value;
+}
+
+bool EffectField::prepare_value(double timecode, QVariant& value) {
+	if (!hasKeyframes()) return false;
+
+	value = interpolate_keyframes(timecode);
+	return true;
 }
 
 void EffectField::ui_element_change() {
+	// copy the edit from the widget into the model
+	QVariant value, previous;
+	switch (type) {
+	case EFFECT_FIELD_DOUBLE:
+		value = static_cast<LabelSlider*>(ui_element)->value();
+		previous = static_cast<LabelSlider*>(ui_element)->getPreviousValue();
+		break;
+	case EFFECT_FIELD_COLOR:
+		value = static_cast<ColorButton*>(ui_element)->get_color();
+		previous = static_cast<ColorButton*>(ui_element)->getPreviousValue();
+		break;
+	case EFFECT_FIELD_STRING:
+		value = static_cast<TextEditEx*>(ui_element)->getPlainTextEx();
+		previous = static_cast<TextEditEx*>(ui_element)->getPreviousValue();
+		break;
+	case EFFECT_FIELD_BOOL:
+		value = static_cast<QCheckBox*>(ui_element)->isChecked();
+		previous = !value.toBool();
+		break;
+	case EFFECT_FIELD_COMBO:
+		value = static_cast<ComboBoxEx*>(ui_element)->currentIndex();
+		previous = static_cast<ComboBoxEx*>(ui_element)->getPreviousIndex();
+		break;
+	case EFFECT_FIELD_FONT:
+		value = static_cast<FontCombobox*>(ui_element)->currentText();
+		previous = static_cast<FontCombobox*>(ui_element)->getPreviousValue();
+		break;
+	case EFFECT_FIELD_FILE:
+		value = static_cast<EmbeddedFileChooser*>(ui_element)->getFilename();
+		previous = static_cast<EmbeddedFileChooser*>(ui_element)->getPreviousValue();
+		break;
+	}
+	data_lock.lock();
+	data = value;
+	previous_data = previous;
+	if (type == EFFECT_FIELD_DOUBLE) value_set = true;
+	data_lock.unlock();
+	if (type == EFFECT_FIELD_BOOL) emit toggled(value.toBool());
+
 	bool dragging_double = (type == EFFECT_FIELD_DOUBLE && static_cast<LabelSlider*>(ui_element)->is_dragging());
 	ComboAction* ca = nullptr;
 	if (!dragging_double) ca = new ComboAction();
@@ -286,124 +391,117 @@ void EffectField::make_key_from_change(ComboAction* ca) {
 	}
 }
 
-QWidget* EffectField::get_ui_element() {
-	return ui_element;
-}
-
 void EffectField::set_enabled(bool e) {
-	ui_element->setEnabled(e);
+	enabled = e;
+	if (ui_element != nullptr) ui_element->setEnabled(e);
 }
 
 double EffectField::get_double_value(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).toDouble();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<LabelSlider*>(ui_element)->value();
+	return validate_keyframe_data(timecode, async).toDouble();
 }
 
 void EffectField::set_double_value(double v) {
-	static_cast<LabelSlider*>(ui_element)->set_value(v, false);
+	set_data(v);
 }
 
 void EffectField::set_double_default_value(double v) {
-	static_cast<LabelSlider*>(ui_element)->set_default_value(v);
+	default_value = v;
+	if (!value_set) {
+		set_data(v);
+		value_set = false;
+	}
+	if (ui_element != nullptr) static_cast<LabelSlider*>(ui_element)->set_default_value(v);
 }
 
 void EffectField::set_double_minimum_value(double v) {
-	static_cast<LabelSlider*>(ui_element)->set_minimum_value(v);
+	min_value = v;
+	min_enabled = true;
+	if (ui_element != nullptr) static_cast<LabelSlider*>(ui_element)->set_minimum_value(v);
 }
 
 void EffectField::set_double_maximum_value(double v) {
-	static_cast<LabelSlider*>(ui_element)->set_maximum_value(v);
+	max_value = v;
+	max_enabled = true;
+	if (ui_element != nullptr) static_cast<LabelSlider*>(ui_element)->set_maximum_value(v);
+}
+
+void EffectField::set_double_display_type(int t) {
+	display_type = t;
+	if (ui_element != nullptr) static_cast<LabelSlider*>(ui_element)->set_display_type(t);
+}
+
+void EffectField::set_double_frame_rate(double rate) {
+	frame_rate = rate;
+	if (ui_element != nullptr) static_cast<LabelSlider*>(ui_element)->set_frame_rate(rate);
 }
 
 void EffectField::add_combo_item(const QString& name, const QVariant& data) {
-	static_cast<ComboBoxEx*>(ui_element)->addItem(name, data);
+	combo_names.append(name);
+	combo_data.append(data);
+	if (ui_element != nullptr) static_cast<ComboBoxEx*>(ui_element)->addItem(name, data);
 }
 
 int EffectField::get_combo_index(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).toInt();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<ComboBoxEx*>(ui_element)->currentIndex();
+	return validate_keyframe_data(timecode, async).toInt();
 }
 
-QVariant EffectField::get_combo_data(double timecode) {
-	validate_keyframe_data(timecode);
-	return static_cast<ComboBoxEx*>(ui_element)->currentData();
+QVariant EffectField::get_combo_data(double timecode, bool async) {
+	int index = get_combo_index(timecode, async);
+	if (index >= 0 && index < combo_data.size()) return combo_data.at(index);
+	return QVariant();
 }
 
 QString EffectField::get_combo_string(double timecode) {
-	validate_keyframe_data(timecode);
-	return static_cast<ComboBoxEx*>(ui_element)->currentText();
+	int index = get_combo_index(timecode);
+	if (index >= 0 && index < combo_names.size()) return combo_names.at(index);
+	return QString();
 }
 
 void EffectField::set_combo_index(int index) {
-	static_cast<ComboBoxEx*>(ui_element)->setCurrentIndexEx(index);
+	set_data(index);
 }
 
 void EffectField::set_combo_string(const QString& s) {
-	static_cast<ComboBoxEx*>(ui_element)->setCurrentTextEx(s);
+	int index = combo_names.indexOf(s);
+	if (index > -1) set_data(index);
 }
 
 bool EffectField::get_bool_value(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).toBool();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<QCheckBox*>(ui_element)->isChecked();
+	return validate_keyframe_data(timecode, async).toBool();
 }
 
 void EffectField::set_bool_value(bool b) {
-	return static_cast<QCheckBox*>(ui_element)->setChecked(b);
+	set_data(b);
 }
 
 QString EffectField::get_string_value(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).toString();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<TextEditEx*>(ui_element)->getPlainTextEx();
+	return validate_keyframe_data(timecode, async).toString();
 }
 
 void EffectField::set_string_value(const QString& s) {
-	static_cast<TextEditEx*>(ui_element)->setPlainTextEx(s);
+	set_data(s);
 }
 
 QString EffectField::get_font_name(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).toString();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<FontCombobox*>(ui_element)->currentText();
+	return validate_keyframe_data(timecode, async).toString();
 }
 
 void EffectField::set_font_name(const QString& s) {
-	static_cast<FontCombobox*>(ui_element)->setCurrentText(s);
+	set_data(s);
 }
 
 QColor EffectField::get_color_value(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).value<QColor>();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<ColorButton*>(ui_element)->get_color();
+	return validate_keyframe_data(timecode, async).value<QColor>();
 }
 
 void EffectField::set_color_value(QColor color) {
-	static_cast<ColorButton*>(ui_element)->set_color(color);
+	set_data(color);
 }
 
 QString EffectField::get_filename(double timecode, bool async) {
-	if (async && hasKeyframes()) {
-		return validate_keyframe_data(timecode, true).toString();
-	}
-	validate_keyframe_data(timecode);
-	return static_cast<EmbeddedFileChooser*>(ui_element)->getFilename();
+	return validate_keyframe_data(timecode, async).toString();
 }
 
 void EffectField::set_filename(const QString &s) {
-	static_cast<EmbeddedFileChooser*>(ui_element)->setFilename(s);
+	set_data(s);
 }
@@ -12,12 +12,25 @@
 #include <QObject>
 #include <QVariant>
 #include <QVector>
+#include <QMutex>
+#include <QHash>
 
 #include "keyframe.h"
 
 class EffectRow;
 class ComboAction;
 
+// a keyframed value evaluated ahead of drawing, held by the frame's draw packet
+struct PreparedFieldValue {
+	double timecode;
+	QVariant value;
+};
+
+/*
+ * An EffectField holds its value, limits and keyframes itself, so effects can be created, loaded and rendered
+ * from any thread. The widget that edits it is only created (on the GUI thread) the first time it's requested
+ * and is kept in sync with the stored value from then on.
+ */
 class EffectField : public QObject {
 	Q_OBJECT
 public:
@@ -27,25 +40,34 @@ public:
 	QString id;
 
 	QVariant get_previous_data();
+	void set_previous_data();
 	QVariant get_current_data();
 	double frameToTimecode(long frame);
 	long timecodeToFrame(double timecode);
 	void set_current_data(const QVariant&);
 	void get_keyframe_data(double timecode, int& before, int& after, double& d);
+
+	// value at timecode, on the GUI thread it also becomes the current value unless async
 	QVariant validate_keyframe_data(double timecode, bool async = false);
 
+	// evaluates the keyframes at timecode ahead of drawing without touching the field, returns false if there's
+	// nothing to evaluate. getters read the value back from the draw packet it's stored in
+	bool prepare_value(double timecode, QVariant& value);
+
 	double get_double_value(double timecode, bool async = false);
 	void set_double_value(double v);
 	void set_double_default_value(double v);
 	void set_double_minimum_value(double v);
 	void set_double_maximum_value(double v);
+	void set_double_display_type(int t);
+	void set_double_frame_rate(double rate);
 
 	QString get_string_value(double timecode, bool async = false);
 	void set_string_value(const QString &s);
 
 	void add_combo_item(const QString& name, const QVariant &data);
 	int get_combo_index(double timecode, bool async = false);
-	QVariant get_combo_data(double timecode);
+	QVariant get_combo_data(double timecode, bool async = false);
 	QString get_combo_string(double timecode);
 	void set_combo_index(int index);
 	void set_combo_string(const QString& s);
@@ -63,15 +85,41 @@ public:
 	void set_filename(const QString& s);
 
 	QWidget* get_ui_element();
+	bool has_ui_element();
 	void set_enabled(bool e);
 	QVector<EffectKeyframe> keyframes;
-	QWidget* ui_element;
 
 	void make_key_from_change(ComboAction* ca);
 public slots:
 	void ui_element_change();
+private slots:
+	void update_ui_element();
 private:
 	bool hasKeyframes();
+	QVariant interpolate_keyframes(double timecode);
+	void set_data(const QVariant& v);
+
+	QWidget* ui_element;
+
+	// value model, guarded by data_lock since render and load threads read it too
+	QMutex data_lock;
+	QVariant data;
+	QVariant previous_data;
+	bool enabled;
+
+	// double
+	bool value_set;
+	double default_value;
+	bool min_enabled;
+	double min_value;
+	bool max_enabled;
+	double max_value;
+	int display_type;
+	double frame_rate;
+
+	// combo
+	QVector<QString> combo_names;
+	QVector<QVariant> combo_data;
 signals:
 	void changed();
 	void toggled(bool);
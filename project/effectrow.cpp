@@ -15,16 +15,27 @@
 #include "ui/viewerwidget.h"
 #include "ui/keyframenavigator.h"
 #include "ui/clickablelabel.h"
+#include "playback/renderthread.h"
 
-EffectRow::EffectRow(Effect *parent, bool save, QGridLayout *uilayout, const QString &n, int row, bool keyframable) :
+EffectRow::EffectRow(Effect *parent, bool save, const QString &n, bool k) :
+	QObject(parent),
+	label(nullptr),
 	parent_effect(parent),
 	savable(save),
 	keyframing(false),
-	ui(uilayout),
+	keyframable(k),
+	ui(nullptr),
 	name(n),
-	ui_row(row),
-	just_made_unsafe_keyframe(false)
-{
+	ui_row(-1),
+	keyframe_nav(nullptr),
+	just_made_unsafe_keyframe(false),
+	column_count(1)
+{}
+
+void EffectRow::create_ui(QGridLayout *uilayout, int row) {
+	ui = uilayout;
+	ui_row = row;
+
 	label = new ClickableLabel(name + ":");
 
 	ui->addWidget(label, row, 0);
@@ -37,6 +48,7 @@ EffectRow::EffectRow(Effect *parent, bool save, QGridLayout *uilayout, const QSt
 		connect(label, SIGNAL(clicked()), this, SLOT(focus_row()));
 
 		keyframe_nav = new KeyframeNavigator();
+		keyframe_nav->enable_keyframes(keyframing);
 		connect(keyframe_nav, SIGNAL(goto_previous_key()), this, SLOT(goto_previous_key()));
 		connect(keyframe_nav, SIGNAL(toggle_key()), this, SLOT(toggle_key()));
 		connect(keyframe_nav, SIGNAL(goto_next_key()), this, SLOT(goto_next_key()));
@@ -44,6 +56,11 @@ EffectRow::EffectRow(Effect *parent, bool save, QGridLayout *uilayout, const QSt
 		connect(keyframe_nav, SIGNAL(clicked()), this, SLOT(focus_row()));
 		ui->addWidget(keyframe_nav, row, 6);
 	}
+
+	for (int i=0;i<fields.size();i++) {
+		ui->addWidget(fields.at(i)->get_ui_element(), ui_row, column_count, 1, field_colspans.at(i));
+		column_count++;
+	}
 }
 
 bool EffectRow::isKeyframing() {
@@ -53,7 +70,7 @@ bool EffectRow::isKeyframing() {
 void EffectRow::setKeyframing(bool b) {
 	if (parent_effect->meta->type != EFFECT_TYPE_TRANSITION) {
 		keyframing = b;
-		keyframe_nav->enable_keyframes(b);
+		if (keyframe_nav != nullptr) keyframe_nav->enable_keyframes(b);
 	}
 }
 
@@ -151,13 +168,16 @@ EffectField* EffectRow::add_field(int type, const QString& id, int colspan) {
 	EffectField* field = new EffectField(this, type, id);
 	if (parent_effect->meta->type != EFFECT_TYPE_TRANSITION) connect(field, SIGNAL(clicked()), this, SLOT(focus_row()));
 	fields.append(field);
-	QWidget* element = field->get_ui_element();
-	ui->addWidget(element, ui_row, column_count, 1, colspan);
-	column_count++;
+	field_colspans.append(colspan);
+	if (ui != nullptr) {
+		ui->addWidget(field->get_ui_element(), ui_row, column_count, 1, colspan);
+		column_count++;
+	}
 	connect(field, SIGNAL(changed()), parent_effect, SLOT(field_changed()));
 	return field;
 }
 
+// only valid once the row's UI exists, see Effect::setup_ui()
 void EffectRow::add_widget(QWidget* w) {
 	ui->addWidget(w, ui_row, column_count);
 	column_count++;
@@ -172,6 +192,9 @@ EffectRow::~EffectRow() {
 void EffectRow::set_keyframe_now(ComboAction* ca) {
 	long time = sequence->playhead-parent_effect->parent_clip->timeline_in+parent_effect->parent_clip->clip_in;
 
+	// the keyframes are changed live while a value is dragged, so a frame being drawn from them finishes first
+	render_lock.lock();
+
 	if (!just_made_unsafe_keyframe) {
 		EffectKeyframe key;
 		key.time = time;
@@ -212,6 +235,8 @@ void EffectRow::set_keyframe_now(ComboAction* ca) {
 		field(i)->keyframes[unsafe_keys.at(i)].data = field(i)->get_current_data();
 	}
 
+	render_lock.unlock();
+
 	if (ca != nullptr)	{
 		for (int i=0;i<fieldCount();i++) {
 			if (key_is_new.at(i)) ca->append(new KeyframeFieldSet(field(i), unsafe_keys.at(i)));
@@ -17,8 +17,9 @@ class ClickableLabel;
 class EffectRow : public QObject {
 	Q_OBJECT
 public:
-	EffectRow(Effect* parent, bool save, QGridLayout* uilayout, const QString& n, int row, bool keyframable = true);
+	EffectRow(Effect* parent, bool save, const QString& n, bool keyframable = true);
 	~EffectRow();
+	void create_ui(QGridLayout* uilayout, int row);
 	EffectField* add_field(int type, const QString &id, int colspan = 1);
 	void add_widget(QWidget *w);
 	EffectField* field(int i);
@@ -41,10 +42,12 @@ private slots:
 	void set_keyframe_enabled(bool);
 private:
 	bool keyframing;
+	bool keyframable;
 	QGridLayout* ui;
 	QString name;
 	int ui_row;
 	QVector<EffectField*> fields;
+	QVector<int> field_colspans;
 
 	KeyframeNavigator* keyframe_nav;
 
@@ -63,3 +63,43 @@ void FootageStream::make_square_thumb() {
 	p.drawImage(sqx, sqy, video_preview);
 	video_preview_square = QIcon(pixmap);
 }
+
+#define WAVEFORM_MIPMAP_FACTOR 4
+
+void FootageStream::make_waveform_mipmaps() {
+	// each waveform sample is a min/max pair per channel, so combine groups of them into coarser levels
+	audio_preview_mipmaps.clear();
+	if (audio_channels <= 0) return;
+
+	int sample_size = audio_channels * 2;
+	const QVector<char>* previous = &audio_preview;
+	while (previous->size() / sample_size >= WAVEFORM_MIPMAP_FACTOR * 2) {
+		QVector<char> level;
+		level.reserve((previous->size() / sample_size / WAVEFORM_MIPMAP_FACTOR + 1) * sample_size);
+		for (int i=0;i<previous->size();i+=sample_size*WAVEFORM_MIPMAP_FACTOR) {
+			int group_end = qMin(i + sample_size*WAVEFORM_MIPMAP_FACTOR, previous->size() - sample_size + 1);
+			for (int j=0;j<audio_channels;j++) {
+				char min = 0;
+				char max = 0;
+				for (int k=i;k<group_end;k+=sample_size) {
+					min = qMin(min, previous->at(k+j*2));
+					max = qMax(max, previous->at(k+j*2+1));
+				}
+				level.append(min);
+				level.append(max);
+			}
+		}
+		audio_preview_mipmaps.append(level);
+		previous = &audio_preview_mipmaps.last();
+	}
+}
+
+const QVector<char>& FootageStream::get_waveform_level(double samples_per_pixel) const {
+	// pick the coarsest level that still has at least one sample for every pixel
+	const QVector<char>* level = &audio_preview;
+	for (int i=0;i<audio_preview_mipmaps.size() && samples_per_pixel >= WAVEFORM_MIPMAP_FACTOR;i++) {
+		level = &audio_preview_mipmaps.at(i);
+		samples_per_pixel /= WAVEFORM_MIPMAP_FACTOR;
+	}
+	return *level;
+}
@@ -36,7 +36,11 @@ struct FootageStream {
 	QImage video_preview;
 	QIcon video_preview_square;
 	QVector<char> audio_preview;
+	QVector< QVector<char> > audio_preview_mipmaps; // each level summarizes 4x as many samples as the last
+	QVector<qint64> keyframe_index; // pts of every keyframe in stream time base, used for seeking
 	void make_square_thumb();
+	void make_waveform_mipmaps();
+	const QVector<char>& get_waveform_level(double samples_per_pixel) const;
 };
 
 struct Footage {
@@ -0,0 +1,95 @@
+#include "superimposerenderer.h"
+
+#include <QRunnable>
+#include <QThreadPool>
+
+class SuperimposeJob : public QRunnable {
+public:
+	SuperimposeJob(SuperimposePainter p, SuperimposeFramePtr f) : painter(p), frame(f) {}
+	void run() {
+		paint_superimpose_frame(painter, frame.data());
+	}
+private:
+	SuperimposePainter painter;
+
+	// keeps the frame alive if the effect drops it before the job runs
+	SuperimposeFramePtr frame;
+};
+
+SuperimposeRenderer::SuperimposeRenderer(SuperimposePainter p) : painter(p) {}
+
+SuperimposeFramePtr SuperimposeRenderer::get(const QVariantList& params, const QSize& size) {
+	lock.lock();
+	SuperimposeFramePtr frame = find(params, size);
+	if (frame.isNull()) frame = add(params, size);
+	lock.unlock();
+
+	// paints it here if the job hasn't started yet, otherwise waits for the worker to finish it
+	paint_superimpose_frame(painter, frame.data());
+	return frame;
+}
+
+void SuperimposeRenderer::prefetch(const QVariantList& params, const QSize& size) {
+	QMutexLocker locker(&lock);
+	if (find(params, size).isNull()) {
+		QThreadPool::globalInstance()->start(new SuperimposeJob(painter, add(params, size)));
+	}
+}
+
+SuperimposeFramePtr SuperimposeRenderer::find(const QVariantList& params, const QSize& size) {
+	for (int i=frames.size()-1;i>=0;i--) {
+		if (frames.at(i)->size == size && frames.at(i)->params == params) {
+			SuperimposeFramePtr frame = frames.takeAt(i);
+			frames.append(frame);
+			return frame;
+		}
+	}
+	return SuperimposeFramePtr();
+}
+
+SuperimposeFramePtr SuperimposeRenderer::add(const QVariantList& params, const QSize& size) {
+	SuperimposeFramePtr frame(new SuperimposeFrame());
+	frame->params = params;
+	frame->size = size;
+	frame->claimed = false;
+	frame->ready = false;
+
+	frames.append(frame);
+	while (frames.size() > SUPERIMPOSE_CACHE_SIZE) {
+		frames.removeFirst();
+	}
+	return frame;
+}
+
+void paint_superimpose_frame(SuperimposePainter painter, SuperimposeFrame* frame) {
+	frame->lock.lock();
+	if (frame->claimed) {
+		while (!frame->ready) {
+			frame->finished.wait(&frame->lock);
+		}
+		frame->lock.unlock();
+		return;
+	}
+	frame->claimed = true;
+	frame->lock.unlock();
+
+	QPoint offset;
+	QImage patch = painter(frame->params, frame->size, offset);
+
+	frame->lock.lock();
+	frame->patch = patch;
+	frame->offset = offset;
+	frame->ready = true;
+	frame->finished.wakeAll();
+	frame->lock.unlock();
+}
+
+QImage create_superimpose_patch(const QRectF& bounds, const QSize& size, QPoint& offset) {
+	QRect rect = bounds.toAlignedRect().intersected(QRect(QPoint(0, 0), size));
+	if (rect.isEmpty()) return QImage();
+
+	QImage patch(rect.size(), QImage::Format_RGBA8888);
+	patch.fill(Qt::transparent);
+	offset = rect.topLeft();
+	return patch;
+}
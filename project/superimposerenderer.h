@@ -0,0 +1,63 @@
+#ifndef SUPERIMPOSERENDERER_H
+#define SUPERIMPOSERENDERER_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVariant>
+#include <QWaitCondition>
+
+// frames kept per effect, enough for the one on screen, the one being painted ahead and a step back
+#define SUPERIMPOSE_CACHE_SIZE 4
+
+/*
+ * Paints a snapshot of a superimpose effect's values for a frame of the given size. Only the area the effect draws
+ * on is returned, as a patch placed at offset in the frame. Runs on worker threads, so it can't touch the effect.
+ */
+typedef QImage (*SuperimposePainter)(const QVariantList& params, const QSize& size, QPoint& offset);
+
+struct SuperimposeFrame {
+	QVariantList params;
+	QSize size;
+	QImage patch;
+	QPoint offset;
+
+	QMutex lock;
+	QWaitCondition finished;
+	bool claimed; // a thread has started painting it
+	bool ready;
+};
+
+typedef QSharedPointer<SuperimposeFrame> SuperimposeFramePtr;
+
+/*
+ * Rasterizes a superimpose effect's frames off the render thread. The render thread takes a snapshot of the
+ * values for the frame after the one it's drawing and prefetch() paints it on the global thread pool, so by the
+ * time the playhead gets there get() only has to hand it over. Frames that weren't prefetched (seeks, scrubbing)
+ * are painted on the calling thread.
+ */
+class SuperimposeRenderer {
+public:
+	SuperimposeRenderer(SuperimposePainter p);
+
+	SuperimposeFramePtr get(const QVariantList& params, const QSize& size);
+	void prefetch(const QVariantList& params, const QSize& size);
+private:
+	SuperimposeFramePtr find(const QVariantList& params, const QSize& size);
+	SuperimposeFramePtr add(const QVariantList& params, const QSize& size);
+
+	SuperimposePainter painter;
+
+	// most recently used last, guarded by lock since frames can be prepared on several threads
+	QList<SuperimposeFramePtr> frames;
+	QMutex lock;
+};
+
+// paints a frame unless another thread already is, then waits for it
+void paint_superimpose_frame(SuperimposePainter painter, SuperimposeFrame* frame);
+
+// creates a cleared patch covering bounds, clipped to the frame, or a null image if nothing of it is visible
+QImage create_superimpose_patch(const QRectF& bounds, const QSize& size, QPoint& offset);
+
+#endif // SUPERIMPOSERENDERER_H
@@ -30,9 +30,8 @@ Transition::Transition(Clip* c, Clip* s, const EffectMeta* em) :
 	length_field->set_double_default_value(30);
 	length_field->set_double_minimum_value(0);
 
-	LabelSlider* length_ui_ele = static_cast<LabelSlider*>(length_field->ui_element);
-	length_ui_ele->set_display_type(LABELSLIDER_FRAMENUMBER);
-	length_ui_ele->set_frame_rate(parent_clip->sequence == nullptr ? parent_clip->cached_fr : parent_clip->sequence->frame_rate);
+	length_field->set_double_display_type(LABELSLIDER_FRAMENUMBER);
+	length_field->set_double_frame_rate(parent_clip->sequence == nullptr ? parent_clip->cached_fr : parent_clip->sequence->frame_rate);
 }
 
 int Transition::copy(Clip *c, Clip* s) {
@@ -12,6 +12,7 @@
 #include "panels/viewer.h"
 #include "panels/timeline.h"
 #include "playback/playback.h"
+#include "playback/renderthread.h"
 #include "ui/sourcetable.h"
 #include "project/effect.h"
 #include "project/transition.h"
@@ -25,7 +26,27 @@
 #include "project/media.h"
 #include "debug.h"
 
-QUndoStack undo_stack;
+UndoStack undo_stack;
+
+void UndoStack::push(QUndoCommand* cmd) {
+	QMutexLocker locker(&render_lock);
+	QUndoStack::push(cmd);
+}
+
+void UndoStack::undo() {
+	QMutexLocker locker(&render_lock);
+	QUndoStack::undo();
+}
+
+void UndoStack::redo() {
+	QMutexLocker locker(&render_lock);
+	QUndoStack::redo();
+}
+
+void UndoStack::clear() {
+	QMutexLocker locker(&render_lock);
+	QUndoStack::clear();
+}
 
 ComboAction::ComboAction() {}
 
@@ -25,7 +25,16 @@ struct EffectMeta;
 #include <QVariant>
 #include <QModelIndex>
 
-extern QUndoStack undo_stack;
+// applies commands while the render thread isn't compositing, so edits never land halfway through a frame
+class UndoStack : public QUndoStack {
+public:
+	void push(QUndoCommand* cmd);
+	void undo();
+	void redo();
+	void clear();
+};
+
+extern UndoStack undo_stack;
 
 class ComboAction : public QUndoCommand {
 public:
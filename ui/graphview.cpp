@@ -17,6 +17,7 @@
 #include "project/effect.h"
 #include "project/clip.h"
 #include "ui/rectangleselect.h"
+#include "playback/renderthread.h"
 
 #include "debug.h"
 
@@ -348,8 +349,10 @@ void GraphView::mousePressEvent(QMouseEvent *event) {
 			key.time = get_value_x(event->pos().x());
 			key.data = get_value_y(event->pos().y());
 			key.type = click_add_type;
+			render_lock.lock();
 			click_add_key = click_add_field->keyframes.size();
 			click_add_field->keyframes.append(key);
+			render_lock.unlock();
 			update_ui(false);
 			click_add_proc = true;
 		} else {
@@ -446,8 +449,11 @@ void GraphView::mouseMoveEvent(QMouseEvent *event) {
 			start_y = event->pos().y();
 			update();
 		} else if (click_add_proc) {
+			// keyframes dragged live are changed between frames, not while one is being drawn from them
+			render_lock.lock();
 			click_add_field->keyframes[click_add_key].time = get_value_x(event->pos().x());
 			click_add_field->keyframes[click_add_key].data = get_value_y(event->pos().y());
+			render_lock.unlock();
 			update_ui(false);
 		} else if (rect_select) {
 			rect_select_w = event->pos().x() - rect_select_x;
@@ -481,6 +487,7 @@ void GraphView::mouseMoveEvent(QMouseEvent *event) {
 		} else {
 			switch (current_handle) {
 			case BEZIER_HANDLE_NONE:
+				render_lock.lock();
 				for (int i=0;i<selected_keys.size();i++) {
 					row->field(selected_keys_fields.at(i))->keyframes[selected_keys.at(i)].time = qRound(selected_keys_old_vals.at(i) + (double(event->pos().x() - start_x)/zoom));
 					if (event->modifiers() & Qt::ShiftModifier) {
@@ -489,6 +496,7 @@ void GraphView::mouseMoveEvent(QMouseEvent *event) {
 						row->field(selected_keys_fields.at(i))->keyframes[selected_keys.at(i)].data = qRound(selected_keys_old_doubles.at(i) + (double(start_y - event->pos().y())/zoom));
 					}
 				}
+				render_lock.unlock();
 				moved_keys = true;
 				update_ui(false);
 				break;
@@ -519,11 +527,13 @@ void GraphView::mouseMoveEvent(QMouseEvent *event) {
 					}
 				}
 
+				render_lock.lock();
 				EffectKeyframe& key = row->field(handle_field)->keyframes[handle_index];
 				key.pre_handle_x = new_pre_handle_x;
 				key.pre_handle_y = new_pre_handle_y;
 				key.post_handle_x = new_post_handle_x;
 				key.post_handle_y = new_post_handle_y;
+				render_lock.unlock();
 
 				moved_keys = true;
 				update_ui(false);
@@ -18,6 +18,7 @@
 #include "ui/rectangleselect.h"
 #include "project/keyframe.h"
 #include "ui/graphview.h"
+#include "playback/renderthread.h"
 
 #include <QMouseEvent>
 #include <QtMath>
@@ -99,15 +100,15 @@ void KeyframeView::paintEvent(QPaintEvent*) {
 			Clip* c = sequence->clips.at(panel_effect_controls->selected_clips.at(j));
 			for (int i=0;i<c->effects.size();i++) {
 				Effect* e = c->effects.at(i);
-				if (e->container->is_expanded()) {
+				if (e->has_container() && e->get_container()->is_expanded()) {
 					for (int j=0;j<e->row_count();j++) {
 						EffectRow* row = e->row(j);
 
 						ClickableLabel* label = row->label;
-						QWidget* contents = e->container->contents;
+						QWidget* contents = e->get_container()->contents;
 
 						QVector<long> key_times;
-						int keyframe_y = label->y() + (label->height()>>1) + mapFrom(panel_effect_controls, contents->mapTo(panel_effect_controls, contents->pos())).y() - e->container->title_bar->height()/* - y_scroll*/;
+						int keyframe_y = label->y() + (label->height()>>1) + mapFrom(panel_effect_controls, contents->mapTo(panel_effect_controls, contents->pos())).y() - e->get_container()->title_bar->height()/* - y_scroll*/;
 						for (int l=0;l<row->fieldCount();l++) {
 							EffectField* f = row->field(l);
 							for (int k=0;k<f->keyframes.size();k++) {
@@ -380,11 +381,13 @@ void KeyframeView::mouseMoveEvent(QMouseEvent* event) {
 				}
 			}
 
-			// apply frame_diffs
+			// apply frame_diffs between frames, not while one is being drawn from them
+			render_lock.lock();
 			for (int i=0;i<selected_keyframes.size();i++) {
 				EffectField* field = selected_fields.at(i);
 				field->keyframes[selected_keyframes.at(i)].time = old_key_vals.at(i) + frame_diff;
 			}
+			render_lock.unlock();
 
 			last_frame_diff = frame_diff;
 
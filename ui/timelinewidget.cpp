@@ -2159,20 +2159,24 @@ void draw_waveform(Clip* clip, const FootageStream* ms, long media_length, QPain
 	int divider = ms->audio_channels*2;
 	int channel_height = clip_rect.height()/ms->audio_channels;
 
+	// use a coarser level when zoomed out so peaks between pixels aren't skipped
+	double samples_per_pixel = ((double) ms->audio_preview.size() / divider) / media_length / zoom;
+	const QVector<char>& preview = ms->get_waveform_level(samples_per_pixel);
+
 	for (int i=waveform_start;i<waveform_limit;i++) {
-		int waveform_index = qFloor((((clip->clip_in + ((double) i/zoom))/media_length) * ms->audio_preview.size())/divider)*divider;
+		int waveform_index = qFloor((((clip->clip_in + ((double) i/zoom))/media_length) * preview.size())/divider)*divider;
 
 		if (clip->reverse) {
-			waveform_index = ms->audio_preview.size() - waveform_index - (ms->audio_channels * 2);
+			waveform_index = preview.size() - waveform_index - (ms->audio_channels * 2);
 		}
 
 		for (int j=0;j<ms->audio_channels;j++) {
 			int mid = (config.rectified_waveforms) ? clip_rect.top()+channel_height*(j+1) : clip_rect.top()+channel_height*j+(channel_height/2);
 			int offset = waveform_index+(j*2);
 
-			if ((offset + 1) < ms->audio_preview.size()) {
-				qint8 min = (double)ms->audio_preview.at(offset) / 128.0 * (channel_height/2);
-				qint8 max = (double)ms->audio_preview.at(offset+1) / 128.0 * (channel_height/2);
+			if ((offset + 1) < preview.size()) {
+				qint8 min = (double)preview.at(offset) / 128.0 * (channel_height/2);
+				qint8 max = (double)preview.at(offset+1) / 128.0 * (channel_height/2);
 
 				if (config.rectified_waveforms)  {
 					p->drawLine(clip_rect.left()+i, mid, clip_rect.left()+i, mid - (max - min));
@@ -2180,7 +2184,7 @@ void draw_waveform(Clip* clip, const FootageStream* ms, long media_length, QPain
 					p->drawLine(clip_rect.left()+i, mid+min, clip_rect.left()+i, mid+max);
 				}
 			}/* else {
-				qWarning() << "Tried to reach" << offset + 1 << ", limit:" << ms->audio_preview.size();
+				qWarning() << "Tried to reach" << offset + 1 << ", limit:" << preview.size();
 			}*/
 		}
 	}
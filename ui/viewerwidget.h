@@ -13,11 +13,10 @@
 class Viewer;
 struct Clip;
 struct FootageStream;
-class QOpenGLFramebufferObject;
 class Effect;
 class EffectGizmo;
 class ViewerContainer;
-struct GLTextureCoords;
+class RenderThread;
 
 class ViewerWidget : public QOpenGLWidget, QOpenGLFunctions
 {
@@ -30,18 +29,23 @@ public:
 	Viewer* viewer;
     ViewerContainer* container;
 
-    QOpenGLFramebufferObject* default_fbo;
+    // composites this viewer's frames and exports, nullptr until the widget has a context
+    RenderThread* renderer;
 
 	bool waveform;
 	Clip* waveform_clip;
     const FootageStream* waveform_ms;
     double waveform_zoom;
     int waveform_scroll;
-
-    bool force_quit;
 public slots:
     void delete_function();
     void set_waveform_scroll(int s);
+
+    // asks the render thread for a new frame, the widget is repainted once it's ready
+    void update();
+
+    // called by cachers when a clip decodes a frame it was seeking to, renders again if the last frame was incomplete
+    void frame_decoded();
 protected:
     void paintEvent(QPaintEvent *e);
 //    void resizeGL(int w, int h);
@@ -53,9 +57,6 @@ private:
     void drawTitleSafeArea();
 	bool dragging;
 	void seek_from_click(int x);
-	GLuint compose_sequence(QVector<Clip *> &nests, bool render_audio);
-    GLuint draw_clip(QOpenGLFramebufferObject *clip, GLuint texture, bool clear);
-    void process_effect(Clip* c, Effect* e, double timecode, GLTextureCoords& coords, GLuint& composite_texture, bool& fbo_switcher, int data);
     Effect* gizmos;
     int drag_start_x;
     int drag_start_y;
@@ -63,9 +64,11 @@ private:
     int gizmo_y_mvmt;
     EffectGizmo* selected_gizmo;
     EffectGizmo* get_gizmo_from_mouse(int x, int y);
-    bool drawn_gizmos;
     void move_gizmos(QMouseEvent *event, bool done);
+    bool frame_dirty;
 private slots:
+	void context_destroyed();
+	void frame_ready(bool complete);
 	void retry();
 	void show_context_menu();
 	void save_frame();